@@ -0,0 +1,116 @@
+/*
+ * aes_bench.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "crypto/ctaes.h"
+
+/**
+ * build:
+ * 
+gcc -std=gnu99 -Wall -O3 -D_GNU_SOURCE -o aes_bench aes_bench.c \
+     -I../utils ../utils/utils.c ../utils/crypto/ctaes.c -lm -lpthread
+ *
+ * usage: ./aes_bench [total_mbytes]
+ *
+ * AES-256 ECB throughput of each ctaes backend (bitsliced, AES-NI, VAES),
+ * single blocks (a key or a credential) up to 64 KiB (an archive segment).
+*/
+
+static const size_t s_blocks[] = { 1, 8, 64, 4096 };
+
+int main(int argc, char ** argv)
+{
+	size_t total = (argc > 1)?(size_t)atol(argv[1]):64;
+	if(total == 0) total = 64;
+	total *= 1024 * 1024;
+	
+	static const enum AES_BACKEND backends[] = { AES_BACKEND_soft, AES_BACKEND_aesni, AES_BACKEND_vaes };
+	#define NUM_BACKENDS (sizeof(backends) / sizeof(backends[0]))
+	#define NUM_SIZES (sizeof(s_blocks) / sizeof(s_blocks[0]))
+	double mbps[NUM_BACKENDS][NUM_SIZES][2];
+	memset(mbps, 0, sizeof(mbps));
+	
+	unsigned char key[32];
+	for(size_t i = 0; i < sizeof(key); ++i) key[i] = (unsigned char)(i * 7 + 1);
+	size_t max_size = s_blocks[NUM_SIZES - 1] * 16;
+	unsigned char * plain = malloc(max_size);
+	unsigned char * cipher = malloc(max_size);
+	unsigned char * reference = malloc(max_size);
+	assert(plain && cipher && reference);
+	for(size_t i = 0; i < max_size; ++i) plain[i] = (unsigned char)(i * 131);
+	
+	for(size_t b = 0; b < NUM_BACKENDS; ++b) {
+		const char * name = AES_backend_name(backends[b]);
+		if(AES_select_backend(backends[b])) {
+			printf("%-6s: not supported by this cpu\n", name);
+			continue;
+		}
+		AES256_ctx ctx[1];
+		AES256_init(ctx, key);
+		
+		// the soft backend is the reference
+		AES256_encrypt(ctx, max_size / 16, cipher, plain);
+		if(b == 0) memcpy(reference, cipher, max_size);
+		else assert(0 == memcmp(cipher, reference, max_size));
+		
+		for(size_t k = 0; k < NUM_SIZES; ++k) {
+			size_t blocks = s_blocks[k];
+			size_t rounds = total / (blocks * 16);
+			if(backends[b] == AES_BACKEND_soft) rounds /= 16;	// an order of magnitude slower
+			if(rounds == 0) rounds = 1;
+			
+			app_timer_t timer[1];
+			app_timer_start(timer);
+			for(size_t i = 0; i < rounds; ++i) AES256_encrypt(ctx, blocks, cipher, plain);
+			double t_encrypt = app_timer_stop(timer);
+			
+			app_timer_start(timer);
+			for(size_t i = 0; i < rounds; ++i) AES256_decrypt(ctx, blocks, plain, cipher);
+			double t_decrypt = app_timer_stop(timer);
+			
+			mbps[b][k][0] = rounds * blocks * 16 / t_encrypt / 1e6;
+			mbps[b][k][1] = rounds * blocks * 16 / t_decrypt / 1e6;
+			printf("%-6s %5zu blocks: encrypt %9.1f MB/s (%8.1f ns/block), decrypt %9.1f MB/s (x%.1f / x%.1f vs soft)\n",
+				name, blocks, 
+				mbps[b][k][0], t_encrypt * 1e9 / (rounds * blocks), mbps[b][k][1],
+				mbps[0][k][0]?(mbps[b][k][0] / mbps[0][k][0]):0, 
+				mbps[0][k][1]?(mbps[b][k][1] / mbps[0][k][1]):0);
+		}
+	}
+	
+	free(plain);
+	free(cipher);
+	free(reference);
+	return 0;
+}
@@ -0,0 +1,211 @@
+/*
+ * base58_bench.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "crypto/base58.h"
+#include "crypto/sha.h"
+
+/**
+ * build:
+ * 
+gcc -std=gnu99 -Wall -O2 -D_GNU_SOURCE -o base58_bench base58_bench.c \
+     -I../utils ../utils/utils.c ../utils/crypto/base58.c ../utils/crypto/sha256_batch.c \
+     $(pkg-config --cflags --libs gnutls) -lm -lpthread
+ *
+ * usage: ./base58_bench [iterations]
+ *
+ * base58 (32-bit limbs) vs the usual byte-at-a-time big number conversion,
+ * 25 bytes (an address), 38 (a WIF key), 82 (an extended key), 256 (the limit),
+ * and base58check_decode_batch() vs one base58check_decode() per address.
+*/
+
+static const char s_alphabet[] = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+
+/*****************************************************
+ * reference: one byte (or digit) at a time
+*****************************************************/
+static ssize_t naive_encode(const uint8_t * data, size_t length, char * b58, size_t size)
+{
+	size_t zeros = 0;
+	while(zeros < length && data[zeros] == 0) ++zeros;
+	
+	size_t cb_digits = (length - zeros) * 138 / 100 + 1;
+	uint8_t digits[BASE58_ENCODED_SIZE(BASE58_MAX_DATA_SIZE)];
+	memset(digits, 0, cb_digits);
+	size_t used = 0;
+	for(size_t i = zeros; i < length; ++i) {
+		int carry = data[i];
+		size_t k = 0;
+		for(uint8_t * p = digits + cb_digits - 1; (carry || k < used) && p >= digits; --p, ++k) {
+			carry += 256 * (*p);
+			*p = carry % 58;
+			carry /= 58;
+		}
+		used = k;
+	}
+	size_t start = cb_digits - used;
+	while(start < cb_digits && digits[start] == 0) ++start;
+	
+	size_t cb = zeros + (cb_digits - start);
+	if(cb + 1 > size) return -1;
+	memset(b58, '1', zeros);
+	for(size_t i = start; i < cb_digits; ++i) b58[zeros + i - start] = s_alphabet[digits[i]];
+	b58[cb] = '\0';
+	return cb;
+}
+
+static ssize_t naive_decode(const char * b58, size_t length, uint8_t * data, size_t size)
+{
+	size_t ones = 0;
+	while(ones < length && b58[ones] == '1') ++ones;
+	
+	size_t cb_bytes = (length - ones) * 733 / 1000 + 1;
+	uint8_t bytes[BASE58_MAX_DATA_SIZE * 2];
+	memset(bytes, 0, cb_bytes);
+	size_t used = 0;
+	for(size_t i = ones; i < length; ++i) {
+		const char * c = strchr(s_alphabet, b58[i]);
+		if(NULL == c || *c == '\0') return -1;
+		int carry = (int)(c - s_alphabet);
+		size_t k = 0;
+		for(uint8_t * p = bytes + cb_bytes - 1; (carry || k < used) && p >= bytes; --p, ++k) {
+			carry += 58 * (*p);
+			*p = carry % 256;
+			carry /= 256;
+		}
+		used = k;
+	}
+	size_t start = cb_bytes - used;
+	while(start < cb_bytes && bytes[start] == 0) ++start;
+	
+	size_t cb = ones + (cb_bytes - start);
+	if(cb > size) return -1;
+	memset(data, 0, ones);
+	memcpy(data + ones, bytes + start, cb_bytes - start);
+	return cb;
+}
+
+/*****************************************************
+ * main
+*****************************************************/
+static const size_t s_sizes[] = { 25, 38, 82, 256 };
+#define NUM_SIZES (sizeof(s_sizes) / sizeof(s_sizes[0]))
+
+int main(int argc, char ** argv)
+{
+	size_t iterations = (argc > 1)?(size_t)atol(argv[1]):100000;
+	if(iterations == 0) iterations = 100000;
+	
+	uint8_t data[BASE58_MAX_DATA_SIZE];
+	uint8_t decoded[BASE58_MAX_DATA_SIZE];
+	char b58[BASE58_ENCODED_SIZE(BASE58_MAX_DATA_SIZE)];
+	char expected[BASE58_ENCODED_SIZE(BASE58_MAX_DATA_SIZE)];
+	volatile size_t sink = 0;
+	
+	for(size_t k = 0; k < NUM_SIZES; ++k) {
+		size_t length = s_sizes[k];
+		for(size_t i = 0; i < length; ++i) data[i] = (uint8_t)(i * 131 + 7);
+		data[0] = 0;	// a version byte
+		
+		// same results
+		ssize_t cb = base58_encode(data, length, b58, sizeof(b58));
+		assert(cb > 0 && naive_encode(data, length, expected, sizeof(expected)) == cb);
+		assert(0 == strcmp(b58, expected));
+		assert(naive_decode(b58, cb, decoded, sizeof(decoded)) == (ssize_t)length);
+		assert(0 == memcmp(decoded, data, length));
+		
+		size_t rounds = iterations * 25 / length;
+		double t[4];
+		app_timer_t timer[1];
+		
+		app_timer_start(timer);
+		for(size_t i = 0; i < rounds; ++i) { data[1] = (uint8_t)i; sink += naive_encode(data, length, b58, sizeof(b58)); }
+		t[0] = app_timer_stop(timer);
+		app_timer_start(timer);
+		for(size_t i = 0; i < rounds; ++i) { data[1] = (uint8_t)i; sink += base58_encode(data, length, b58, sizeof(b58)); }
+		t[1] = app_timer_stop(timer);
+		
+		app_timer_start(timer);
+		for(size_t i = 0; i < rounds; ++i) sink += naive_decode(expected, cb, decoded, sizeof(decoded));
+		t[2] = app_timer_stop(timer);
+		app_timer_start(timer);
+		for(size_t i = 0; i < rounds; ++i) sink += base58_decode(expected, cb, decoded, sizeof(decoded));
+		t[3] = app_timer_stop(timer);
+		
+		printf("%3zu bytes: encode %8.1f ns (naive %9.1f ns, x%.1f), decode %8.1f ns (naive %9.1f ns, x%.1f)\n",
+			length,
+			t[1] * 1e9 / rounds, t[0] * 1e9 / rounds, t[0] / t[1],
+			t[3] * 1e9 / rounds, t[2] * 1e9 / rounds, t[2] / t[3]);
+	}
+	
+	// address lists
+	enum { NUM_ADDRESSES = 1024 };
+	static char storage[NUM_ADDRESSES][40];
+	const char * addresses[NUM_ADDRESSES];
+	struct base58check_payload * payloads = calloc(NUM_ADDRESSES, sizeof(*payloads));
+	assert(payloads);
+	for(size_t i = 0; i < NUM_ADDRESSES; ++i) {
+		data[0] = (i % 2)?0x05:0x00;
+		for(size_t k = 1; k < 21; ++k) data[k] = (uint8_t)(i * 17 + k * 3);
+		ssize_t cb = base58check_encode(data, 21, storage[i], sizeof(storage[i]));
+		assert(cb > 0);
+		addresses[i] = storage[i];
+	}
+	
+	size_t rounds = iterations / NUM_ADDRESSES + 1;
+	app_timer_t timer[1];
+	app_timer_start(timer);
+	for(size_t r = 0; r < rounds; ++r) {
+		for(size_t i = 0; i < NUM_ADDRESSES; ++i) {
+			sink += base58check_decode(addresses[i], strlen(addresses[i]), decoded, sizeof(decoded));
+		}
+	}
+	double t_single = app_timer_stop(timer);
+	
+	app_timer_start(timer);
+	for(size_t r = 0; r < rounds; ++r) {
+		size_t num_valid = base58check_decode_batch(addresses, NUM_ADDRESSES, payloads);
+		assert(num_valid == NUM_ADDRESSES);
+		sink += num_valid;
+	}
+	double t_batch = app_timer_stop(timer);
+	
+	printf("base58check addresses: %.1f ns/address one by one, %.1f ns/address batched (x%.2f, sha256: %s)\n",
+		t_single * 1e9 / (rounds * NUM_ADDRESSES), t_batch * 1e9 / (rounds * NUM_ADDRESSES), t_single / t_batch,
+		sha256_batch_impl_name());
+	
+	free(payloads);
+	(void)sink;
+	return 0;
+}
@@ -0,0 +1,414 @@
+/*
+ * crypto_bench.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <time.h>
+#include <getopt.h>
+#include <curl/curl.h>
+
+#include <gnutls/gnutls.h>
+#include <gnutls/crypto.h>
+
+#include "utils.h"
+#include "auto_buffer.h"
+#include "crypto/hmac_signer.h"
+#include "trading_agency_coincheck.h"
+#include "trading_agency_zaif.h"
+
+/**
+ * build: make bench  (bin/crypto_bench)
+ * 
+ * usage: crypto_bench [-o results.json] [-t seconds_per_case] [name_filter]
+ * 
+ * the per-request signing path:
+ *   nonce formatting, hex encoding, HMAC-SHA256 (coincheck) / HMAC-SHA512 (zaif)
+ *   on request-sized messages, and the complete auth header list.
+ * 
+ * every case reports ns/op (mean and p50 / p90 / p99 / max over batches)
+ * and heap allocations per op (malloc / calloc / realloc from any library, glibc only).
+ * -o writes the results as json, compare two runs to spot regressions.
+*/
+
+/*****************************************************
+ * allocation counter: 
+ *   interpose the allocator (also for gnutls / libcurl), count while a case is running
+*****************************************************/
+static __thread int s_count_allocs;
+static __thread int64_t s_num_allocs;
+
+#ifdef __GLIBC__
+#define BENCH_COUNT_ALLOCS (1)
+extern void * __libc_malloc(size_t size);
+extern void * __libc_calloc(size_t n, size_t size);
+extern void * __libc_realloc(void * ptr, size_t size);
+extern void __libc_free(void * ptr);
+
+void * malloc(size_t size) 
+{ 
+	if(s_count_allocs) ++s_num_allocs; 
+	return __libc_malloc(size); 
+}
+void * calloc(size_t n, size_t size) 
+{ 
+	if(s_count_allocs) ++s_num_allocs; 
+	return __libc_calloc(n, size); 
+}
+void * realloc(void * ptr, size_t size) 
+{ 
+	if(s_count_allocs) ++s_num_allocs; 
+	return __libc_realloc(ptr, size); 
+}
+void free(void * ptr) { __libc_free(ptr); }
+#endif
+
+/*****************************************************
+ * runner
+*****************************************************/
+#define MAX_SAMPLES (100000)
+#define MIN_BATCH_NS (2000.0)	// one clock_gettime() pair per batch
+
+struct bench_case
+{
+	const char * name;
+	void (* run)(void * user_data);
+	void * user_data;
+};
+
+struct bench_result
+{
+	const char * name;
+	int64_t ops;
+	double ns_per_op;
+	double allocs_per_op;
+	double p50, p90, p99, max;	// ns / op within a batch
+};
+
+static inline double now_ns(void)
+{
+	struct timespec ts[1];
+	clock_gettime(CLOCK_MONOTONIC, ts);
+	return (double)ts->tv_sec * 1e9 + (double)ts->tv_nsec;
+}
+
+static int compare_double(const void * a, const void * b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static double percentile(const double * sorted, size_t count, double p)
+{
+	size_t index = (size_t)(p * (count - 1) + 0.5);
+	return sorted[index];
+}
+
+static void bench_run(const struct bench_case * bench, double seconds, struct bench_result * result)
+{
+	static double samples[MAX_SAMPLES];
+	
+	// warm up (caches, the signer cache), then choose the batch size
+	for(int i = 0; i < 1000; ++i) bench->run(bench->user_data);
+	int64_t batch = 1;
+	while(1) {
+		double begin = now_ns();
+		for(int64_t i = 0; i < batch; ++i) bench->run(bench->user_data);
+		if((now_ns() - begin) >= MIN_BATCH_NS || batch >= (1 << 20)) break;
+		batch *= 2;
+	}
+	
+	size_t num_samples = 0;
+	int64_t ops = 0;
+	double total_ns = 0;
+	s_num_allocs = 0;
+	s_count_allocs = 1;
+	while(num_samples < MAX_SAMPLES && total_ns < seconds * 1e9) {
+		double begin = now_ns();
+		for(int64_t i = 0; i < batch; ++i) bench->run(bench->user_data);
+		double elapsed = now_ns() - begin;
+		
+		samples[num_samples++] = elapsed / batch;
+		total_ns += elapsed;
+		ops += batch;
+	}
+	s_count_allocs = 0;
+	
+	qsort(samples, num_samples, sizeof(samples[0]), compare_double);
+	result->name = bench->name;
+	result->ops = ops;
+	result->ns_per_op = total_ns / ops;
+	result->allocs_per_op = (double)s_num_allocs / ops;
+	result->p50 = percentile(samples, num_samples, 0.50);
+	result->p90 = percentile(samples, num_samples, 0.90);
+	result->p99 = percentile(samples, num_samples, 0.99);
+	result->max = samples[num_samples - 1];
+	return;
+}
+
+/*****************************************************
+ * cases
+*****************************************************/
+static const char * s_api_key = "0123456789abcdef";
+static const char * s_api_secret = "0123456789abcdef0123456789abcdef";
+static hmac_signer_t s_sha256_signer[1];	// one per credential, as trading_agency::get_signer()
+static hmac_signer_t s_sha512_signer[1];
+
+struct message
+{
+	const char * uri;
+	const char * body;
+};
+
+// nonce | uri | body, sizes as sent by coincheck.c
+static struct message s_coincheck_get = { "https://coincheck.com/api/accounts/balance", NULL };
+static struct message s_coincheck_order = { 
+	"https://coincheck.com/api/exchange/orders", 
+	"{\"pair\":\"btc_jpy\",\"order_type\":\"buy\",\"rate\":\"4000000.000000\",\"amount\":\"0.010000\"}" 
+};
+static struct message s_coincheck_withdraw = { 
+	"https://coincheck.com/api/withdraws", 
+	"{\"bank_account_id\":\"1234567\",\"amount\":\"1000000.000000\",\"currency\":\"JPY\","
+	"\"is_fast\":false,\"comment\":\"withdraw to the registered bank account for the monthly settlement\","
+	"\"bank_name\":\"example bank\",\"branch_name\":\"head office\",\"bank_account_type\":\"futsu\","
+	"\"number\":\"0123456\",\"name\":\"EXAMPLE TARO\"}" 
+};
+
+// post fields, as sent by zaif.c
+static const char s_zaif_get_info[] = "nonce=1620000000.123&method=get_info2";
+static const char s_zaif_trade[] = "nonce=1620000000.123&method=trade&currency_pair=btc_jpy&action=bid&price=4000000&amount=0.0100&limit=4100000&comment=bench";
+static const char s_zaif_withdraw[] = "nonce=1620000000.123&method=withdraw&currency=btc"
+	"&address=bc1qexampleexampleexampleexampleexampleexample0000&amount=0.12345678&opt_fee=0.0005"
+	"&message=withdraw%20to%20the%20cold%20wallet%20for%20the%20monthly%20settlement";
+
+static unsigned char s_digest[64];
+static unsigned char s_data[64];
+static char s_hex[64 * 2 + 1];
+static volatile size_t s_sink;
+
+static void run_nonce_coincheck(void * user_data)
+{
+	struct timespec ts[1];
+	clock_gettime(CLOCK_REALTIME, ts);
+	int64_t nonce_ms = (int64_t)ts->tv_sec * 1000 + (ts->tv_nsec / 1000000) % 1000;
+	char sz_nonce[100] = "";
+	s_sink += snprintf(sz_nonce, sizeof(sz_nonce), "%lu", (unsigned long)nonce_ms);
+}
+
+static void run_nonce_zaif(void * user_data)
+{
+	struct timespec ts[1];
+	clock_gettime(CLOCK_REALTIME, ts);
+	double nonce = (double)ts->tv_sec + (double)ts->tv_nsec / 1000000000.0;
+	
+	auto_buffer_t post_fields[1];
+	memset(post_fields, 0, sizeof(post_fields));
+	auto_buffer_init(post_fields, 0);
+	auto_buffer_resize(post_fields, PATH_MAX);
+	s_sink += snprintf((char *)post_fields->data, PATH_MAX, "nonce=%.3f&method=%s", nonce, "get_info2");
+	auto_buffer_cleanup(post_fields);
+}
+
+static void run_hex_encode(void * user_data)
+{
+	size_t size = (size_t)user_data;
+	s_sink += hex_encode(s_data, size, s_hex);
+}
+
+static void run_hex_decode(void * user_data)
+{
+	size_t size = (size_t)user_data;
+	s_sink += hex_decode(s_hex, size * 2, s_digest);
+}
+
+static void run_sha256(void * user_data)
+{
+	static unsigned char message[1024];
+	gnutls_hash_fast(GNUTLS_DIG_SHA256, message, sizeof(message), s_digest);
+}
+
+static void run_hmac_coincheck(void * user_data)
+{
+	const struct message * msg = user_data;
+	struct iovec parts[3] = {
+		{ .iov_base = "1620000000123", .iov_len = 13 },
+		{ .iov_base = (void *)msg->uri, .iov_len = strlen(msg->uri) },
+		{ .iov_base = (void *)msg->body, .iov_len = msg->body?strlen(msg->body):0 },
+	};
+	hmac_signer_sign(s_sha256_signer, parts, 3, s_digest);
+}
+
+static void run_hmac_zaif(void * user_data)
+{
+	const char * post_fields = user_data;
+	struct iovec parts[1] = { { .iov_base = (void *)post_fields, .iov_len = strlen(post_fields) } };
+	hmac_signer_sign(s_sha512_signer, parts, 1, s_digest);
+}
+
+// a keyed init per message (the path before hmac_signer)
+static void run_hmac_sha256_uncached(void * user_data)
+{
+	const struct message * msg = user_data;
+	char message[1024];
+	int cb = snprintf(message, sizeof(message), "%s%s%s", "1620000000123", msg->uri, msg->body?msg->body:"");
+	gnutls_hmac_fast(GNUTLS_MAC_SHA256, s_api_secret, strlen(s_api_secret), message, cb, s_digest);
+}
+
+static void run_headers_coincheck(void * user_data)
+{
+	const struct message * msg = user_data;
+	struct curl_slist * headers = coincheck_auth_add_headers(NULL, s_api_key, s_sha256_signer, 
+		msg->uri, msg->body, -1, NULL);
+	curl_slist_free_all(headers);
+}
+
+static void run_headers_zaif(void * user_data)
+{
+	const char * post_fields = user_data;
+	struct curl_slist * headers = zaif_auth_add_headers(NULL, s_api_key, s_sha512_signer, post_fields, -1);
+	curl_slist_free_all(headers);
+}
+
+static const struct bench_case s_cases[] = {
+	{ "nonce.coincheck", run_nonce_coincheck, NULL },
+	{ "nonce.zaif", run_nonce_zaif, NULL },
+	
+	{ "hex.encode.32", run_hex_encode, (void *)32 },
+	{ "hex.encode.64", run_hex_encode, (void *)64 },
+	{ "hex.decode.64", run_hex_decode, (void *)64 },
+	
+	{ "sha256.1k", run_sha256, NULL },
+	
+	{ "hmac_sha256.coincheck.get", run_hmac_coincheck, &s_coincheck_get },
+	{ "hmac_sha256.coincheck.order", run_hmac_coincheck, &s_coincheck_order },
+	{ "hmac_sha256.coincheck.withdraw", run_hmac_coincheck, &s_coincheck_withdraw },
+	{ "hmac_sha256.uncached.order", run_hmac_sha256_uncached, &s_coincheck_order },
+	
+	{ "hmac_sha512.zaif.get_info2", run_hmac_zaif, (void *)s_zaif_get_info },
+	{ "hmac_sha512.zaif.trade", run_hmac_zaif, (void *)s_zaif_trade },
+	{ "hmac_sha512.zaif.withdraw", run_hmac_zaif, (void *)s_zaif_withdraw },
+	
+	{ "headers.coincheck.get", run_headers_coincheck, &s_coincheck_get },
+	{ "headers.coincheck.order", run_headers_coincheck, &s_coincheck_order },
+	{ "headers.zaif.trade", run_headers_zaif, (void *)s_zaif_trade },
+};
+#define NUM_CASES (sizeof(s_cases) / sizeof(s_cases[0]))
+
+/*****************************************************
+ * output
+*****************************************************/
+static int write_json(const char * path, const struct bench_result * results, size_t count, double seconds)
+{
+	FILE * fp = fopen(path, "w");
+	if(NULL == fp) {
+		perror(path);
+		return -1;
+	}
+	
+	char timestamp[64] = "";
+	time_t now = time(NULL);
+	struct tm t[1];
+	strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime_r(&now, t));
+	
+	fprintf(fp, "{\n");
+	fprintf(fp, "\t\"benchmark\": \"crypto_bench\",\n");
+	fprintf(fp, "\t\"timestamp\": \"%s\",\n", timestamp);
+	fprintf(fp, "\t\"gnutls\": \"%s\",\n", gnutls_check_version(NULL));
+	fprintf(fp, "\t\"hex_impl\": \"%s\",\n", hex_impl_name());
+	fprintf(fp, "\t\"seconds_per_case\": %g,\n", seconds);
+	fprintf(fp, "\t\"allocs_counted\": %s,\n", 
+#ifdef BENCH_COUNT_ALLOCS
+		"true"
+#else
+		"false"
+#endif
+	);
+	fprintf(fp, "\t\"cases\": [\n");
+	for(size_t i = 0; i < count; ++i) {
+		const struct bench_result * r = &results[i];
+		fprintf(fp, "\t\t{ \"name\": \"%s\", \"ops\": %" PRIi64 ", \"ns_per_op\": %.2f, \"allocs_per_op\": %.3f, "
+			"\"p50_ns\": %.2f, \"p90_ns\": %.2f, \"p99_ns\": %.2f, \"max_ns\": %.2f }%s\n",
+			r->name, r->ops, r->ns_per_op, r->allocs_per_op, 
+			r->p50, r->p90, r->p99, r->max, 
+			(i + 1 < count)?",":"");
+	}
+	fprintf(fp, "\t]\n}\n");
+	fclose(fp);
+	return 0;
+}
+
+int main(int argc, char ** argv)
+{
+	const char * output_file = NULL;
+	double seconds = 0.5;
+	int opt;
+	while((opt = getopt(argc, argv, "o:t:h")) != -1) {
+		switch(opt) {
+		case 'o': output_file = optarg; break;
+		case 't': seconds = atof(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-o results.json] [-t seconds_per_case] [name_filter]\n", argv[0]);
+			return 1;
+		}
+	}
+	const char * filter = (optind < argc)?argv[optind]:NULL;
+	if(seconds <= 0) seconds = 0.5;
+	
+	gnutls_global_init();
+	for(size_t i = 0; i < sizeof(s_data); ++i) s_data[i] = (unsigned char)(i * 131 + 7);
+	hex_encode(s_data, sizeof(s_data), s_hex);
+	hmac_signer_init(s_sha256_signer, GNUTLS_MAC_SHA256, s_api_secret, strlen(s_api_secret));
+	hmac_signer_init(s_sha512_signer, GNUTLS_MAC_SHA512, s_api_secret, strlen(s_api_secret));
+	
+	struct bench_result results[NUM_CASES];
+	size_t count = 0;
+	
+	printf("%-32s %10s %10s %10s %10s %10s %8s\n", "case", "ns/op", "p50", "p90", "p99", "max", "allocs");
+	for(size_t i = 0; i < NUM_CASES; ++i) {
+		if(filter && NULL == strstr(s_cases[i].name, filter)) continue;
+		
+		struct bench_result * r = &results[count++];
+		bench_run(&s_cases[i], seconds, r);
+		printf("%-32s %10.1f %10.1f %10.1f %10.1f %10.1f %8.2f\n", 
+			r->name, r->ns_per_op, r->p50, r->p90, r->p99, r->max, r->allocs_per_op);
+	}
+	
+	int rc = 0;
+	if(output_file) rc = write_json(output_file, results, count, seconds);
+	
+	hmac_signer_cleanup(s_sha256_signer);
+	hmac_signer_cleanup(s_sha512_signer);
+	gnutls_global_deinit();
+	return rc;
+}
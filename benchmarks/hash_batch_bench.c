@@ -0,0 +1,122 @@
+/*
+ * hash_batch_bench.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "crypto/sha.h"
+
+/**
+ * build:
+ * 
+gcc -std=gnu99 -Wall -O2 -D_GNU_SOURCE -o hash_batch_bench hash_batch_bench.c \
+     -I../utils ../utils/utils.c ../utils/crypto/sha256_batch.c \
+     $(pkg-config --cflags --libs gnutls) -lm -lpthread
+ *
+ * usage: ./hash_batch_bench [total_mbytes] [batch_size]
+ *
+ * sha256_batch / hash256_batch throughput of each engine,
+ * batches of equal-sized messages from 32 bytes (a key, a digest) to 4 KiB (a snapshot page).
+ * 'gnutls' is one gnutls_hash_fast() per message, i.e. what the callers did before.
+*/
+
+static const size_t s_sizes[] = { 32, 64, 128, 256, 512, 1024, 4096 };
+
+int main(int argc, char ** argv)
+{
+	size_t total = (argc > 1)?(size_t)atol(argv[1]):64;
+	size_t batch_size = (argc > 2)?(size_t)atol(argv[2]):256;
+	if(total == 0) total = 64;
+	if(batch_size == 0) batch_size = 256;
+	total *= 1024 * 1024;
+	
+	static const enum sha256_batch_impl impls[] = { sha256_batch_impl_gnutls, sha256_batch_impl_avx2, sha256_batch_impl_shani };
+	#define NUM_IMPLS (sizeof(impls) / sizeof(impls[0]))
+	#define NUM_SIZES (sizeof(s_sizes) / sizeof(s_sizes[0]))
+	double mbps[NUM_IMPLS][NUM_SIZES];
+	memset(mbps, 0, sizeof(mbps));
+	
+	size_t max_size = s_sizes[NUM_SIZES - 1];
+	uint8_t * data = malloc(max_size * batch_size);
+	struct iovec * messages = calloc(batch_size, sizeof(*messages));
+	uint8_t (* digests)[32] = calloc(batch_size, 32);
+	uint8_t (* reference)[32] = calloc(batch_size * NUM_SIZES, 32);	// per size
+	assert(data && messages && digests && reference);
+	for(size_t i = 0; i < max_size * batch_size; ++i) data[i] = (uint8_t)(i * 131 + (i >> 8));
+	
+	printf("batch: %zu messages\n", batch_size);
+	for(size_t b = 0; b < NUM_IMPLS; ++b) {
+		if(sha256_batch_impl_select(impls[b])) {
+			printf("impl %d: not supported by this cpu\n", (int)impls[b]);
+			continue;
+		}
+		const char * name = sha256_batch_impl_name();
+		
+		for(size_t k = 0; k < NUM_SIZES; ++k) {
+			size_t size = s_sizes[k];
+			for(size_t i = 0; i < batch_size; ++i) {
+				messages[i].iov_base = data + i * size;
+				messages[i].iov_len = size;
+			}
+			
+			// gnutls is the reference
+			sha256_batch(messages, batch_size, digests);
+			if(b == 0) memcpy(reference[k * batch_size], digests, batch_size * 32);
+			else assert(0 == memcmp(digests, reference[k * batch_size], batch_size * 32));
+			
+			size_t rounds = total / (size * batch_size);
+			if(rounds == 0) rounds = 1;
+			
+			app_timer_t timer[1];
+			app_timer_start(timer);
+			for(size_t i = 0; i < rounds; ++i) sha256_batch(messages, batch_size, digests);
+			double t_sha256 = app_timer_stop(timer);
+			
+			app_timer_start(timer);
+			for(size_t i = 0; i < rounds; ++i) hash256_batch(messages, batch_size, digests);
+			double t_hash256 = app_timer_stop(timer);
+			
+			double num_messages = (double)rounds * batch_size;
+			mbps[b][k] = num_messages * size / t_sha256 / 1e6;
+			printf("%-6s %5zu bytes: sha256 %8.1f MB/s (%7.1f ns/msg, x%.2f vs gnutls), hash256 %7.1f ns/msg\n",
+				name, size, mbps[b][k], t_sha256 * 1e9 / num_messages,
+				mbps[0][k]?(mbps[b][k] / mbps[0][k]):0,
+				t_hash256 * 1e9 / num_messages);
+		}
+	}
+	
+	free(data);
+	free(messages);
+	free(digests);
+	free(reference);
+	return 0;
+}
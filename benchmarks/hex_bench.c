@@ -0,0 +1,136 @@
+/*
+ * hex_bench.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "utils.h"
+
+/**
+ * build:
+ * 
+gcc -std=gnu99 -Wall -O3 -D_GNU_SOURCE -o hex_bench hex_bench.c \
+     -I../utils ../utils/utils.c -lm -lpthread
+ *
+ * usage: ./hex_bench [total_mbytes]
+ *
+ * hex encode / decode throughput of each implementation,
+ * at the signature sizes (32, 64 bytes) and in bulk (4096 bytes),
+ * plus the allocating bin2hex() against hex_encode() into a stack buffer.
+*/
+
+static const size_t s_sizes[] = { 32, 64, 4096 };
+
+static void bench_impl(const char * name, size_t total)
+{
+	unsigned char data[4096];
+	char hex[4096 * 2 + 1];
+	unsigned char decoded[4096];
+	for(size_t i = 0; i < sizeof(data); ++i) data[i] = (unsigned char)(i * 131 + 7);
+	
+	for(size_t k = 0; k < sizeof(s_sizes) / sizeof(s_sizes[0]); ++k) {
+		size_t size = s_sizes[k];
+		size_t rounds = total / size;
+		app_timer_t timer[1];
+		
+		app_timer_start(timer);
+		for(size_t i = 0; i < rounds; ++i) {
+			data[0] = (unsigned char)i;		// keep the loop from being hoisted
+			hex_encode(data, size, hex);
+		}
+		double t_encode = app_timer_stop(timer);
+		
+		app_timer_start(timer);
+		for(size_t i = 0; i < rounds; ++i) {
+			ssize_t cb = hex_decode(hex, size * 2, decoded);
+			assert(cb == (ssize_t)size);
+		}
+		double t_decode = app_timer_stop(timer);
+		assert(0 == memcmp(decoded + 1, data + 1, size - 1));
+		
+		printf("%-8s %5zu bytes: encode %8.1f MB/s (%6.1f ns), decode %8.1f MB/s (%6.1f ns)\n", 
+			name, size, 
+			rounds * size / t_encode / 1e6, t_encode * 1e9 / rounds,
+			rounds * size / t_decode / 1e6, t_decode * 1e9 / rounds);
+	}
+}
+
+static void bench_signature(size_t rounds)
+{
+	unsigned char digest[32];
+	for(size_t i = 0; i < sizeof(digest); ++i) digest[i] = (unsigned char)i;
+	size_t checksum = 0;
+	app_timer_t timer[1];
+	
+	app_timer_start(timer);
+	for(size_t i = 0; i < rounds; ++i) {
+		digest[0] = (unsigned char)i;
+		char * hex = NULL;
+		bin2hex(digest, sizeof(digest), &hex);
+		checksum += hex[1];
+		free(hex);
+	}
+	double t_alloc = app_timer_stop(timer);
+	
+	app_timer_start(timer);
+	for(size_t i = 0; i < rounds; ++i) {
+		digest[0] = (unsigned char)i;
+		char hex[sizeof(digest) * 2 + 1];
+		hex_encode(digest, sizeof(digest), hex);
+		checksum -= hex[1];
+	}
+	double t_stack = app_timer_stop(timer);
+	assert(checksum == 0);
+	
+	printf("signature (32 bytes, %s): bin2hex + free %.1f ns, hex_encode (stack) %.1f ns\n",
+		hex_impl_name(), t_alloc * 1e9 / rounds, t_stack * 1e9 / rounds);
+}
+
+int main(int argc, char ** argv)
+{
+	size_t total = (argc > 1)?(size_t)atol(argv[1]):256;
+	if(total == 0) total = 256;
+	total *= 1024 * 1024;
+	
+	static const enum hex_impl impls[] = { hex_impl_scalar, hex_impl_ssse3, hex_impl_avx2 };
+	static const char * names[] = { "scalar", "ssse3", "avx2" };
+	for(size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); ++i) {
+		if(hex_impl_select(impls[i])) {
+			printf("%-8s: not supported by this cpu\n", names[i]);
+			continue;
+		}
+		bench_impl(names[i], total);
+	}
+	
+	hex_impl_select(hex_impl_auto);
+	bench_signature(10000000);
+	return 0;
+}
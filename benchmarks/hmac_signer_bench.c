@@ -0,0 +1,172 @@
+/*
+ * hmac_signer_bench.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "utils.h"
+#include "auto_buffer.h"
+#include "crypto/hmac.h"
+#include "crypto/hmac_signer.h"
+
+/**
+ * build:
+ * 
+gcc -std=gnu99 -Wall -O3 -D_GNU_SOURCE -o hmac_signer_bench hmac_signer_bench.c \
+     -I../include -I../utils \
+     ../utils/utils.c ../utils/auto_buffer.c ../utils/crypto/hmac_signer.c \
+     -lm -lpthread \
+     $(pkg-config --cflags --libs gnutls)
+ *
+ * usage: ./hmac_signer_bench [iterations]
+ *
+ * compares the request signing before / after hmac_signer:
+ *   coincheck: HMAC-SHA256(nonce | uri | body), keyed init + auto_buffer + bin2hex per request
+ *   zaif:      HMAC-SHA512(post_fields), gnutls_hmac_fast + bin2hex per request
+*/
+
+static const char * s_secret = "0123456789abcdef0123456789abcdef";
+static const char * s_uri = "https://coincheck.com/api/exchange/orders";
+static const char * s_body = "pair=btc_jpy&order_type=buy&rate=4000000.000000&amount=0.010000";
+static hmac_signer_t s_sha256_signer[1];	// one per credential, as trading_agency::get_signer()
+static hmac_signer_t s_sha512_signer[1];
+
+// the previous coincheck_auth_add_headers()
+static void coincheck_sign_baseline(const char * nonce, char signature[static 65])
+{
+	hmac_sha256_t hmac[1];
+	unsigned char hash[32] = { 0 };
+	
+	auto_buffer_t message[1];
+	memset(message, 0, sizeof(message));
+	auto_buffer_init(message, 0);
+	auto_buffer_push(message, nonce, strlen(nonce));
+	auto_buffer_push(message, s_uri, strlen(s_uri));
+	auto_buffer_push(message, s_body, strlen(s_body));
+	
+	hmac_sha256_init(hmac, (unsigned char *)s_secret, strlen(s_secret));
+	hmac_sha256_update(hmac, (unsigned char *)message->data, message->length);
+	hmac_sha256_final(hmac, hash);
+	
+	char * hex = NULL;
+	bin2hex(hash, sizeof(hash), &hex);
+	memcpy(signature, hex, 65);
+	free(hex);
+	auto_buffer_cleanup(message);
+	return;
+}
+
+static void coincheck_sign_signer(const char * nonce, char signature[static 65])
+{
+	struct iovec parts[3] = {
+		{ .iov_base = (void *)nonce, .iov_len = strlen(nonce) },
+		{ .iov_base = (void *)s_uri, .iov_len = strlen(s_uri) },
+		{ .iov_base = (void *)s_body, .iov_len = strlen(s_body) },
+	};
+	hmac_signer_sign_hex(s_sha256_signer, parts, 3, signature);
+	return;
+}
+
+static void zaif_sign_baseline(const char * post_fields, char signature[static 129])
+{
+	unsigned char hash[64] = { 0 };
+	hmac_sha512_hash(s_secret, strlen(s_secret), post_fields, strlen(post_fields), hash);
+	char * hex = NULL;
+	bin2hex(hash, sizeof(hash), &hex);
+	memcpy(signature, hex, 129);
+	free(hex);
+	return;
+}
+
+static void zaif_sign_signer(const char * post_fields, char signature[static 129])
+{
+	struct iovec parts[1] = { { .iov_base = (void *)post_fields, .iov_len = strlen(post_fields) } };
+	hmac_signer_sign_hex(s_sha512_signer, parts, 1, signature);
+	return;
+}
+
+typedef void (* sign_fn)(const char * message, char * signature);
+static double run(const char * title, sign_fn sign, long iterations, size_t cb_signature)
+{
+	char message[256] = "";
+	char signature[129] = "";
+	uint64_t checksum = 0;
+	
+	app_timer_t timer[1];
+	app_timer_start(timer);
+	for(long i = 0; i < iterations; ++i) {
+		snprintf(message, sizeof(message), "%ld", 1620000000000L + i);	// nonce / post_fields
+		sign(message, signature);
+		checksum += (unsigned char)signature[i % cb_signature];
+	}
+	double elapsed = app_timer_stop(timer);
+	printf("%-24s: %8.1f ns/sign, %10.0f signs/s (checksum: %" PRIu64 ")\n", 
+		title, elapsed * 1e9 / iterations, iterations / elapsed, checksum);
+	return elapsed;
+}
+
+int main(int argc, char ** argv)
+{
+	long iterations = (argc > 1)?atol(argv[1]):1000000;
+	if(iterations <= 0) iterations = 1000000;
+	
+	gnutls_global_init();
+	int rc = hmac_signer_init(s_sha256_signer, GNUTLS_MAC_SHA256, s_secret, strlen(s_secret));
+	assert(0 == rc);
+	rc = hmac_signer_init(s_sha512_signer, GNUTLS_MAC_SHA512, s_secret, strlen(s_secret));
+	assert(0 == rc);
+	
+	// both paths must produce the same signatures
+	char expected[129] = "", actual[129] = "";
+	coincheck_sign_baseline("1620000000000", expected);
+	coincheck_sign_signer("1620000000000", actual);
+	assert(0 == strcmp(expected, actual));
+	zaif_sign_baseline("nonce=1&method=get_info2", expected);
+	zaif_sign_signer("nonce=1&method=get_info2", actual);
+	assert(0 == strcmp(expected, actual));
+	
+	double t0 = run("coincheck (baseline)", (sign_fn)coincheck_sign_baseline, iterations, 64);
+	double t1 = run("coincheck (hmac_signer)", (sign_fn)coincheck_sign_signer, iterations, 64);
+	printf("  speedup: %.2fx\n", t0 / t1);
+	
+	t0 = run("zaif (baseline)", (sign_fn)zaif_sign_baseline, iterations, 128);
+	t1 = run("zaif (hmac_signer)", (sign_fn)zaif_sign_signer, iterations, 128);
+	printf("  speedup: %.2fx\n", t0 / t1);
+	
+	hmac_signer_cleanup(s_sha256_signer);
+	hmac_signer_cleanup(s_sha512_signer);
+	gnutls_global_deinit();
+	return 0;
+}
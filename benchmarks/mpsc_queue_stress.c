@@ -0,0 +1,252 @@
+/*
+ * mpsc_queue_stress.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "utils.h"
+#include "mpsc_queue.h"
+#include "trading_agency.h"
+
+/**
+ * build:
+ * 
+gcc -std=gnu99 -Wall -O3 -D_GNU_SOURCE -o mpsc_queue_stress mpsc_queue_stress.c \
+     -I../include -I../utils \
+     ../utils/utils.c ../utils/mpsc_queue.c \
+     -lm -lpthread -ljson-c
+ *
+ * usage: ./mpsc_queue_stress [max_producers] [commands_per_producer]
+*/
+
+#define MAX_PRODUCERS (64)
+#define CONSUMER_BATCH_SIZE TRADING_AGENCY_COMMAND_BATCH_SIZE
+
+static int s_num_producers;
+static int64_t s_commands_per_producer = 100000;
+
+static inline int64_t get_time_ns(void)
+{
+	struct timespec ts[1];
+	clock_gettime(CLOCK_MONOTONIC, ts);
+	return (int64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+static int compare_int64(const void * a, const void * b)
+{
+	int64_t x = *(const int64_t *)a;
+	int64_t y = *(const int64_t *)b;
+	return (x > y) - (x < y);
+}
+
+/*********************************************
+ * baseline: mutex-protected ring buffer
+*********************************************/
+struct mutex_queue
+{
+	pthread_mutex_t mutex;
+	size_t capacity;
+	size_t head;
+	size_t length;
+	struct trading_agency_command * items;
+};
+
+static int mutex_queue_push(struct mutex_queue * queue, const struct trading_agency_command * cmd)
+{
+	pthread_mutex_lock(&queue->mutex);
+	if(queue->length == queue->capacity) {
+		pthread_mutex_unlock(&queue->mutex);
+		return -1;
+	}
+	queue->items[(queue->head + queue->length) % queue->capacity] = *cmd;
+	++queue->length;
+	pthread_mutex_unlock(&queue->mutex);
+	return 0;
+}
+
+static ssize_t mutex_queue_pop_batch(struct mutex_queue * queue, struct trading_agency_command * cmds, size_t max_items)
+{
+	pthread_mutex_lock(&queue->mutex);
+	size_t count = 0;
+	while(count < max_items && queue->length > 0) {
+		cmds[count++] = queue->items[queue->head];
+		queue->head = (queue->head + 1) % queue->capacity;
+		--queue->length;
+	}
+	pthread_mutex_unlock(&queue->mutex);
+	return count;
+}
+
+/*********************************************
+ * stress test
+*********************************************/
+struct stress_context
+{
+	int use_mutex;
+	mpsc_queue_t * queue;
+	struct mutex_queue mqueue[1];
+	
+	int64_t total_pushed;
+	int64_t num_retries;	// queue was full
+	volatile int start;
+};
+
+struct producer_context
+{
+	struct stress_context * ctx;
+	int id;
+	int64_t * latencies;	// ns
+	int64_t num_retries;
+};
+
+static void * producer_thread(void * user_data)
+{
+	struct producer_context * producer = user_data;
+	struct stress_context * ctx = producer->ctx;
+	
+	struct trading_agency_command cmd = {
+		.type = trading_agency_command_type_new_order,
+		.pair = "btc_jpy",
+		.order = { .order_type = "buy", .rate = 4000000.0, .amount = 0.005 },
+	};
+	
+	while(!ctx->start) sched_yield();
+	
+	for(int64_t i = 0; i < s_commands_per_producer; ++i) {
+		cmd.seq = ((int64_t)producer->id << 32) | i;
+		
+		int64_t begin = get_time_ns();
+		int rc = 0;
+		while(1) {
+			rc = ctx->use_mutex?mutex_queue_push(ctx->mqueue, &cmd):mpsc_queue_push(ctx->queue, &cmd);
+			if(0 == rc) break;
+			++producer->num_retries;
+			sched_yield();
+		}
+		producer->latencies[i] = get_time_ns() - begin;
+	}
+	return NULL;
+}
+
+static void run_stress(int use_mutex, int num_producers)
+{
+	struct stress_context ctx[1];
+	memset(ctx, 0, sizeof(ctx));
+	ctx->use_mutex = use_mutex;
+	ctx->queue = mpsc_queue_init(NULL, TRADING_AGENCY_COMMAND_QUEUE_SIZE, sizeof(struct trading_agency_command));
+	
+	pthread_mutex_init(&ctx->mqueue->mutex, NULL);
+	ctx->mqueue->capacity = TRADING_AGENCY_COMMAND_QUEUE_SIZE;
+	ctx->mqueue->items = calloc(ctx->mqueue->capacity, sizeof(*ctx->mqueue->items));
+	assert(ctx->mqueue->items);
+	
+	struct producer_context producers[MAX_PRODUCERS];
+	pthread_t threads[MAX_PRODUCERS];
+	memset(producers, 0, sizeof(producers));
+	for(int i = 0; i < num_producers; ++i) {
+		producers[i].ctx = ctx;
+		producers[i].id = i;
+		producers[i].latencies = calloc(s_commands_per_producer, sizeof(int64_t));
+		assert(producers[i].latencies);
+		int rc = pthread_create(&threads[i], NULL, producer_thread, &producers[i]);
+		assert(0 == rc);
+	}
+	
+	// consumer (current thread)
+	int64_t total = (int64_t)num_producers * s_commands_per_producer;
+	int64_t received = 0;
+	int64_t num_batches = 0;
+	struct trading_agency_command batch[CONSUMER_BATCH_SIZE];
+	
+	int64_t begin = get_time_ns();
+	ctx->start = 1;
+	while(received < total) {
+		ssize_t count = use_mutex?
+			mutex_queue_pop_batch(ctx->mqueue, batch, CONSUMER_BATCH_SIZE):
+			mpsc_queue_pop_batch(ctx->queue, batch, CONSUMER_BATCH_SIZE);
+		if(count <= 0) continue;
+		received += count;
+		++num_batches;
+	}
+	int64_t elapsed = get_time_ns() - begin;
+	
+	for(int i = 0; i < num_producers; ++i) pthread_join(threads[i], NULL);
+	
+	// merge latencies
+	int64_t * latencies = malloc(total * sizeof(*latencies));
+	assert(latencies);
+	int64_t num_retries = 0;
+	for(int i = 0; i < num_producers; ++i) {
+		memcpy(latencies + i * s_commands_per_producer, producers[i].latencies, s_commands_per_producer * sizeof(int64_t));
+		num_retries += producers[i].num_retries;
+		free(producers[i].latencies);
+	}
+	qsort(latencies, total, sizeof(*latencies), compare_int64);
+	
+#define percentile(p) latencies[(int64_t)((double)(total - 1) * (p))]
+	printf("%-6s producers=%2d: %8.2f Mcmd/s, enqueue ns: p50=%5" PRIi64 " p99=%6" PRIi64 " p99.9=%7" PRIi64 " max=%9" PRIi64 
+		", avg batch=%5.2f, retries=%" PRIi64 "\n",
+		use_mutex?"mutex":"mpsc", num_producers,
+		(double)total / ((double)elapsed / 1000.0),
+		percentile(0.50), percentile(0.99), percentile(0.999), latencies[total - 1],
+		(double)received / (double)num_batches, num_retries);
+#undef percentile
+	
+	free(latencies);
+	free(ctx->mqueue->items);
+	pthread_mutex_destroy(&ctx->mqueue->mutex);
+	mpsc_queue_cleanup(ctx->queue);
+	free(ctx->queue);
+	return;
+}
+
+int main(int argc, char ** argv)
+{
+	int max_producers = 16;
+	if(argc > 1) max_producers = atoi(argv[1]);
+	if(argc > 2) s_commands_per_producer = atoll(argv[2]);
+	if(max_producers <= 0 || max_producers > MAX_PRODUCERS) max_producers = MAX_PRODUCERS;
+	if(s_commands_per_producer <= 0) s_commands_per_producer = 100000;
+	
+	printf("sizeof(struct trading_agency_command) = %d, queue size = %d, consumer batch = %d\n", 
+		(int)sizeof(struct trading_agency_command), TRADING_AGENCY_COMMAND_QUEUE_SIZE, CONSUMER_BATCH_SIZE);
+	for(s_num_producers = 1; s_num_producers <= max_producers; s_num_producers *= 2) {
+		run_stress(0, s_num_producers);
+		run_stress(1, s_num_producers);
+	}
+	return 0;
+}
@@ -0,0 +1,94 @@
+#ifndef BTC_TRADER_BANK_CODES_H_
+#define BTC_TRADER_BANK_CODES_H_
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "db_context.h"
+
+/*****************************************************
+ * bank_codes_index:
+ *   in-memory prefix index of the bank codes.
+ *
+ *   all records are loaded into one string pool,
+ *   each key (code, name, kana, hiragana) has a sorted array of record indices,
+ *   a prefix lookup is a binary search (UTF-8 byte order == code point order).
+ *
+ *   db_context.bank_codes is only used as the persistence backend,
+ *   the secondary databases are not queried.
+*****************************************************/
+enum bank_code_field
+{
+	BANK_CODE_FIELD_any = -1,
+	BANK_CODE_FIELD_code,
+	BANK_CODE_FIELD_name,
+	BANK_CODE_FIELD_half_width_kana,
+	BANK_CODE_FIELD_full_width_kana,
+	BANK_CODE_FIELD_hiragana,
+	BANK_CODE_FIELDS_COUNT
+};
+
+struct bank_code_entry
+{
+	union {
+		const char * fields[BANK_CODE_FIELDS_COUNT];
+		struct {
+			const char * code;
+			const char * name;
+			const char * half_width_kana;
+			const char * full_width_kana;
+			const char * hiragana;
+		};
+	};
+};
+
+struct bank_codes_load_stats
+{
+	size_t num_inserted;
+	size_t num_updated;
+	size_t num_deleted;
+	size_t num_unchanged;
+	int full_rebuild;	// truncated and bulk loaded
+	double elapsed;		// seconds
+};
+
+/*
+ * bank_codes_bulk_load(): replace the stored list with @records (the full remote list).
+ *   records are sorted by code (in place) and diffed against the database.
+ *   small diffs are applied with normal puts / deletes in one transaction,
+ *   otherwise the primary and the secondary indices are truncated and 
+ *   written in key order with DB_MULTIPLE_KEY buffers (one transaction).
+ *   must not run concurrently with other writers of db_context.bank_codes.
+ */
+int bank_codes_bulk_load(db_context_t * db, struct bank_code_record * records, size_t count, struct bank_codes_load_stats * stats);
+
+typedef struct bank_codes_index
+{
+	void * priv;
+	void * user_data;
+	db_context_t * db;	// (nullable) memory only
+	size_t num_banks;
+	
+	int (* reload)(struct bank_codes_index * index);	// from the database
+	// insert or replace, the records are written to the database first
+	int (* add_records)(struct bank_codes_index * index, const struct bank_code_record * records, size_t count);
+	// bank_codes_bulk_load() + reload()
+	int (* bulk_load)(struct bank_codes_index * index, struct bank_code_record * records, size_t count, struct bank_codes_load_stats * stats);
+	
+	// top-k matches in key order, results are valid until the next reload() / add_records()
+	ssize_t (* search)(struct bank_codes_index * index, enum bank_code_field field, const char * prefix, 
+		size_t max_results, const struct bank_code_entry ** results);
+	const struct bank_code_entry * (* find)(struct bank_codes_index * index, const char * code);
+}bank_codes_index_t;
+
+bank_codes_index_t * bank_codes_index_init(bank_codes_index_t * index, db_context_t * db, void * user_data);
+void bank_codes_index_cleanup(bank_codes_index_t * index);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,95 @@
+#ifndef BTC_TRADER_CANDLES_H_
+#define BTC_TRADER_CANDLES_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "db_context.h"
+
+/*****************************************************
+ * candle_engine:
+ *   incremental OHLCV aggregation (1s / 1m / 5m / 1h / 1d) of one pair.
+ *
+ *   each resolution keeps a ring of the latest CANDLE_ENGINE_RING_SIZE bars,
+ *   add_trade() / add_ticker() update every resolution in O(1).
+ *   late trades inside the ring correct the bar in memory, 
+ *   older ones are corrected in the database (read-modify-write).
+ *
+ *   closed bars are queued and written to db_context.candles by a background thread,
+ *   one transaction per CANDLE_ENGINE_FLUSH_THRESHOLD bars or CANDLE_ENGINE_COMMIT_INTERVAL_MS,
+ *   add_trade() / add_ticker() never wait for the disk (unless the queue is full).
+ *   key: pair[12] | resolution (seconds, uint32 BE) | start (ms, uint64 BE)
+ *
+ *   init() loads the stored bars of the ring range, the open bars written 
+ *   by cleanup() keep being updated after a restart.
+ *
+ *   thread-safe (one internal mutex).
+*****************************************************/
+enum candle_resolution
+{
+	CANDLE_RESOLUTION_1s,
+	CANDLE_RESOLUTION_1m,
+	CANDLE_RESOLUTION_5m,
+	CANDLE_RESOLUTION_1h,
+	CANDLE_RESOLUTION_1d,
+	CANDLE_RESOLUTIONS_COUNT
+};
+extern const int64_t candle_resolution_ms[CANDLE_RESOLUTIONS_COUNT];
+
+#define CANDLE_ENGINE_PAIR_SIZE (12)
+#define CANDLE_ENGINE_RING_SIZE (256)	// bars kept in memory per resolution
+#define CANDLE_ENGINE_FLUSH_THRESHOLD (64)	// closed bars per write transaction
+#define CANDLE_ENGINE_COMMIT_INTERVAL_MS (1000)
+#define CANDLE_ENGINE_MAX_PENDING (1024)	// queued writes, add_*() waits for the writer when it is full
+
+struct candle
+{
+	int64_t start_ms;
+	double open;
+	double high;
+	double low;
+	double close;
+	double volume;
+	uint32_t num_trades;
+};
+
+typedef struct candle_engine
+{
+	void * priv;
+	void * user_data;
+	char pair[CANDLE_ENGINE_PAIR_SIZE];
+	db_context_t * db;	// (nullable) no persistence
+	
+	// statistics
+	int64_t num_updates;
+	int64_t num_late_corrections;	// corrected in memory
+	int64_t num_db_corrections;		// too old for the ring, corrected in the database
+	
+	int (* add_trade)(struct candle_engine * engine, int64_t timestamp_ms, double price, double amount);
+	int (* add_ticker)(struct candle_engine * engine, int64_t timestamp_ms, double last);	// price only
+	
+	// the latest (open) bar, return 0 if found
+	int (* get_current)(struct candle_engine * engine, enum candle_resolution resolution, struct candle * candle);
+	
+	// bars with begin_ms <= start_ms < end_ms, *p_candles must be freed by the caller
+	ssize_t (* query)(struct candle_engine * engine, enum candle_resolution resolution, 
+		int64_t begin_ms, int64_t end_ms, struct candle ** p_candles);
+	
+	int (* flush)(struct candle_engine * engine);	// wait until the queued bars are written
+}candle_engine_t;
+
+candle_engine_t * candle_engine_init(candle_engine_t * engine, const char * pair, db_context_t * db, void * user_data);
+void candle_engine_cleanup(candle_engine_t * engine);
+
+struct app_context;
+extern candle_engine_t * app_context_get_candle_engine(struct app_context * app, const char * pair);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
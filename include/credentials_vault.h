@@ -0,0 +1,97 @@
+#ifndef BTC_TRADER_CREDENTIALS_VAULT_H_
+#define BTC_TRADER_CREDENTIALS_VAULT_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "utils.h"
+#include "crypto/hmac_signer.h"
+
+/*****************************************************
+ * credentials_vault:
+ *   encrypted at-rest API credentials (instead of .private/credentials-*.json).
+ *
+ *   file layout (native byte order):
+ *     header { magic "CRDVAULT", version, num_records }
+ *     records { type, length, iv[16], ciphertext[length], mac[32] } ...
+ *   plaintext of a record: api_key '\0' api_secret '\0'
+ *   AES-256-CTR (ctaes) then HMAC-SHA256 over (header, type, length, iv, ciphertext).
+ *
+ *   keys: a random 32-byte master key, stored as hex in a key file (0600)
+ *     or passed in $BTC_TRADER_VAULT_KEY,
+ *     enc_key = HMAC-SHA256(master, "enc"), mac_key = HMAC-SHA256(master, "mac").
+ *     there is no passphrase KDF, opening a vault costs about as much as parsing the json file.
+ *
+ *   lazy unlock: init() only reads the file, a record is verified and decrypted
+ *   on the first get() of its type. keys and decrypted records live in one
+ *   mlock()ed page region excluded from core dumps and not inherited by fork().
+ *   the strings returned by get() stay valid until cleanup().
+ *
+ *   get_signer() keeps one HMAC signer per record next to it, destroyed by cleanup().
+ *   the hmac_signer_t lives in the locked region, but its keyed state 
+ *   (the gnutls handle, or the key copy when gnutls_hmac_copy is unavailable) 
+ *   is on the heap: it is neither locked nor excluded from core dumps.
+*****************************************************/
+#define CREDENTIALS_VAULT_MAGIC "CRDVAULT"
+#define CREDENTIALS_VAULT_VERSION (1)
+#define CREDENTIALS_VAULT_KEY_SIZE (32)
+#define CREDENTIALS_VAULT_MAX_FIELD_SIZE (256)	// api_key / api_secret, including '\0'
+#define CREDENTIALS_VAULT_KEY_ENV "BTC_TRADER_VAULT_KEY"
+
+// same values as enum trading_agency_credentials_type
+enum credentials_vault_type
+{
+	credentials_vault_type_query,
+	credentials_vault_type_trade,
+	credentials_vault_type_withdraw,
+	credentials_vault_types_count
+};
+
+struct credentials_vault_entry
+{
+	const char * api_key;		// NULL: no record of this type
+	const char * api_secret;
+};
+
+typedef struct credentials_vault
+{
+	void * priv;
+	void * user_data;
+	char path[PATH_MAX];
+
+	unsigned int unlocked_types;	// (1 << type) bits, records decrypted so far
+	perf_stats_t unlock_stats[1];	// time per record (verify + decrypt)
+
+	// (thread-safe) decrypts the record on the first call
+	// return 0 on success, 1 if the vault has no record of @type (outputs: ""), -1 on error (bad key / tampered file)
+	int (* get)(struct credentials_vault * vault, enum credentials_vault_type type,
+		const char ** p_api_key, const char ** p_api_secret);
+	
+	// (thread-safe) the signer of the record's secret, built by the first call (one algorithm per record)
+	// return values as get(), *p_signer is NULL unless 0 is returned
+	int (* get_signer)(struct credentials_vault * vault, enum credentials_vault_type type,
+		gnutls_mac_algorithm_t algorithm, const char ** p_api_key, const hmac_signer_t ** p_signer);
+}credentials_vault_t;
+
+// reads @path, @master_key is copied into locked memory (the caller should wipe its copy)
+credentials_vault_t * credentials_vault_init(credentials_vault_t * vault, const char * path,
+	const unsigned char master_key[static CREDENTIALS_VAULT_KEY_SIZE], void * user_data);
+void credentials_vault_cleanup(credentials_vault_t * vault);	// wipes the secrets
+
+// key_file: NULL ==> $BTC_TRADER_VAULT_KEY
+int credentials_vault_load_key(const char * key_file, unsigned char master_key[static CREDENTIALS_VAULT_KEY_SIZE]);
+int credentials_vault_generate_key(const char * key_file, unsigned char master_key[static CREDENTIALS_VAULT_KEY_SIZE]);
+
+// encrypt @entries (indexed by type) into @path (written to '<path>.tmp', synced, renamed)
+int credentials_vault_seal(const char * path, const unsigned char master_key[static CREDENTIALS_VAULT_KEY_SIZE],
+	const struct credentials_vault_entry entries[static credentials_vault_types_count]);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
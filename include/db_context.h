@@ -0,0 +1,76 @@
+#ifndef BTC_TRADER_DB_CONTEXT_H_
+#define BTC_TRADER_DB_CONTEXT_H_
+
+#include <stdio.h>
+#include <db.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************
+ * db_context:
+ *   the Berkeley DB environment (transactional, DB_THREAD)
+ *   and the databases opened in it.
+*****************************************************/
+struct bank_code_record_data
+{
+	char name[64];
+	char half_width_kana[256];
+	char full_width_kana[256];
+	char hiragana[256];
+};
+struct bank_code_record
+{
+	char code[8];
+	union {
+		struct bank_code_record_data data[1];
+		struct {
+			char name[64];
+			char half_width_kana[256];
+			char full_width_kana[256];
+			char hiragana[256];
+		};
+	};
+};
+
+#define BANK_CODES_SDBP_COUNT (4)
+typedef struct db_context
+{
+	void * user_data;
+	DB_ENV * env;
+	DB * bank_codes;			// for write
+	DB * bank_codes_readonly;	// for read
+	union {
+		struct {
+			DB * bank_codes_by_name;
+			DB * bank_codes_by_half_width_kana;
+			DB * bank_codes_by_full_width_kana;
+			DB * bank_codes_by_hiragana;
+		};
+		DB * sdbps[BANK_CODES_SDBP_COUNT];
+	};
+	
+	struct {
+		DB * tickers;	// btree, see tick_store.h
+	} coincheck;
+	
+	DB * candles;	// btree, see candles.h
+}db_context_t;
+
+// return NULL on failure
+db_context_t * db_context_init(db_context_t * db, const char * db_home, void * user_data);
+void db_context_cleanup(db_context_t * db);
+
+// the bank code secondary indices (sdbps), 
+// associate == 0: plain handles, the caller maintains the indices (bulk loading)
+int db_context_open_bank_code_indices(db_context_t * db, int associate);
+void db_context_close_bank_code_indices(db_context_t * db);
+
+struct app_context;
+extern const char * app_context_get_db_home(struct app_context * app);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,135 @@
+#ifndef BTC_TRADER_ORDER_JOURNAL_H_
+#define BTC_TRADER_ORDER_JOURNAL_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "utils.h"
+
+/*****************************************************
+ * order_journal:
+ *   append-only local log of the orders sent to one exchange.
+ *
+ *   every order gets a journal id (unique across restarts),
+ *   the intent is logged before the request is sent and the outcome
+ *   (ack / reject / cancel / fill) when it is known.
+ *   an order with an intent but no outcome is 'in doubt':
+ *   the process died (or the connection dropped) while it was in flight.
+ *
+ *   records are fixed-size with a FNV-1a checksum, a torn tail is truncated on open.
+ *
+ *   append (any thread) only queues the record and never blocks on disk,
+ *   a writer thread writes the queued records and calls fdatasync() once per batch
+ *   (group commit), sync() waits until a given lsn is durable.
+ *   a batch which fails to be written or synced is truncated off the file and kept queued,
+ *   the writer retries it every ORDER_JOURNAL_RETRY_INTERVAL_MS, sync() returns -1 meanwhile.
+ *
+ *   recovery: the writer thread replays the file right after init(),
+ *   so the caller can query the exchange's unsettled orders at the same time,
+ *   reconcile() waits for the replay and applies the exchange's view.
+*****************************************************/
+#define ORDER_JOURNAL_PAIR_SIZE (16)
+#define ORDER_JOURNAL_ORDER_ID_SIZE (64)
+#define ORDER_JOURNAL_COMPACT_THRESHOLD (4096)	// records, rewrite the file on open when closed orders dominate
+#define ORDER_JOURNAL_RETRY_INTERVAL_MS (1000)	// after a failed group commit
+
+enum order_journal_record_type
+{
+	order_journal_record_type_unknown,
+	order_journal_record_type_intent,		// new order, before the request is sent
+	order_journal_record_type_ack,			// accepted, order_id assigned by the exchange
+	order_journal_record_type_reject,		// refused by the exchange, the order does not exist
+	order_journal_record_type_cancel,		// cancel request, before it is sent
+	order_journal_record_type_cancel_ack,	// cancelled by the exchange
+	order_journal_record_type_fill,			// no longer unsettled at the exchange
+	order_journal_record_type_checkpoint,	// (compaction) id: next journal id
+};
+
+enum order_journal_order_state
+{
+	order_journal_order_state_in_doubt,		// intent without an outcome
+	order_journal_order_state_open,
+	order_journal_order_state_cancelling,
+	order_journal_order_state_closed,		// rejected, cancelled or filled
+};
+
+struct order_journal_order
+{
+	int64_t id;
+	enum order_journal_order_state state;
+	char pair[ORDER_JOURNAL_PAIR_SIZE];
+	char order_type[16];
+	double rate;
+	double amount;
+	char order_id[ORDER_JOURNAL_ORDER_ID_SIZE];	// empty while in doubt
+	int64_t created_at;	// ms
+	int64_t updated_at;	// ms
+};
+
+// an unsettled order as reported by the exchange
+struct order_journal_exchange_order
+{
+	const char * order_id;
+	const char * pair;
+	const char * order_type;
+	double rate;
+};
+
+struct order_journal_reconcile_stats
+{
+	int num_open;			// still unsettled at the exchange
+	int num_filled;			// acked orders which are no longer unsettled
+	int num_recovered;		// in doubt orders found at the exchange
+	int num_lost;			// in doubt orders not found: never placed or already filled
+	int num_unknown;		// unsettled at the exchange but not in the journal
+};
+
+typedef struct order_journal
+{
+	void * priv;
+	void * user_data;
+	char path[PATH_MAX / 2];
+
+	// statistics
+	int64_t num_records;	// written
+	int64_t num_commits;	// fdatasync() calls
+	int64_t num_failed_commits;	// write() or fdatasync() failed, the batch is retried
+	perf_stats_t commit_stats[1];	// time per group commit
+
+	// return the journal id of the order, 0 on error (never blocks on disk)
+	int64_t (* new_order)(struct order_journal * journal, const char * pair, const char * order_type, double rate, double amount);
+	int (* acknowledge)(struct order_journal * journal, int64_t id, const char * order_id);
+	int (* reject)(struct order_journal * journal, int64_t id, int rc);
+
+	// by the exchange's order id
+	int (* cancel)(struct order_journal * journal, const char * order_id);
+	int (* cancel_acknowledge)(struct order_journal * journal, const char * order_id, int rc);
+	int (* fill)(struct order_journal * journal, const char * order_id);
+
+	int64_t (* get_lsn)(struct order_journal * journal);	// lsn of the last queued record
+	// wait until @lsn is durable, lsn <= 0: everything queued. -1: the last group commit failed
+	int (* sync)(struct order_journal * journal, int64_t lsn);
+
+	// orders not closed yet, *p_orders must be freed by the caller
+	ssize_t (* get_orders)(struct order_journal * journal, struct order_journal_order ** p_orders);
+
+	// apply the exchange's unsettled orders (waits for the replay)
+	int (* reconcile)(struct order_journal * journal,
+		const struct order_journal_exchange_order * orders, size_t count,
+		struct order_journal_reconcile_stats * stats);
+}order_journal_t;
+
+// opens (or creates) @path and starts the replay in the background
+order_journal_t * order_journal_init(order_journal_t * journal, const char * path, void * user_data);
+void order_journal_cleanup(order_journal_t * journal);	// commits the queued records
+
+#ifdef __cplusplus
+}
+#endif
+#endif
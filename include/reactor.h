@@ -0,0 +1,75 @@
+#ifndef BTC_TRADER_REACTOR_H_
+#define BTC_TRADER_REACTOR_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************
+ * reactor:
+ *   single-threaded event loop (epoll + hashed timer wheel).
+ *
+ *   all methods except wakeup() and stop() must be called 
+ *   on the thread that runs the reactor.
+ *   busy_poll: never block in epoll_wait(), lowest latency, burns one core.
+*****************************************************/
+#define REACTOR_TIMER_WHEEL_SIZE (1024)	// slots, 1 ms per slot
+#define REACTOR_MAX_EVENTS (64)
+
+enum reactor_event_flags
+{
+	REACTOR_EVENT_READ = 1,
+	REACTOR_EVENT_WRITE = 2,
+	REACTOR_EVENT_ERROR = 4,	// error or hang up, always reported
+};
+
+struct reactor_context;
+struct reactor_timer;
+
+typedef void (* reactor_fd_callback)(struct reactor_context * reactor, int fd, int events, void * user_data);
+
+// return 0 to keep a repeating timer, non-zero to remove it
+typedef int (* reactor_timer_callback)(struct reactor_context * reactor, void * user_data);
+
+typedef struct reactor_context
+{
+	void * priv;
+	void * user_data;
+	
+	int quit;
+	int is_running;
+	int busy_poll;
+	
+	// statistics
+	int64_t num_wakeups;		// epoll_wait() returns
+	int64_t num_fd_events;
+	int64_t num_timer_events;
+	
+	int (* run)(struct reactor_context * reactor);		// loop until stop()
+	int (* stop)(struct reactor_context * reactor);
+	int (* dispatch)(struct reactor_context * reactor, int timeout_ms);	// one iteration
+	int (* wakeup)(struct reactor_context * reactor);
+	
+	int (* add_fd)(struct reactor_context * reactor, int fd, int events, reactor_fd_callback callback, void * user_data);
+	int (* modify_fd)(struct reactor_context * reactor, int fd, int events);
+	int (* remove_fd)(struct reactor_context * reactor, int fd);
+	
+	struct reactor_timer * (* add_timer)(struct reactor_context * reactor, int64_t timeout_ms, int repeat, 
+		reactor_timer_callback callback, void * user_data);
+	int (* remove_timer)(struct reactor_context * reactor, struct reactor_timer * timer);
+	
+	// integration with other loops (e.g. GSource)
+	int (* get_fd)(struct reactor_context * reactor);		// the epoll fd
+	int (* get_timeout)(struct reactor_context * reactor);	// ms until the next timer, -1: no timers
+}reactor_context_t;
+
+reactor_context_t * reactor_context_init(reactor_context_t * reactor, void * user_data);
+void reactor_context_cleanup(reactor_context_t * reactor);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
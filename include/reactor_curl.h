@@ -0,0 +1,44 @@
+#ifndef BTC_TRADER_REACTOR_CURL_H_
+#define BTC_TRADER_REACTOR_CURL_H_
+
+#include <stdio.h>
+#include <curl/curl.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "reactor.h"
+
+/*****************************************************
+ * reactor_curl:
+ *   drives a curl_multi handle from the reactor's epoll set
+ *   (CURLMOPT_SOCKETFUNCTION / CURLMOPT_TIMERFUNCTION).
+ *
+ *   on_completed() is called on the reactor thread, 
+ *   the easy handle is already removed from the multi handle.
+*****************************************************/
+struct reactor_curl_context;
+typedef void (* reactor_curl_completed_fn)(struct reactor_curl_context * rcurl, CURL * easy, CURLcode result, void * user_data);
+
+typedef struct reactor_curl_context
+{
+	void * priv;
+	void * user_data;
+	
+	reactor_context_t * reactor;
+	CURLM * multi;
+	int num_running;
+	
+	int (* add_handle)(struct reactor_curl_context * rcurl, CURL * easy, 
+		reactor_curl_completed_fn on_completed, void * user_data);
+	int (* remove_handle)(struct reactor_curl_context * rcurl, CURL * easy);
+}reactor_curl_context_t;
+
+reactor_curl_context_t * reactor_curl_context_init(reactor_curl_context_t * rcurl, reactor_context_t * reactor, void * user_data);
+void reactor_curl_context_cleanup(reactor_curl_context_t * rcurl);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -10,6 +10,7 @@ extern "C" {
 
 #include <gtk/gtk.h>
 
+struct io_workers_context;
 typedef struct shell_context
 {
 	void * priv;
@@ -24,6 +25,8 @@ typedef struct shell_context
 	GtkWidget * info_bar;
 	GtkWidget * message_label;
 	
+	struct io_workers_context * io_workers;	// exchange I/O, keeps the blocking requests off the GTK main loop
+	
 	int (* load_config)(struct shell_context * shell, json_object * jconfig);
 	int (* init)(struct shell_context * shell);
 	int (* run)(struct shell_context * shell);
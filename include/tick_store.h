@@ -0,0 +1,78 @@
+#ifndef BTC_TRADER_TICK_STORE_H_
+#define BTC_TRADER_TICK_STORE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "db_context.h"
+#include "utils.h"
+
+/*****************************************************
+ * tick_store:
+ *   durable ticker history on db_context.coincheck.tickers
+ *
+ *   key:    pair[12] | timestamp (uint64, big-endian, ms)   ==> memcmp order == (pair, time) order
+ *   record: last, bid, ask, high, low, volume (packed doubles)
+ *
+ *   append() only queues the tick (any thread, never blocks on disk),
+ *   a background thread writes the queued ticks in one transaction 
+ *   per TICK_STORE_COMMIT_INTERVAL_MS (group commit) with DB_MULTIPLE_KEY puts.
+*****************************************************/
+#define TICK_STORE_PAIR_SIZE (12)
+#define TICK_STORE_MAX_PENDING (4096)
+#define TICK_STORE_COMMIT_INTERVAL_MS (200)
+
+struct tick_data
+{
+	int64_t timestamp;	// ms
+	double last;
+	double bid;
+	double ask;
+	double high;
+	double low;
+	double volume;
+};
+
+struct tick_store_item
+{
+	char pair[TICK_STORE_PAIR_SIZE];
+	struct tick_data tick;
+};
+
+typedef struct tick_store
+{
+	void * priv;
+	void * user_data;
+	db_context_t * db;
+	
+	// statistics
+	int64_t num_committed;
+	int64_t num_dropped;		// pending queue was full
+	perf_stats_t commit_stats[1];	// time per group commit
+	
+	int (* append)(struct tick_store * store, const char * pair, const struct tick_data * tick);
+	int (* flush)(struct tick_store * store);	// wait until all queued ticks are committed
+	
+	// synchronous bulk put, one transaction
+	int (* put_batch)(struct tick_store * store, const struct tick_store_item * items, size_t count);
+	
+	// cursor range scan: begin_ms <= timestamp < end_ms, *p_ticks must be freed by the caller
+	ssize_t (* query)(struct tick_store * store, const char * pair, int64_t begin_ms, int64_t end_ms, 
+		struct tick_data ** p_ticks);
+}tick_store_t;
+
+tick_store_t * tick_store_init(tick_store_t * store, db_context_t * db, void * user_data);
+void tick_store_cleanup(tick_store_t * store);
+
+struct app_context;
+extern tick_store_t * app_context_get_tick_store(struct app_context * app);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -7,8 +7,11 @@ extern "C" {
 
 #include <json-c/json.h>
 #include <limits.h>
+#include <gnutls/crypto.h>
 
 #include "json-response.h"
+#include "reactor.h"
+#include "reactor_curl.h"
 
 #define TRADING_AGENCY_MAX_NAME_LEN (100)
 enum trading_agency_credentials_type
@@ -18,6 +21,8 @@ enum trading_agency_credentials_type
 	trading_agency_credentials_type_withdraw,
 };
 
+struct trading_agency_command;
+struct hmac_signer;
 typedef struct trading_agency
 {
 	void * priv;
@@ -35,13 +40,182 @@ typedef struct trading_agency
 		enum trading_agency_credentials_type type, 
 		const char ** p_api_key, const char ** p_api_secret);
 	
+	// (thread-safe) the HMAC signer of the credentials' secret (key pads precomputed),
+	// built by the first call of each type and owned by the agency (or its credentials vault) until trading_agency_free(),
+	// one algorithm per type: a later call with another algorithm fails (-1).
+	int (* get_signer)(struct trading_agency * agent, 
+		enum trading_agency_credentials_type type, gnutls_mac_algorithm_t algorithm,
+		const char ** p_api_key, const struct hmac_signer ** p_signer);
+	
+	// (agency thread) send the request of a posted command
+	int (* execute_command)(struct trading_agency * agent, 
+		const struct trading_agency_command * cmd, 
+		json_object ** p_jresult);
+	
 	// private 
-	struct http_json_context http[1];
+	struct http_json_context http[1];	// the first context of the http pool
 }trading_agency_t;
 trading_agency_t * trading_agency_new(const char * agency_name, void * user_data);
 int trading_agency_class_init(trading_agency_t * agent);
 void trading_agency_free(trading_agency_t * agent);
 
+/************************************************
+ * trading_agency::event loop
+ *   each agency owns a worker thread (started by agent->run()),
+ *   all REST requests of the agency should be submitted as jobs.
+ *
+ *   job->execute() and job->on_completed() run on the agency thread,
+ *   on_completed() may hand the result over to another loop (e.g. g_idle_add).
+ *
+ *   agent->stop() does not drop anything: the jobs and commands still queued
+ *   are completed (on the calling thread) with rc = TRADING_AGENCY_ERROR_STOPPED.
+************************************************/
+#define TRADING_AGENCY_ERROR_STOPPED (-2)	// not executed: the event loop has stopped
+#define TRADING_AGENCY_ERROR_QUEUE_FULL (-3)	// not queued: too many commands in flight
+struct trading_agency_job
+{
+	struct trading_agency_job * next;
+	trading_agency_t * agent;
+	void * user_data;
+	int rc;
+	double submitted_at;	// CLOCK_MONOTONIC, seconds
+	
+	int (* execute)(struct trading_agency_job * job);
+	void (* on_completed)(struct trading_agency_job * job);	// (nullable)
+	void (* free_job)(struct trading_agency_job * job);		// (nullable) default: free(job)
+};
+struct trading_agency_job * trading_agency_job_new(size_t size, 
+	int (* execute)(struct trading_agency_job *), 
+	void (* on_completed)(struct trading_agency_job *), 
+	void * user_data);
+int trading_agency_submit(trading_agency_t * agent, struct trading_agency_job * job);
+
+// job->execute() may start a non-blocking request (trading_agency_async_get()) and return TRADING_AGENCY_JOB_PENDING,
+// the job is then completed by trading_agency_job_complete() (agency thread) once the response has been handled.
+#define TRADING_AGENCY_JOB_PENDING (1)
+void trading_agency_job_complete(struct trading_agency_job * job, int rc);
+
+/************************************************
+ * trading_agency::async requests
+ *   (agency thread) sent on the agency's curl_multi handle (reactor_curl), 
+ *   the event loop keeps running while the request is in flight.
+ *
+ *   on_response() is called on the agency thread:
+ *     rc: CURLcode, or TRADING_AGENCY_ERROR_STOPPED if the loop stopped first,
+ *     jresponse: (nullable) owned by the callback.
+************************************************/
+typedef void (* trading_agency_response_fn)(trading_agency_t * agent, int rc, json_object * jresponse, void * user_data);
+int trading_agency_async_get(trading_agency_t * agent, const char * url, trading_agency_response_fn on_response, void * user_data);
+
+// return 0 to keep the timer, non-zero to remove it
+typedef int (* trading_agency_timer_fn)(trading_agency_t * agent, void * user_data);
+int trading_agency_add_timer(trading_agency_t * agent, int64_t interval_ms, trading_agency_timer_fn on_timeout, void * user_data);
+int trading_agency_remove_timer(trading_agency_t * agent, int timer_id);
+
+/************************************************
+ * trading_agency::commands
+ *   can be posted by any thread (GUI, CLI, strategies) without locking,
+ *   the agency's event loop executes them in batches.
+************************************************/
+#define TRADING_AGENCY_COMMAND_QUEUE_SIZE (1024)
+#define TRADING_AGENCY_COMMAND_BATCH_SIZE (16)
+enum trading_agency_command_type
+{
+	trading_agency_command_type_unknown,
+	trading_agency_command_type_new_order,
+	trading_agency_command_type_cancel_order,
+	trading_agency_command_type_query,
+};
+
+enum trading_agency_query_type
+{
+	trading_agency_query_type_balance,
+	trading_agency_query_type_unsettled_orders,
+	trading_agency_query_type_order_history,
+	trading_agency_query_type_ticker,
+	trading_agency_query_type_order_book,
+};
+
+struct trading_agency_command
+{
+	enum trading_agency_command_type type;
+	int64_t seq;	// assigned by trading_agency_post_command()
+	char pair[16];	// e.g. "btc_jpy"
+	union {
+		struct {
+			char order_type[16];	// "buy" or "sell"
+			double rate;
+			double amount;
+		}order;
+		struct {
+			char order_id[64];
+		}cancel;
+		struct {
+			enum trading_agency_query_type type;
+		}query;
+	};
+	
+	// (nullable, agency thread) jresult is released after the callback returns, 
+	// use json_object_get() to keep it.
+	void (* on_completed)(const struct trading_agency_command * cmd, int rc, json_object * jresult);
+	void * user_data;
+};
+// 0: ok, TRADING_AGENCY_ERROR_STOPPED: the agency is stopping, TRADING_AGENCY_ERROR_QUEUE_FULL: the queue is full
+// (on error, on_completed() is not called)
+int trading_agency_post_command(trading_agency_t * agent, struct trading_agency_command * cmd);
+
+/************************************************
+ * trading_agency::order journal
+ *   (nullable) new_order / cancel_order commands are logged 
+ *   before and after execute_command(), see order_journal.h.
+ *   set it before agent->run().
+************************************************/
+struct order_journal;
+void trading_agency_set_order_journal(trading_agency_t * agent, struct order_journal * journal);
+struct order_journal * trading_agency_get_order_journal(trading_agency_t * agent);
+
+/************************************************
+ * trading_agency::http pool
+ *   a http_json_context can only be used by one thread at a time, 
+ *   lease one from the pool for each request and release it afterwards.
+ *   (config: "http_pool_size", default: TRADING_AGENCY_DEFAULT_HTTP_POOL_SIZE)
+************************************************/
+#define TRADING_AGENCY_DEFAULT_HTTP_POOL_SIZE (4)
+#define TRADING_AGENCY_MAX_HTTP_POOL_SIZE (64)
+struct http_json_context * trading_agency_lease_http(trading_agency_t * agent);	// blocks until a context is available
+void trading_agency_release_http(trading_agency_t * agent, struct http_json_context * http);
+
+// private (signed) requests: the exchanges reject a nonce which is not greater than the last one,
+// so at most one signed request per agency is in flight (sign and send while holding the lease).
+// public requests still run in parallel.
+struct http_json_context * trading_agency_lease_signed_http(trading_agency_t * agent);
+
+#define AUTO_RELEASE_HTTP __attribute__((cleanup(trading_agency_auto_release_http)))
+void trading_agency_auto_release_http(void * p_http);
+
+struct perf_stats;
+struct trading_agency_http_pool_stats
+{
+	int pool_size;
+	int num_created;
+	int num_in_use;
+	int max_in_use;
+	double utilization;	// busy time / (elapsed time * pool_size)
+};
+void trading_agency_get_http_pool_stats(trading_agency_t * agent, 
+	struct trading_agency_http_pool_stats * stats,
+	struct perf_stats * lease_wait);
+
+// the agency thread's reactor, must only be used on the agency thread (e.g. in a job or a command).
+// config: "busy_poll": true ==> the loop never blocks in epoll_wait()
+reactor_context_t * trading_agency_get_reactor(trading_agency_t * agent);
+reactor_curl_context_t * trading_agency_get_reactor_curl(trading_agency_t * agent);
+
+int trading_agency_is_running(trading_agency_t * agent);
+void trading_agency_get_loop_stats(trading_agency_t * agent, 
+	struct perf_stats * exec_stats,		// time spent in job->execute()
+	struct perf_stats * wait_stats);	// time between submit and execute
+
 struct app_context;
 extern trading_agency_t * app_context_get_trading_agency(struct app_context * app, const char * agency_name);
 
@@ -11,15 +11,16 @@ extern "C" {
 #endif
 
 #include "trading_agency.h"
+#include "crypto/hmac_signer.h"
 
 /****************************************************
  * API Documentation: 
  *   https://coincheck.com/documents/exchange/api
 ****************************************************/
 
-/* Coincheck Authentication */
+/* Coincheck Authentication (@signer: HMAC-SHA256 of the api_secret, see agent->get_signer()) */
 struct curl_slist * coincheck_auth_add_headers(struct curl_slist * headers, 
-	const char * api_key, const char * api_secret, 
+	const char * api_key, const hmac_signer_t * signer, 
 	const char * uri, 
 	const char * body, ssize_t cb_body, /* post_data */
 	const struct timespec * timestamp 	/* nonce */
@@ -48,6 +49,10 @@ int coincheck_public_get_order_book(trading_agency_t * agent, json_object ** p_j
 int coincheck_public_calc_rate(trading_agency_t * agent, const char * pair, const char * order_type, double price, double amount, json_object ** p_jresponse);
 int coincheck_public_get_buy_rate(trading_agency_t * agent, const char * pair, json_object ** p_jresponse);
 
+// (agency thread) non-blocking, on_response() is called on the agency thread
+int coincheck_public_async_get_ticker(trading_agency_t * agent, trading_agency_response_fn on_response, void * user_data);
+int coincheck_public_async_get_order_book(trading_agency_t * agent, trading_agency_response_fn on_response, void * user_data);
+
 /****************************************
  * coincheck private APIs
  * coincheck::Order
@@ -97,6 +102,11 @@ int coincheck_withdraw_cancel(trading_agency_t * agent,
 	long widthdraw_id, // 出金申請のID
 	json_object ** p_jresponse);
 
+/****************************************
+ * agent->execute_command
+****************************************/
+int coincheck_execute_command(trading_agency_t * agent, const struct trading_agency_command * cmd, json_object ** p_jresult);
+
 #ifdef __cplusplus
 }
 #endif
@@ -8,6 +8,7 @@ extern "C" {
 
 #include <json-c/json.h>
 #include "trading_agency.h"
+#include "crypto/hmac_signer.h"
 #include "auto_buffer.h"
 
 #include <stdbool.h>
@@ -16,10 +17,10 @@ extern "C" {
  * API Documentation: 
  *   https://zaif-api-document.readthedocs.io/ja/latest
 ****************************************************/
-/* zaif Authentication */
+/* zaif Authentication (@signer: HMAC-SHA512 of the api_secret, see agent->get_signer()) */
 struct curl_slist * zaif_auth_add_headers(
 	struct curl_slist * headers, 
-	const char * api_key, const char * api_secret, 
+	const char * api_key, const hmac_signer_t * signer, 
 	const char * post_fields, ssize_t length);
 
 
@@ -54,6 +55,12 @@ int zaif_trade_cancel_order(trading_agency_t * agent, const char * order_id,
 	const char * currency_pair, // nullable
 	_Bool is_token, // nullable
 	json_object ** p_jresponse);
+
+/****************************************
+ * agent->execute_command
+****************************************/
+int zaif_execute_command(trading_agency_t * agent, const struct trading_agency_command * cmd, json_object ** p_jresult);
+
 #ifdef __cplusplus
 }
 #endif
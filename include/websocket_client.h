@@ -0,0 +1,64 @@
+#ifndef BTC_TRADER_WEBSOCKET_CLIENT_H_
+#define BTC_TRADER_WEBSOCKET_CLIENT_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "reactor.h"
+
+/*****************************************************
+ * websocket_client:
+ *   RFC 6455 client on top of a curl CONNECT_ONLY (TLS) connection.
+ *   
+ *   connect() performs the opening handshake (blocking),
+ *   afterwards the socket is watched by the reactor and 
+ *   all callbacks run on the reactor thread.
+*****************************************************/
+enum websocket_opcode
+{
+	WEBSOCKET_OPCODE_continuation = 0x0,
+	WEBSOCKET_OPCODE_text = 0x1,
+	WEBSOCKET_OPCODE_binary = 0x2,
+	WEBSOCKET_OPCODE_close = 0x8,
+	WEBSOCKET_OPCODE_ping = 0x9,
+	WEBSOCKET_OPCODE_pong = 0xA,
+};
+
+#define WEBSOCKET_MAX_MESSAGE_SIZE (16 * 1024 * 1024)
+
+typedef struct websocket_client_context
+{
+	void * priv;
+	void * user_data;
+	
+	reactor_context_t * reactor;
+	int is_connected;
+	
+	// statistics
+	int64_t num_messages;
+	int64_t num_bytes;
+	
+	// callbacks
+	void (* on_connected)(struct websocket_client_context * wss);
+	void (* on_message)(struct websocket_client_context * wss, int opcode, const char * data, size_t length);
+	void (* on_closed)(struct websocket_client_context * wss, int status_code);
+	
+	// methods
+	int (* connect)(struct websocket_client_context * wss, const char * uri);	// "wss://host[:port]/path"
+	int (* send)(struct websocket_client_context * wss, int opcode, const void * data, size_t length);
+	int (* close)(struct websocket_client_context * wss);
+}websocket_client_context_t;
+
+websocket_client_context_t * websocket_client_context_init(websocket_client_context_t * wss, reactor_context_t * reactor, void * user_data);
+void websocket_client_context_cleanup(websocket_client_context_t * wss);
+
+#define websocket_client_send_text(wss, text, length) (wss)->send(wss, WEBSOCKET_OPCODE_text, text, length)
+
+#ifdef __cplusplus
+}
+#endif
+#endif
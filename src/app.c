@@ -36,6 +36,12 @@
 #include <json-c/json.h>
 #include "shell.h"
 #include "trading_agency.h"
+#include "trading_agency_coincheck.h"
+#include "trading_agency_zaif.h"
+#include "db_context.h"
+#include "tick_store.h"
+#include "candles.h"
+#include "order_journal.h"
 
 #include "gui/coincheck-gui.h"
 #include "utils.h"
@@ -69,6 +75,12 @@ typedef struct app_private
 	
 	int num_agencies;
 	trading_agency_t ** agencies;
+	order_journal_t ** journals;	// (nullable items) one per agency
+	
+	const char * db_home;
+	db_context_t * db;
+	tick_store_t * tick_store;
+	candle_engine_t * candles;	// btc_jpy
 }app_private_t;
 
 static app_private_t * app_private_new(app_context_t * app) 
@@ -89,6 +101,23 @@ static void * app_private_free(app_private_t * priv)
 	shell_context_cleanup(priv->shell);
 	priv->shell = NULL;
 	
+	// commit the queued ticks before closing the databases
+	if(priv->tick_store) {
+		tick_store_cleanup(priv->tick_store);
+		free(priv->tick_store);
+		priv->tick_store = NULL;
+	}
+	if(priv->candles) {
+		candle_engine_cleanup(priv->candles);
+		free(priv->candles);
+		priv->candles = NULL;
+	}
+	if(priv->db) {
+		db_context_cleanup(priv->db);
+		free(priv->db);
+		priv->db = NULL;
+	}
+	
 	int num_agencies = priv->num_agencies;
 	trading_agency_t ** agencies = priv->agencies;
 	priv->agencies = NULL;
@@ -102,6 +131,17 @@ static void * app_private_free(app_private_t * priv)
 		free(agencies);
 	}
 	
+	// after the agencies: commit the last outcomes
+	if(priv->journals) {
+		for(int i = 0; i < num_agencies; ++i) {
+			if(NULL == priv->journals[i]) continue;
+			order_journal_cleanup(priv->journals[i]);
+			free(priv->journals[i]);
+		}
+		free(priv->journals);
+		priv->journals = NULL;
+	}
+	
 	if(priv->jconfig) {
 		json_object_put(priv->jconfig);
 		priv->jconfig = NULL;
@@ -139,6 +179,25 @@ static int app_private_parse_args(app_private_t * priv, int argc, char ** argv)
 }
 
 
+static const struct
+{
+	const char * exchange_name;
+	int (* execute_command)(trading_agency_t * agent, const struct trading_agency_command * cmd, json_object ** p_jresult);
+}s_command_executors[] = {
+	{ "coincheck", coincheck_execute_command },
+	{ "zaif", zaif_execute_command },
+};
+static void bind_command_executor(trading_agency_t * agent)
+{
+	for(size_t i = 0; i < sizeof(s_command_executors) / sizeof(s_command_executors[0]); ++i) {
+		if(strcasecmp(agent->exchange_name, s_command_executors[i].exchange_name) == 0) {
+			agent->execute_command = s_command_executors[i].execute_command;
+			return;
+		}
+	}
+	return;
+}
+
 static int app_load_config(struct app_context * app, const char * conf_file)
 {
 	assert(app && app->priv);
@@ -167,14 +226,119 @@ static int app_load_config(struct app_context * app, const char * conf_file)
 		assert(agent);
 		rc = agent->load_config(agent, jagency_config);
 		assert(0 == rc);
+		bind_command_executor(agent);
 		agencies[i] = agent;
 	}
 	priv->num_agencies = num_agencies;
 	priv->agencies = agencies;
 	
+	// the tick store is optional, the app still works without a database
+	const char * db_home = json_get_value(jconfig, string, db_home);
+	if(NULL == db_home) db_home = "data";
+	priv->db_home = db_home;
+	priv->db = db_context_init(NULL, db_home, app);
+	if(priv->db) priv->tick_store = tick_store_init(NULL, priv->db, app);
+	else fprintf(stderr, "[WARNING]: open database '%s' failed, tickers will not be saved.\n", db_home);
+	
+	// without a database only the latest bars are kept in memory
+	priv->candles = candle_engine_init(NULL, "btc_jpy", priv->db, app);
+	
+	// the journals start replaying now, reconcile_order_journals() runs once the agencies are up
+	priv->journals = calloc(num_agencies, sizeof(*priv->journals));
+	assert(priv->journals);
+	for(int i = 0; i < num_agencies; ++i) {
+		char path[PATH_MAX] = "";
+		snprintf(path, sizeof(path), "%s/%s-orders.journal", db_home, agencies[i]->exchange_name);
+		priv->journals[i] = order_journal_init(NULL, path, app);
+		if(NULL == priv->journals[i]) {
+			fprintf(stderr, "[WARNING]: open order journal '%s' failed, orders will not be journaled.\n", path);
+			continue;
+		}
+		trading_agency_set_order_journal(agencies[i], priv->journals[i]);
+	}
+	
 	return rc;
 }
 
+/************************************************
+ * order journal: recovery
+ *   the exchange's unsettled orders are fetched on the agency thread
+ *   while the journal is replayed by its writer thread.
+************************************************/
+static void on_reconcile_unsettled_orders(const struct trading_agency_command * cmd, int rc, json_object * jresult)
+{
+	order_journal_t * journal = cmd->user_data;
+	assert(journal);
+	
+	json_object * jstatus = NULL;
+	if(rc || NULL == jresult 
+		|| !json_object_object_get_ex(jresult, "success", &jstatus) || !json_object_get_boolean(jstatus)) {
+		fprintf(stderr, "[WARNING]: '%s': query unsettled orders failed (rc = %d), not reconciled.\n", journal->path, rc);
+		return;
+	}
+	
+	struct order_journal_exchange_order * orders = NULL;
+	size_t count = 0;
+	json_object * jorders = NULL;
+	if(json_object_object_get_ex(jresult, "orders", &jorders)) {
+		// coincheck: { "orders": [ { "id": ..., "order_type": "buy", "rate": "...", "pair": "btc_jpy", ... } ] }
+		count = json_object_array_length(jorders);
+		orders = calloc(count + 1, sizeof(*orders));
+		assert(orders);
+		for(size_t i = 0; i < count; ++i) {
+			json_object * jorder = json_object_array_get_idx(jorders, i);
+			json_object * jid = NULL;
+			if(json_object_object_get_ex(jorder, "id", &jid)) orders[i].order_id = json_object_get_string(jid);
+			orders[i].pair = json_get_value(jorder, string, pair);
+			orders[i].order_type = json_get_value(jorder, string, order_type);
+			orders[i].rate = json_get_value(jorder, double, rate);
+		}
+	}else if(json_object_object_get_ex(jresult, "return", &jorders)) {
+		// zaif: { "return": { "<order_id>": { "currency_pair": "btc_jpy", "action": "bid" | "ask", "price": ... } } }
+		count = json_object_object_length(jorders);
+		orders = calloc(count + 1, sizeof(*orders));
+		assert(orders);
+		size_t i = 0;
+		json_object_object_foreach(jorders, order_id, jorder) {
+			if(i >= count) break;
+			const char * action = json_get_value(jorder, string, action);
+			orders[i].order_id = order_id;
+			orders[i].pair = json_get_value(jorder, string, currency_pair);
+			orders[i].order_type = (action && strcmp(action, "ask") == 0)?"sell":"buy";
+			orders[i].rate = json_get_value(jorder, double, price);
+			++i;
+		}
+	}
+	
+	struct order_journal_reconcile_stats stats[1];
+	memset(stats, 0, sizeof(stats));
+	journal->reconcile(journal, orders, count, stats);
+	free(orders);
+	
+	fprintf(stderr, "order journal '%s' reconciled: open=%d, filled=%d, recovered=%d, lost=%d, unknown=%d\n",
+		journal->path, stats->num_open, stats->num_filled, stats->num_recovered, stats->num_lost, stats->num_unknown);
+	return;
+}
+
+static void reconcile_order_journals(app_private_t * priv)
+{
+	for(int i = 0; i < priv->num_agencies; ++i) {
+		trading_agency_t * agent = priv->agencies[i];
+		order_journal_t * journal = priv->journals?priv->journals[i]:NULL;
+		if(NULL == agent || NULL == journal) continue;
+		
+		struct trading_agency_command cmd = {
+			.type = trading_agency_command_type_query,
+			.pair = "btc_jpy",
+			.query.type = trading_agency_query_type_unsettled_orders,
+			.on_completed = on_reconcile_unsettled_orders,
+			.user_data = journal,
+		};
+		trading_agency_post_command(agent, &cmd);
+	}
+	return;
+}
+
 static int app_init(struct app_context * app)
 {
 	assert(app && app->priv);
@@ -207,13 +371,21 @@ static int app_run(struct app_context * app)
 	if(app->is_running || app->quit) return -1;
 	app->is_running = 1;
 	
-	//
-	// ...
-	
+	// start the event loop of each trading agency
+	for(int i = 0; i < priv->num_agencies; ++i) {
+		trading_agency_t * agent = priv->agencies[i];
+		if(agent && agent->run) agent->run(agent);
+	}
+	reconcile_order_journals(priv);
 	
 	// start shell 
 	shell->run(shell);
 	
+	for(int i = 0; i < priv->num_agencies; ++i) {
+		trading_agency_t * agent = priv->agencies[i];
+		if(agent && agent->stop) agent->stop(agent);
+	}
+	
 	app->is_running = 0;
 	app->quit = 1;
 	return 0;
@@ -278,6 +450,28 @@ shell_context_t * app_context_get_shell(struct app_context * app)
 	return priv->shell;
 }
 
+const char * app_context_get_db_home(struct app_context * app)
+{
+	assert(app && app->priv);
+	app_private_t * priv = app->priv;
+	return priv->db_home;
+}
+
+tick_store_t * app_context_get_tick_store(struct app_context * app)
+{
+	assert(app && app->priv);
+	app_private_t * priv = app->priv;
+	return priv->tick_store;
+}
+
+candle_engine_t * app_context_get_candle_engine(struct app_context * app, const char * pair)
+{
+	assert(app && app->priv && pair);
+	app_private_t * priv = app->priv;
+	if(NULL == priv->candles || strcmp(priv->candles->pair, pair) != 0) return NULL;
+	return priv->candles;
+}
+
 trading_agency_t * app_context_get_trading_agency(struct app_context * app, const char * agency_name)
 {
 	assert(app && app->priv);
@@ -0,0 +1,699 @@
+/*
+ * bank_codes.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stddef.h>
+
+#include <pthread.h>
+#include <db.h>
+
+#include "bank_codes.h"
+#include "utils.h"
+
+/************************************************
+ * bank_codes_index_private
+************************************************/
+struct bank_code_slot
+{
+	// offsets into the string pool
+	size_t offsets[BANK_CODE_FIELDS_COUNT];
+};
+
+typedef struct bank_codes_index_private
+{
+	bank_codes_index_t * index;
+	pthread_rwlock_t rwlock;
+	
+	// string pool
+	char * pool;
+	size_t pool_size;
+	size_t pool_length;
+	
+	size_t num_slots;
+	size_t max_slots;
+	struct bank_code_slot * slots;
+	struct bank_code_entry * entries;	// resolved pointers, rebuilt with the indices
+	uint32_t * sorted[BANK_CODE_FIELDS_COUNT];
+}bank_codes_index_private_t;
+
+static bank_codes_index_private_t * bank_codes_index_private_new(bank_codes_index_t * index)
+{
+	bank_codes_index_private_t * priv = calloc(1, sizeof(*priv));
+	assert(priv);
+	priv->index = index;
+	index->priv = priv;
+	
+	int rc = pthread_rwlock_init(&priv->rwlock, NULL);
+	assert(0 == rc);
+	return priv;
+}
+
+static void clear_records(bank_codes_index_private_t * priv)
+{
+	free(priv->pool);
+	priv->pool = NULL;
+	priv->pool_size = priv->pool_length = 0;
+	
+	free(priv->slots);
+	free(priv->entries);
+	priv->slots = NULL;
+	priv->entries = NULL;
+	priv->num_slots = priv->max_slots = 0;
+	for(int i = 0; i < BANK_CODE_FIELDS_COUNT; ++i) {
+		free(priv->sorted[i]);
+		priv->sorted[i] = NULL;
+	}
+	priv->index->num_banks = 0;
+	return;
+}
+
+static void bank_codes_index_private_free(bank_codes_index_private_t * priv)
+{
+	if(NULL == priv) return;
+	clear_records(priv);
+	pthread_rwlock_destroy(&priv->rwlock);
+	free(priv);
+	return;
+}
+
+static size_t pool_add(bank_codes_index_private_t * priv, const char * text, size_t max_length)
+{
+	size_t length = strnlen(text, max_length);
+	if(priv->pool_length + length + 1 > priv->pool_size) {
+		size_t new_size = priv->pool_size?(priv->pool_size * 2):(64 * 1024);
+		while(new_size < priv->pool_length + length + 1) new_size *= 2;
+		char * pool = realloc(priv->pool, new_size);
+		assert(pool);
+		priv->pool = pool;
+		priv->pool_size = new_size;
+	}
+	size_t offset = priv->pool_length;
+	memcpy(priv->pool + offset, text, length);
+	priv->pool[offset + length] = '\0';
+	priv->pool_length += length + 1;
+	return offset;
+}
+
+// (write-locked)
+static ssize_t find_slot(bank_codes_index_private_t * priv, const char * code)
+{
+	// only the records indexed by the last rebuild(), codes within one batch are expected to be unique
+	uint32_t * sorted = priv->sorted[BANK_CODE_FIELD_code];
+	if(NULL == sorted) return -1;
+	
+	size_t lo = 0, hi = priv->index->num_banks;
+	while(lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		int cmp = strcmp(priv->pool + priv->slots[sorted[mid]].offsets[BANK_CODE_FIELD_code], code);
+		if(cmp == 0) return sorted[mid];
+		if(cmp < 0) lo = mid + 1;
+		else hi = mid;
+	}
+	return -1;
+}
+
+// (write-locked) replaced records leave their old strings in the pool until the next reload()
+static void add_record(bank_codes_index_private_t * priv, const struct bank_code_record * record)
+{
+	ssize_t index = find_slot(priv, record->code);
+	if(index < 0) {
+		if(priv->num_slots >= priv->max_slots) {
+			size_t new_size = priv->max_slots?(priv->max_slots * 2):1024;
+			struct bank_code_slot * slots = realloc(priv->slots, new_size * sizeof(*slots));
+			assert(slots);
+			priv->slots = slots;
+			priv->max_slots = new_size;
+		}
+		index = priv->num_slots++;
+	}
+	
+	struct bank_code_slot * slot = &priv->slots[index];
+	slot->offsets[BANK_CODE_FIELD_code] = pool_add(priv, record->code, sizeof(record->code));
+	slot->offsets[BANK_CODE_FIELD_name] = pool_add(priv, record->name, sizeof(record->name));
+	slot->offsets[BANK_CODE_FIELD_half_width_kana] = pool_add(priv, record->half_width_kana, sizeof(record->half_width_kana));
+	slot->offsets[BANK_CODE_FIELD_full_width_kana] = pool_add(priv, record->full_width_kana, sizeof(record->full_width_kana));
+	slot->offsets[BANK_CODE_FIELD_hiragana] = pool_add(priv, record->hiragana, sizeof(record->hiragana));
+	return;
+}
+
+struct sort_context
+{
+	const bank_codes_index_private_t * priv;
+	int field;
+};
+static int compare_slots(const void * a, const void * b, void * user_data)
+{
+	const struct sort_context * ctx = user_data;
+	const bank_codes_index_private_t * priv = ctx->priv;
+	const char * key1 = priv->pool + priv->slots[*(const uint32_t *)a].offsets[ctx->field];
+	const char * key2 = priv->pool + priv->slots[*(const uint32_t *)b].offsets[ctx->field];
+	int cmp = strcmp(key1, key2);
+	if(cmp) return cmp;
+	return (*(const uint32_t *)a > *(const uint32_t *)b) - (*(const uint32_t *)a < *(const uint32_t *)b);
+}
+
+// (write-locked)
+static void rebuild(bank_codes_index_private_t * priv)
+{
+	size_t count = priv->num_slots;
+	struct bank_code_entry * entries = realloc(priv->entries, (count + 1) * sizeof(*entries));
+	assert(entries);
+	priv->entries = entries;
+	for(size_t i = 0; i < count; ++i) {
+		for(int field = 0; field < BANK_CODE_FIELDS_COUNT; ++field) {
+			entries[i].fields[field] = priv->pool + priv->slots[i].offsets[field];
+		}
+	}
+	
+	for(int field = 0; field < BANK_CODE_FIELDS_COUNT; ++field) {
+		uint32_t * sorted = realloc(priv->sorted[field], (count + 1) * sizeof(*sorted));
+		assert(sorted);
+		for(size_t i = 0; i < count; ++i) sorted[i] = i;
+		
+		struct sort_context ctx = { .priv = priv, .field = field };
+		qsort_r(sorted, count, sizeof(*sorted), compare_slots, &ctx);
+		priv->sorted[field] = sorted;
+	}
+	priv->index->num_banks = count;
+	return;
+}
+
+/************************************************
+ * bulk loader
+************************************************/
+#define BANK_CODES_BULK_BUFFER_SIZE (4 * 1024 * 1024)	// multiple of 1024
+
+static int compare_records(const void * a, const void * b)
+{
+	return strcmp(((const struct bank_code_record *)a)->code, ((const struct bank_code_record *)b)->code);
+}
+
+// (code, position in the input): qsort is not stable, the position keeps the input order of the duplicates
+static int compare_record_refs(const void * a, const void * b)
+{
+	const struct bank_code_record * ra = *(const struct bank_code_record **)a;
+	const struct bank_code_record * rb = *(const struct bank_code_record **)b;
+	int cmp = strcmp(ra->code, rb->code);
+	if(cmp) return cmp;
+	return (ra > rb) - (ra < rb);
+}
+
+static inline u_int32_t code_size(const struct bank_code_record * record)
+{
+	return strnlen(record->code, sizeof(record->code) - 1) + 1;
+}
+
+static ssize_t read_all_records(db_context_t * db, void * bulk_buffer, struct bank_code_record ** p_records)
+{
+	DB * dbp = db->bank_codes;
+	DBC * cursorp = NULL;
+	int rc = dbp->cursor(dbp, NULL, &cursorp, DB_READ_COMMITTED);
+	if(rc) return -1;
+	
+	DBT key, bulk;
+	memset(&key, 0, sizeof(key));
+	memset(&bulk, 0, sizeof(bulk));
+	bulk.data = bulk_buffer;
+	bulk.ulen = BANK_CODES_BULK_BUFFER_SIZE;
+	bulk.flags = DB_DBT_USERMEM;
+	
+	size_t count = 0, max_records = 0;
+	struct bank_code_record * records = NULL;
+	while(0 == (rc = cursorp->get(cursorp, &key, &bulk, DB_NEXT | DB_MULTIPLE_KEY))) {
+		void * p = NULL;
+		DB_MULTIPLE_INIT(p, &bulk);
+		while(1) {
+			void * retkey = NULL, * retdata = NULL;
+			u_int32_t retklen = 0, retdlen = 0;
+			DB_MULTIPLE_KEY_NEXT(p, &bulk, retkey, retklen, retdata, retdlen);
+			if(NULL == p) break;
+			
+			if(count >= max_records) {
+				max_records = max_records?(max_records * 2):2048;
+				records = realloc(records, max_records * sizeof(*records));
+				assert(records);
+			}
+			struct bank_code_record * record = &records[count++];
+			memset(record, 0, sizeof(*record));
+			memcpy(record->code, retkey, (retklen < sizeof(record->code))?retklen:(sizeof(record->code) - 1));
+			memcpy(record->data, retdata, (retdlen < sizeof(record->data))?retdlen:sizeof(record->data));
+		}
+	}
+	cursorp->close(cursorp);
+	if(rc != DB_NOTFOUND) {
+		free(records);
+		return -1;
+	}
+	*p_records = records;
+	return count;
+}
+
+static int put_records_bulk(DB * dbp, DB_TXN * txn, void * bulk_buffer, const struct bank_code_record * records, size_t count)
+{
+	int rc = 0;
+	size_t offset = 0;
+	while(0 == rc && offset < count) {
+		DBT bulk, unused;
+		memset(&bulk, 0, sizeof(bulk));
+		memset(&unused, 0, sizeof(unused));
+		bulk.data = bulk_buffer;
+		bulk.ulen = BANK_CODES_BULK_BUFFER_SIZE;
+		bulk.flags = DB_DBT_USERMEM | DB_DBT_BULK;
+		
+		void * p = NULL;
+		DB_MULTIPLE_WRITE_INIT(p, &bulk);
+		size_t num_items = 0;
+		for(; offset < count; ++offset, ++num_items) {
+			const struct bank_code_record * record = &records[offset];
+			DB_MULTIPLE_KEY_WRITE_NEXT(p, &bulk, record->code, code_size(record), record->data, sizeof(record->data));
+			if(NULL == p) break;	// the buffer is full
+		}
+		if(num_items == 0) return DB_BUFFER_SMALL;
+		rc = dbp->put(dbp, txn, &bulk, &unused, DB_MULTIPLE_KEY);
+	}
+	return rc;
+}
+
+// secondary index entries: (field value, primary key), written in sorted order
+struct index_pair
+{
+	const char * skey;
+	const char * pkey;
+};
+
+static int compare_index_pairs(const void * a, const void * b)
+{
+	const struct index_pair * p1 = a;
+	const struct index_pair * p2 = b;
+	int cmp = strcmp(p1->skey, p2->skey);
+	if(cmp) return cmp;
+	return strcmp(p1->pkey, p2->pkey);
+}
+
+static int put_index_bulk(DB * sdbp, DB_TXN * txn, void * bulk_buffer, struct index_pair * pairs, size_t count)
+{
+	qsort(pairs, count, sizeof(*pairs), compare_index_pairs);
+	
+	int rc = 0;
+	size_t offset = 0;
+	while(0 == rc && offset < count) {
+		DBT bulk, unused;
+		memset(&bulk, 0, sizeof(bulk));
+		memset(&unused, 0, sizeof(unused));
+		bulk.data = bulk_buffer;
+		bulk.ulen = BANK_CODES_BULK_BUFFER_SIZE;
+		bulk.flags = DB_DBT_USERMEM | DB_DBT_BULK;
+		
+		void * p = NULL;
+		DB_MULTIPLE_WRITE_INIT(p, &bulk);
+		size_t num_items = 0;
+		for(; offset < count; ++offset, ++num_items) {
+			DB_MULTIPLE_KEY_WRITE_NEXT(p, &bulk, 
+				pairs[offset].skey, strlen(pairs[offset].skey) + 1, 
+				pairs[offset].pkey, strlen(pairs[offset].pkey) + 1);
+			if(NULL == p) break;
+		}
+		if(num_items == 0) return DB_BUFFER_SMALL;
+		rc = sdbp->put(sdbp, txn, &bulk, &unused, DB_MULTIPLE_KEY);
+	}
+	return rc;
+}
+
+static int rebuild_all(db_context_t * db, void * bulk_buffer, const struct bank_code_record * records, size_t count)
+{
+	// the secondaries are written directly: reopen them without association
+	db_context_close_bank_code_indices(db);
+	int rc = db_context_open_bank_code_indices(db, 0);
+	if(rc) {
+		db_context_close_bank_code_indices(db);
+		db_context_open_bank_code_indices(db, 1);
+		return rc;
+	}
+	
+	struct index_pair * pairs = calloc(count + 1, sizeof(*pairs));
+	assert(pairs);
+	
+	DB_TXN * txn = NULL;
+	rc = db->env->txn_begin(db->env, NULL, &txn, 0);
+	if(0 == rc) {
+		u_int32_t num_discarded = 0;
+		rc = db->bank_codes->truncate(db->bank_codes, txn, &num_discarded, 0);
+		for(int i = 0; 0 == rc && i < BANK_CODES_SDBP_COUNT; ++i) {
+			rc = db->sdbps[i]->truncate(db->sdbps[i], txn, &num_discarded, 0);
+		}
+		
+		// pass 1: the primary, in key order
+		if(0 == rc) rc = put_records_bulk(db->bank_codes, txn, bulk_buffer, records, count);
+		
+		// pass 2: each secondary, sorted by (field, code)
+		static const size_t field_offsets[BANK_CODES_SDBP_COUNT] = {
+			offsetof(struct bank_code_record, name),
+			offsetof(struct bank_code_record, half_width_kana),
+			offsetof(struct bank_code_record, full_width_kana),
+			offsetof(struct bank_code_record, hiragana),
+		};
+		for(int i = 0; 0 == rc && i < BANK_CODES_SDBP_COUNT; ++i) {
+			for(size_t j = 0; j < count; ++j) {
+				pairs[j].skey = (const char *)&records[j] + field_offsets[i];
+				pairs[j].pkey = records[j].code;
+			}
+			rc = put_index_bulk(db->sdbps[i], txn, bulk_buffer, pairs, count);
+		}
+		
+		if(rc) txn->abort(txn);
+		else rc = txn->commit(txn, 0);
+	}
+	free(pairs);
+	
+	db_context_close_bank_code_indices(db);
+	int rc2 = db_context_open_bank_code_indices(db, 1);
+	return rc?rc:rc2;
+}
+
+static int apply_diff(db_context_t * db, 
+	const struct bank_code_record * records, const unsigned char * actions, size_t count,
+	const struct bank_code_record * deleted, size_t num_deleted)
+{
+	DB * dbp = db->bank_codes;
+	DB_TXN * txn = NULL;
+	int rc = db->env->txn_begin(db->env, NULL, &txn, 0);
+	if(rc) return rc;
+	
+	// the secondaries are maintained by the associations
+	for(size_t i = 0; 0 == rc && i < count; ++i) {
+		if(!actions[i]) continue;
+		DBT key, value;
+		memset(&key, 0, sizeof(key));
+		memset(&value, 0, sizeof(value));
+		key.data = (void *)records[i].code;
+		key.size = code_size(&records[i]);
+		value.data = (void *)records[i].data;
+		value.size = sizeof(records[i].data);
+		rc = dbp->put(dbp, txn, &key, &value, 0);
+	}
+	for(size_t i = 0; 0 == rc && i < num_deleted; ++i) {
+		DBT key;
+		memset(&key, 0, sizeof(key));
+		key.data = (void *)deleted[i].code;
+		key.size = code_size(&deleted[i]);
+		rc = dbp->del(dbp, txn, &key, 0);
+	}
+	
+	if(rc) txn->abort(txn);
+	else rc = txn->commit(txn, 0);
+	return rc;
+}
+
+int bank_codes_bulk_load(db_context_t * db, struct bank_code_record * records, size_t count, struct bank_codes_load_stats * stats)
+{
+	assert(db && db->bank_codes && (records || count == 0));
+	struct bank_codes_load_stats dummy[1];
+	if(NULL == stats) stats = dummy;
+	memset(stats, 0, sizeof(*stats));
+	
+	app_timer_t timer[1];
+	app_timer_start(timer);
+	
+	// sort and drop duplicated codes (the last one in the input wins)
+	const struct bank_code_record ** refs = calloc(count + 1, sizeof(*refs));
+	struct bank_code_record * sorted = calloc(count + 1, sizeof(*sorted));
+	assert(refs && sorted);
+	for(size_t i = 0; i < count; ++i) refs[i] = &records[i];
+	qsort(refs, count, sizeof(*refs), compare_record_refs);
+	
+	size_t num_records = 0;
+	for(size_t i = 0; i < count; ++i) {
+		if(num_records > 0 && compare_records(&sorted[num_records - 1], refs[i]) == 0) --num_records;
+		sorted[num_records++] = *refs[i];
+	}
+	memcpy(records, sorted, num_records * sizeof(*records));
+	count = num_records;
+	free(sorted);
+	free(refs);
+	
+	void * bulk_buffer = malloc(BANK_CODES_BULK_BUFFER_SIZE);
+	assert(bulk_buffer);
+	
+	struct bank_code_record * existing = NULL;
+	ssize_t num_existing = read_all_records(db, bulk_buffer, &existing);
+	if(num_existing < 0) {
+		free(bulk_buffer);
+		return -1;
+	}
+	
+	// merge the two sorted lists
+	unsigned char * actions = calloc(count + 1, 1);	// 1: insert or update
+	struct bank_code_record * deleted = calloc(num_existing + 1, sizeof(*deleted));
+	assert(actions && deleted);
+	size_t num_deleted = 0;
+	
+	size_t i = 0, j = 0;
+	while(i < count || j < (size_t)num_existing) {
+		int cmp = (i >= count)?1:(j >= (size_t)num_existing)?-1:compare_records(&records[i], &existing[j]);
+		if(cmp < 0) {
+			actions[i++] = 1;
+			++stats->num_inserted;
+		}else if(cmp > 0) {
+			deleted[num_deleted++] = existing[j++];
+		}else {
+			if(memcmp(records[i].data, existing[j].data, sizeof(records[i].data)) != 0) {
+				actions[i] = 1;
+				++stats->num_updated;
+			}else ++stats->num_unchanged;
+			++i;
+			++j;
+		}
+	}
+	stats->num_deleted = num_deleted;
+	
+	size_t num_changes = stats->num_inserted + stats->num_updated + stats->num_deleted;
+	int rc = 0;
+	if(num_changes > 0) {
+		stats->full_rebuild = (num_existing == 0 || num_changes * 2 > count);
+		if(stats->full_rebuild) rc = rebuild_all(db, bulk_buffer, records, count);
+		else rc = apply_diff(db, records, actions, count, deleted, num_deleted);
+	}
+	if(rc) fprintf(stderr, "[ERROR]: %s(): %s\n", __FUNCTION__, db_strerror(rc));
+	
+	free(actions);
+	free(deleted);
+	free(existing);
+	free(bulk_buffer);
+	stats->elapsed = app_timer_stop(timer);
+	return rc?-1:0;
+}
+
+/************************************************
+ * bank_codes_index::member functions
+************************************************/
+static int bank_codes_index_reload(struct bank_codes_index * index)
+{
+	assert(index && index->priv);
+	bank_codes_index_private_t * priv = index->priv;
+	db_context_t * db = index->db;
+	if(NULL == db || NULL == db->bank_codes) return -1;
+	
+	DB * dbp = db->bank_codes;
+	DBC * cursorp = NULL;
+	int rc = dbp->cursor(dbp, NULL, &cursorp, DB_READ_COMMITTED);
+	if(rc) {
+		fprintf(stderr, "[ERROR]: %s(): %s\n", __FUNCTION__, db_strerror(rc));
+		return -1;
+	}
+	
+	struct bank_code_record record[1];
+	memset(record, 0, sizeof(record));
+	
+	DBT key, value;
+	memset(&key, 0, sizeof(key));
+	memset(&value, 0, sizeof(value));
+	key.data = record->code;
+	key.ulen = sizeof(record->code);
+	key.flags = DB_DBT_USERMEM;
+	value.data = record->data;
+	value.ulen = sizeof(record->data);
+	value.flags = DB_DBT_USERMEM;
+	
+	pthread_rwlock_wrlock(&priv->rwlock);
+	clear_records(priv);
+	while(0 == (rc = cursorp->get(cursorp, &key, &value, DB_NEXT))) {
+		record->code[sizeof(record->code) - 1] = '\0';
+		if(value.size < sizeof(record->data)) memset((char *)record->data + value.size, 0, sizeof(record->data) - value.size);
+		add_record(priv, record);
+	}
+	rebuild(priv);
+	pthread_rwlock_unlock(&priv->rwlock);
+	cursorp->close(cursorp);
+	
+	if(rc != DB_NOTFOUND) {
+		fprintf(stderr, "[ERROR]: %s(): %s\n", __FUNCTION__, db_strerror(rc));
+		return -1;
+	}
+	return 0;
+}
+
+static int bank_codes_index_add_records(struct bank_codes_index * index, const struct bank_code_record * records, size_t count)
+{
+	assert(index && index->priv);
+	bank_codes_index_private_t * priv = index->priv;
+	db_context_t * db = index->db;
+	
+	if(db && db->bank_codes) {
+		DB * dbp = db->bank_codes;
+		DB_TXN * txn = NULL;
+		int rc = db->env->txn_begin(db->env, NULL, &txn, 0);
+		for(size_t i = 0; 0 == rc && i < count; ++i) {
+			const struct bank_code_record * record = &records[i];
+			DBT key, value;
+			memset(&key, 0, sizeof(key));
+			memset(&value, 0, sizeof(value));
+			key.data = (void *)record->code;
+			key.size = strnlen(record->code, sizeof(record->code) - 1) + 1;
+			value.data = (void *)record->data;
+			value.size = sizeof(record->data);
+			rc = dbp->put(dbp, txn, &key, &value, 0);
+		}
+		if(txn) {
+			if(rc) txn->abort(txn);
+			else rc = txn->commit(txn, 0);
+		}
+		if(rc) {
+			fprintf(stderr, "[ERROR]: %s(): %s\n", __FUNCTION__, db_strerror(rc));
+			return -1;
+		}
+	}
+	
+	pthread_rwlock_wrlock(&priv->rwlock);
+	for(size_t i = 0; i < count; ++i) add_record(priv, &records[i]);
+	rebuild(priv);
+	pthread_rwlock_unlock(&priv->rwlock);
+	return 0;
+}
+
+// (read-locked)
+static size_t search_field(bank_codes_index_private_t * priv, int field, const char * prefix, size_t cb_prefix,
+	size_t max_results, const struct bank_code_entry ** results, size_t num_results)
+{
+	const uint32_t * sorted = priv->sorted[field];
+	if(NULL == sorted) return num_results;
+	
+	// lower bound
+	size_t lo = 0, hi = priv->num_slots;
+	while(lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if(strcmp(priv->entries[sorted[mid]].fields[field], prefix) < 0) lo = mid + 1;
+		else hi = mid;
+	}
+	
+	for(size_t i = lo; i < priv->num_slots && num_results < max_results; ++i) {
+		const struct bank_code_entry * entry = &priv->entries[sorted[i]];
+		if(strncmp(entry->fields[field], prefix, cb_prefix) != 0) break;
+		
+		// BANK_CODE_FIELD_any: a record matched by several keys is reported once
+		int duplicated = 0;
+		for(size_t j = 0; j < num_results && !duplicated; ++j) duplicated = (results[j] == entry);
+		if(!duplicated) results[num_results++] = entry;
+	}
+	return num_results;
+}
+
+static int bank_codes_index_bulk_load(struct bank_codes_index * index, struct bank_code_record * records, size_t count, struct bank_codes_load_stats * stats)
+{
+	assert(index && index->priv);
+	if(NULL == index->db) return -1;
+	
+	int rc = bank_codes_bulk_load(index->db, records, count, stats);
+	if(0 == rc) rc = index->reload(index);
+	return rc;
+}
+
+static ssize_t bank_codes_index_search(struct bank_codes_index * index, enum bank_code_field field, const char * prefix, 
+	size_t max_results, const struct bank_code_entry ** results)
+{
+	assert(index && index->priv && prefix && results);
+	bank_codes_index_private_t * priv = index->priv;
+	if(field < BANK_CODE_FIELD_any || field >= BANK_CODE_FIELDS_COUNT) return -1;
+	
+	size_t cb_prefix = strlen(prefix);
+	size_t num_results = 0;
+	
+	pthread_rwlock_rdlock(&priv->rwlock);
+	if(field == BANK_CODE_FIELD_any) {
+		for(int i = 0; i < BANK_CODE_FIELDS_COUNT && num_results < max_results; ++i) {
+			num_results = search_field(priv, i, prefix, cb_prefix, max_results, results, num_results);
+		}
+	}else {
+		num_results = search_field(priv, field, prefix, cb_prefix, max_results, results, 0);
+	}
+	pthread_rwlock_unlock(&priv->rwlock);
+	return num_results;
+}
+
+static const struct bank_code_entry * bank_codes_index_find(struct bank_codes_index * index, const char * code)
+{
+	const struct bank_code_entry * entry = NULL;
+	ssize_t count = bank_codes_index_search(index, BANK_CODE_FIELD_code, code, 1, &entry);
+	if(count == 1 && strcmp(entry->code, code) == 0) return entry;
+	return NULL;
+}
+
+/************************************************
+ * public interfaces
+************************************************/
+bank_codes_index_t * bank_codes_index_init(bank_codes_index_t * index, db_context_t * db, void * user_data)
+{
+	if(NULL == index) index = calloc(1, sizeof(*index));
+	assert(index);
+	
+	index->user_data = user_data;
+	index->db = db;
+	
+	index->reload = bank_codes_index_reload;
+	index->add_records = bank_codes_index_add_records;
+	index->bulk_load = bank_codes_index_bulk_load;
+	index->search = bank_codes_index_search;
+	index->find = bank_codes_index_find;
+	
+	bank_codes_index_private_t * priv = bank_codes_index_private_new(index);
+	assert(priv && priv == index->priv);
+	
+	if(db) index->reload(index);
+	return index;
+}
+
+void bank_codes_index_cleanup(bank_codes_index_t * index)
+{
+	if(NULL == index) return;
+	bank_codes_index_private_free(index->priv);
+	index->priv = NULL;
+	return;
+}
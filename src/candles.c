@@ -0,0 +1,822 @@
+/*
+ * candles.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <pthread.h>
+#include <endian.h>
+#include <stddef.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <db.h>
+#include "candles.h"
+#include "utils.h"
+
+const int64_t candle_resolution_ms[CANDLE_RESOLUTIONS_COUNT] = {
+	[CANDLE_RESOLUTION_1s] = 1000,
+	[CANDLE_RESOLUTION_1m] = 60 * 1000,
+	[CANDLE_RESOLUTION_5m] = 5 * 60 * 1000,
+	[CANDLE_RESOLUTION_1h] = 60 * 60 * 1000,
+	[CANDLE_RESOLUTION_1d] = 24 * 60 * 60 * 1000,
+};
+
+/************************************************
+ * on-disk layout
+************************************************/
+struct candle_key
+{
+	char pair[CANDLE_ENGINE_PAIR_SIZE];
+	uint32_t resolution;	// seconds, big-endian
+	uint64_t start_ms;		// big-endian
+}__attribute__((packed));
+
+struct candle_record
+{
+	double open;
+	double high;
+	double low;
+	double close;
+	double volume;
+	uint32_t num_trades;
+}__attribute__((packed));
+
+static inline void candle_key_set(struct candle_key * key, const char * pair, enum candle_resolution resolution, int64_t start_ms)
+{
+	memset(key->pair, 0, sizeof(key->pair));
+	strncpy(key->pair, pair, sizeof(key->pair));
+	key->resolution = htobe32((uint32_t)(candle_resolution_ms[resolution] / 1000));
+	key->start_ms = htobe64((uint64_t)start_ms);
+	return;
+}
+
+static inline void candle_record_set(struct candle_record * record, const struct candle * candle)
+{
+	record->open = candle->open;
+	record->high = candle->high;
+	record->low = candle->low;
+	record->close = candle->close;
+	record->volume = candle->volume;
+	record->num_trades = candle->num_trades;
+	return;
+}
+
+static inline void candle_set(struct candle * candle, const struct candle_key * key, const struct candle_record * record)
+{
+	candle->start_ms = (int64_t)be64toh(key->start_ms);
+	candle->open = record->open;
+	candle->high = record->high;
+	candle->low = record->low;
+	candle->close = record->close;
+	candle->volume = record->volume;
+	candle->num_trades = record->num_trades;
+	return;
+}
+
+static inline void candle_update(struct candle * candle, double price, double amount, int is_trade)
+{
+	if(price > candle->high) candle->high = price;
+	if(price < candle->low) candle->low = price;
+	candle->volume += amount;
+	candle->num_trades += is_trade;
+	return;
+}
+
+/************************************************
+ * candle_engine_private
+************************************************/
+struct candle_slot
+{
+	struct candle candle;
+	int64_t bucket;		// start_ms / resolution_ms, -1: empty
+	int64_t last_ms;	// timestamp of the latest update, decides 'close'
+	int dirty;			// not yet written since the last change
+};
+
+struct candle_series
+{
+	enum candle_resolution resolution;
+	int64_t latest_bucket;	// -1: no data
+	struct candle_slot ring[CANDLE_ENGINE_RING_SIZE];
+};
+
+struct candle_write
+{
+	enum candle_resolution resolution;
+	int merge;		// 1: a late trade older than the ring, merged into the stored bar
+	struct candle candle;
+};
+
+typedef struct candle_engine_private
+{
+	candle_engine_t * engine;
+	pthread_mutex_t mutex;
+	struct candle_series series[CANDLE_RESOLUTIONS_COUNT];
+	
+	// background writer (engine->db only)
+	struct {
+		pthread_mutex_t mutex;
+		pthread_cond_t cond;		// new writes / quit
+		pthread_cond_t written;		// a batch was committed
+		pthread_t th;
+		int running;
+		int quit;
+		int flush_requested;
+		
+		// double buffer: the engine fills 'pending', the writer thread swaps it with 'writing'
+		size_t num_pending;
+		struct candle_write * pending;
+		struct candle_write * writing;
+		int64_t num_queued;
+		int64_t num_written;	// queued writes that have been committed (or failed)
+	}writer;
+}candle_engine_private_t;
+
+static candle_engine_private_t * candle_engine_private_new(candle_engine_t * engine)
+{
+	candle_engine_private_t * priv = calloc(1, sizeof(*priv));
+	assert(priv);
+	priv->engine = engine;
+	engine->priv = priv;
+	
+	int rc = pthread_mutex_init(&priv->mutex, NULL);
+	assert(0 == rc);
+	rc = pthread_mutex_init(&priv->writer.mutex, NULL);
+	assert(0 == rc);
+	rc = pthread_cond_init(&priv->writer.cond, NULL);
+	assert(0 == rc);
+	rc = pthread_cond_init(&priv->writer.written, NULL);
+	assert(0 == rc);
+	
+	for(int i = 0; i < CANDLE_RESOLUTIONS_COUNT; ++i) {
+		struct candle_series * series = &priv->series[i];
+		series->resolution = i;
+		series->latest_bucket = -1;
+		for(int j = 0; j < CANDLE_ENGINE_RING_SIZE; ++j) series->ring[j].bucket = -1;
+	}
+	return priv;
+}
+
+static void candle_engine_private_free(candle_engine_private_t * priv)
+{
+	if(NULL == priv) return;
+	pthread_cond_destroy(&priv->writer.written);
+	pthread_cond_destroy(&priv->writer.cond);
+	pthread_mutex_destroy(&priv->writer.mutex);
+	pthread_mutex_destroy(&priv->mutex);
+	free(priv->writer.pending);
+	free(priv->writer.writing);
+	free(priv);
+	return;
+}
+
+/************************************************
+ * persistence
+************************************************/
+// the late trade can not change open/close of the stored bar, their time order is unknown here
+static int merge_in_db(DB * dbp, DB_TXN * txn, const char * pair, const struct candle_write * item)
+{
+	struct candle_key key;
+	struct candle_record record;
+	candle_key_set(&key, pair, item->resolution, item->candle.start_ms);
+	
+	DBT k, v;
+	memset(&k, 0, sizeof(k));
+	memset(&v, 0, sizeof(v));
+	k.data = &key;
+	k.size = sizeof(key);
+	v.data = &record;
+	v.ulen = sizeof(record);
+	v.flags = DB_DBT_USERMEM;
+	
+	struct candle candle = item->candle;
+	int rc = dbp->get(dbp, txn, &k, &v, DB_RMW);
+	if(0 == rc && v.size == sizeof(record)) {
+		candle_set(&candle, &key, &record);
+		candle_update(&candle, item->candle.close, item->candle.volume, item->candle.num_trades);
+	}else if(rc == DB_NOTFOUND) {
+		rc = 0;
+	}
+	if(rc) return rc;
+	
+	candle_record_set(&record, &candle);
+	v.size = sizeof(record);
+	v.flags = 0;
+	return dbp->put(dbp, txn, &k, &v, 0);
+}
+
+static int write_batch(candle_engine_t * engine, const struct candle_write * items, size_t count)
+{
+	db_context_t * db = engine->db;
+	DB * dbp = db->candles;
+	DB_TXN * txn = NULL;
+	int rc = db->env->txn_begin(db->env, NULL, &txn, 0);
+	if(rc) return rc;
+	
+	for(size_t i = 0; 0 == rc && i < count; ++i) {
+		if(items[i].merge) {
+			rc = merge_in_db(dbp, txn, engine->pair, &items[i]);
+			continue;
+		}
+		
+		struct candle_key key;
+		struct candle_record record;
+		candle_key_set(&key, engine->pair, items[i].resolution, items[i].candle.start_ms);
+		candle_record_set(&record, &items[i].candle);
+		
+		DBT k, v;
+		memset(&k, 0, sizeof(k));
+		memset(&v, 0, sizeof(v));
+		k.data = &key;
+		k.size = sizeof(key);
+		v.data = &record;
+		v.size = sizeof(record);
+		rc = dbp->put(dbp, txn, &k, &v, 0);
+	}
+	if(rc) {
+		txn->abort(txn);
+		return rc;
+	}
+	return txn->commit(txn, 0);
+}
+
+static void * writer_thread(void * user_data)
+{
+	candle_engine_t * engine = user_data;
+	assert(engine && engine->priv);
+	candle_engine_private_t * priv = engine->priv;
+	
+	pthread_mutex_lock(&priv->writer.mutex);
+	while(1) {
+		while(!priv->writer.quit && priv->writer.num_pending == 0) {
+			pthread_cond_wait(&priv->writer.cond, &priv->writer.mutex);
+		}
+		
+		// collect more bars until the commit interval elapses
+		struct timespec expires;
+		clock_gettime(CLOCK_REALTIME, &expires);
+		expires.tv_nsec += CANDLE_ENGINE_COMMIT_INTERVAL_MS * 1000000L;
+		expires.tv_sec += expires.tv_nsec / 1000000000L;
+		expires.tv_nsec %= 1000000000L;
+		
+		while(!priv->writer.quit && !priv->writer.flush_requested 
+			&& priv->writer.num_pending < CANDLE_ENGINE_FLUSH_THRESHOLD) 
+		{
+			int rc = pthread_cond_timedwait(&priv->writer.cond, &priv->writer.mutex, &expires);
+			if(rc == ETIMEDOUT) break;
+		}
+		priv->writer.flush_requested = 0;
+		
+		size_t count = priv->writer.num_pending;
+		if(count == 0) {
+			if(priv->writer.quit) break;
+			continue;
+		}
+		
+		struct candle_write * items = priv->writer.pending;
+		priv->writer.pending = priv->writer.writing;
+		priv->writer.writing = items;
+		priv->writer.num_pending = 0;
+		pthread_cond_broadcast(&priv->writer.written);	// the queue has room again
+		pthread_mutex_unlock(&priv->writer.mutex);
+		
+		int rc = write_batch(engine, items, count);
+		if(rc) fprintf(stderr, "[ERROR]: candle_engine(%s)::write(%ld bars): %s\n", engine->pair, (long)count, db_strerror(rc));
+		
+		int64_t num_merged = 0;
+		for(size_t i = 0; 0 == rc && i < count; ++i) num_merged += items[i].merge;
+		
+		pthread_mutex_lock(&priv->writer.mutex);
+		engine->num_db_corrections += num_merged;
+		priv->writer.num_written += count;
+		pthread_cond_broadcast(&priv->writer.written);
+	}
+	pthread_cond_broadcast(&priv->writer.written);
+	pthread_mutex_unlock(&priv->writer.mutex);
+	return NULL;
+}
+
+// (locked) hand the bar to the writer thread
+static void queue_write(candle_engine_private_t * priv, enum candle_resolution resolution, int merge, const struct candle * candle)
+{
+	if(!priv->writer.running) return;
+	
+	pthread_mutex_lock(&priv->writer.mutex);
+	// the writer is behind: wait rather than lose the bar
+	while(priv->writer.num_pending >= CANDLE_ENGINE_MAX_PENDING) {
+		priv->writer.flush_requested = 1;
+		pthread_cond_signal(&priv->writer.cond);
+		pthread_cond_wait(&priv->writer.written, &priv->writer.mutex);
+	}
+	struct candle_write * item = &priv->writer.pending[priv->writer.num_pending++];
+	item->resolution = resolution;
+	item->merge = merge;
+	item->candle = *candle;
+	++priv->writer.num_queued;
+	
+	if(priv->writer.num_pending == 1 || priv->writer.num_pending == CANDLE_ENGINE_FLUSH_THRESHOLD) {
+		pthread_cond_signal(&priv->writer.cond);
+	}
+	pthread_mutex_unlock(&priv->writer.mutex);
+	return;
+}
+
+// (locked)
+static void push_pending(candle_engine_private_t * priv, enum candle_resolution resolution, struct candle_slot * slot)
+{
+	queue_write(priv, resolution, 0, &slot->candle);
+	slot->dirty = 0;
+	return;
+}
+
+// wait until the writes queued so far are committed
+static void wait_written(candle_engine_private_t * priv)
+{
+	pthread_mutex_lock(&priv->writer.mutex);
+	int64_t target = priv->writer.num_queued;
+	if(priv->writer.num_written < target) {
+		priv->writer.flush_requested = 1;
+		pthread_cond_signal(&priv->writer.cond);
+	}
+	while(priv->writer.running && priv->writer.num_written < target) {
+		pthread_cond_wait(&priv->writer.written, &priv->writer.mutex);
+	}
+	pthread_mutex_unlock(&priv->writer.mutex);
+	return;
+}
+
+// (init) the stored bars of the ring range, the latest one might have been written while it was open
+static int load_series(candle_engine_private_t * priv, struct candle_series * series)
+{
+	candle_engine_t * engine = priv->engine;
+	DB * dbp = engine->db->candles;
+	DBC * cursorp = NULL;
+	int rc = dbp->cursor(dbp, NULL, &cursorp, DB_READ_COMMITTED);
+	if(rc) return -1;
+	
+	struct candle_key end_key, key;
+	struct candle_record record;
+	candle_key_set(&end_key, engine->pair, series->resolution, INT64_MAX);
+	key = end_key;
+	
+	DBT k, v;
+	memset(&k, 0, sizeof(k));
+	memset(&v, 0, sizeof(v));
+	k.data = &key;
+	k.size = sizeof(key);
+	k.ulen = sizeof(key);
+	k.flags = DB_DBT_USERMEM;
+	v.data = &record;
+	v.ulen = sizeof(record);
+	v.flags = DB_DBT_USERMEM;
+	
+	// the latest bar: the one before the first key of the next (pair, resolution)
+	rc = cursorp->get(cursorp, &k, &v, DB_SET_RANGE);
+	if(0 == rc) rc = cursorp->get(cursorp, &k, &v, DB_PREV);
+	else if(rc == DB_NOTFOUND) rc = cursorp->get(cursorp, &k, &v, DB_LAST);
+	
+	int64_t resolution_ms = candle_resolution_ms[series->resolution];
+	while(0 == rc) {
+		if(k.size != sizeof(key) || v.size != sizeof(record)
+			|| memcmp(&key, &end_key, offsetof(struct candle_key, start_ms)) != 0) break;
+		
+		struct candle candle;
+		candle_set(&candle, &key, &record);
+		int64_t bucket = candle.start_ms / resolution_ms;
+		if(series->latest_bucket < 0) series->latest_bucket = bucket;
+		else if(series->latest_bucket - bucket >= CANDLE_ENGINE_RING_SIZE) break;
+		
+		struct candle_slot * slot = &series->ring[bucket % CANDLE_ENGINE_RING_SIZE];
+		slot->bucket = bucket;
+		slot->last_ms = candle.start_ms;	// not stored, the next update sets 'close'
+		slot->candle = candle;
+		slot->dirty = 0;
+		rc = cursorp->get(cursorp, &k, &v, DB_PREV);
+	}
+	cursorp->close(cursorp);
+	if(rc && rc != DB_NOTFOUND) return -1;
+	return 0;
+}
+
+/************************************************
+ * aggregation
+************************************************/
+// (locked)
+static void series_update(candle_engine_private_t * priv, struct candle_series * series, 
+	int64_t timestamp_ms, double price, double amount, int is_trade)
+{
+	int64_t resolution_ms = candle_resolution_ms[series->resolution];
+	int64_t bucket = timestamp_ms / resolution_ms;
+	
+	if(bucket > series->latest_bucket) {
+		// the previous bar is closed
+		if(series->latest_bucket >= 0) {
+			struct candle_slot * prev = &series->ring[series->latest_bucket % CANDLE_ENGINE_RING_SIZE];
+			if(prev->bucket == series->latest_bucket && prev->dirty) push_pending(priv, series->resolution, prev);
+		}
+		series->latest_bucket = bucket;
+	}else if(series->latest_bucket - bucket >= CANDLE_ENGINE_RING_SIZE) {
+		// too old for the ring: read-modify-write by the writer thread
+		struct candle late = { .start_ms = bucket * resolution_ms, 
+			.open = price, .high = price, .low = price, .close = price, 
+			.volume = amount, .num_trades = is_trade };
+		queue_write(priv, series->resolution, 1, &late);
+		return;
+	}
+	
+	struct candle_slot * slot = &series->ring[bucket % CANDLE_ENGINE_RING_SIZE];
+	if(slot->bucket != bucket) {
+		// reuse the slot, write the evicted bar first if it was changed after it was closed
+		if(slot->bucket >= 0 && slot->dirty) push_pending(priv, series->resolution, slot);
+		
+		slot->bucket = bucket;
+		slot->last_ms = timestamp_ms;
+		slot->candle = (struct candle){ .start_ms = bucket * resolution_ms, 
+			.open = price, .high = price, .low = price, .close = price, 
+			.volume = amount, .num_trades = is_trade };
+		slot->dirty = 1;
+		if(bucket < series->latest_bucket) {
+			// a bar of the past without any trades so far
+			++priv->engine->num_late_corrections;
+			push_pending(priv, series->resolution, slot);
+		}
+		return;
+	}
+	
+	candle_update(&slot->candle, price, amount, is_trade);
+	if(timestamp_ms >= slot->last_ms) {
+		slot->last_ms = timestamp_ms;
+		slot->candle.close = price;
+	}
+	
+	if(bucket < series->latest_bucket) {
+		++priv->engine->num_late_corrections;
+		// a closed bar changed: write it again
+		if(!slot->dirty) {
+			slot->dirty = 1;
+			push_pending(priv, series->resolution, slot);
+		}
+	}else {
+		slot->dirty = 1;
+	}
+	return;
+}
+
+static int add_price(struct candle_engine * engine, int64_t timestamp_ms, double price, double amount, int is_trade)
+{
+	assert(engine && engine->priv);
+	candle_engine_private_t * priv = engine->priv;
+	if(timestamp_ms < 0 || price <= 0) return -1;
+	
+	pthread_mutex_lock(&priv->mutex);
+	for(int i = 0; i < CANDLE_RESOLUTIONS_COUNT; ++i) {
+		series_update(priv, &priv->series[i], timestamp_ms, price, amount, is_trade);
+	}
+	++engine->num_updates;
+	pthread_mutex_unlock(&priv->mutex);
+	return 0;
+}
+
+/************************************************
+ * candle_engine::member functions
+************************************************/
+static int candle_engine_add_trade(struct candle_engine * engine, int64_t timestamp_ms, double price, double amount)
+{
+	return add_price(engine, timestamp_ms, price, amount, 1);
+}
+
+static int candle_engine_add_ticker(struct candle_engine * engine, int64_t timestamp_ms, double last)
+{
+	return add_price(engine, timestamp_ms, last, 0.0, 0);
+}
+
+static int candle_engine_get_current(struct candle_engine * engine, enum candle_resolution resolution, struct candle * candle)
+{
+	assert(engine && engine->priv && candle);
+	if(resolution < 0 || resolution >= CANDLE_RESOLUTIONS_COUNT) return -1;
+	candle_engine_private_t * priv = engine->priv;
+	
+	int rc = -1;
+	pthread_mutex_lock(&priv->mutex);
+	struct candle_series * series = &priv->series[resolution];
+	if(series->latest_bucket >= 0) {
+		struct candle_slot * slot = &series->ring[series->latest_bucket % CANDLE_ENGINE_RING_SIZE];
+		if(slot->bucket == series->latest_bucket) {
+			*candle = slot->candle;
+			rc = 0;
+		}
+	}
+	pthread_mutex_unlock(&priv->mutex);
+	return rc;
+}
+
+static int candle_engine_flush(struct candle_engine * engine)
+{
+	assert(engine && engine->priv);
+	wait_written(engine->priv);
+	return 0;
+}
+
+static int append_candle(struct candle ** p_candles, size_t * p_max, size_t * p_count, const struct candle * candle)
+{
+	if(*p_count >= *p_max) {
+		size_t new_size = *p_max?(*p_max * 2):256;
+		struct candle * candles = realloc(*p_candles, new_size * sizeof(*candles));
+		assert(candles);
+		*p_candles = candles;
+		*p_max = new_size;
+	}
+	(*p_candles)[(*p_count)++] = *candle;
+	return 0;
+}
+
+static ssize_t query_db(candle_engine_private_t * priv, enum candle_resolution resolution, 
+	int64_t begin_ms, int64_t end_ms, struct candle ** p_candles, size_t * p_max)
+{
+	candle_engine_t * engine = priv->engine;
+	DB * dbp = engine->db->candles;
+	DBC * cursorp = NULL;
+	int rc = dbp->cursor(dbp, NULL, &cursorp, DB_READ_COMMITTED);
+	if(rc) return -1;
+	
+	struct candle_key begin_key, key;
+	struct candle_record record;
+	candle_key_set(&begin_key, engine->pair, resolution, begin_ms);
+	key = begin_key;
+	
+	DBT k, v;
+	memset(&k, 0, sizeof(k));
+	memset(&v, 0, sizeof(v));
+	k.data = &key;
+	k.size = sizeof(key);
+	k.ulen = sizeof(key);
+	k.flags = DB_DBT_USERMEM;
+	v.data = &record;
+	v.ulen = sizeof(record);
+	v.flags = DB_DBT_USERMEM;
+	
+	size_t count = 0;
+	rc = cursorp->get(cursorp, &k, &v, DB_SET_RANGE);
+	while(0 == rc) {
+		// same pair and resolution
+		if(k.size != sizeof(key) || memcmp(&key, &begin_key, offsetof(struct candle_key, start_ms)) != 0) break;
+		
+		struct candle candle;
+		candle_set(&candle, &key, &record);
+		if(candle.start_ms >= end_ms) break;
+		append_candle(p_candles, p_max, &count, &candle);
+		rc = cursorp->get(cursorp, &k, &v, DB_NEXT);
+	}
+	cursorp->close(cursorp);
+	if(rc && rc != DB_NOTFOUND) return -1;
+	return (ssize_t)count;
+}
+
+static ssize_t candle_engine_query(struct candle_engine * engine, enum candle_resolution resolution, 
+	int64_t begin_ms, int64_t end_ms, struct candle ** p_candles)
+{
+	assert(engine && engine->priv && p_candles);
+	if(resolution < 0 || resolution >= CANDLE_RESOLUTIONS_COUNT) return -1;
+	candle_engine_private_t * priv = engine->priv;
+	*p_candles = NULL;
+	
+	size_t max_candles = 0;
+	size_t count = 0;
+	struct candle * candles = NULL;
+	
+	size_t max_ring_candles = 0;
+	size_t num_ring_candles = 0;
+	struct candle * ring_candles = NULL;
+	
+	// the ring holds every bar of its range (the stored ones are loaded by init()),
+	// they are newer than (or equal to) the persisted ones
+	pthread_mutex_lock(&priv->mutex);
+	struct candle_series * series = &priv->series[resolution];
+	int64_t resolution_ms = candle_resolution_ms[resolution];
+	
+	int64_t ring_begin_ms = end_ms;
+	if(series->latest_bucket >= 0) {
+		int64_t first_bucket = series->latest_bucket - CANDLE_ENGINE_RING_SIZE + 1;
+		if(first_bucket < 0) first_bucket = 0;
+		ring_begin_ms = first_bucket * resolution_ms;
+	}
+	if(ring_begin_ms < begin_ms) ring_begin_ms = begin_ms;
+	if(ring_begin_ms > end_ms) ring_begin_ms = end_ms;
+	
+	if(series->latest_bucket >= 0) {
+		int64_t first = ring_begin_ms / resolution_ms;
+		if(first * resolution_ms < ring_begin_ms) ++first;
+		for(int64_t bucket = first; bucket <= series->latest_bucket && bucket * resolution_ms < end_ms; ++bucket) {
+			struct candle_slot * slot = &series->ring[bucket % CANDLE_ENGINE_RING_SIZE];
+			if(slot->bucket == bucket) append_candle(&ring_candles, &max_ring_candles, &num_ring_candles, &slot->candle);
+		}
+	}
+	pthread_mutex_unlock(&priv->mutex);
+	
+	if(engine->db && begin_ms < ring_begin_ms) {
+		// the bars evicted from the ring might be still queued
+		wait_written(priv);
+		ssize_t n = query_db(priv, resolution, begin_ms, ring_begin_ms, &candles, &max_candles);
+		if(n < 0) {
+			free(candles);
+			free(ring_candles);
+			return -1;
+		}
+		count = n;
+	}
+	
+	for(size_t i = 0; i < num_ring_candles; ++i) append_candle(&candles, &max_candles, &count, &ring_candles[i]);
+	free(ring_candles);
+	
+	*p_candles = candles;
+	return (ssize_t)count;
+}
+
+/************************************************
+ * public interfaces
+************************************************/
+candle_engine_t * candle_engine_init(candle_engine_t * engine, const char * pair, db_context_t * db, void * user_data)
+{
+	assert(pair);
+	if(NULL == engine) engine = calloc(1, sizeof(*engine));
+	assert(engine);
+	
+	engine->user_data = user_data;
+	engine->db = (db && db->candles)?db:NULL;
+	strncpy(engine->pair, pair, sizeof(engine->pair) - 1);
+	
+	engine->add_trade = candle_engine_add_trade;
+	engine->add_ticker = candle_engine_add_ticker;
+	engine->get_current = candle_engine_get_current;
+	engine->query = candle_engine_query;
+	engine->flush = candle_engine_flush;
+	
+	candle_engine_private_t * priv = candle_engine_private_new(engine);
+	assert(priv && priv == engine->priv);
+	if(NULL == engine->db) return engine;
+	
+	for(int i = 0; i < CANDLE_RESOLUTIONS_COUNT; ++i) {
+		if(load_series(priv, &priv->series[i]) != 0) {
+			fprintf(stderr, "[ERROR]: candle_engine(%s)::load(resolution=%d) failed\n", engine->pair, i);
+		}
+	}
+	
+	priv->writer.pending = calloc(CANDLE_ENGINE_MAX_PENDING, sizeof(*priv->writer.pending));
+	priv->writer.writing = calloc(CANDLE_ENGINE_MAX_PENDING, sizeof(*priv->writer.writing));
+	assert(priv->writer.pending && priv->writer.writing);
+	
+	int rc = pthread_create(&priv->writer.th, NULL, writer_thread, engine);
+	assert(0 == rc);
+	priv->writer.running = 1;
+	return engine;
+}
+
+void candle_engine_cleanup(candle_engine_t * engine)
+{
+	if(NULL == engine || NULL == engine->priv) return;
+	candle_engine_private_t * priv = engine->priv;
+	
+	// the open bars are written too, they will be updated after a restart
+	pthread_mutex_lock(&priv->mutex);
+	for(int i = 0; i < CANDLE_RESOLUTIONS_COUNT; ++i) {
+		struct candle_series * series = &priv->series[i];
+		for(int j = 0; j < CANDLE_ENGINE_RING_SIZE; ++j) {
+			struct candle_slot * slot = &series->ring[j];
+			if(slot->bucket >= 0 && slot->dirty) push_pending(priv, i, slot);
+		}
+	}
+	pthread_mutex_unlock(&priv->mutex);
+	
+	// the writer commits the remaining bars before it exits
+	if(priv->writer.running) {
+		pthread_mutex_lock(&priv->writer.mutex);
+		priv->writer.quit = 1;
+		pthread_cond_signal(&priv->writer.cond);
+		pthread_mutex_unlock(&priv->writer.mutex);
+		pthread_join(priv->writer.th, NULL);
+		priv->writer.running = 0;
+	}
+	
+	candle_engine_private_free(priv);
+	engine->priv = NULL;
+	return;
+}
+
+#if defined(_TEST_CANDLES) && defined(_STAND_ALONE)
+int main(int argc, char ** argv)
+{
+	const char * db_home = (argc > 1)?argv[1]:"/tmp/test_candles_db";
+	db_context_t * db = db_context_init(NULL, db_home, NULL);	// (nullable) memory only
+	
+	// a new pair per run, the database keeps the bars of the previous runs
+	char pair[CANDLE_ENGINE_PAIR_SIZE] = "";
+	snprintf(pair, sizeof(pair), "test_%d", (int)(getpid() % 100000));
+	
+	candle_engine_t engine[1];
+	memset(engine, 0, sizeof(engine));
+	candle_engine_init(engine, pair, db, NULL);
+	
+	// 10 minutes, one trade per second: price == seconds
+	const int64_t t0 = 18500LL * 86400 * 1000;	// aligned to 1d
+	for(int i = 0; i < 600; ++i) {
+		engine->add_trade(engine, t0 + i * 1000 + 500, 100.0 + i, 1.0);
+	}
+	
+	struct candle candle;
+	int rc = engine->get_current(engine, CANDLE_RESOLUTION_1m, &candle);
+	assert(0 == rc && candle.start_ms == t0 + 9 * 60000);
+	assert(candle.open == 100.0 + 540 && candle.close == 100.0 + 599);
+	assert(candle.volume == 60.0 && candle.num_trades == 60);
+	
+	rc = engine->get_current(engine, CANDLE_RESOLUTION_1d, &candle);
+	assert(0 == rc && candle.start_ms == t0 && candle.low == 100.0 && candle.high == 699.0);
+	
+	// late trade inside the ring: corrects the 2nd minute, does not change open / close
+	engine->add_trade(engine, t0 + 90 * 1000, 50.0, 2.0);
+	assert(engine->num_late_corrections > 0);
+	
+	struct candle * candles = NULL;
+	ssize_t count = engine->query(engine, CANDLE_RESOLUTION_1m, t0, t0 + 600 * 1000, &candles);
+	assert(count == 10);
+	assert(candles[1].start_ms == t0 + 60000 && candles[1].low == 50.0);
+	assert(candles[1].open == 160.0 && candles[1].close == 219.0);
+	assert(candles[1].volume == 62.0 && candles[1].num_trades == 61);
+	free(candles);
+	
+	// 1s bars: only the latest CANDLE_ENGINE_RING_SIZE are in memory
+	count = engine->query(engine, CANDLE_RESOLUTION_1s, t0, t0 + 600 * 1000, &candles);
+	if(db) {
+		assert(count == 600);
+		assert(candles[0].start_ms == t0 && candles[599].start_ms == t0 + 599 * 1000);
+	}else {
+		assert(count == CANDLE_ENGINE_RING_SIZE);
+		assert(candles[count - 1].start_ms == t0 + 599 * 1000);
+	}
+	free(candles);
+	
+	// too late for the ring: corrected in the database
+	engine->add_trade(engine, t0 + 1000, 10.0, 1.0);
+	if(db) {
+		engine->flush(engine);
+		assert(engine->num_db_corrections == 2);	// the 1s bars of both late trades
+		count = engine->query(engine, CANDLE_RESOLUTION_1s, t0 + 1000, t0 + 2000, &candles);
+		assert(count == 1 && candles[0].low == 10.0 && candles[0].num_trades == 2);
+		free(candles);
+	}
+	
+	printf("candles: updates=%ld, late=%ld, db_corrections=%ld\n", 
+		(long)engine->num_updates, (long)engine->num_late_corrections, (long)engine->num_db_corrections);
+	candle_engine_cleanup(engine);
+	
+	if(db) {
+		// restart: the open bars continue, the bars of the previous run are still queried
+		candle_engine_init(engine, pair, db, NULL);
+		rc = engine->get_current(engine, CANDLE_RESOLUTION_1d, &candle);
+		assert(0 == rc && candle.start_ms == t0 && candle.open == 100.0 && candle.num_trades == 602);
+		
+		engine->add_trade(engine, t0 + 599 * 1000 + 800, 700.0, 1.0);
+		rc = engine->get_current(engine, CANDLE_RESOLUTION_1m, &candle);
+		assert(0 == rc && candle.open == 100.0 + 540 && candle.close == 700.0 && candle.num_trades == 61);
+		
+		engine->add_trade(engine, t0 + 3600 * 1000, 800.0, 1.0);	// the 1s ring moves past the previous run
+		count = engine->query(engine, CANDLE_RESOLUTION_1s, t0, t0 + 600 * 1000, &candles);
+		assert(count == 600 && candles[599].close == 700.0);
+		free(candles);
+		candle_engine_cleanup(engine);
+		
+		db_context_cleanup(db);
+		free(db);
+	}
+	return 0;
+}
+#endif
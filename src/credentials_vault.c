@@ -0,0 +1,657 @@
+/*
+ * credentials_vault.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <pthread.h>
+#include <errno.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <gnutls/gnutls.h>
+#include <gnutls/crypto.h>
+
+#include "credentials_vault.h"
+#include "crypto/ctaes.h"
+#include "utils.h"
+
+/************************************************
+ * on-disk layout (native byte order)
+************************************************/
+#define VAULT_IV_SIZE (16)
+#define VAULT_MAC_SIZE (32)
+#define VAULT_MAX_RECORDS (16)
+#define VAULT_MAX_PLAINTEXT_SIZE (CREDENTIALS_VAULT_MAX_FIELD_SIZE * 2)
+#define VAULT_MAX_FILE_SIZE (64 * 1024)
+
+struct vault_header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t num_records;
+}__attribute__((packed));
+
+struct vault_record_header
+{
+	uint32_t type;
+	uint32_t length;	// ciphertext
+	unsigned char iv[VAULT_IV_SIZE];
+}__attribute__((packed));
+// followed by ciphertext[length], mac[VAULT_MAC_SIZE]
+
+/************************************************
+ * locked memory: 
+ *   never swapped, not in core dumps, zero-filled in a forked child
+************************************************/
+struct vault_secrets
+{
+	unsigned char enc_key[32];
+	unsigned char mac_key[32];
+	AES256_ctx aes;
+	unsigned char keystream[VAULT_MAX_PLAINTEXT_SIZE];	// scratch
+	unsigned char plaintext[VAULT_MAX_PLAINTEXT_SIZE];	// scratch
+	struct {
+		char api_key[CREDENTIALS_VAULT_MAX_FIELD_SIZE];
+		char api_secret[CREDENTIALS_VAULT_MAX_FIELD_SIZE];
+	}records[credentials_vault_types_count];
+	hmac_signer_t signers[credentials_vault_types_count];	// the keyed state itself is on the heap
+};
+
+static size_t secure_region_size(void)
+{
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	return (sizeof(struct vault_secrets) + page_size - 1) / page_size * page_size;
+}
+
+static struct vault_secrets * secure_region_new(void)
+{
+	size_t size = secure_region_size();
+	void * region = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(region == MAP_FAILED) {
+		perror("credentials_vault::mmap()");
+		return NULL;
+	}
+	
+	// not fatal: RLIMIT_MEMLOCK may be small
+	if(mlock(region, size)) perror("credentials_vault::mlock()");
+#ifdef MADV_DONTDUMP
+	madvise(region, size, MADV_DONTDUMP);
+#endif
+#ifdef MADV_WIPEONFORK
+	madvise(region, size, MADV_WIPEONFORK);
+#endif
+	return region;
+}
+
+static void secure_region_free(struct vault_secrets * secrets)
+{
+	if(NULL == secrets) return;
+	size_t size = secure_region_size();
+	gnutls_memset(secrets, 0, size);
+	munlock(secrets, size);
+	munmap(secrets, size);
+}
+
+static void derive_keys(struct vault_secrets * secrets, const unsigned char master_key[static CREDENTIALS_VAULT_KEY_SIZE])
+{
+	gnutls_hmac_fast(GNUTLS_MAC_SHA256, master_key, CREDENTIALS_VAULT_KEY_SIZE, "enc", 3, secrets->enc_key);
+	gnutls_hmac_fast(GNUTLS_MAC_SHA256, master_key, CREDENTIALS_VAULT_KEY_SIZE, "mac", 3, secrets->mac_key);
+	AES256_init(&secrets->aes, secrets->enc_key);
+}
+
+/************************************************
+ * AES-256-CTR / HMAC-SHA256
+************************************************/
+static void aes_ctr_xor(struct vault_secrets * secrets, const unsigned char iv[static VAULT_IV_SIZE], 
+	unsigned char * output, const unsigned char * input, size_t length)
+{
+	assert(length <= VAULT_MAX_PLAINTEXT_SIZE);
+	size_t blocks = (length + 15) / 16;
+	unsigned char counters[VAULT_MAX_PLAINTEXT_SIZE] = { 0 };
+	
+	// big-endian 128-bit counter starting at iv
+	for(size_t i = 0; i < blocks; ++i) {
+		unsigned char * counter = counters + i * 16;
+		memcpy(counter, iv, 16);
+		unsigned int carry = (unsigned int)i;
+		for(int k = 15; k >= 0 && carry; --k) {
+			carry += counter[k];
+			counter[k] = (unsigned char)carry;
+			carry >>= 8;
+		}
+	}
+	
+	AES256_encrypt(&secrets->aes, blocks, secrets->keystream, counters);	// all blocks at once (pipelined)
+	for(size_t i = 0; i < length; ++i) output[i] = input[i] ^ secrets->keystream[i];
+	gnutls_memset(secrets->keystream, 0, blocks * 16);
+}
+
+static void record_mac(struct vault_secrets * secrets, const struct vault_header * header, 
+	const struct vault_record_header * record, unsigned char mac[static VAULT_MAC_SIZE])
+{
+	gnutls_hmac_hd_t hmac = NULL;
+	int rc = gnutls_hmac_init(&hmac, GNUTLS_MAC_SHA256, secrets->mac_key, sizeof(secrets->mac_key));
+	assert(0 == rc);
+	gnutls_hmac(hmac, header, sizeof(*header));
+	gnutls_hmac(hmac, record, sizeof(*record) + record->length);	// header, iv, ciphertext
+	gnutls_hmac_deinit(hmac, mac);
+}
+
+static int mac_equals(const unsigned char * a, const unsigned char * b, size_t length)
+{
+	unsigned char diff = 0;
+	for(size_t i = 0; i < length; ++i) diff |= a[i] ^ b[i];
+	return diff == 0;
+}
+
+/************************************************
+ * credentials_vault_private
+************************************************/
+enum vault_record_state
+{
+	vault_record_state_failed = -1,
+	vault_record_state_locked = 0,
+	vault_record_state_unlocked = 1,
+	vault_record_state_missing = 2,
+};
+
+typedef struct credentials_vault_private
+{
+	credentials_vault_t * vault;
+	pthread_mutex_t mutex;
+	
+	unsigned char * data;	// the file, ciphertexts stay encrypted until get()
+	size_t length;
+	
+	struct {
+		int state;	// enum vault_record_state
+		const struct vault_record_header * record;
+		const unsigned char * mac;
+	}records[credentials_vault_types_count];
+	
+	struct vault_secrets * secrets;
+	int signer_ready[credentials_vault_types_count];
+}credentials_vault_private_t;
+
+static credentials_vault_private_t * credentials_vault_private_new(credentials_vault_t * vault)
+{
+	credentials_vault_private_t * priv = calloc(1, sizeof(*priv));
+	assert(priv);
+	priv->vault = vault;
+	vault->priv = priv;
+	
+	int rc = pthread_mutex_init(&priv->mutex, NULL);
+	assert(0 == rc);
+	for(int i = 0; i < credentials_vault_types_count; ++i) priv->records[i].state = vault_record_state_missing;
+	return priv;
+}
+
+static void credentials_vault_private_free(credentials_vault_private_t * priv)
+{
+	if(NULL == priv) return;
+	for(int i = 0; i < credentials_vault_types_count; ++i) {
+		if(priv->signer_ready[i]) hmac_signer_cleanup(&priv->secrets->signers[i]);
+		priv->signer_ready[i] = 0;
+	}
+	secure_region_free(priv->secrets);
+	free(priv->data);
+	pthread_mutex_destroy(&priv->mutex);
+	free(priv);
+}
+
+static int parse_vault(credentials_vault_private_t * priv)
+{
+	const unsigned char * p = priv->data;
+	const unsigned char * p_end = p + priv->length;
+	const struct vault_header * header = (const struct vault_header *)p;
+	
+	if(priv->length < sizeof(*header)) return -1;
+	if(memcmp(header->magic, CREDENTIALS_VAULT_MAGIC, sizeof(header->magic)) != 0) return -1;
+	if(header->version != CREDENTIALS_VAULT_VERSION) return -1;
+	if(header->num_records > VAULT_MAX_RECORDS) return -1;
+	p += sizeof(*header);
+	
+	for(uint32_t i = 0; i < header->num_records; ++i) {
+		const struct vault_record_header * record = (const struct vault_record_header *)p;
+		if((p_end - p) < (ssize_t)sizeof(*record)) return -1;
+		if(record->type >= credentials_vault_types_count || record->length > VAULT_MAX_PLAINTEXT_SIZE) return -1;
+		if((p_end - p) < (ssize_t)(sizeof(*record) + record->length + VAULT_MAC_SIZE)) return -1;
+		if(priv->records[record->type].state != vault_record_state_missing) return -1;	// duplicated
+		
+		priv->records[record->type].state = vault_record_state_locked;
+		priv->records[record->type].record = record;
+		priv->records[record->type].mac = p + sizeof(*record) + record->length;
+		p += sizeof(*record) + record->length + VAULT_MAC_SIZE;
+	}
+	return (p == p_end)?0:-1;
+}
+
+// (locked) verify and decrypt a record into the secure region
+static int unlock_record(credentials_vault_private_t * priv, enum credentials_vault_type type)
+{
+	struct vault_secrets * secrets = priv->secrets;
+	const struct vault_record_header * record = priv->records[type].record;
+	unsigned char mac[VAULT_MAC_SIZE];
+	
+	record_mac(secrets, (const struct vault_header *)priv->data, record, mac);
+	if(!mac_equals(mac, priv->records[type].mac, VAULT_MAC_SIZE)) {
+		fprintf(stderr, "[ERROR]::%s(%s): record %d: bad key or corrupted file\n", __FUNCTION__, priv->vault->path, type);
+		return vault_record_state_failed;
+	}
+	
+	unsigned char * plaintext = secrets->plaintext;
+	aes_ctr_xor(secrets, record->iv, plaintext, (const unsigned char *)(record + 1), record->length);
+	
+	// api_key '\0' api_secret '\0'
+	int state = vault_record_state_failed;
+	size_t cb_key = strnlen((char *)plaintext, record->length);
+	if(cb_key < record->length && cb_key < CREDENTIALS_VAULT_MAX_FIELD_SIZE) {
+		const char * secret = (char *)plaintext + cb_key + 1;
+		size_t cb_secret = strnlen(secret, record->length - cb_key - 1);
+		if((cb_key + 1 + cb_secret) < record->length && cb_secret < CREDENTIALS_VAULT_MAX_FIELD_SIZE) {
+			memcpy(secrets->records[type].api_key, plaintext, cb_key + 1);
+			memcpy(secrets->records[type].api_secret, secret, cb_secret + 1);
+			state = vault_record_state_unlocked;
+		}
+	}
+	gnutls_memset(plaintext, 0, sizeof(secrets->plaintext));
+	return state;
+}
+
+static int credentials_vault_get(struct credentials_vault * vault, enum credentials_vault_type type,
+	const char ** p_api_key, const char ** p_api_secret)
+{
+	assert(vault && vault->priv);
+	credentials_vault_private_t * priv = vault->priv;
+	if(p_api_key) *p_api_key = "";
+	if(p_api_secret) *p_api_secret = "";
+	if(type < 0 || type >= credentials_vault_types_count) return -1;
+	
+	int state = __atomic_load_n(&priv->records[type].state, __ATOMIC_ACQUIRE);
+	if(state == vault_record_state_locked) {
+		pthread_mutex_lock(&priv->mutex);
+		state = priv->records[type].state;
+		if(state == vault_record_state_locked) {
+			app_timer_t timer[1];
+			app_timer_start(timer);
+			state = unlock_record(priv, type);
+			perf_stats_update(vault->unlock_stats, app_timer_stop(timer));
+			if(state == vault_record_state_unlocked) __atomic_fetch_or(&vault->unlocked_types, 1u << type, __ATOMIC_RELAXED);
+			__atomic_store_n(&priv->records[type].state, state, __ATOMIC_RELEASE);
+		}
+		pthread_mutex_unlock(&priv->mutex);
+	}
+	
+	switch(state) {
+	case vault_record_state_unlocked:
+		if(p_api_key) *p_api_key = priv->secrets->records[type].api_key;
+		if(p_api_secret) *p_api_secret = priv->secrets->records[type].api_secret;
+		return 0;
+	case vault_record_state_missing: 
+		return 1;
+	default:
+		break;
+	}
+	return -1;
+}
+
+static int credentials_vault_get_signer(struct credentials_vault * vault, enum credentials_vault_type type,
+	gnutls_mac_algorithm_t algorithm, const char ** p_api_key, const hmac_signer_t ** p_signer)
+{
+	assert(vault && vault->priv && p_signer);
+	credentials_vault_private_t * priv = vault->priv;
+	*p_signer = NULL;
+	
+	const char * api_secret = NULL;
+	int rc = credentials_vault_get(vault, type, p_api_key, &api_secret);
+	if(rc) return rc;
+	
+	hmac_signer_t * signer = &priv->secrets->signers[type];
+	if(!__atomic_load_n(&priv->signer_ready[type], __ATOMIC_ACQUIRE)) {
+		pthread_mutex_lock(&priv->mutex);
+		if(!priv->signer_ready[type]) {
+			rc = hmac_signer_init(signer, algorithm, api_secret, strlen(api_secret));
+			if(0 == rc) __atomic_store_n(&priv->signer_ready[type], 1, __ATOMIC_RELEASE);
+		}
+		pthread_mutex_unlock(&priv->mutex);
+		if(rc) return -1;
+	}
+	if(signer->algorithm != algorithm) return -1;
+	
+	*p_signer = signer;
+	return 0;
+}
+
+static ssize_t read_file(const char * path, unsigned char ** p_data, size_t max_size)
+{
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0) return -1;
+	
+	struct stat st[1];
+	ssize_t length = -1;
+	unsigned char * data = NULL;
+	if(0 == fstat(fd, st) && st->st_size > 0 && (size_t)st->st_size <= max_size) {
+		data = malloc(st->st_size);
+		assert(data);
+		length = read(fd, data, st->st_size);
+		if(length != st->st_size) {
+			free(data);
+			data = NULL;
+			length = -1;
+		}
+	}
+	close(fd);
+	*p_data = data;
+	return length;
+}
+
+credentials_vault_t * credentials_vault_init(credentials_vault_t * vault, const char * path,
+	const unsigned char master_key[static CREDENTIALS_VAULT_KEY_SIZE], void * user_data)
+{
+	assert(path && master_key);
+	if(strlen(path) >= sizeof(vault->path)) return NULL;
+	
+	unsigned char * data = NULL;
+	ssize_t length = read_file(path, &data, VAULT_MAX_FILE_SIZE);
+	if(length <= 0) {
+		fprintf(stderr, "[ERROR]::%s(%s): %s\n", __FUNCTION__, path, strerror(errno?errno:EINVAL));
+		return NULL;
+	}
+	
+	struct vault_secrets * secrets = secure_region_new();
+	if(NULL == secrets) {
+		free(data);
+		return NULL;
+	}
+	
+	int is_allocated = (NULL == vault);
+	if(NULL == vault) vault = calloc(1, sizeof(*vault));
+	else memset(vault, 0, sizeof(*vault));
+	assert(vault);
+	
+	vault->user_data = user_data;
+	strncpy(vault->path, path, sizeof(vault->path) - 1);
+	vault->get = credentials_vault_get;
+	vault->get_signer = credentials_vault_get_signer;
+	
+	credentials_vault_private_t * priv = credentials_vault_private_new(vault);
+	assert(priv && priv == vault->priv);
+	priv->data = data;
+	priv->length = length;
+	priv->secrets = secrets;
+	
+	if(parse_vault(priv)) {
+		fprintf(stderr, "[ERROR]::%s(%s): invalid file format\n", __FUNCTION__, path);
+		credentials_vault_cleanup(vault);
+		if(is_allocated) free(vault);
+		return NULL;
+	}
+	
+	derive_keys(secrets, master_key);
+	return vault;
+}
+
+void credentials_vault_cleanup(credentials_vault_t * vault)
+{
+	if(NULL == vault) return;
+	credentials_vault_private_free(vault->priv);
+	vault->priv = NULL;
+	vault->unlocked_types = 0;
+	return;
+}
+
+/************************************************
+ * master key
+************************************************/
+static int parse_hex_key(const char * hex, size_t length, unsigned char master_key[static CREDENTIALS_VAULT_KEY_SIZE])
+{
+	while(length > 0 && isspace((unsigned char)hex[length - 1])) --length;
+	if(length != CREDENTIALS_VAULT_KEY_SIZE * 2) return -1;
+	return (hex_decode(hex, length, master_key) == CREDENTIALS_VAULT_KEY_SIZE)?0:-1;
+}
+
+int credentials_vault_load_key(const char * key_file, unsigned char master_key[static CREDENTIALS_VAULT_KEY_SIZE])
+{
+	int rc = -1;
+	if(NULL == key_file) {
+		const char * hex = getenv(CREDENTIALS_VAULT_KEY_ENV);
+		if(NULL == hex) return -1;
+		rc = parse_hex_key(hex, strlen(hex), master_key);
+	}else {
+		unsigned char * data = NULL;
+		ssize_t length = read_file(key_file, &data, 1024);
+		if(length <= 0) return -1;
+		rc = parse_hex_key((char *)data, length, master_key);
+		gnutls_memset(data, 0, length);
+		free(data);
+	}
+	if(rc) fprintf(stderr, "[ERROR]::%s(%s): expect %d hex digits\n", __FUNCTION__, 
+		key_file?key_file:"$" CREDENTIALS_VAULT_KEY_ENV, CREDENTIALS_VAULT_KEY_SIZE * 2);
+	return rc;
+}
+
+static int write_file(const char * path, const void * data, size_t length, int exclusive)
+{
+	int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (exclusive?O_EXCL:O_TRUNC);
+	int fd = open(path, flags, 0600);
+	if(fd < 0) {
+		perror(path);
+		return -1;
+	}
+	ssize_t cb = write(fd, data, length);
+	int rc = (cb == (ssize_t)length)?fdatasync(fd):-1;
+	close(fd);
+	return rc;
+}
+
+int credentials_vault_generate_key(const char * key_file, unsigned char master_key[static CREDENTIALS_VAULT_KEY_SIZE])
+{
+	assert(key_file);
+	int rc = gnutls_rnd(GNUTLS_RND_KEY, master_key, CREDENTIALS_VAULT_KEY_SIZE);
+	if(rc) return -1;
+	
+	char hex[CREDENTIALS_VAULT_KEY_SIZE * 2 + 2];
+	hex_encode(master_key, CREDENTIALS_VAULT_KEY_SIZE, hex);
+	hex[CREDENTIALS_VAULT_KEY_SIZE * 2] = '\n';
+	rc = write_file(key_file, hex, CREDENTIALS_VAULT_KEY_SIZE * 2 + 1, 1);	// never overwrite a key
+	gnutls_memset(hex, 0, sizeof(hex));
+	return rc;
+}
+
+/************************************************
+ * seal
+************************************************/
+int credentials_vault_seal(const char * path, const unsigned char master_key[static CREDENTIALS_VAULT_KEY_SIZE],
+	const struct credentials_vault_entry entries[static credentials_vault_types_count])
+{
+	assert(path && master_key && entries);
+	
+	struct vault_secrets * secrets = secure_region_new();
+	if(NULL == secrets) return -1;
+	derive_keys(secrets, master_key);
+	
+	size_t max_size = sizeof(struct vault_header) 
+		+ credentials_vault_types_count * (sizeof(struct vault_record_header) + VAULT_MAX_PLAINTEXT_SIZE + VAULT_MAC_SIZE);
+	unsigned char * data = calloc(1, max_size);
+	assert(data);
+	
+	struct vault_header * header = (struct vault_header *)data;
+	memcpy(header->magic, CREDENTIALS_VAULT_MAGIC, sizeof(header->magic));
+	header->version = CREDENTIALS_VAULT_VERSION;
+	
+	// num_records is authenticated: count first
+	for(int type = 0; type < credentials_vault_types_count; ++type) {
+		if(entries[type].api_key && entries[type].api_secret) ++header->num_records;
+	}
+	
+	int rc = 0;
+	unsigned char * p = data + sizeof(*header);
+	for(int type = 0; type < credentials_vault_types_count; ++type) {
+		const char * api_key = entries[type].api_key;
+		const char * api_secret = entries[type].api_secret;
+		if(NULL == api_key || NULL == api_secret) continue;
+		
+		size_t cb_key = strlen(api_key);
+		size_t cb_secret = strlen(api_secret);
+		if(cb_key >= CREDENTIALS_VAULT_MAX_FIELD_SIZE || cb_secret >= CREDENTIALS_VAULT_MAX_FIELD_SIZE) {
+			rc = -1;
+			break;
+		}
+		
+		struct vault_record_header * record = (struct vault_record_header *)p;
+		record->type = type;
+		record->length = cb_key + 1 + cb_secret + 1;
+		rc = gnutls_rnd(GNUTLS_RND_NONCE, record->iv, sizeof(record->iv));
+		if(rc) break;
+		
+		unsigned char * plaintext = secrets->plaintext;
+		memcpy(plaintext, api_key, cb_key + 1);
+		memcpy(plaintext + cb_key + 1, api_secret, cb_secret + 1);
+		aes_ctr_xor(secrets, record->iv, (unsigned char *)(record + 1), plaintext, record->length);
+		gnutls_memset(plaintext, 0, record->length);
+		
+		record_mac(secrets, header, record, p + sizeof(*record) + record->length);
+		p += sizeof(*record) + record->length + VAULT_MAC_SIZE;
+	}
+	secure_region_free(secrets);
+	
+	if(0 == rc) {
+		char tmp_file[PATH_MAX] = "";
+		snprintf(tmp_file, sizeof(tmp_file), "%s.tmp", path);
+		rc = write_file(tmp_file, data, p - data, 0);
+		if(0 == rc) rc = rename(tmp_file, path);
+		else unlink(tmp_file);
+	}
+	free(data);
+	return rc;
+}
+
+
+#if defined(_TEST_CREDENTIALS_VAULT) && defined(_STAND_ALONE)
+int main(int argc, char ** argv)
+{
+	const char * path = "/tmp/test_credentials.vault";
+	const char * key_file = "/tmp/test_credentials.key";
+	unlink(path);
+	unlink(key_file);
+	
+	unsigned char master_key[CREDENTIALS_VAULT_KEY_SIZE];
+	unsigned char loaded_key[CREDENTIALS_VAULT_KEY_SIZE];
+	int rc = credentials_vault_generate_key(key_file, master_key);
+	assert(0 == rc);
+	assert(0 != credentials_vault_generate_key(key_file, loaded_key));	// never overwritten
+	rc = credentials_vault_load_key(key_file, loaded_key);
+	assert(0 == rc && 0 == memcmp(master_key, loaded_key, sizeof(master_key)));
+	
+	struct credentials_vault_entry entries[credentials_vault_types_count] = {
+		[credentials_vault_type_query] = { "query-key", "query-secret-0123456789abcdef" },
+		[credentials_vault_type_trade] = { "trade-key", "trade-secret-0123456789abcdef0123456789abcdef" },
+	};
+	rc = credentials_vault_seal(path, master_key, entries);
+	assert(0 == rc);
+	
+	// 1. lazy unlock
+	app_timer_t timer[1];
+	app_timer_start(timer);
+	credentials_vault_t * vault = credentials_vault_init(NULL, path, master_key, NULL);
+	assert(vault);
+	printf("init: %.3f us\n", app_timer_stop(timer) * 1000000.0);
+	assert(vault->unlocked_types == 0);
+	
+	const char * api_key = NULL, * api_secret = NULL;
+	rc = vault->get(vault, credentials_vault_type_trade, &api_key, &api_secret);
+	assert(0 == rc && 0 == strcmp(api_key, "trade-key") && 0 == strcmp(api_secret, entries[1].api_secret));
+	assert(vault->unlocked_types == (1 << credentials_vault_type_trade));
+	printf("unlock: %.3f us\n", vault->unlock_stats->last * 1000000.0);
+	
+	const char * again = NULL;
+	rc = vault->get(vault, credentials_vault_type_trade, NULL, &again);
+	assert(0 == rc && again == api_secret);	// decrypted once
+	assert(vault->unlock_stats->count == 1);
+	
+	rc = vault->get(vault, credentials_vault_type_query, &api_key, &api_secret);
+	assert(0 == rc && 0 == strcmp(api_key, "query-key"));
+	rc = vault->get(vault, credentials_vault_type_withdraw, &api_key, &api_secret);
+	assert(1 == rc && api_key[0] == '\0' && api_secret[0] == '\0');
+	
+	// signers are built once per record and sign with the decrypted secret
+	const hmac_signer_t * signer = NULL, * signer2 = NULL;
+	rc = vault->get_signer(vault, credentials_vault_type_trade, GNUTLS_MAC_SHA256, &api_key, &signer);
+	assert(0 == rc && signer && 0 == strcmp(api_key, "trade-key"));
+	rc = vault->get_signer(vault, credentials_vault_type_trade, GNUTLS_MAC_SHA256, NULL, &signer2);
+	assert(0 == rc && signer2 == signer);
+	assert(-1 == vault->get_signer(vault, credentials_vault_type_trade, GNUTLS_MAC_SHA512, NULL, &signer2));
+	assert(1 == vault->get_signer(vault, credentials_vault_type_withdraw, GNUTLS_MAC_SHA256, NULL, &signer2) && NULL == signer2);
+	
+	unsigned char digest[32], expected[32];
+	struct iovec parts[1] = { { .iov_base = "message", .iov_len = 7 } };
+	rc = hmac_signer_sign(signer, parts, 1, digest);
+	assert(0 == rc);
+	gnutls_hmac_fast(GNUTLS_MAC_SHA256, entries[1].api_secret, strlen(entries[1].api_secret), "message", 7, expected);
+	assert(0 == memcmp(digest, expected, sizeof(digest)));
+	credentials_vault_cleanup(vault);
+	free(vault);
+	
+	// 2. wrong key
+	loaded_key[0] ^= 1;
+	vault = credentials_vault_init(NULL, path, loaded_key, NULL);
+	assert(vault);
+	rc = vault->get(vault, credentials_vault_type_query, &api_key, &api_secret);
+	assert(-1 == rc && api_secret[0] == '\0');
+	credentials_vault_cleanup(vault);
+	free(vault);
+	
+	// 3. tampered ciphertext
+	unsigned char * data = NULL;
+	ssize_t length = read_file(path, &data, VAULT_MAX_FILE_SIZE);
+	assert(length > 0);
+	data[sizeof(struct vault_header) + sizeof(struct vault_record_header) + 2] ^= 0x80;
+	rc = write_file(path, data, length, 0);
+	assert(0 == rc);
+	free(data);
+	
+	credentials_vault_t vault_buf[1];
+	vault = credentials_vault_init(vault_buf, path, master_key, NULL);
+	assert(vault == vault_buf);
+	assert(-1 == vault->get(vault, credentials_vault_type_query, &api_key, &api_secret));
+	assert(0 == vault->get(vault, credentials_vault_type_trade, &api_key, &api_secret));	// records are independent
+	credentials_vault_cleanup(vault);
+	
+	unlink(path);
+	unlink(key_file);
+	printf("ok\n");
+	return 0;
+}
+#endif
@@ -0,0 +1,233 @@
+/*
+ * db_context.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <db.h>
+#include "db_context.h"
+#include "utils.h"
+
+/************************************************
+ * bank codes: secondary keys
+************************************************/
+static int bank_codes_associate_by_name(DB * sdbp, const DBT *key, const DBT *value, DBT * skey)
+{
+	struct bank_code_record_data * record = value->data;
+	skey->data = record->name;
+	skey->size = strlen(record->name) + 1;
+	return 0;
+}
+static int bank_codes_associate_by_half_width_kana(DB * sdbp, const DBT *key, const DBT *value, DBT * skey)
+{
+	struct bank_code_record_data * record = value->data;
+	skey->data = record->half_width_kana;
+	skey->size = strlen(record->half_width_kana) + 1;
+	return 0;
+}
+static int bank_codes_associate_by_full_width_kana(DB * sdbp, const DBT *key, const DBT *value, DBT * skey)
+{
+	struct bank_code_record_data * record = value->data;
+	skey->data = record->full_width_kana;
+	skey->size = strlen(record->full_width_kana) + 1;
+	return 0;
+}
+static int bank_codes_associate_by_hiragana(DB * sdbp, const DBT *key, const DBT *value, DBT * skey)
+{
+	struct bank_code_record_data * record = value->data;
+	skey->data = record->hiragana;
+	skey->size = strlen(record->hiragana) + 1;
+	return 0;
+}
+
+static const u_int32_t s_db_flags = DB_CREATE 
+	| DB_THREAD
+	| DB_READ_UNCOMMITTED
+	| DB_AUTO_COMMIT
+	| 0;
+
+static int open_secondary_db(db_context_t * db, DB ** p_sdbp, const char * db_name, 
+	int (* associate)(DB *, const DBT *, const DBT *, DBT *), u_int32_t db_flags)
+{
+	DB * sdbp = NULL;
+	int rc = db_create(&sdbp, db->env, 0);
+	if(rc) return rc;
+	
+	sdbp->set_flags(sdbp, DB_DUPSORT);
+	rc = sdbp->open(sdbp, NULL, db_name, NULL, DB_BTREE, db_flags, 0);
+	// associate: NULL ==> a plain handle, used by the bulk loaders to write the index directly
+	if(0 == rc && associate) rc = db->bank_codes->associate(db->bank_codes, NULL, sdbp, associate, DB_CREATE);
+	if(rc) {
+		sdbp->close(sdbp, 0);
+		return rc;
+	}
+	*p_sdbp = sdbp;
+	return 0;
+}
+
+static int open_db(db_context_t * db, DB ** p_dbp, const char * db_name, u_int32_t db_flags)
+{
+	DB * dbp = NULL;
+	int rc = db_create(&dbp, db->env, 0);
+	if(rc) return rc;
+	
+	rc = dbp->open(dbp, NULL, db_name, NULL, DB_BTREE, db_flags, 0);
+	if(rc) {
+		dbp->close(dbp, 0);
+		return rc;
+	}
+	*p_dbp = dbp;
+	return 0;
+}
+
+/************************************************
+ * public interfaces
+************************************************/
+static const struct {
+	const char * db_name;
+	int (* associate)(DB *, const DBT *, const DBT *, DBT *);
+}s_bank_code_indices[BANK_CODES_SDBP_COUNT] = {
+	{ "bank_codes_by_name.db", bank_codes_associate_by_name },
+	{ "bank_codes_by_half_width_kana.db", bank_codes_associate_by_half_width_kana },
+	{ "bank_codes_by_full_width_kana.db", bank_codes_associate_by_full_width_kana },
+	{ "bank_codes_by_hiragana.db", bank_codes_associate_by_hiragana },
+};
+
+int db_context_open_bank_code_indices(db_context_t * db, int associate)
+{
+	assert(db && db->env && db->bank_codes);
+	for(int i = 0; i < BANK_CODES_SDBP_COUNT; ++i) {
+		if(db->sdbps[i]) continue;
+		int rc = open_secondary_db(db, &db->sdbps[i], s_bank_code_indices[i].db_name, 
+			associate?s_bank_code_indices[i].associate:NULL, s_db_flags);
+		if(rc) {
+			fprintf(stderr, "[ERROR]: %s(%s): %s\n", __FUNCTION__, s_bank_code_indices[i].db_name, db_strerror(rc));
+			return rc;
+		}
+	}
+	return 0;
+}
+
+void db_context_close_bank_code_indices(db_context_t * db)
+{
+	assert(db);
+	for(int i = 0; i < BANK_CODES_SDBP_COUNT; ++i) {
+		if(db->sdbps[i]) db->sdbps[i]->close(db->sdbps[i], 0);
+		db->sdbps[i] = NULL;
+	}
+	return;
+}
+
+db_context_t * db_context_init(db_context_t * db, const char * db_home, void * user_data)
+{
+	assert(db_home);
+	int rc = mkdir(db_home, 0700);
+	if(rc && errno != EEXIST) {
+		perror("db_context_init::mkdir()");
+		return NULL;
+	}
+	
+	int is_allocated = 0;
+	if(NULL == db) {
+		db = calloc(1, sizeof(*db));
+		assert(db);
+		is_allocated = 1;
+	}
+	db->user_data = user_data;
+	
+	DB_ENV * env = NULL;
+	rc = db_env_create(&env, 0);
+	if(rc) goto label_error;
+	db->env = env;
+	
+	u_int32_t env_flags = DB_CREATE | DB_INIT_MPOOL
+		| DB_INIT_LOCK
+		| DB_INIT_TXN
+		| DB_INIT_LOG
+		| DB_RECOVER
+		| DB_REGISTER
+		| DB_THREAD
+		| 0;
+	u_int32_t db_flags = s_db_flags;
+	rc = env->open(env, db_home, env_flags, 0);
+	if(rc) goto label_error;
+	
+	// bank codes and the secondary indices
+	rc = open_db(db, &db->bank_codes, "bank_codes.db", db_flags);
+	if(rc) goto label_error;
+	
+	rc = db_context_open_bank_code_indices(db, 1);
+	if(rc) goto label_error;
+	
+	// tick store
+	rc = open_db(db, &db->coincheck.tickers, "coincheck_tickers.db", db_flags);
+	if(rc) goto label_error;
+	
+	// OHLCV bars
+	rc = open_db(db, &db->candles, "candles.db", db_flags);
+	if(rc) goto label_error;
+	
+	return db;
+	
+label_error:
+	fprintf(stderr, "[ERROR]: %s(home=%s): %s\n", __FUNCTION__, db_home, db_strerror(rc));
+	db_context_cleanup(db);
+	if(is_allocated) free(db);
+	return NULL;
+}
+
+void db_context_cleanup(db_context_t * db)
+{
+	if(NULL == db) return;
+	if(db->candles) {
+		db->candles->close(db->candles, 0);
+		db->candles = NULL;
+	}
+	if(db->coincheck.tickers) {
+		db->coincheck.tickers->close(db->coincheck.tickers, 0);
+		db->coincheck.tickers = NULL;
+	}
+	
+	// secondary databases must be closed before the primary
+	db_context_close_bank_code_indices(db);
+	if(db->bank_codes) db->bank_codes->close(db->bank_codes, 0);
+	db->bank_codes = NULL;
+	
+	if(db->env) {
+		db->env->close(db->env, 0);
+		db->env = NULL;
+	}
+	return;
+}
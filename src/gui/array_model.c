@@ -0,0 +1,528 @@
+/*
+ * array_model.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <limits.h>
+
+#include "array_model.h"
+
+/*****************************************************
+ * positions during set_data():
+ *   top-level positions < diff_j are the new nodes [0, diff_j),
+ *   the following ones are the old nodes from diff_i,
+ *   a node is a row (flat list) or a group.
+ *   the children of the group being merged (child_pos) are mapped the same way
+ *   with child_j / child_i.
+ *   outside of set_data(): diff_j = INT_MAX, child_pos = -1.
+*****************************************************/
+struct array_model_rows
+{
+	const void * data;
+	int count;
+	int num_groups;
+	int * groups;	// first row of each group, groups[num_groups] = count
+	int max_groups;
+};
+
+struct array_model
+{
+	GObject parent;
+	int stamp;
+	const struct array_model_spec * spec;
+	
+	struct array_model_rows rows[1];	// current
+	struct array_model_rows old[1];		// during set_data(), its groups buffer is reused
+	
+	int diff_i;
+	int diff_j;
+	int child_pos;
+	int child_i;
+	int child_j;
+	int child_old_first;
+	int child_old_count;
+	int child_new_first;
+};
+
+struct array_model_class
+{
+	GObjectClass parent_class;
+};
+
+static void array_model_tree_model_init(GtkTreeModelIface * iface);
+G_DEFINE_TYPE_WITH_CODE(ArrayModel, array_model, G_TYPE_OBJECT,
+	G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL, array_model_tree_model_init))
+
+static inline int is_grouped(const ArrayModel * model)
+{
+	return (NULL != model->spec->compare_groups);
+}
+
+static inline int rows_num_nodes(const ArrayModel * model, const struct array_model_rows * rows)
+{
+	return is_grouped(model)?rows->num_groups:rows->count;
+}
+
+static inline const void * rows_get(const ArrayModel * model, const struct array_model_rows * rows, int index)
+{
+	return model->spec->get_row(rows->data, index);
+}
+
+// the first row of each group
+static void rows_build_groups(const ArrayModel * model, struct array_model_rows * rows)
+{
+	rows->num_groups = 0;
+	if(!is_grouped(model)) return;
+	if(rows->max_groups < rows->count + 1) {
+		int max_groups = (rows->count + 1 + 1023) & ~1023;
+		rows->groups = realloc(rows->groups, max_groups * sizeof(*rows->groups));
+		assert(rows->groups);
+		rows->max_groups = max_groups;
+	}
+	
+	const void * prev = NULL;
+	for(int i = 0; i < rows->count; ++i) {
+		const void * row = rows_get(model, rows, i);
+		if(NULL == prev || model->spec->compare_groups(prev, row) != 0) rows->groups[rows->num_groups++] = i;
+		prev = row;
+	}
+	if(rows->groups) rows->groups[rows->num_groups] = rows->count;
+}
+
+static int model_num_nodes(const ArrayModel * model)
+{
+	if(model->diff_j == INT_MAX) return rows_num_nodes(model, model->rows);
+	return model->diff_j + (rows_num_nodes(model, model->old) - model->diff_i);
+}
+
+static const struct array_model_rows * model_resolve_node(const ArrayModel * model, int pos, int * p_node)
+{
+	if(pos < model->diff_j) {
+		*p_node = pos;
+		return model->rows;
+	}
+	*p_node = model->diff_i + (pos - model->diff_j);
+	return model->old;
+}
+
+static int model_num_children(const ArrayModel * model, int pos)
+{
+	if(!is_grouped(model)) return 0;
+	if(pos == model->child_pos) return model->child_j + (model->child_old_count - model->child_i);
+	
+	int node = 0;
+	const struct array_model_rows * rows = model_resolve_node(model, pos, &node);
+	return rows->groups[node + 1] - rows->groups[node];
+}
+
+// child < 0: the node itself (the row, or the first row of the group)
+static const void * model_get_row(const ArrayModel * model, int pos, int child)
+{
+	if(child >= 0 && pos == model->child_pos) {
+		if(child < model->child_j) return rows_get(model, model->rows, model->child_new_first + child);
+		return rows_get(model, model->old, model->child_old_first + model->child_i + (child - model->child_j));
+	}
+	
+	int node = 0;
+	const struct array_model_rows * rows = model_resolve_node(model, pos, &node);
+	if(!is_grouped(model)) return rows_get(model, rows, node);
+	return rows_get(model, rows, rows->groups[node] + ((child > 0)?child:0));
+}
+
+static inline void model_set_iter(const ArrayModel * model, GtkTreeIter * iter, int pos, int child)
+{
+	iter->stamp = model->stamp;
+	iter->user_data = GINT_TO_POINTER(pos);
+	iter->user_data2 = GINT_TO_POINTER(child + 1);	// 0: top-level
+	iter->user_data3 = NULL;
+}
+
+static inline int iter_pos(const GtkTreeIter * iter) { return GPOINTER_TO_INT(iter->user_data); }
+static inline int iter_child(const GtkTreeIter * iter) { return GPOINTER_TO_INT(iter->user_data2) - 1; }
+
+/*****************************************************
+ * GtkTreeModel interface
+*****************************************************/
+static GtkTreeModelFlags array_model_get_flags(GtkTreeModel * tree_model)
+{
+	ArrayModel * model = ARRAY_MODEL(tree_model);
+	return is_grouped(model)?0:GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint array_model_get_n_columns(GtkTreeModel * tree_model)
+{
+	return ARRAY_MODEL(tree_model)->spec->n_columns;
+}
+
+static GType array_model_get_column_type(GtkTreeModel * tree_model, gint column)
+{
+	ArrayModel * model = ARRAY_MODEL(tree_model);
+	g_return_val_if_fail(column >= 0 && column < model->spec->n_columns, G_TYPE_INVALID);
+	return model->spec->column_types[column];
+}
+
+static gboolean array_model_get_iter(GtkTreeModel * tree_model, GtkTreeIter * iter, GtkTreePath * path)
+{
+	ArrayModel * model = ARRAY_MODEL(tree_model);
+	int depth = gtk_tree_path_get_depth(path);
+	const gint * indices = gtk_tree_path_get_indices(path);
+	if(depth < 1 || depth > (is_grouped(model)?2:1)) return FALSE;
+	
+	int pos = indices[0];
+	if(pos < 0 || pos >= model_num_nodes(model)) return FALSE;
+	int child = -1;
+	if(depth == 2) {
+		child = indices[1];
+		if(child < 0 || child >= model_num_children(model, pos)) return FALSE;
+	}
+	model_set_iter(model, iter, pos, child);
+	return TRUE;
+}
+
+static GtkTreePath * array_model_get_path(GtkTreeModel * tree_model, GtkTreeIter * iter)
+{
+	ArrayModel * model = ARRAY_MODEL(tree_model);
+	g_return_val_if_fail(iter->stamp == model->stamp, NULL);
+	
+	GtkTreePath * path = gtk_tree_path_new();
+	gtk_tree_path_append_index(path, iter_pos(iter));
+	if(iter_child(iter) >= 0) gtk_tree_path_append_index(path, iter_child(iter));
+	return path;
+}
+
+static void array_model_get_value(GtkTreeModel * tree_model, GtkTreeIter * iter, gint column, GValue * value)
+{
+	ArrayModel * model = ARRAY_MODEL(tree_model);
+	const struct array_model_spec * spec = model->spec;
+	g_return_if_fail(iter->stamp == model->stamp);
+	g_return_if_fail(column >= 0 && column < spec->n_columns);
+	
+	g_value_init(value, spec->column_types[column]);
+	int child = iter_child(iter);
+	const void * row = model_get_row(model, iter_pos(iter), child);
+	if(NULL == row) return;
+	
+	if(is_grouped(model) && child < 0) {
+		if(spec->get_group_value) spec->get_group_value(row, column, value);
+		return;
+	}
+	spec->get_value(row, column, value);
+}
+
+static gboolean array_model_iter_next(GtkTreeModel * tree_model, GtkTreeIter * iter)
+{
+	ArrayModel * model = ARRAY_MODEL(tree_model);
+	g_return_val_if_fail(iter->stamp == model->stamp, FALSE);
+	
+	int pos = iter_pos(iter), child = iter_child(iter);
+	if(child < 0) {
+		if(pos + 1 >= model_num_nodes(model)) { iter->stamp = 0; return FALSE; }
+		model_set_iter(model, iter, pos + 1, -1);
+		return TRUE;
+	}
+	if(child + 1 >= model_num_children(model, pos)) { iter->stamp = 0; return FALSE; }
+	model_set_iter(model, iter, pos, child + 1);
+	return TRUE;
+}
+
+static gboolean array_model_iter_previous(GtkTreeModel * tree_model, GtkTreeIter * iter)
+{
+	ArrayModel * model = ARRAY_MODEL(tree_model);
+	g_return_val_if_fail(iter->stamp == model->stamp, FALSE);
+	
+	int pos = iter_pos(iter), child = iter_child(iter);
+	if(child < 0) {
+		if(pos <= 0) { iter->stamp = 0; return FALSE; }
+		model_set_iter(model, iter, pos - 1, -1);
+		return TRUE;
+	}
+	if(child <= 0) { iter->stamp = 0; return FALSE; }
+	model_set_iter(model, iter, pos, child - 1);
+	return TRUE;
+}
+
+static gboolean array_model_iter_nth_child(GtkTreeModel * tree_model, GtkTreeIter * iter, GtkTreeIter * parent, gint n)
+{
+	ArrayModel * model = ARRAY_MODEL(tree_model);
+	if(NULL == parent) {
+		if(n < 0 || n >= model_num_nodes(model)) return FALSE;
+		model_set_iter(model, iter, n, -1);
+		return TRUE;
+	}
+	
+	g_return_val_if_fail(parent->stamp == model->stamp, FALSE);
+	if(iter_child(parent) >= 0) return FALSE;
+	int pos = iter_pos(parent);
+	if(n < 0 || n >= model_num_children(model, pos)) return FALSE;
+	model_set_iter(model, iter, pos, n);
+	return TRUE;
+}
+
+static gboolean array_model_iter_children(GtkTreeModel * tree_model, GtkTreeIter * iter, GtkTreeIter * parent)
+{
+	return array_model_iter_nth_child(tree_model, iter, parent, 0);
+}
+
+static gboolean array_model_iter_has_child(GtkTreeModel * tree_model, GtkTreeIter * iter)
+{
+	ArrayModel * model = ARRAY_MODEL(tree_model);
+	g_return_val_if_fail(iter->stamp == model->stamp, FALSE);
+	return iter_child(iter) < 0 && model_num_children(model, iter_pos(iter)) > 0;
+}
+
+static gint array_model_iter_n_children(GtkTreeModel * tree_model, GtkTreeIter * iter)
+{
+	ArrayModel * model = ARRAY_MODEL(tree_model);
+	if(NULL == iter) return model_num_nodes(model);
+	
+	g_return_val_if_fail(iter->stamp == model->stamp, 0);
+	if(iter_child(iter) >= 0) return 0;
+	return model_num_children(model, iter_pos(iter));
+}
+
+static gboolean array_model_iter_parent(GtkTreeModel * tree_model, GtkTreeIter * iter, GtkTreeIter * child)
+{
+	ArrayModel * model = ARRAY_MODEL(tree_model);
+	g_return_val_if_fail(child->stamp == model->stamp, FALSE);
+	if(iter_child(child) < 0) return FALSE;
+	model_set_iter(model, iter, iter_pos(child), -1);
+	return TRUE;
+}
+
+static void array_model_tree_model_init(GtkTreeModelIface * iface)
+{
+	iface->get_flags = array_model_get_flags;
+	iface->get_n_columns = array_model_get_n_columns;
+	iface->get_column_type = array_model_get_column_type;
+	iface->get_iter = array_model_get_iter;
+	iface->get_path = array_model_get_path;
+	iface->get_value = array_model_get_value;
+	iface->iter_next = array_model_iter_next;
+	iface->iter_previous = array_model_iter_previous;
+	iface->iter_children = array_model_iter_children;
+	iface->iter_has_child = array_model_iter_has_child;
+	iface->iter_n_children = array_model_iter_n_children;
+	iface->iter_nth_child = array_model_iter_nth_child;
+	iface->iter_parent = array_model_iter_parent;
+}
+
+static void array_model_finalize(GObject * object)
+{
+	ArrayModel * model = ARRAY_MODEL(object);
+	free(model->rows->groups);
+	free(model->old->groups);
+	G_OBJECT_CLASS(array_model_parent_class)->finalize(object);
+}
+
+static void array_model_class_init(ArrayModelClass * klass)
+{
+	G_OBJECT_CLASS(klass)->finalize = array_model_finalize;
+}
+
+static void array_model_init(ArrayModel * model)
+{
+	model->stamp = g_random_int();
+	model->diff_j = INT_MAX;
+	model->child_pos = -1;
+}
+
+ArrayModel * array_model_new(const struct array_model_spec * spec)
+{
+	assert(spec && spec->n_columns > 0 && spec->column_types);
+	assert(spec->get_row && spec->get_value && spec->compare_rows && spec->rows_equal);
+	
+	ArrayModel * model = g_object_new(ARRAY_TYPE_MODEL, NULL);
+	model->spec = spec;
+	return model;
+}
+
+/*****************************************************
+ * set_data(): merge the old and the new rows
+ *   the positions are updated before each signal, so the handlers
+ *   (e.g. GtkTreeView) always see a consistent model.
+*****************************************************/
+enum array_model_signal
+{
+	array_model_signal_inserted,
+	array_model_signal_changed,
+	array_model_signal_deleted,
+	array_model_signal_has_child_toggled,
+};
+
+static void model_emit(ArrayModel * model, enum array_model_signal signal, int pos, int child)
+{
+	GtkTreeModel * tree_model = GTK_TREE_MODEL(model);
+	GtkTreePath * path = gtk_tree_path_new();
+	gtk_tree_path_append_index(path, pos);
+	if(child >= 0) gtk_tree_path_append_index(path, child);
+	
+	GtkTreeIter iter;
+	model_set_iter(model, &iter, pos, child);
+	switch(signal)
+	{
+	case array_model_signal_inserted: gtk_tree_model_row_inserted(tree_model, path, &iter); break;
+	case array_model_signal_changed: gtk_tree_model_row_changed(tree_model, path, &iter); break;
+	case array_model_signal_deleted: gtk_tree_model_row_deleted(tree_model, path); break;
+	case array_model_signal_has_child_toggled: gtk_tree_model_row_has_child_toggled(tree_model, path, &iter); break;
+	}
+	gtk_tree_path_free(path);
+}
+
+// the children of the group at @pos: old rows (old_count is 0 for a new group) ==> new rows
+static void model_merge_children(ArrayModel * model, int pos, int old_first, int old_count, int new_first, int new_count,
+	struct array_model_changes * changes)
+{
+	const struct array_model_spec * spec = model->spec;
+	model->child_pos = pos;
+	model->child_old_first = old_first;
+	model->child_old_count = old_count;
+	model->child_new_first = new_first;
+	model->child_i = model->child_j = 0;
+	
+	while(model->child_i < old_count || model->child_j < new_count) {
+		int c = 0;
+		const void * old_row = (model->child_i < old_count)?rows_get(model, model->old, old_first + model->child_i):NULL;
+		const void * new_row = (model->child_j < new_count)?rows_get(model, model->rows, new_first + model->child_j):NULL;
+		if(NULL == old_row) c = 1;
+		else if(NULL == new_row) c = -1;
+		else c = spec->compare_rows(old_row, new_row);
+		
+		// never leave the parent without children (the views would collapse it)
+		int num_children = model->child_j + (old_count - model->child_i);
+		if(c < 0 && num_children == 1 && new_row) c = 1;
+		
+		if(c < 0) {
+			++model->child_i;
+			model_emit(model, array_model_signal_deleted, pos, model->child_j);
+			++changes->num_deleted;
+		}else if(c > 0) {
+			++model->child_j;
+			model_emit(model, array_model_signal_inserted, pos, model->child_j - 1);
+			if(num_children == 0) model_emit(model, array_model_signal_has_child_toggled, pos, -1);
+			++changes->num_inserted;
+		}else {
+			++model->child_i;
+			++model->child_j;
+			if(!spec->rows_equal(old_row, new_row)) {
+				model_emit(model, array_model_signal_changed, pos, model->child_j - 1);
+				++changes->num_changed;
+			}
+		}
+	}
+	model->child_pos = -1;
+}
+
+void array_model_set_data(ArrayModel * model, const void * data, int count, struct array_model_changes * p_changes)
+{
+	assert(model && model->spec);
+	assert(model->diff_j == INT_MAX);	// no re-entrant set_data() from a signal handler
+	const struct array_model_spec * spec = model->spec;
+	struct array_model_changes changes[1];
+	memset(changes, 0, sizeof(changes));
+	
+	// the old rows keep their groups, the new ones use the spare buffer
+	struct array_model_rows spare = *model->old;
+	*model->old = *model->rows;
+	model->rows->data = data;
+	model->rows->count = (data && count > 0)?count:0;
+	model->rows->groups = spare.groups;
+	model->rows->max_groups = spare.max_groups;
+	rows_build_groups(model, model->rows);
+	++model->stamp;
+	
+	const int grouped = is_grouped(model);
+	const int old_n = rows_num_nodes(model, model->old);
+	const int new_n = rows_num_nodes(model, model->rows);
+	const struct array_model_rows * old = model->old;
+	const struct array_model_rows * rows = model->rows;
+	
+	model->diff_i = model->diff_j = 0;
+	while(model->diff_i < old_n || model->diff_j < new_n) {
+		int i = model->diff_i, j = model->diff_j;
+		const void * old_row = (i < old_n)?rows_get(model, old, grouped?old->groups[i]:i):NULL;
+		const void * new_row = (j < new_n)?rows_get(model, rows, grouped?rows->groups[j]:j):NULL;
+		int c = 0;
+		if(NULL == old_row) c = 1;
+		else if(NULL == new_row) c = -1;
+		else c = grouped?spec->compare_groups(old_row, new_row):spec->compare_rows(old_row, new_row);
+		
+		if(c < 0) {
+			++model->diff_i;
+			model_emit(model, array_model_signal_deleted, j, -1);
+			if(grouped) {
+				++changes->num_groups_deleted;
+				changes->num_deleted += old->groups[i + 1] - old->groups[i];
+			}else ++changes->num_deleted;
+		}else if(c > 0) {
+			if(grouped) {
+				// the parent without children first, then its children one by one
+				model->child_pos = j;
+				model->child_i = model->child_j = model->child_old_count = 0;
+				++model->diff_j;
+				model_emit(model, array_model_signal_inserted, j, -1);
+				model_merge_children(model, j, 0, 0, rows->groups[j], rows->groups[j + 1] - rows->groups[j], changes);
+				++changes->num_groups_inserted;
+			}else {
+				++model->diff_j;
+				model_emit(model, array_model_signal_inserted, j, -1);
+				++changes->num_inserted;
+			}
+		}else {
+			if(grouped) {
+				model_merge_children(model, j, old->groups[i], old->groups[i + 1] - old->groups[i],
+					rows->groups[j], rows->groups[j + 1] - rows->groups[j], changes);
+			}
+			++model->diff_i;
+			++model->diff_j;
+			if(!grouped && !spec->rows_equal(old_row, new_row)) {
+				model_emit(model, array_model_signal_changed, j, -1);
+				++changes->num_changed;
+			}
+		}
+	}
+	
+	model->diff_j = INT_MAX;
+	model->diff_i = 0;
+	model->old->data = NULL;
+	model->old->count = 0;
+	model->old->num_groups = 0;
+	if(p_changes) *p_changes = *changes;
+}
+
+const void * array_model_get_row(ArrayModel * model, GtkTreeIter * iter, gboolean * p_is_group)
+{
+	g_return_val_if_fail(IS_ARRAY_MODEL(model) && iter, NULL);
+	g_return_val_if_fail(iter->stamp == model->stamp, NULL);
+	
+	int child = iter_child(iter);
+	if(p_is_group) *p_is_group = (is_grouped(model) && child < 0);
+	return model_get_row(model, iter_pos(iter), child);
+}
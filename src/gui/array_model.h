@@ -0,0 +1,75 @@
+#ifndef BTC_TRADER_ARRAY_MODEL_H_
+#define BTC_TRADER_ARRAY_MODEL_H_
+
+#include <gtk/gtk.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************
+ * array_model:
+ *   GtkTreeModel over an array owned by the caller (orders, transactions,
+ *   price levels), nothing is copied into the model.
+ *
+ *   an iter is a position, get_value() reads the current array through
+ *   the spec's callbacks, strings should be set with g_value_set_static_string().
+ *
+ *   optional 2 levels: consecutive rows of the same group (e.g. the
+ *   transactions of one order) are the children of one parent row.
+ *
+ *   array_model_set_data() swaps the array and emits row-deleted /
+ *   row-inserted / row-changed for the differences only: the old and the
+ *   new rows are merged with compare_rows(), so views keep their selection,
+ *   expanded rows and scroll position. the old array must stay valid until
+ *   set_data() returns.
+ *
+ *   GTK main thread only.
+*****************************************************/
+struct array_model_spec
+{
+	int n_columns;
+	const GType * column_types;
+	
+	const void * (* get_row)(const void * data, int index);
+	void (* get_value)(const void * row, int column, GValue * value);	// @value is initialized with the column type
+	
+	// in the array's order: < 0 if @a comes first, 0: the same row (e.g. the same id)
+	int (* compare_rows)(const void * a, const void * b);
+	int (* rows_equal)(const void * a, const void * b);	// the displayed contents did not change
+	
+	// (nullable) flat list
+	int (* compare_groups)(const void * a, const void * b);	// by the group key, in the array's order
+	void (* get_group_value)(const void * first_row, int column, GValue * value);
+};
+
+struct array_model_changes
+{
+	int num_inserted;
+	int num_deleted;
+	int num_changed;
+	int num_groups_inserted;	// parent rows
+	int num_groups_deleted;
+};
+
+typedef struct array_model ArrayModel;
+typedef struct array_model_class ArrayModelClass;
+
+GType array_model_get_type(void);
+#define ARRAY_TYPE_MODEL (array_model_get_type())
+#define ARRAY_MODEL(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), ARRAY_TYPE_MODEL, ArrayModel))
+#define IS_ARRAY_MODEL(obj) (G_TYPE_CHECK_INSTANCE_TYPE((obj), ARRAY_TYPE_MODEL))
+
+// @spec must outlive the model (usually static)
+ArrayModel * array_model_new(const struct array_model_spec * spec);
+
+// @changes: (nullable)
+void array_model_set_data(ArrayModel * model, const void * data, int count, struct array_model_changes * changes);
+
+// the row behind @iter, the first row of the group for a parent row (*p_is_group: TRUE)
+const void * array_model_get_row(ArrayModel * model, GtkTreeIter * iter, gboolean * p_is_group);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -39,22 +39,17 @@
 #include "utils.h"
 
 #include "order_history.h"
-
-static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
-#define AUTO_UNLOCK_MUTEX_PTR __attribute__((cleanup(auto_unlock_mutex_ptr)))
-static void auto_unlock_mutex_ptr(void * ptr)
-{
-	pthread_mutex_t ** p_mutex = ptr;
-	if(p_mutex && *p_mutex) pthread_mutex_unlock(*p_mutex);
-	return;
-}
-
-#define auto_lock() AUTO_UNLOCK_MUTEX_PTR pthread_mutex_t *_m_ = &s_mutex; \
-		pthread_mutex_lock(_m_)
-
+#include "array_model.h"
+#include "ui_scheduler.h"
+#include "io_workers.h"
+#include "tick_store.h"
+#include "candles.h"
+#include "db_context.h"
+#include <limits.h>
 
 static void update_balance(panel_view_t * panel);
 static gboolean update_orders_history(panel_view_t * panel);
+static void panel_mark_fresh(panel_view_t * panel, unsigned int section);
 
 enum ORDER_BOOK_COLUMN
 {
@@ -93,6 +88,121 @@ static void show_info(shell_context_t * shell, const char * fmt, ...)
 }
 
 
+/**************************************
+ * io jobs
+ *   fetch(): worker thread, apply(): GTK main thread
+***************************************/
+static int panel_submit_job(panel_view_t * panel, struct io_job * job)
+{
+	assert(panel && panel->shell && job);
+	io_workers_context_t * io = panel->shell->io_workers;
+	assert(io);
+	job->agent = panel->agent;	// run on the agency's event loop
+	return io->submit(io, job);
+}
+
+/**************************************
+ * orders (buy / sell / cancel)
+ *   posted to the agency as trading_agency_commands
+***************************************/
+struct new_order_job
+{
+	struct io_job base[1];
+	char order_type[16];	// "buy" or "sell"
+	char sz_rate[100];
+	double rate;
+	double amount;
+	json_object * jresult;
+};
+
+struct cancel_order_job
+{
+	struct io_job base[1];
+	char order_id[100];
+	json_object * jresult;
+};
+
+static void new_order_job_free(struct io_job * job)
+{
+	struct new_order_job * order = (struct new_order_job *)job;
+	if(order->jresult) json_object_put(order->jresult);
+	free(order);
+	return;
+}
+
+// agency thread
+static void on_command_completed(const struct trading_agency_command * cmd, int rc, json_object * jresult)
+{
+	struct io_job * job = cmd->user_data;
+	panel_view_t * panel = job->user_data;
+	
+	job->rc = rc;
+	if(jresult) {
+		json_object ** p_jresult = (cmd->type == trading_agency_command_type_new_order)?
+			&((struct new_order_job *)job)->jresult:
+			&((struct cancel_order_job *)job)->jresult;
+		*p_jresult = json_object_get(jresult);
+	}
+	io_workers_complete(panel->shell->io_workers, job);
+	return;
+}
+
+static int panel_post_command(panel_view_t * panel, struct trading_agency_command * cmd, struct io_job * job)
+{
+	assert(panel && panel->agent && cmd && job);
+	cmd->on_completed = on_command_completed;
+	cmd->user_data = job;
+	
+	int rc = trading_agency_post_command(panel->agent, cmd);
+	if(rc) {
+		show_info(panel->shell, "%s: %s", panel->agent->exchange_name, 
+			(rc == TRADING_AGENCY_ERROR_STOPPED)?"trading agency is stopping":"command queue is full");
+		job->free_job(job);
+	}
+	return rc;
+}
+
+static void apply_new_order(struct io_job * job)
+{
+	struct new_order_job * order = (struct new_order_job *)job;
+	panel_view_t * panel = job->user_data;
+	
+	if(job->rc) {
+		show_info(panel->shell, 
+			"btc_%s(rate=%s, amount=%.3f): ERROR, rc = %d", order->order_type, order->sz_rate, order->amount, job->rc);
+	}
+	if(order->jresult) {
+		show_info(panel->shell, 
+			"btc_%s(rate=%s, amount=%.3f): %s", order->order_type, order->sz_rate, order->amount,
+			json_object_to_json_string_ext(order->jresult, JSON_C_TO_STRING_SPACED)
+		);
+		update_balance(panel);
+		update_orders_history(panel);
+	}
+	return;
+}
+
+static int submit_new_order(panel_view_t * panel, const char * order_type, const char * sz_rate, double rate, double amount)
+{
+	struct new_order_job * order = (struct new_order_job *)io_job_new(sizeof(*order), NULL, 
+		NULL, apply_new_order, panel);
+	order->base->free_job = new_order_job_free;
+	
+	strncpy(order->order_type, order_type, sizeof(order->order_type) - 1);
+	strncpy(order->sz_rate, sz_rate, sizeof(order->sz_rate) - 1);
+	order->rate = rate;
+	order->amount = amount;
+	
+	struct trading_agency_command cmd = {
+		.type = trading_agency_command_type_new_order,
+		.pair = "btc_jpy",
+	};
+	strncpy(cmd.order.order_type, order_type, sizeof(cmd.order.order_type) - 1);
+	cmd.order.rate = rate;
+	cmd.order.amount = amount;
+	return panel_post_command(panel, &cmd, order->base);
+}
+
 static void coincheck_panel_btc_buy(GtkWidget * button, panel_view_t * panel)
 {
 	GtkWidget * entry = panel->btc_buy_rate;
@@ -110,29 +220,8 @@ static void coincheck_panel_btc_buy(GtkWidget * button, panel_view_t * panel)
 		return;
 	}
 	
-	///< @todo : update order history and unsettled order list
-	trading_agency_t * agent = panel->agent;
-	assert(agent);
-	
-	json_object * jresult = NULL;
-	int rc = coincheck_new_order(agent, 
-		"btc_jpy", "buy", 
-		rate, amount, &jresult);
-	if(rc) {
-		show_info(panel->shell, 
-			"%s(rate=%s, amount=%.3f): ERROR, rc = %d", __FUNCTION__, sz_rate, amount, rc);
-	}
-	if(jresult) {
-		show_info(panel->shell, 
-			"%s(rate=%s, amount=%.3f): %s", __FUNCTION__, sz_rate, amount,
-			json_object_to_json_string_ext(jresult, JSON_C_TO_STRING_SPACED)
-		);
-		json_object_put(jresult);
-		
-		update_balance(panel);
-		update_orders_history(panel);
-	}
-	
+	assert(panel->agent);
+	submit_new_order(panel, "buy", sz_rate, rate, amount);
 }
 static void coincheck_panel_btc_sell(GtkWidget * button, panel_view_t * panel)
 {
@@ -151,25 +240,8 @@ static void coincheck_panel_btc_sell(GtkWidget * button, panel_view_t * panel)
 		return;
 	}
 	
-	///< @todo : update order history and unsettled order list
-	trading_agency_t * agent = panel->agent;
-	json_object * jresult = NULL;
-	int rc = coincheck_new_order(agent, 
-		"btc_jpy", "sell", 
-		rate, amount, &jresult);
-	if(rc) {
-		show_info(panel->shell, 
-			"%s(rate=%s, amount=%.3f): ERROR, rc = %d", __FUNCTION__, sz_rate, amount, rc);
-	}
-	if(jresult) {
-		show_info(panel->shell, 
-			"%s(rate=%s, amount=%.3f): %s", rc, __FUNCTION__, sz_rate, amount,
-			json_object_to_json_string_ext(jresult, JSON_C_TO_STRING_SPACED)
-		);
-		json_object_put(jresult);
-		update_balance(panel);
-		update_orders_history(panel);
-	}
+	assert(panel->agent);
+	submit_new_order(panel, "sell", sz_rate, rate, amount);
 }
 
 static void coincheck_panel_buy_rate_changed(GtkEntry * entry, panel_view_t * panel)
@@ -282,6 +354,73 @@ static void coincheck_panel_sell_amount_changed(GtkSpinButton  * spin, panel_vie
 /**************************************
  * orders book
 ***************************************/
+/*
+ * the order book models read panel->asks_list / bids_list in place (array_model),
+ * price levels are matched by rate, only the levels whose amount changed are redrawn.
+ */
+static const void * get_order_book_row(const void * data, int index)
+{
+	return &((const struct order_book_data *)data)[index];
+}
+
+static void get_order_book_value(const void * row, int column, GValue * value)
+{
+	const struct order_book_data * level = row;
+	switch(column)
+	{
+	case ORDER_BOOK_COLUMN_rate: g_value_set_static_string(value, level->rate); break;
+	case ORDER_BOOK_COLUMN_amount: g_value_set_static_string(value, level->amount); break;
+	case ORDER_BOOK_COLUMN_scales: g_value_set_int(value, (int)level->scales); break;
+	default: break;
+	}
+}
+
+static int compare_asks(const void * a, const void * b)	// rate ASC
+{
+	const struct order_book_data * level_a = a;
+	const struct order_book_data * level_b = b;
+	if(level_a->d_rate < level_b->d_rate) return -1;
+	if(level_a->d_rate > level_b->d_rate) return 1;
+	return 0;
+}
+
+static int compare_bids(const void * a, const void * b)	// rate DESC
+{
+	return compare_asks(b, a);
+}
+
+static int order_book_levels_equal(const void * a, const void * b)
+{
+	const struct order_book_data * level_a = a;
+	const struct order_book_data * level_b = b;
+	return level_a->d_amount == level_b->d_amount 
+		&& (int)level_a->scales == (int)level_b->scales;
+}
+
+static const GType s_order_book_types[ORDER_BOOK_COLUMNS_COUNT] = {
+	[ORDER_BOOK_COLUMN_rate] = G_TYPE_STRING,
+	[ORDER_BOOK_COLUMN_amount] = G_TYPE_STRING,
+	[ORDER_BOOK_COLUMN_scales] = G_TYPE_INT,
+};
+
+static const struct array_model_spec s_asks_spec = {
+	.n_columns = ORDER_BOOK_COLUMNS_COUNT,
+	.column_types = s_order_book_types,
+	.get_row = get_order_book_row,
+	.get_value = get_order_book_value,
+	.compare_rows = compare_asks,
+	.rows_equal = order_book_levels_equal,
+};
+
+static const struct array_model_spec s_bids_spec = {
+	.n_columns = ORDER_BOOK_COLUMNS_COUNT,
+	.column_types = s_order_book_types,
+	.get_row = get_order_book_row,
+	.get_value = get_order_book_value,
+	.compare_rows = compare_bids,
+	.rows_equal = order_book_levels_equal,
+};
+
 static void on_ask_orders_selection_changed(GtkTreeSelection *selection, panel_view_t * panel)
 {
 	GtkTreeModel * model = NULL;
@@ -299,6 +438,8 @@ static void on_ask_orders_selection_changed(GtkTreeSelection *selection, panel_v
 	if(rate) gtk_entry_set_text(GTK_ENTRY(panel->btc_buy_rate), rate);
 	if(amount) gtk_spin_button_set_value(GTK_SPIN_BUTTON(panel->btc_buy_amount), (double)atof(amount));
 	coincheck_panel_buy_rate_changed(GTK_ENTRY(panel->btc_buy_rate), panel);
+	g_free(rate);
+	g_free(amount);
 }
 
 
@@ -319,12 +460,80 @@ static void on_bid_orders_selection_changed(GtkTreeSelection *selection, panel_v
 	if(rate) gtk_entry_set_text(GTK_ENTRY(panel->btc_sell_rate), rate);
 	if(amount) gtk_spin_button_set_value(GTK_SPIN_BUTTON(panel->btc_sell_amount), (double)atof(amount));
 	coincheck_panel_buy_rate_changed(GTK_ENTRY(panel->btc_sell_rate), panel);
+	g_free(rate);
+	g_free(amount);
 }
 
 /**************************************
  * tickers
 ***************************************/
-void draw_tickers(panel_view_t * panel);
+struct ticker_job
+{
+	struct io_job base[1];
+	struct coincheck_ticker ticker;
+};
+
+static int on_ticker(struct ticker_job * tjob, int rc, json_object * jticker)
+{
+	panel_view_t * panel = tjob->base->user_data;
+	if(0 == rc && jticker) {
+		rc = coincheck_ticker_parse(&tjob->ticker, jticker);
+	}else if(0 == rc) rc = -1;
+	
+	tick_store_t * store = app_context_get_tick_store(panel->shell->user_data);
+	if(0 == rc && store) {
+		const struct coincheck_ticker * ticker = &tjob->ticker;
+		struct tick_data tick = {
+			.timestamp = ticker->timestamp * 1000,	// coincheck: seconds
+			.last = ticker->last, .bid = ticker->bid, .ask = ticker->ask,
+			.high = ticker->high, .low = ticker->low, .volume = ticker->volume,
+		};
+		store->append(store, "btc_jpy", &tick);
+	}
+	
+	candle_engine_t * candles = app_context_get_candle_engine(panel->shell->user_data, "btc_jpy");
+	if(0 == rc && candles) {
+		candles->add_ticker(candles, tjob->ticker.timestamp * 1000, tjob->ticker.last);
+	}
+	
+	if(jticker) json_object_put(jticker);
+	return rc;
+}
+
+static int fetch_ticker(struct io_job * job)
+{
+	panel_view_t * panel = job->user_data;
+	json_object * jticker = NULL;
+	int rc = coincheck_public_get_ticker(panel->agent, &jticker);
+	return on_ticker((struct ticker_job *)job, rc, jticker);
+}
+
+static void on_ticker_response(trading_agency_t * agent, int rc, json_object * jticker, void * user_data)
+{
+	struct io_job * job = user_data;
+	io_job_fetched(job, on_ticker((struct ticker_job *)job, rc, jticker));
+	return;
+}
+
+// the agency's event loop: sent on its curl_multi handle
+static int fetch_ticker_async(struct io_job * job)
+{
+	panel_view_t * panel = job->user_data;
+	return coincheck_public_async_get_ticker(panel->agent, on_ticker_response, job);
+}
+
+static void apply_ticker(struct io_job * job)
+{
+	struct ticker_job * tjob = (struct ticker_job *)job;
+	panel_view_t * panel = job->user_data;
+	if(0 == job->rc) {
+		panel_ticker_append(panel->ticker_ctx, &tjob->ticker);
+		ui_scheduler_request(panel->ui, PANEL_UI_SLOT_ticker);
+	}
+	draw_charts_invalidate(panel, PANEL_CHART_SOURCE_tickers | PANEL_CHART_SOURCE_candles);
+	return;
+}
+
 static gboolean update_tickers(panel_view_t * panel)
 {
 	assert(panel && panel->shell);
@@ -332,40 +541,73 @@ static gboolean update_tickers(panel_view_t * panel)
 	if(shell->quit) return G_SOURCE_REMOVE;
 	if(!shell->action_state || !shell->is_running) return G_SOURCE_CONTINUE;
 	
-	struct panel_ticker_context * ctx = panel->ticker_ctx;
-	int rc = 0;
-	trading_agency_t * agent = panel->agent;
-	json_object * jtickers = NULL;
-	rc = coincheck_public_get_ticker(agent, &jtickers);
-	if(0 == rc && jtickers) {
-		panel_ticker_append(ctx, jtickers);
-	}
-	if(jtickers) json_object_put(jtickers);
-	
-	draw_tickers(panel);
+	struct io_job * job = io_job_new(sizeof(struct ticker_job), &panel->io_job_keys[PANEL_IO_JOB_ticker], 
+		fetch_ticker, apply_ticker, panel);
+	job->fetch_async = fetch_ticker_async;
+	panel_submit_job(panel, job);
 	return G_SOURCE_CONTINUE;
 }
 
 /**************************************
  * order history
 ***************************************/
+struct orders_history_job
+{
+	struct io_job base[1];
+	struct order_history history[1];
+};
+
+static void orders_history_job_free(struct io_job * job)
+{
+	struct orders_history_job * hjob = (struct orders_history_job *)job;
+	order_history_cleanup(hjob->history);
+	free(hjob);
+	return;
+}
+
+static int fetch_orders_history(struct io_job * job)
+{
+	struct orders_history_job * hjob = (struct orders_history_job *)job;
+	panel_view_t * panel = job->user_data;
+	struct order_history * history = hjob->history;
+	
+	return history->get_orders(history, panel->agent);
+}
+
+static void apply_orders_history(struct io_job * job)
+{
+	struct orders_history_job * hjob = (struct orders_history_job *)job;
+	panel_view_t * panel = job->user_data;
+	if(job->rc) return;
+	
+	// shown on the next frame (present_orders_history), 
+	// a previous history not shown yet is released by orders_history_job_free()
+	struct order_history pending = *panel->pending_orders;
+	*panel->pending_orders = *hjob->history;
+	*hjob->history = pending;
+	ui_scheduler_request(panel->ui, PANEL_UI_SLOT_orders_history);
+	return;
+}
+
 static gboolean update_orders_history(panel_view_t * panel)
 {
 	assert(panel && panel->shell);
 	shell_context_t * shell = panel->shell;
 	if(shell->quit) return G_SOURCE_REMOVE;
 	
-	struct order_history * history = panel->orders;
-	int rc = history->get_orders(history, panel->agent);
-	if(rc) return G_SOURCE_CONTINUE;
+	struct orders_history_job * hjob = (struct orders_history_job *)io_job_new(sizeof(*hjob), 
+		&panel->io_job_keys[PANEL_IO_JOB_orders_history], 
+		fetch_orders_history, apply_orders_history, panel);
+	hjob->base->free_job = orders_history_job_free;
+	order_history_init(hjob->history);
 	
-	order_history_update(history, GTK_TREE_VIEW(panel->orders_tree), GTK_TREE_VIEW(panel->unsettled_tree));
+	panel_submit_job(panel, hjob->base);
 	return G_SOURCE_CONTINUE;
 }
 
 static gboolean on_panel_view_da_draw(GtkWidget * da, cairo_t * cr, panel_view_t * panel)
 {
-	static int margin = 10;
+	static int margin = PANEL_CHART_MARGIN;
 	int width = gtk_widget_get_allocated_width(da);
 	int height = gtk_widget_get_allocated_height(da);
 	
@@ -392,41 +634,124 @@ static gboolean on_panel_view_da_draw(GtkWidget * da, cairo_t * cr, panel_view_t
 	cairo_set_source_surface(cr, surface, margin, margin);
 	cairo_paint(cr);
 	
+	cairo_translate(cr, margin, margin);
+	draw_charts_overlay(panel, cr);
 	return FALSE;
 }
 
-static void update_balance(panel_view_t * panel)
+// click: next chart mode (line -> candles -> depth)
+static gboolean on_panel_view_da_button_press(GtkWidget * da, GdkEventButton * event, panel_view_t * panel)
+{
+	if(event->type != GDK_BUTTON_PRESS || event->button != 1) return FALSE;
+	draw_charts_set_mode(panel, (panel->chart_ctx.state->mode + 1) % panel_chart_modes_count);
+	return TRUE;
+}
+
+// wheel: zoom out (down) / in (up) by powers of 2, from 1 hour to 30 days,
+// candles mode: next / previous resolution
+#define PANEL_CHART_MIN_SPAN (3600 * 1000)
+#define PANEL_CHART_MAX_SPAN ((int64_t)30 * 86400 * 1000)
+static gboolean on_panel_view_da_scroll(GtkWidget * da, GdkEventScroll * event, panel_view_t * panel)
+{
+	const struct panel_chart_state * state = panel->chart_ctx.state;
+	if(state->mode == panel_chart_mode_candles) {
+		int resolution = state->resolution;
+		if(event->direction == GDK_SCROLL_DOWN && resolution + 1 < CANDLE_RESOLUTIONS_COUNT) ++resolution;
+		else if(event->direction == GDK_SCROLL_UP && resolution > 0) --resolution;
+		else return FALSE;
+		draw_charts_set_resolution(panel, resolution);
+		return TRUE;
+	}
+	if(state->mode != panel_chart_mode_line) return FALSE;
+	
+	int64_t span = state->span_ms;
+	switch(event->direction)
+	{
+	case GDK_SCROLL_DOWN:
+		span = (span > 0)?(span * 2):PANEL_CHART_MIN_SPAN;
+		if(span > PANEL_CHART_MAX_SPAN) span = PANEL_CHART_MAX_SPAN;
+		break;
+	case GDK_SCROLL_UP:
+		span /= 2;
+		if(span < PANEL_CHART_MIN_SPAN) span = 0;
+		break;
+	default:
+		return FALSE;
+	}
+	draw_tickers_set_span(panel, span);
+	return TRUE;
+}
+
+/**************************************
+ * balance
+***************************************/
+struct balance_job
 {
+	struct io_job base[1];
+	char btc[100];
+	char jpy[100];
+	char btc_reserved[100];
+	char jpy_reserved[100];
+};
+
+static int fetch_balance(struct io_job * job)
+{
+	struct balance_job * bjob = (struct balance_job *)job;
+	panel_view_t * panel = job->user_data;
 	assert(panel && panel->agent);
+	
 	json_object * jbalance = NULL;
 	int rc = 0;
 	rc = coincheck_account_get_balance(panel->agent, &jbalance);
-	if(NULL == jbalance) return;
-	assert(0 == rc);
-	
-	GtkEntry * btc_balance = GTK_ENTRY(panel->btc_balance);
-	GtkEntry * btc_in_use = GTK_ENTRY(panel->btc_in_use);
-	GtkEntry * jpy_balance = GTK_ENTRY(panel->jpy_balance);
-	GtkEntry * jpy_in_use = GTK_ENTRY(panel->jpy_in_use);
+	if(NULL == jbalance) return rc?rc:-1;
 	
 	json_object * jstatus = NULL;
 	json_bool ok = json_object_object_get_ex(jbalance, "success", &jstatus);
 	if(!ok || !jstatus || ! json_object_get_boolean(jstatus)) {
 		json_object_put(jbalance);
-		return;
+		return -1;
 	}
 	
-	const char * btc = json_get_value_default(jbalance, string, btc, "");
-	const char * jpy = json_get_value_default(jbalance, string, jpy, "");
-	const char * btc_reserved = json_get_value_default(jbalance, string, btc_reserved, "");
-	const char * jpy_reserved = json_get_value_default(jbalance, string, jpy_reserved, "");
-	
-	gtk_entry_set_text(btc_balance, btc);
-	gtk_entry_set_text(btc_in_use, btc_reserved);
-	gtk_entry_set_text(jpy_balance, jpy);
-	gtk_entry_set_text(jpy_in_use, jpy_reserved);
+#define copy_value(key) strncpy(bjob->key, json_get_value_default(jbalance, string, key, ""), sizeof(bjob->key) - 1)
+	copy_value(btc);
+	copy_value(jpy);
+	copy_value(btc_reserved);
+	copy_value(jpy_reserved);
+#undef copy_value
 	
 	json_object_put(jbalance);
+	return 0;
+}
+
+static void show_balance(panel_view_t * panel)
+{
+	gtk_entry_set_text(GTK_ENTRY(panel->btc_balance), panel->balance.btc);
+	gtk_entry_set_text(GTK_ENTRY(panel->btc_in_use), panel->balance.btc_reserved);
+	gtk_entry_set_text(GTK_ENTRY(panel->jpy_balance), panel->balance.jpy);
+	gtk_entry_set_text(GTK_ENTRY(panel->jpy_in_use), panel->balance.jpy_reserved);
+	return;
+}
+
+static void apply_balance(struct io_job * job)
+{
+	struct balance_job * bjob = (struct balance_job *)job;
+	panel_view_t * panel = job->user_data;
+	if(job->rc) return;
+	
+	memcpy(panel->balance.btc, bjob->btc, sizeof(panel->balance.btc));
+	memcpy(panel->balance.jpy, bjob->jpy, sizeof(panel->balance.jpy));
+	memcpy(panel->balance.btc_reserved, bjob->btc_reserved, sizeof(panel->balance.btc_reserved));
+	memcpy(panel->balance.jpy_reserved, bjob->jpy_reserved, sizeof(panel->balance.jpy_reserved));
+	ui_scheduler_request(panel->ui, PANEL_UI_SLOT_balance);
+	return;
+}
+
+static void update_balance(panel_view_t * panel)
+{
+	assert(panel && panel->agent);
+	struct io_job * job = io_job_new(sizeof(struct balance_job), &panel->io_job_keys[PANEL_IO_JOB_balance], 
+		fetch_balance, apply_balance, panel);
+	panel_submit_job(panel, job);
 	return;
 }
 
@@ -434,19 +759,49 @@ static void update_balance(panel_view_t * panel)
 /****************************************************
  * order book
 ***************************************************/
-static void update_orders(panel_view_t * panel, json_object * jorders)
+struct order_book_job
+{
+	struct io_job base[1];
+	json_object * jorders;	// owns the strings referenced by asks_list / bids_list
+	int num_asks;
+	int num_bids;
+	struct order_book_data * asks_list;
+	struct order_book_data * bids_list;
+};
+
+static void order_book_job_clear(struct order_book_job * ojob)
+{
+	free(ojob->asks_list);
+	free(ojob->bids_list);
+	if(ojob->jorders) json_object_put(ojob->jorders);
+	ojob->asks_list = NULL;
+	ojob->bids_list = NULL;
+	ojob->jorders = NULL;
+	ojob->num_asks = ojob->num_bids = 0;
+	return;
+}
+
+static void order_book_job_free(struct io_job * job)
 {
-	if(NULL == jorders) return;
+	struct order_book_job * ojob = (struct order_book_job *)job;
+	order_book_job_clear(ojob);
+	free(ojob);
+	return;
+}
+
+static int parse_orders(struct order_book_job * ojob, json_object * jorders)
+{
+	if(NULL == jorders) return -1;
 	
 	//~ fprintf(stderr, "order_book: %s\n", json_object_to_json_string_ext(jorders, JSON_C_TO_STRING_SPACED));
 	json_object * jasks = NULL;
 	json_object * jbids = NULL;
 	json_bool ok = 0;
 	ok = json_object_object_get_ex(jorders, "asks", &jasks);
-	assert(ok && jasks);
+	if(!ok || NULL == jasks) return -1;
 	
 	ok = json_object_object_get_ex(jorders, "bids", &jbids);
-	assert(ok && jbids);
+	if(!ok || NULL == jbids) return -1;
 	
 	int num_asks = json_object_array_length(jasks);
 	int num_bids = json_object_array_length(jbids);
@@ -466,6 +821,7 @@ static void update_orders(panel_view_t * panel, json_object * jorders)
 			assert(jask);
 			asks_list[i].rate = json_object_get_string(json_object_array_get_idx(jask, 0));
 			asks_list[i].amount = json_object_get_string(json_object_array_get_idx(jask, 1));
+			asks_list[i].d_rate = atof(asks_list[i].rate);
 			asks_list[i].d_amount = atof(asks_list[i].amount);
 			if(asks_list[i].d_amount > max_amount) max_amount = asks_list[i].d_amount;
 		}
@@ -481,6 +837,7 @@ static void update_orders(panel_view_t * panel, json_object * jorders)
 			assert(jbid);
 			bids_list[i].rate = json_object_get_string(json_object_array_get_idx(jbid, 0));
 			bids_list[i].amount = json_object_get_string(json_object_array_get_idx(jbid, 1));
+			bids_list[i].d_rate = atof(bids_list[i].rate);
 			bids_list[i].d_amount = atof(bids_list[i].amount);
 			if(bids_list[i].d_amount > max_amount) max_amount = bids_list[i].d_amount;
 		}
@@ -497,63 +854,116 @@ static void update_orders(panel_view_t * panel, json_object * jorders)
 		}
 	}
 	
-	GtkListStore * asks_store = gtk_list_store_new(ORDER_BOOK_COLUMNS_COUNT, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_DOUBLE);
-	GtkTreeIter iter_asks;
-	for(int i = 0; i < num_asks; ++i) {
-		gtk_list_store_append(asks_store, &iter_asks);
-		gtk_list_store_set(asks_store, &iter_asks,
-			ORDER_BOOK_COLUMN_rate,   asks_list[i].rate,
-			ORDER_BOOK_COLUMN_amount, asks_list[i].amount,
-			ORDER_BOOK_COLUMN_scales, asks_list[i].scales,
-			-1);
-	}
-	
-	GtkListStore * bids_store = gtk_list_store_new(ORDER_BOOK_COLUMNS_COUNT, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_DOUBLE);
-	GtkTreeIter iter_bids;
-	for(int i = 0; i < num_bids; ++i) {
-		gtk_list_store_append(bids_store, &iter_bids);
-		gtk_list_store_set(bids_store, &iter_bids,
-			ORDER_BOOK_COLUMN_rate,   bids_list[i].rate,
-			ORDER_BOOK_COLUMN_amount, bids_list[i].amount,
-			ORDER_BOOK_COLUMN_scales, bids_list[i].scales,
-			-1);
-	}
-	
+	ojob->num_asks = num_asks;
+	ojob->asks_list = asks_list;
+	ojob->num_bids = num_bids;
+	ojob->bids_list = bids_list;
+	return 0;
+}
+
+static void update_orders(panel_view_t * panel, struct order_book_job * ojob)
+{
+	// the models read the lists in place: 
+	// diff against the new lists while the previous ones are still alive, release them afterwards.
 	pthread_mutex_lock(&panel->mutex);
-	if(panel->asks_list) free(panel->asks_list);
-	if(panel->bids_list) free(panel->bids_list);
-	panel->num_asks = num_asks;
-	panel->asks_list = asks_list;
-	panel->num_bids = num_bids;
-	panel->bids_list = bids_list;
-	
-	gtk_tree_view_set_model(GTK_TREE_VIEW(panel->ask_orders), GTK_TREE_MODEL(asks_store));
-	gtk_tree_view_set_model(GTK_TREE_VIEW(panel->bid_orders), GTK_TREE_MODEL(bids_store));
+	struct order_book_data * old_asks = panel->asks_list;
+	struct order_book_data * old_bids = panel->bids_list;
+	json_object * old_jorder_book = panel->jorder_book;
+	
+	// take over the parsed lists (and the json object they point into)
+	panel->num_asks = ojob->num_asks;
+	panel->asks_list = ojob->asks_list;
+	panel->num_bids = ojob->num_bids;
+	panel->bids_list = ojob->bids_list;
+	panel->jorder_book = ojob->jorders;
+	ojob->asks_list = NULL;
+	ojob->bids_list = NULL;
+	ojob->jorders = NULL;
+	
+	array_model_set_data(ARRAY_MODEL(gtk_tree_view_get_model(GTK_TREE_VIEW(panel->ask_orders))), 
+		panel->asks_list, panel->num_asks, NULL);
+	array_model_set_data(ARRAY_MODEL(gtk_tree_view_get_model(GTK_TREE_VIEW(panel->bid_orders))), 
+		panel->bids_list, panel->num_bids, NULL);
 	pthread_mutex_unlock(&panel->mutex);
 	
-	g_object_unref(asks_store);
-	g_object_unref(bids_store);
+	free(old_asks);
+	free(old_bids);
+	if(old_jorder_book) json_object_put(old_jorder_book);
 	
+	draw_charts_invalidate(panel, PANEL_CHART_SOURCE_order_book);
 }
-int update_order_book(panel_view_t * panel)
+
+static int fetch_order_book(struct io_job * job)
 {
+	struct order_book_job * ojob = (struct order_book_job *)job;
+	panel_view_t * panel = job->user_data;
 	trading_agency_t * agent = panel->agent;
 	assert(agent);
 	
-	json_object * jorders = NULL;
 	int rc = 0;
-	rc = coincheck_public_get_order_book(agent, &jorders);
+	rc = coincheck_public_get_order_book(agent, &ojob->jorders);
 	if(rc) return -1;
 	
-	update_orders(panel, jorders);
+	return parse_orders(ojob, ojob->jorders);
+}
 
-	json_object_put(jorders);
-	return 0;
+static void on_order_book_response(trading_agency_t * agent, int rc, json_object * jorders, void * user_data)
+{
+	struct order_book_job * ojob = user_data;
+	ojob->jorders = jorders;
+	io_job_fetched(ojob->base, rc?-1:parse_orders(ojob, jorders));
+	return;
+}
+
+// the agency's event loop: sent on its curl_multi handle
+static int fetch_order_book_async(struct io_job * job)
+{
+	panel_view_t * panel = job->user_data;
+	return coincheck_public_async_get_order_book(panel->agent, on_order_book_response, job);
+}
+
+static void apply_order_book(struct io_job * job)
+{
+	struct order_book_job * ojob = (struct order_book_job *)job;
+	panel_view_t * panel = job->user_data;
+	if(job->rc) return;
+	
+	// take over the parsed lists, shown on the next frame (present_order_book)
+	struct order_book_job * pending = panel->pending_order_book;
+	if(NULL == pending) {
+		pending = calloc(1, sizeof(*pending));
+		assert(pending);
+		panel->pending_order_book = pending;
+	}
+	order_book_job_clear(pending);	// not shown yet: superseded
+	pending->num_asks = ojob->num_asks;
+	pending->asks_list = ojob->asks_list;
+	pending->num_bids = ojob->num_bids;
+	pending->bids_list = ojob->bids_list;
+	pending->jorders = ojob->jorders;
+	ojob->asks_list = NULL;
+	ojob->bids_list = NULL;
+	ojob->jorders = NULL;
+	
+	ui_scheduler_request(panel->ui, PANEL_UI_SLOT_order_book);
+	return;
+}
+
+int update_order_book(panel_view_t * panel)
+{
+	assert(panel && panel->agent);
+	struct order_book_job * ojob = (struct order_book_job *)io_job_new(sizeof(*ojob), 
+		&panel->io_job_keys[PANEL_IO_JOB_order_book], 
+		fetch_order_book, apply_order_book, panel);
+	ojob->base->fetch_async = fetch_order_book_async;
+	ojob->base->free_job = order_book_job_free;
+	return panel_submit_job(panel, ojob->base);
 }
 
 /*****************************************************
  * background tasks 
  * ( on_timeout callbacks <== g_timeout_add)
+ *   only queue io_jobs, the requests are sent by the io_workers
 ***************************************************/
 gboolean coincheck_check_banlance(shell_context_t * shell)
 {
@@ -563,9 +973,7 @@ gboolean coincheck_check_banlance(shell_context_t * shell)
 	panel_view_t * panel = shell_get_main_panel(shell, "coincheck");
 	if(!panel->agent) return G_SOURCE_CONTINUE;
 	
-	auto_lock();
 	update_balance(panel);
-	
 	return G_SOURCE_CONTINUE;
 }
 
@@ -576,7 +984,6 @@ gboolean coincheck_update_order_book(shell_context_t * shell)
 	
 	panel_view_t * coincheck_panel = shell_get_main_panel(shell, "coincheck");
 	
-	auto_lock();
 	update_order_book(coincheck_panel);
 	return G_SOURCE_CONTINUE;
 }
@@ -585,59 +992,30 @@ gboolean coincheck_update_order_book(shell_context_t * shell)
  * panel::tickers
 *********************************/
 #define PANEL_TICKER_MAX_HISTORY_SIZE (1000000)
-struct panel_ticker_context * panel_ticker_context_init(struct panel_ticker_context * ctx, size_t max_history_size)
+struct panel_ticker_context * panel_ticker_context_init(struct panel_ticker_context * ctx, const char * history_file, size_t max_history_size)
 {
 	if(NULL == ctx) ctx = calloc(1, sizeof(*ctx));
 	if(max_history_size <= 0) max_history_size = PANEL_TICKER_MAX_HISTORY_SIZE;
 	
-	struct coincheck_ticker * history = calloc(max_history_size, sizeof(*history));
+	ticker_history_t * history = ticker_history_init(ctx->history, history_file, max_history_size);
+	if(NULL == history && history_file) {
+		fprintf(stderr, "[WARNING]: open '%s' failed, the ticker history will not be saved.\n", history_file);
+		history = ticker_history_init(ctx->history, NULL, max_history_size);
+	}
 	assert(history);
-	
-	ctx->tickers_history = history;
-	ctx->history_size = max_history_size;
 	return ctx;
 }
 void panel_ticker_context_cleanup(struct panel_ticker_context * ctx)
 {
 	if(NULL == ctx) return;
-	if(ctx->tickers_history) {
-		free(ctx->tickers_history);
-		ctx->tickers_history = NULL;
-	}
-	ctx->history_size = 0;
-	ctx->start_pos = 0;
-	ctx->length = 0;
+	ticker_history_cleanup(ctx->history);
 	return;
 }
 
-ssize_t panel_ticker_get_lastest_history(struct panel_ticker_context * ctx, size_t count, struct coincheck_ticker ** p_tickers)
+ssize_t panel_ticker_get_lastest_history(struct panel_ticker_context * ctx, size_t count, struct ticker_history_view * view)
 {
-	if(NULL == ctx->tickers_history || ctx->history_size == 0) return -1;
-	if(count == 0 || count > ctx->length) count = ctx->length;
-	if(count == 0) return 0;
-	if(NULL == p_tickers) return (ssize_t)count;
-	
-	size_t start_pos = ctx->start_pos + ctx->length - count;
-	size_t end_pos = start_pos + count;
-	if(end_pos > ctx->history_size) end_pos -= ctx->history_size;
-	
-	struct coincheck_ticker * tickers = *p_tickers;
-	if(NULL == tickers) {
-		tickers = malloc(count * sizeof(*tickers));
-		assert(tickers);
-		*p_tickers = tickers;
-	}
-	
-	if(end_pos > start_pos) {
-		memcpy(tickers, ctx->tickers_history + start_pos, sizeof(*tickers) * count);
-	}else {
-		size_t partial_length = ctx->history_size - start_pos;
-		assert(partial_length > 0 && end_pos > 0);
-		
-		memcpy(tickers, ctx->tickers_history + start_pos, sizeof(*tickers) * partial_length);
-		memcpy(tickers + partial_length, ctx->tickers_history,  sizeof(*tickers) * end_pos);
-	}
-	return (ssize_t)count;
+	if(NULL == ctx->history->priv) return -1;
+	return ticker_history_get_latest(ctx->history, count, view);
 }
 
 int panel_ticker_load_from_builder(struct panel_ticker_context * ctx, GtkBuilder * builder)
@@ -654,32 +1032,37 @@ int panel_ticker_load_from_builder(struct panel_ticker_context * ctx, GtkBuilder
 	return 0;
 }
 
-static int ticker_history_append(struct panel_ticker_context * ctx, const struct coincheck_ticker * ticker)
+int coincheck_ticker_parse(struct coincheck_ticker * ticker, json_object * jticker)
 {
-	assert(ctx->tickers_history && ctx->history_size > 0);
-	size_t cur_pos = ctx->start_pos + ctx->length;
-	cur_pos %= ctx->history_size;
-	
-	ctx->tickers_history[cur_pos] = *ticker;
-	
-	if(ctx->length < ctx->history_size) {
-		++ctx->length;
-	}else {
-		++ctx->start_pos;
-		if(ctx->start_pos == ctx->history_size) ctx->start_pos = 0;
-	}
+	assert(ticker && jticker);
+	memset(ticker, 0, sizeof(*ticker));
+	
+	ticker->last = json_get_value(jticker, double, last);
+	ticker->ask = json_get_value(jticker, double, ask);
+	ticker->bid = json_get_value(jticker, double, bid);
+	ticker->high = json_get_value(jticker, double, high);
+	ticker->low = json_get_value(jticker, double, low);
+	ticker->volume = json_get_value(jticker, double, volume);
+	ticker->timestamp = json_get_value(jticker, int, timestamp);
 	return 0;
 }
 
-int panel_ticker_append(struct panel_ticker_context * ctx, json_object * jticker)
+int panel_ticker_set_current(struct panel_ticker_context * ctx, const struct coincheck_ticker * ticker)
 {
-	assert(ctx && jticker);
-	struct coincheck_ticker ticker = { 0 };
+	assert(ctx && ticker);
+	ctx->current = *ticker;
+	panel_ticker_show(ctx);
+	return 0;
+}
+
+void panel_ticker_show(struct panel_ticker_context * ctx)
+{
+	assert(ctx);
+	const struct coincheck_ticker * ticker = &ctx->current;
 	
 	char sz_val[100] = "";
 #define set_entry(key) do { \
-		ticker.key = json_get_value(jticker, double, key); \
-		snprintf(sz_val, sizeof(sz_val), "%s: %.2f", #key, ticker.key); \
+		snprintf(sz_val, sizeof(sz_val), "%s: %.2f", #key, ticker->key); \
 		gtk_entry_set_text(GTK_ENTRY(ctx->widget.key), sz_val); \
 	} while(0)
 	
@@ -690,21 +1073,334 @@ int panel_ticker_append(struct panel_ticker_context * ctx, json_object * jticker
 	set_entry(low);
 	set_entry(volume);
 #undef set_entry
+	return;
+}
 
-	ctx->current = ticker;
-	ticker_history_append(ctx, &ticker);
+int panel_ticker_append(struct panel_ticker_context * ctx, const struct coincheck_ticker * ticker)
+{
+	assert(ctx && ticker);
+	ctx->current = *ticker;
+	
+	struct ticker_history_record record = {
+		.timestamp = ticker->timestamp * 1000,	// coincheck: seconds
+		.last = ticker->last, .bid = ticker->bid, .ask = ticker->ask,
+		.high = ticker->high, .low = ticker->low, .volume = ticker->volume,
+	};
+	ticker_history_append(ctx->history, &record);
 	return 0;
 }
 
 
 
 
+/*********************************
+ * panel::snapshot (warm start)
+*********************************/
+#define PANEL_STALE_OPACITY (0.5)
+
+void panel_view_set_stale(panel_view_t * panel, unsigned int sections, gboolean stale)
+{
+	assert(panel);
+	double opacity = stale?PANEL_STALE_OPACITY:1.0;
+	
+	GtkWidget * ticker_widgets[] = { 
+		panel->ticker_ctx->widget.last, panel->ticker_ctx->widget.bid, panel->ticker_ctx->widget.ask,
+		panel->ticker_ctx->widget.high, panel->ticker_ctx->widget.low, panel->ticker_ctx->widget.volume,
+	};
+	GtkWidget * balance_widgets[] = { panel->btc_balance, panel->btc_in_use, panel->jpy_balance, panel->jpy_in_use };
+	GtkWidget * order_book_widgets[] = { panel->ask_orders, panel->bid_orders };
+	GtkWidget * orders_widgets[] = { panel->orders_tree, panel->unsettled_tree };
+	
+#define set_opacity(section, widgets) do { \
+		if(!(sections & section)) break; \
+		for(size_t i = 0; i < sizeof(widgets) / sizeof(widgets[0]); ++i) { \
+			if(widgets[i]) gtk_widget_set_opacity(widgets[i], opacity); \
+		} \
+	} while(0)
+	
+	set_opacity(PANEL_SNAPSHOT_SECTION_ticker, ticker_widgets);
+	set_opacity(PANEL_SNAPSHOT_SECTION_balance, balance_widgets);
+	set_opacity(PANEL_SNAPSHOT_SECTION_order_book, order_book_widgets);
+	set_opacity(PANEL_SNAPSHOT_SECTION_orders, orders_widgets);
+#undef set_opacity
+	
+	if(stale) panel->stale_sections |= sections;
+	else panel->stale_sections &= ~sections;
+	return;
+}
+
+static void panel_mark_fresh(panel_view_t * panel, unsigned int section)
+{
+	panel->valid_sections |= section;
+	if(panel->stale_sections & section) panel_view_set_stale(panel, section, FALSE);
+	return;
+}
+
+static void restore_order_book(panel_view_t * panel, const struct panel_snapshot * snapshot)
+{
+	json_object * jorder_book = json_object_new_object();
+	json_object * jasks = json_object_new_array();
+	json_object * jbids = json_object_new_array();
+	
+#define add_levels(jlevels, levels, count) for(int i = 0; i < count; ++i) { \
+		json_object * jlevel = json_object_new_array(); \
+		json_object_array_add(jlevel, json_object_new_string(levels[i].rate)); \
+		json_object_array_add(jlevel, json_object_new_string(levels[i].amount)); \
+		json_object_array_add(jlevels, jlevel); \
+	}
+	add_levels(jasks, snapshot->asks, snapshot->num_asks);
+	add_levels(jbids, snapshot->bids, snapshot->num_bids);
+#undef add_levels
+	json_object_object_add(jorder_book, "asks", jasks);
+	json_object_object_add(jorder_book, "bids", jbids);
+	
+	// same path as a fetched order book, update_orders() takes over the json object
+	struct order_book_job ojob[1];
+	memset(ojob, 0, sizeof(ojob));
+	ojob->jorders = jorder_book;
+	if(0 == parse_orders(ojob, jorder_book)) update_orders(panel, ojob);
+	order_book_job_clear(ojob);
+	return;
+}
+
+int panel_view_restore_snapshot(panel_view_t * panel)
+{
+	assert(panel);
+	if(!panel->snapshot_file[0]) return -1;
+	
+	app_timer_t timer[1];
+	app_timer_start(timer);
+	
+	struct panel_snapshot snapshot[1];
+	int rc = panel_snapshot_load(snapshot, panel->snapshot_file);
+	if(rc) return rc;
+	
+	unsigned int sections = snapshot->sections;
+	if(sections & PANEL_SNAPSHOT_SECTION_ticker) {
+		struct coincheck_ticker ticker = {
+			.last = snapshot->ticker.last, .bid = snapshot->ticker.bid, .ask = snapshot->ticker.ask,
+			.high = snapshot->ticker.high, .low = snapshot->ticker.low, .volume = snapshot->ticker.volume,
+			.timestamp = snapshot->ticker.timestamp,
+		};
+		panel_ticker_set_current(panel->ticker_ctx, &ticker);
+	}
+	
+	if(sections & PANEL_SNAPSHOT_SECTION_balance) {
+		strncpy(panel->balance.btc, snapshot->balance.btc, sizeof(panel->balance.btc) - 1);
+		strncpy(panel->balance.jpy, snapshot->balance.jpy, sizeof(panel->balance.jpy) - 1);
+		strncpy(panel->balance.btc_reserved, snapshot->balance.btc_reserved, sizeof(panel->balance.btc_reserved) - 1);
+		strncpy(panel->balance.jpy_reserved, snapshot->balance.jpy_reserved, sizeof(panel->balance.jpy_reserved) - 1);
+		show_balance(panel);
+	}
+	
+	if(sections & PANEL_SNAPSHOT_SECTION_order_book) restore_order_book(panel, snapshot);
+	
+	if(sections & PANEL_SNAPSHOT_SECTION_orders) {
+		// the models still read panel->orders: switch them to the restored lists first
+		struct order_history restored[1];
+		order_history_init(restored);
+		order_history_load_json(restored, snapshot->jorders, snapshot->junsettled_orders);
+		order_history_update(restored, GTK_TREE_VIEW(panel->orders_tree), GTK_TREE_VIEW(panel->unsettled_tree));
+		
+		struct order_history old_history = *panel->orders;
+		*panel->orders = *restored;
+		*restored = old_history;
+		order_history_cleanup(restored);
+	}
+	
+	panel->valid_sections |= sections;
+	panel_view_set_stale(panel, sections, TRUE);
+	
+	double elapsed = app_timer_stop(timer);
+	fprintf(stderr, "restored '%s' (sections: 0x%x, saved_at: %ld) in %.3f ms\n", 
+		panel->snapshot_file, sections, (long)(snapshot->saved_at / 1000), elapsed * 1000.0);
+	
+	panel_snapshot_cleanup(snapshot);
+	return 0;
+}
+
+// (GTK main thread)
+static int serialize_panel(panel_view_t * panel, auto_buffer_t * buf)
+{
+	struct timespec ts[1];
+	clock_gettime(CLOCK_REALTIME, ts);
+	
+	const struct coincheck_ticker * ticker = &panel->ticker_ctx->current;
+	struct panel_snapshot snapshot = {
+		.saved_at = (int64_t)ts->tv_sec * 1000 + ts->tv_nsec / 1000000,
+		.sections = panel->valid_sections,
+		.ticker = {
+			.last = ticker->last, .bid = ticker->bid, .ask = ticker->ask,
+			.high = ticker->high, .low = ticker->low, .volume = ticker->volume,
+			.timestamp = ticker->timestamp,
+		},
+		.balance = {
+			.btc = panel->balance.btc, .jpy = panel->balance.jpy, 
+			.btc_reserved = panel->balance.btc_reserved, .jpy_reserved = panel->balance.jpy_reserved,
+		},
+		.jorders = panel->orders->jorders,
+		.junsettled_orders = panel->orders->junsettled_orders,
+	};
+	
+	pthread_mutex_lock(&panel->mutex);
+	struct panel_snapshot_level * levels = NULL;
+	int num_levels = panel->num_asks + panel->num_bids;
+	if(num_levels > 0) {
+		levels = calloc(num_levels, sizeof(*levels));
+		assert(levels);
+		for(int i = 0; i < panel->num_asks; ++i) {
+			levels[i].rate = panel->asks_list[i].rate;
+			levels[i].amount = panel->asks_list[i].amount;
+		}
+		for(int i = 0; i < panel->num_bids; ++i) {
+			levels[panel->num_asks + i].rate = panel->bids_list[i].rate;
+			levels[panel->num_asks + i].amount = panel->bids_list[i].amount;
+		}
+	}
+	snapshot.num_asks = panel->num_asks;
+	snapshot.asks = levels;
+	snapshot.num_bids = panel->num_bids;
+	snapshot.bids = levels?(levels + panel->num_asks):NULL;
+	
+	int rc = panel_snapshot_serialize(&snapshot, buf);
+	pthread_mutex_unlock(&panel->mutex);
+	
+	free(levels);
+	return rc;
+}
+
+struct snapshot_job
+{
+	struct io_job base[1];
+	char path[PATH_MAX];
+	auto_buffer_t buf[1];
+};
+
+static void snapshot_job_free(struct io_job * job)
+{
+	struct snapshot_job * sjob = (struct snapshot_job *)job;
+	auto_buffer_cleanup(sjob->buf);
+	free(sjob);
+	return;
+}
+
+static int write_snapshot(struct io_job * job)
+{
+	struct snapshot_job * sjob = (struct snapshot_job *)job;
+	return panel_snapshot_save(sjob->path, sjob->buf->data + sjob->buf->start_pos, sjob->buf->length);
+}
+
+int panel_view_save_snapshot(panel_view_t * panel, int async)
+{
+	assert(panel && panel->shell);
+	if(!async) ui_scheduler_flush(panel->ui);	// (shutdown) include the updates not shown yet
+	if(!panel->snapshot_file[0] || 0 == panel->valid_sections) return -1;
+	
+	int rc = 0;
+	if(!async) {
+		auto_buffer_t buf[1];
+		auto_buffer_init(buf, 0);
+		rc = serialize_panel(panel, buf);
+		if(0 == rc) rc = panel_snapshot_save(panel->snapshot_file, buf->data + buf->start_pos, buf->length);
+		auto_buffer_cleanup(buf);
+		return rc;
+	}
+	
+	io_workers_context_t * io = panel->shell->io_workers;
+	if(NULL == io) return -1;
+	
+	// serialize here (the panel data belongs to the GTK thread), write on an io_worker
+	struct snapshot_job * sjob = (struct snapshot_job *)io_job_new(sizeof(*sjob), 
+		&panel->io_job_keys[PANEL_IO_JOB_snapshot], 
+		write_snapshot, NULL, panel);
+	sjob->base->free_job = snapshot_job_free;
+	strncpy(sjob->path, panel->snapshot_file, sizeof(sjob->path) - 1);
+	auto_buffer_init(sjob->buf, 0);
+	
+	rc = serialize_panel(panel, sjob->buf);
+	if(rc) {
+		snapshot_job_free(sjob->base);
+		return rc;
+	}
+	return io->submit(io, sjob->base);	// no agent: local file I/O stays off the agency's event loop
+}
+
+static gboolean save_snapshot(panel_view_t * panel)
+{
+	shell_context_t * shell = panel->shell;
+	if(shell->quit) return G_SOURCE_REMOVE;
+	if(!shell->is_running) return G_SOURCE_CONTINUE;
+	
+	panel_view_save_snapshot(panel, 1);
+	return G_SOURCE_CONTINUE;
+}
+
+
+/*****************************************************
+ * ui::frame
+ *   (ui_scheduler slots) copy the latest received state into the widgets,
+ *   at most once per frame and per min_interval.
+*****************************************************/
+static void present_ticker(void * user_data)
+{
+	panel_view_t * panel = user_data;
+	panel_ticker_show(panel->ticker_ctx);
+	panel_mark_fresh(panel, PANEL_SNAPSHOT_SECTION_ticker);
+}
+
+static void present_balance(void * user_data)
+{
+	panel_view_t * panel = user_data;
+	show_balance(panel);
+	panel_mark_fresh(panel, PANEL_SNAPSHOT_SECTION_balance);
+}
+
+static void present_order_book(void * user_data)
+{
+	panel_view_t * panel = user_data;
+	assert(panel->pending_order_book);
+	update_orders(panel, panel->pending_order_book);
+	panel_mark_fresh(panel, PANEL_SNAPSHOT_SECTION_order_book);
+}
+
+static void present_orders_history(void * user_data)
+{
+	panel_view_t * panel = user_data;
+	
+	// the tree models read the order lists in place, 
+	// diff against the new lists first, then swap and release the old ones.
+	order_history_update(panel->pending_orders, GTK_TREE_VIEW(panel->orders_tree), GTK_TREE_VIEW(panel->unsettled_tree));
+	
+	struct order_history old_history = *panel->orders;
+	*panel->orders = *panel->pending_orders;
+	*panel->pending_orders = old_history;
+	order_history_cleanup(panel->pending_orders);
+	panel_mark_fresh(panel, PANEL_SNAPSHOT_SECTION_orders);
+}
+
+static void present_chart(void * user_data)
+{
+	draw_charts_frame(user_data);
+}
+
+static const struct {
+	const char * name;
+	double min_interval;	// seconds
+	void (* apply)(void * user_data);
+}s_panel_ui_slots[PANEL_UI_SLOTS_COUNT] = {
+	[PANEL_UI_SLOT_ticker] = { "ticker", 0.1, present_ticker },
+	[PANEL_UI_SLOT_balance] = { "balance", 0.25, present_balance },
+	[PANEL_UI_SLOT_order_book] = { "order_book", 0.1, present_order_book },
+	[PANEL_UI_SLOT_orders_history] = { "orders_history", 0.25, present_orders_history },
+	[PANEL_UI_SLOT_chart] = { "chart", 0, present_chart },	// budgeted by draw_charts
+};
+
 /*****************************************************
  * ui::init
 *****************************************************/
 static void init_bid_tree(GtkTreeView * tree)
 {
-	GtkListStore * store = NULL;
+	ArrayModel * model = NULL;
 	GtkTreeViewColumn * col = NULL;
 	GtkCellRenderer * cr = NULL;
 	
@@ -733,15 +1429,15 @@ static void init_bid_tree(GtkTreeView * tree)
 	gtk_tree_view_column_set_min_width(col, 80);
 	gtk_tree_view_append_column(tree, col);
 	
-	store = gtk_list_store_new(ORDER_BOOK_COLUMNS_COUNT, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_INT);
-	gtk_tree_view_set_model(tree, GTK_TREE_MODEL(store));
-	g_object_unref(store);
+	model = array_model_new(&s_bids_spec);
+	gtk_tree_view_set_model(tree, GTK_TREE_MODEL(model));
+	g_object_unref(model);
 	return;
 }
 
 static void init_ask_tree(GtkTreeView * tree)
 {
-	GtkListStore * store = NULL;
+	ArrayModel * model = NULL;
 	GtkTreeViewColumn * col = NULL;
 	GtkCellRenderer * cr = NULL;
 	
@@ -769,9 +1465,36 @@ static void init_ask_tree(GtkTreeView * tree)
 	gtk_tree_view_column_set_expand(col, TRUE);
 	gtk_tree_view_append_column(tree, col);
 	
-	store = gtk_list_store_new(ORDER_BOOK_COLUMNS_COUNT, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_INT);
-	gtk_tree_view_set_model(tree, GTK_TREE_MODEL(store));
-	g_object_unref(store);
+	model = array_model_new(&s_asks_spec);
+	gtk_tree_view_set_model(tree, GTK_TREE_MODEL(model));
+	g_object_unref(model);
+	return;
+}
+
+static void cancel_order_job_free(struct io_job * job)
+{
+	struct cancel_order_job * cjob = (struct cancel_order_job *)job;
+	if(cjob->jresult) json_object_put(cjob->jresult);
+	free(cjob);
+	return;
+}
+
+static void apply_cancel_order(struct io_job * job)
+{
+	struct cancel_order_job * cjob = (struct cancel_order_job *)job;
+	panel_view_t * panel = job->user_data;
+	if(job->rc) {
+		show_info(panel->shell, "cancel order %s: ERROR, rc = %d", cjob->order_id, job->rc);
+		return;
+	}
+	
+	const char * result = cjob->jresult?json_object_to_json_string_ext(cjob->jresult, JSON_C_TO_STRING_SPACED):"";
+	fprintf(stderr, "canceled order: %s\n", result);
+	show_info(panel->shell, "cancel order: %s", result);
+	
+	// the unsettled list will be rebuilt from the server's response
+	update_balance(panel);
+	update_orders_history(panel);
 	return;
 }
 
@@ -791,19 +1514,17 @@ static void on_row_activated_unsettled_tree(GtkTreeView * tree, GtkTreePath * pa
 	
 	const char * colname = gtk_tree_view_column_get_title(col);
 	if(NULL == colname || !colname[0]) {
-		char sz_order_id[100] = "";
-		snprintf(sz_order_id, sizeof(sz_order_id), "%" PRIi64, order_id);
-		
-		json_object * jresult = NULL;
-		int rc = coincheck_cancel_order(panel->agent, sz_order_id, &jresult);
-		if(0 == rc) {
-			fprintf(stderr, "canceled order: %s\n", json_object_to_json_string_ext(jresult, JSON_C_TO_STRING_PRETTY));
-			show_info(panel->shell, "cancel order: %ld", (long)json_object_to_json_string_ext(jresult, JSON_C_TO_STRING_SPACED));
-			gtk_list_store_remove(GTK_LIST_STORE(model), &iter);
-			
-			update_balance(panel);
-		}
+		struct cancel_order_job * cjob = (struct cancel_order_job *)io_job_new(sizeof(*cjob), NULL, 
+			NULL, apply_cancel_order, panel);
+		cjob->base->free_job = cancel_order_job_free;
+		snprintf(cjob->order_id, sizeof(cjob->order_id), "%" PRIi64, order_id);
 		
+		struct trading_agency_command cmd = {
+			.type = trading_agency_command_type_cancel_order,
+			.pair = "btc_jpy",
+		};
+		strncpy(cmd.cancel.order_id, cjob->order_id, sizeof(cmd.cancel.order_id) - 1);
+		panel_post_command(panel, &cmd, cjob->base);
 	}
 }
 static void on_refresh(GtkButton * button, panel_view_t * panel)
@@ -821,6 +1542,7 @@ int panel_view_load_from_builder(panel_view_t * panel, GtkBuilder * builder)
 {
 	assert(panel && builder);
 	load_widget(frame        , main_panel);
+	panel->ui->widget = panel->frame;	// frame clock of the ui_scheduler
 	load_widget(btc_balance  , btc_balance);
 	load_widget(btc_in_use   , btc_in_use);
 	load_widget(jpy_balance  , jpy_balance);
@@ -889,17 +1611,61 @@ panel_view_t * panel_view_init(panel_view_t * panel, const char * title, shell_c
 	panel->shell = shell;
 	if(title) strncpy(panel->title, title, sizeof(panel->title));
 	
-	struct panel_ticker_context * ctx = panel_ticker_context_init(panel->ticker_ctx, 0);
+	char history_file[PATH_MAX] = "";
+	const char * db_home = app_context_get_db_home(shell->user_data);
+	if(db_home) {
+		snprintf(history_file, sizeof(history_file), "%s/%s-tickers.dat", db_home, panel->title);
+		snprintf(panel->snapshot_file, sizeof(panel->snapshot_file), "%s/%s-snapshot.bin", db_home, panel->title);
+	}
+	
+	struct panel_ticker_context * ctx = panel_ticker_context_init(panel->ticker_ctx, 
+		history_file[0]?history_file:NULL, 0);
 	assert(ctx);
+	panel->chart_ctx.state->mode = panel_chart_mode_line;
+	panel->chart_ctx.state->resolution = CANDLE_RESOLUTION_1m;
 	
 	order_history_init(panel->orders);
+	order_history_init(panel->pending_orders);
+	
+	// the widget (frame clock) is set by panel_view_load_from_builder()
+	ui_scheduler_init(panel->ui, NULL);
+	for(int i = 0; i < PANEL_UI_SLOTS_COUNT; ++i) {
+		int slot_id = ui_scheduler_add_slot(panel->ui, s_panel_ui_slots[i].name, s_panel_ui_slots[i].min_interval, 
+			s_panel_ui_slots[i].apply, panel);
+		assert(slot_id == i);
+	}
 	return panel;
 }
 
 void panel_view_cleanup(panel_view_t * panel)
 {
 	if(NULL == panel) return;
+	ui_scheduler_cleanup(panel->ui);
+	if(panel->pending_order_book) {
+		order_book_job_clear(panel->pending_order_book);
+		free(panel->pending_order_book);
+		panel->pending_order_book = NULL;
+	}
+	order_history_cleanup(panel->pending_orders);
+	
 	panel_ticker_context_cleanup(panel->ticker_ctx);
+	draw_charts_cleanup(panel);
+	if(panel->chart_ctx.surface) {
+		cairo_surface_destroy(panel->chart_ctx.surface);
+		panel->chart_ctx.surface = NULL;
+	}
+	free(panel->chart_ctx.state->buckets);
+	panel->chart_ctx.state->buckets = NULL;
+	
+	free(panel->asks_list);
+	free(panel->bids_list);
+	panel->asks_list = panel->bids_list = NULL;
+	panel->num_asks = panel->num_bids = 0;
+	if(panel->jorder_book) {
+		json_object_put(panel->jorder_book);
+		panel->jorder_book = NULL;
+	}
+	order_history_cleanup(panel->orders);
 	return;
 }
 
@@ -915,14 +1681,22 @@ int coincheck_panel_init(trading_agency_t * agent, shell_context_t * shell)
 	
 	if(da) {
 		g_signal_connect(da, "draw", G_CALLBACK(on_panel_view_da_draw), panel);
+		gtk_widget_add_events(da, GDK_SCROLL_MASK);
+		g_signal_connect(da, "scroll-event", G_CALLBACK(on_panel_view_da_scroll), panel);
+		gtk_widget_add_events(da, GDK_BUTTON_PRESS_MASK);
+		g_signal_connect(da, "button-press-event", G_CALLBACK(on_panel_view_da_button_press), panel);
 	}
 	
+	// show the last session's state (dimmed) until the first responses arrive
+	panel_view_restore_snapshot(panel);
+	
 	update_balance(panel);
 	update_tickers(panel);
 	update_orders_history(panel);
 	
 	// run backgound tasks
 	g_timeout_add(1000, (GSourceFunc)update_tickers, panel);
+	g_timeout_add_seconds(PANEL_SNAPSHOT_INTERVAL, (GSourceFunc)save_snapshot, panel);
 	//~ g_timeout_add(3000, (GSourceFunc)update_orders_history, panel);
 	
 	return 0;
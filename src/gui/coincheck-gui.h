@@ -8,15 +8,22 @@ extern "C" {
 
 #include "shell.h"
 #include "trading_agency.h"
+#include "utils.h"
 
 #include <pthread.h>
 #include <time.h>
+#include <limits.h>
 #include "order_history.h"
+#include "ticker_history.h"
+#include "panel_snapshot.h"
+#include "candles.h"
+#include "ui_scheduler.h"
 
 struct order_book_data
 {
 	const char * rate;
 	const char * amount;
+	double d_rate;
 	double d_amount;
 	double scales;	// range: [0, 100]
 };
@@ -32,6 +39,8 @@ struct coincheck_ticker
 	int64_t timestamp;
 };
 
+int coincheck_ticker_parse(struct coincheck_ticker * ticker, json_object * jticker);
+
 struct panel_ticker_context
 {
 	struct {
@@ -44,18 +53,95 @@ struct panel_ticker_context
 	} widget;
 	
 	struct coincheck_ticker current;
-	
-	size_t history_size;	// window size
-	size_t length;
-	size_t start_pos;
-	struct coincheck_ticker * tickers_history; // Circular array
+	ticker_history_t history[1];	// memory-mapped, persists across restarts
 };
-struct panel_ticker_context * panel_ticker_context_init(struct panel_ticker_context * ctx, size_t max_history_size);
+// history_file: NULL ==> not persistent
+struct panel_ticker_context * panel_ticker_context_init(struct panel_ticker_context * ctx, const char * history_file, size_t max_history_size);
 void panel_ticker_context_cleanup(struct panel_ticker_context * ctx);
 int panel_ticker_load_from_builder(struct panel_ticker_context * ctx, GtkBuilder * builder);
-int panel_ticker_append(struct panel_ticker_context * ctx, json_object * jticker);
-ssize_t panel_ticker_get_lastest_history(struct panel_ticker_context * ctx, size_t count, struct coincheck_ticker ** p_tickers);
+// add @ticker to the history, the entries are updated by panel_ticker_show()
+int panel_ticker_append(struct panel_ticker_context * ctx, const struct coincheck_ticker * ticker);
+// show @ticker without adding it to the history (e.g. restored from a snapshot)
+int panel_ticker_set_current(struct panel_ticker_context * ctx, const struct coincheck_ticker * ticker);
+void panel_ticker_show(struct panel_ticker_context * ctx);	// ctx->current ==> entries
+// zero-copy view of the latest @count tickers, valid until the next panel_ticker_append()
+ssize_t panel_ticker_get_lastest_history(struct panel_ticker_context * ctx, size_t count, struct ticker_history_view * view);
+
+// chart surface layout (image coordinates), shared by all the chart modes
+#define PANEL_CHART_IMAGE_WIDTH (2400)
+#define PANEL_CHART_IMAGE_HEIGHT (600)
+#define PANEL_CHART_PLOT_WIDTH (2000)	// x: [0, 2000), labels on the right
+#define PANEL_CHART_RANGE (400.0)		// pixels between the min and the max
+#define PANEL_CHART_BASELINE (500.0)	// y of the min
+#define PANEL_CHART_MARGIN (10)			// around the image in the drawing area
+
+enum panel_chart_mode
+{
+	panel_chart_mode_line,		// last prices, draw_tickers()
+	panel_chart_mode_candles,	// OHLC bars of the candle_engine
+	panel_chart_mode_depth,		// cumulative order book
+	panel_chart_modes_count
+};
+
+// draw_charts_invalidate(): what changed
+#define PANEL_CHART_SOURCE_tickers		(1u << 0)
+#define PANEL_CHART_SOURCE_candles		(1u << 1)
+#define PANEL_CHART_SOURCE_order_book	(1u << 2)
+
+// draw_tickers(): what the chart surface currently shows
+struct panel_chart_state
+{
+	uint64_t total;		// history->total at the last draw
+	ssize_t count;		// tickers plotted, x: [0, count)
+	double min_tick;
+	double max_tick;
+	double tick_scale;
+	double last;
+	
+	// > 0: the latest span_ms of history decimated to one bucket per pixel,
+	// 0: one pixel per ticker (latest s_max_tickers)
+	int64_t span_ms;
+	struct ticker_history_bucket * buckets;
+	
+	// statistics
+	int64_t num_full_redraws;
+	int64_t num_incremental_redraws;
+	perf_stats_t full_redraw_stats[1];
+	perf_stats_t incremental_stats[1];	// scroll + new segment
+	
+	// draw_charts.c: updates are rendered once per frame (PANEL_UI_SLOT_chart)
+	enum panel_chart_mode mode;
+	enum candle_resolution resolution;	// candles mode
+	void * layers;	// candles / depth caches
+	int64_t num_frames;
+	int64_t num_coalesced;		// updates merged into an already pending frame
+	int64_t num_damage_redraws;	// candles / depth: only the damaged regions repainted
+	int64_t num_over_budget;	// frames over PANEL_CHART_FRAME_BUDGET
+	perf_stats_t frame_stats[1];
+};
 
+enum PANEL_IO_JOB_TYPE
+{
+	PANEL_IO_JOB_ticker,
+	PANEL_IO_JOB_balance,
+	PANEL_IO_JOB_order_book,
+	PANEL_IO_JOB_orders_history,
+	PANEL_IO_JOB_snapshot,
+	PANEL_IO_JOB_TYPES_COUNT
+};
+
+// ui_scheduler slots, applied in this order within a frame
+enum PANEL_UI_SLOT
+{
+	PANEL_UI_SLOT_ticker,
+	PANEL_UI_SLOT_balance,
+	PANEL_UI_SLOT_order_book,
+	PANEL_UI_SLOT_orders_history,
+	PANEL_UI_SLOT_chart,	// last: redrawn after the sources above
+	PANEL_UI_SLOTS_COUNT
+};
+
+struct order_book_job;
 typedef struct panel_view
 {
 	void * user_data;
@@ -68,14 +154,21 @@ typedef struct panel_view
 	GtkWidget * btc_in_use;
 	GtkWidget * jpy_balance;
 	GtkWidget * jpy_in_use;
+	struct {
+		char btc[100];
+		char jpy[100];
+		char btc_reserved[100];
+		char jpy_reserved[100];
+	}balance;
 	
 	struct {
 		GtkWidget * da;
-		cairo_surface_t * surface;
+		cairo_surface_t * surface;	// the plot only, labels: draw_charts_overlay()
 		int image_width;
 		int image_height;
 		int da_width;
 		int da_height;
+		struct panel_chart_state state[1];
 	}chart_ctx;
 	
 	GtkWidget * ask_orders;
@@ -99,16 +192,51 @@ typedef struct panel_view
 	int num_bids;
 	struct order_book_data * asks_list;
 	struct order_book_data * bids_list;
+	json_object * jorder_book;	// owns the strings referenced by asks_list / bids_list
 	
 	struct order_history orders[1];
 	GtkWidget * orders_tree;
 	GtkWidget * unsettled_tree;
+	
+	// received but not shown yet: the widgets are updated on the next frame
+	ui_scheduler_t ui[1];
+	struct order_book_job * pending_order_book;
+	struct order_history pending_orders[1];
+	
+	// addresses used as io_job keys: at most one request of each type is in flight
+	char io_job_keys[PANEL_IO_JOB_TYPES_COUNT];
+	
+	// warm start (PANEL_SNAPSHOT_SECTION_xxx bits)
+	char snapshot_file[PATH_MAX];	// empty: disabled
+	unsigned int valid_sections;	// sections holding data (restored or fetched)
+	unsigned int stale_sections;	// restored and not refreshed yet
 }panel_view_t;
 
 panel_view_t * panel_view_init(panel_view_t * panel, const char * title, shell_context_t * shell);
 void panel_view_cleanup(panel_view_t * panel);
 int panel_view_load_from_builder(panel_view_t * panel, GtkBuilder * builder);
 
+// (GTK main thread) dim / undim the widgets of @sections
+void panel_view_set_stale(panel_view_t * panel, unsigned int sections, gboolean stale);
+// restore the last snapshot, the restored sections are marked as stale
+int panel_view_restore_snapshot(panel_view_t * panel);
+// async: write the file on an io_worker, otherwise before returning (e.g. on shutdown)
+int panel_view_save_snapshot(panel_view_t * panel, int async);
+
+// draw_tickers.c (GTK main thread) line mode
+cairo_surface_t * panel_chart_get_surface(panel_view_t * panel);
+void draw_tickers(panel_view_t * panel);
+void draw_tickers_overlay(panel_view_t * panel, cairo_t * cr);
+void draw_tickers_set_span(panel_view_t * panel, int64_t span_ms);	// span_ms <= 0: one pixel per ticker
+
+// draw_charts.c (GTK main thread)
+void draw_charts_invalidate(panel_view_t * panel, unsigned int sources);	// PANEL_CHART_SOURCE_xxx bits
+void draw_charts_frame(panel_view_t * panel);	// (PANEL_UI_SLOT_chart) render the invalidated sources
+void draw_charts_set_mode(panel_view_t * panel, enum panel_chart_mode mode);
+void draw_charts_set_resolution(panel_view_t * panel, enum candle_resolution resolution);
+void draw_charts_overlay(panel_view_t * panel, cairo_t * cr);	// (da "draw" handler) in image coordinates
+void draw_charts_cleanup(panel_view_t * panel);
+
 extern panel_view_t * shell_get_main_panel(shell_context_t * shell, const char * agency_name);
 int coincheck_panel_init(trading_agency_t * coincheck, shell_context_t * shell);
 int coincheck_panel_update_order_book(panel_view_t * panel);
@@ -0,0 +1,657 @@
+/*
+ * draw_charts.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#include "coincheck-gui.h"
+#include "io_workers.h"
+
+/*****************************************************
+ * draw_charts: chart modes, rendered once per frame
+ *   updates only mark the chart dirty, the panel's ui_scheduler renders
+ *   the pending changes once per frame (a burst of messages costs one render).
+ *
+ *   line: draw_tickers()
+ *   candles: the closed bars are drawn when a new bar opens (the window moves)
+ *     or the open bar leaves the y-range, otherwise only the open bar's column
+ *     and the label strip are repainted and queued as damage.
+ *   depth: cumulative asks / bids (best level first) as filled steps,
+ *     the path of each side is cached, an update rebuilds the changed side
+ *     and repaints from its first changed level to its outer edge.
+ *   the y-range (and the depth x-range) has headroom, so most updates fit in it.
+*****************************************************/
+#define PANEL_CHART_FRAME_BUDGET (IO_WORKERS_FRAME_BUDGET / 4)	// the chart's share of a frame
+
+#define CANDLE_WIDTH (10)		// pixels per bar, including the gap
+#define CANDLE_BODY_WIDTH (7)
+#define CANDLES_COUNT (PANEL_CHART_PLOT_WIDTH / CANDLE_WIDTH)
+#define CANDLE_HEADROOM (0.1)	// of the price range, above and below
+
+#define DEPTH_MAX_LEVELS (200)	// per side
+#define DEPTH_HEADROOM (0.25)
+#define DEPTH_LINE_WIDTH (2.0)
+
+#define LABELS_X (PANEL_CHART_PLOT_WIDTH)
+#define LABELS_WIDTH (PANEL_CHART_IMAGE_WIDTH - PANEL_CHART_PLOT_WIDTH)
+
+static const unsigned int s_mode_sources[panel_chart_modes_count] = {
+	[panel_chart_mode_line] = PANEL_CHART_SOURCE_tickers,
+	[panel_chart_mode_candles] = PANEL_CHART_SOURCE_candles,
+	[panel_chart_mode_depth] = PANEL_CHART_SOURCE_order_book,
+};
+static const char * s_resolution_names[CANDLE_RESOLUTIONS_COUNT] = { "1s", "1m", "5m", "1h", "1d" };
+
+enum depth_side_index
+{
+	depth_side_asks,
+	depth_side_bids,
+	depth_sides_count
+};
+
+struct depth_side
+{
+	int count;
+	double rate[DEPTH_MAX_LEVELS];
+	double total[DEPTH_MAX_LEVELS];	// cumulative amount
+};
+
+struct chart_layers
+{
+	unsigned int dirty;		// PANEL_CHART_SOURCE_xxx, rendered on the next frame
+	int full_redraw;
+	
+	// created once
+	cairo_pattern_t * up;
+	cairo_pattern_t * down;
+	cairo_pattern_t * fills[depth_sides_count];
+	
+	// candles: the open bar is the rightmost one
+	int num_candles;	// plotted, 0: nothing
+	int64_t first_ms;
+	struct candle current;
+	double min_price;
+	double max_price;
+	double price_scale;
+	
+	// depth: x = rate, y = cumulative amount
+	double min_rate;
+	double max_rate;
+	double rate_scale;
+	double max_total;
+	double total_scale;
+	struct depth_side sides[depth_sides_count];
+	cairo_path_t * paths[depth_sides_count];	// image coordinates
+};
+
+static struct chart_layers * chart_layers_get(panel_view_t * panel)
+{
+	struct panel_chart_state * state = panel->chart_ctx.state;
+	struct chart_layers * layers = state->layers;
+	if(layers) return layers;
+	
+	layers = calloc(1, sizeof(*layers));
+	assert(layers);
+	layers->full_redraw = 1;
+	layers->up = cairo_pattern_create_rgba(0.0, 0.8, 0.4, 1.0);
+	layers->down = cairo_pattern_create_rgba(0.9, 0.2, 0.2, 1.0);
+	
+	// opaque at the top of the range, fading towards the baseline
+	static const double colors[depth_sides_count][3] = {
+		[depth_side_asks] = { 0.9, 0.2, 0.2 },
+		[depth_side_bids] = { 0.0, 0.8, 0.4 },
+	};
+	for(int i = 0; i < depth_sides_count; ++i) {
+		cairo_pattern_t * fill = cairo_pattern_create_linear(0, PANEL_CHART_BASELINE - PANEL_CHART_RANGE, 0, PANEL_CHART_BASELINE);
+		cairo_pattern_add_color_stop_rgba(fill, 0.0, colors[i][0], colors[i][1], colors[i][2], 0.8);
+		cairo_pattern_add_color_stop_rgba(fill, 1.0, colors[i][0], colors[i][1], colors[i][2], 0.2);
+		layers->fills[i] = fill;
+	}
+	
+	state->layers = layers;
+	return layers;
+}
+
+// an image rectangle ==> the drawing area, same transform as on_panel_view_da_draw()
+static void chart_queue_damage(panel_view_t * panel, double x, double y, double width, double height)
+{
+	GtkWidget * da = panel->chart_ctx.da;
+	if(NULL == da) return;
+	int da_width = gtk_widget_get_allocated_width(da) - PANEL_CHART_MARGIN * 2;
+	int da_height = gtk_widget_get_allocated_height(da) - PANEL_CHART_MARGIN * 2;
+	if(da_width <= 1 || da_height <= 1) return;
+	
+	double scale_x = (double)da_width / (double)PANEL_CHART_IMAGE_WIDTH;
+	double scale_y = (double)da_height / (double)PANEL_CHART_IMAGE_HEIGHT;
+	int left = (int)floor((PANEL_CHART_MARGIN + x) * scale_x) - 1;
+	int top = (int)floor((PANEL_CHART_MARGIN + y) * scale_y) - 1;
+	int right = (int)ceil((PANEL_CHART_MARGIN + x + width) * scale_x) + 1;
+	int bottom = (int)ceil((PANEL_CHART_MARGIN + y + height) * scale_y) + 1;
+	gtk_widget_queue_draw_area(da, left, top, right - left, bottom - top);
+}
+
+static void chart_clear(panel_view_t * panel)
+{
+	cairo_t * cr = cairo_create(panel_chart_get_surface(panel));
+	cairo_set_source_rgba(cr, 0, 0, 0, 1);
+	cairo_paint(cr);
+	cairo_destroy(cr);
+}
+
+/*****************************************************
+ * candles
+*****************************************************/
+static inline double candle_y(const struct chart_layers * layers, double price)
+{
+	return PANEL_CHART_BASELINE - (price - layers->min_price) * layers->price_scale;
+}
+
+static void candle_fill(cairo_t * cr, const struct chart_layers * layers, int index, const struct candle * bar)
+{
+	double x = index * CANDLE_WIDTH;
+	double y_high = candle_y(layers, bar->high);
+	double y_low = candle_y(layers, bar->low);
+	double y_open = candle_y(layers, bar->open);
+	double y_close = candle_y(layers, bar->close);
+	double top = (y_open < y_close)?y_open:y_close;
+	double height = fabs(y_close - y_open);
+	if(height < 1.0) height = 1.0;	// doji
+	
+	cairo_set_source(cr, (bar->close >= bar->open)?layers->up:layers->down);
+	cairo_rectangle(cr, x + CANDLE_BODY_WIDTH / 2, y_high, 1, y_low - y_high + 1);	// wick
+	cairo_rectangle(cr, x, top, CANDLE_BODY_WIDTH, height);
+	cairo_fill(cr);
+}
+
+static inline int candle_equals(const struct candle * a, const struct candle * b)
+{
+	return a->start_ms == b->start_ms && a->open == b->open && a->high == b->high
+		&& a->low == b->low && a->close == b->close;
+}
+
+// the closed bars of the window (from the engine's ring) and the open one
+static void candles_rebuild(panel_view_t * panel, candle_engine_t * engine, const struct candle * current)
+{
+	struct panel_chart_state * state = panel->chart_ctx.state;
+	struct chart_layers * layers = state->layers;
+	int64_t resolution_ms = candle_resolution_ms[state->resolution];
+	int64_t first_ms = current->start_ms - (int64_t)(CANDLES_COUNT - 1) * resolution_ms;
+	
+	struct candle * bars = NULL;
+	ssize_t count = engine->query(engine, state->resolution, first_ms, current->start_ms, &bars);
+	if(count < 0) count = 0;
+	
+	double min_price = current->low, max_price = current->high;
+	for(ssize_t i = 0; i < count; ++i) {
+		if(bars[i].low < min_price) min_price = bars[i].low;
+		if(bars[i].high > max_price) max_price = bars[i].high;
+	}
+	double headroom = (max_price - min_price) * CANDLE_HEADROOM;
+	if(headroom <= 0) headroom = 1.0;
+	layers->min_price = min_price - headroom;
+	layers->max_price = max_price + headroom;
+	layers->price_scale = PANEL_CHART_RANGE / (layers->max_price - layers->min_price);
+	
+	cairo_t * cr = cairo_create(panel_chart_get_surface(panel));
+	cairo_set_source_rgba(cr, 0, 0, 0, 1);
+	cairo_paint(cr);
+	for(ssize_t i = 0; i < count; ++i) {
+		int64_t index = (bars[i].start_ms - first_ms) / resolution_ms;	// no bar: no trade in that interval
+		if(index < 0 || index >= (CANDLES_COUNT - 1)) continue;
+		candle_fill(cr, layers, (int)index, &bars[i]);
+	}
+	candle_fill(cr, layers, CANDLES_COUNT - 1, current);
+	cairo_destroy(cr);
+	free(bars);
+	
+	layers->first_ms = first_ms;
+	layers->num_candles = (int)count + 1;
+	layers->current = *current;
+}
+
+static void candles_update(panel_view_t * panel)
+{
+	struct panel_chart_state * state = panel->chart_ctx.state;
+	struct chart_layers * layers = state->layers;
+	candle_engine_t * engine = app_context_get_candle_engine(panel->shell->user_data, "btc_jpy");
+	
+	struct candle current;
+	memset(&current, 0, sizeof(current));
+	if(NULL == engine || engine->get_current(engine, state->resolution, &current)) {
+		// no bar yet
+		if(layers->full_redraw || layers->num_candles > 0) {
+			chart_clear(panel);
+			layers->num_candles = 0;
+			layers->full_redraw = 0;
+			gtk_widget_queue_draw(panel->chart_ctx.da);
+		}
+		return;
+	}
+	
+	if(layers->full_redraw || layers->num_candles == 0
+		|| current.start_ms != layers->current.start_ms
+		|| current.low < layers->min_price || current.high > layers->max_price)
+	{
+		candles_rebuild(panel, engine, &current);
+		layers->full_redraw = 0;
+		++state->num_full_redraws;
+		gtk_widget_queue_draw(panel->chart_ctx.da);
+		return;
+	}
+	if(candle_equals(&current, &layers->current)) return;
+	
+	// the open bar's column, then the label strip right of it
+	double x = (CANDLES_COUNT - 1) * CANDLE_WIDTH;
+	cairo_t * cr = cairo_create(panel_chart_get_surface(panel));
+	cairo_rectangle(cr, x, 0, CANDLE_WIDTH, PANEL_CHART_IMAGE_HEIGHT);
+	cairo_set_source_rgba(cr, 0, 0, 0, 1);
+	cairo_fill(cr);
+	candle_fill(cr, layers, CANDLES_COUNT - 1, &current);
+	cairo_destroy(cr);
+	layers->current = current;
+	
+	chart_queue_damage(panel, x, 0, PANEL_CHART_IMAGE_WIDTH - x, PANEL_CHART_IMAGE_HEIGHT);
+	++state->num_damage_redraws;
+}
+
+static void candles_overlay(const struct panel_chart_state * state, const struct chart_layers * layers, cairo_t * cr)
+{
+	if(layers->num_candles <= 0) return;
+	
+	char title[100] = "";
+	double dashes[2] = { 2, 1 };
+	cairo_save(cr);
+	cairo_select_font_face(cr, "Mono", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
+	cairo_set_font_size(cr, 16);
+	
+	// the y-range
+	cairo_set_line_width(cr, 2);
+	cairo_set_source_rgba(cr, 0, 1, 1, 1);
+	cairo_set_dash(cr, dashes, 2, 0);
+	cairo_move_to(cr, 0, PANEL_CHART_BASELINE);
+	cairo_line_to(cr, PANEL_CHART_PLOT_WIDTH, PANEL_CHART_BASELINE);
+	cairo_move_to(cr, 0, PANEL_CHART_BASELINE - PANEL_CHART_RANGE);
+	cairo_line_to(cr, PANEL_CHART_PLOT_WIDTH, PANEL_CHART_BASELINE - PANEL_CHART_RANGE);
+	cairo_stroke(cr);
+	cairo_set_dash(cr, NULL, 0, 0);
+	
+	cairo_set_source_rgba(cr, 1, 1, 1, 1);
+	snprintf(title, sizeof(title), "high: %f", layers->max_price);
+	cairo_move_to(cr, 0, PANEL_CHART_BASELINE - PANEL_CHART_RANGE - 24);
+	cairo_show_text(cr, title);
+	snprintf(title, sizeof(title), "low: %f", layers->min_price);
+	cairo_move_to(cr, 0, PANEL_CHART_BASELINE + 40);
+	cairo_show_text(cr, title);
+	snprintf(title, sizeof(title), "%s x %d", s_resolution_names[state->resolution], CANDLES_COUNT);
+	cairo_move_to(cr, PANEL_CHART_PLOT_WIDTH / 2, PANEL_CHART_BASELINE - PANEL_CHART_RANGE - 24);
+	cairo_show_text(cr, title);
+	
+	// the open bar's close
+	const struct candle * current = &layers->current;
+	cairo_set_font_size(cr, 18);
+	cairo_set_source(cr, (current->close >= current->open)?layers->up:layers->down);
+	snprintf(title, sizeof(title), "%.2f", current->close);
+	cairo_move_to(cr, LABELS_X + 8, candle_y(layers, current->close) + 6);
+	cairo_show_text(cr, title);
+	cairo_new_path(cr);
+	cairo_restore(cr);
+}
+
+/*****************************************************
+ * depth
+*****************************************************/
+static inline double depth_x(const struct chart_layers * layers, double rate)
+{
+	return (rate - layers->min_rate) * layers->rate_scale;
+}
+
+static inline double depth_y(const struct chart_layers * layers, double total)
+{
+	return PANEL_CHART_BASELINE - total * layers->total_scale;
+}
+
+static void depth_side_load(struct depth_side * side, const struct order_book_data * levels, int num_levels)
+{
+	if(num_levels > DEPTH_MAX_LEVELS) num_levels = DEPTH_MAX_LEVELS;
+	double total = 0;
+	for(int i = 0; i < num_levels; ++i) {
+		side->rate[i] = levels[i].d_rate;
+		total += levels[i].d_amount;
+		side->total[i] = total;
+	}
+	side->count = (num_levels > 0)?num_levels:0;
+}
+
+// asks: steps up to the right, bids: to the left
+static cairo_path_t * depth_side_build_path(cairo_t * cr, const struct chart_layers * layers,
+	const struct depth_side * side, double edge_x)
+{
+	cairo_new_path(cr);
+	if(side->count > 0) {
+		double y = PANEL_CHART_BASELINE;
+		cairo_move_to(cr, depth_x(layers, side->rate[0]), y);
+		for(int i = 0; i < side->count; ++i) {
+			double x = depth_x(layers, side->rate[i]);
+			cairo_line_to(cr, x, y);
+			y = depth_y(layers, side->total[i]);
+			cairo_line_to(cr, x, y);
+		}
+		cairo_line_to(cr, edge_x, y);
+		cairo_line_to(cr, edge_x, PANEL_CHART_BASELINE);
+		cairo_close_path(cr);
+	}
+	cairo_path_t * path = cairo_copy_path(cr);
+	cairo_new_path(cr);
+	return path;
+}
+
+static void depth_fill(cairo_t * cr, const struct chart_layers * layers)
+{
+	cairo_set_line_width(cr, DEPTH_LINE_WIDTH);
+	for(int i = 0; i < depth_sides_count; ++i) {
+		if(NULL == layers->paths[i]) continue;
+		cairo_append_path(cr, layers->paths[i]);
+		cairo_set_source(cr, layers->fills[i]);
+		cairo_fill_preserve(cr);
+		cairo_set_source(cr, (i == depth_side_asks)?layers->down:layers->up);
+		cairo_stroke(cr);
+	}
+}
+
+// the x-range which changed: from the first changed level to the outer edge
+// return 0 if the side is unchanged
+static int depth_side_damage(const struct chart_layers * layers, int side_index,
+	const struct depth_side * old_side, const struct depth_side * new_side,
+	double * p_left, double * p_right)
+{
+	int count = (old_side->count < new_side->count)?old_side->count:new_side->count;
+	int i = 0;
+	while(i < count && old_side->rate[i] == new_side->rate[i] && old_side->total[i] == new_side->total[i]) ++i;
+	if(i == count && old_side->count == new_side->count) return 0;
+	
+	// the step at level i moved (or appeared / disappeared), and every level beyond it
+	double x_min = PANEL_CHART_PLOT_WIDTH, x_max = 0;
+	if(i < old_side->count) x_min = x_max = depth_x(layers, old_side->rate[i]);
+	if(i < new_side->count) {
+		double x = depth_x(layers, new_side->rate[i]);
+		if(x < x_min) x_min = x;
+		if(x > x_max) x_max = x;
+	}
+	
+	if(side_index == depth_side_asks) {
+		*p_left = x_min - DEPTH_LINE_WIDTH * 2;
+		*p_right = PANEL_CHART_PLOT_WIDTH;
+	}else {
+		*p_left = 0;
+		*p_right = x_max + DEPTH_LINE_WIDTH * 2;
+	}
+	return 1;
+}
+
+static void depth_update(panel_view_t * panel)
+{
+	struct panel_chart_state * state = panel->chart_ctx.state;
+	struct chart_layers * layers = state->layers;
+	
+	// the book is only replaced on this thread (update_orders())
+	struct depth_side sides[depth_sides_count];
+	depth_side_load(&sides[depth_side_asks], panel->asks_list, panel->num_asks);
+	depth_side_load(&sides[depth_side_bids], panel->bids_list, panel->num_bids);
+	
+	int num_levels = 0;
+	double min_rate = 0, max_rate = 0, max_total = 0;
+	for(int i = 0; i < depth_sides_count; ++i) {
+		const struct depth_side * side = &sides[i];
+		for(int level = 0; level < side->count; ++level, ++num_levels) {
+			if(num_levels == 0 || side->rate[level] < min_rate) min_rate = side->rate[level];
+			if(num_levels == 0 || side->rate[level] > max_rate) max_rate = side->rate[level];
+		}
+		if(side->count > 0 && side->total[side->count - 1] > max_total) max_total = side->total[side->count - 1];
+	}
+	
+	if(num_levels == 0) {
+		if(layers->full_redraw || layers->sides[depth_side_asks].count || layers->sides[depth_side_bids].count) {
+			chart_clear(panel);
+			for(int i = 0; i < depth_sides_count; ++i) {
+				layers->sides[i].count = 0;
+				if(layers->paths[i]) cairo_path_destroy(layers->paths[i]);
+				layers->paths[i] = NULL;
+			}
+			layers->full_redraw = 0;
+			gtk_widget_queue_draw(panel->chart_ctx.da);
+		}
+		return;
+	}
+	
+	// keep the ranges until the book leaves them or shrinks to less than half
+	int full_redraw = layers->full_redraw
+		|| min_rate < layers->min_rate || max_rate > layers->max_rate
+		|| (max_rate - min_rate) < (layers->max_rate - layers->min_rate) / 2
+		|| max_total > layers->max_total || max_total < layers->max_total / 2;
+	if(full_redraw) {
+		double span = max_rate - min_rate;
+		if(span <= 0) span = 1.0;
+		layers->min_rate = min_rate - span * DEPTH_HEADROOM;
+		layers->max_rate = max_rate + span * DEPTH_HEADROOM;
+		layers->rate_scale = PANEL_CHART_PLOT_WIDTH / (layers->max_rate - layers->min_rate);
+		layers->max_total = ((max_total > 0)?max_total:1.0) * (1.0 + DEPTH_HEADROOM);
+		layers->total_scale = PANEL_CHART_RANGE / layers->max_total;
+	}
+	
+	static const double edges[depth_sides_count] = {
+		[depth_side_asks] = PANEL_CHART_PLOT_WIDTH,
+		[depth_side_bids] = 0,
+	};
+	cairo_t * cr = cairo_create(panel_chart_get_surface(panel));
+	int num_damages = 0;
+	double damages[depth_sides_count][2];	// left, right
+	for(int i = 0; i < depth_sides_count; ++i) {
+		if(!full_redraw) {
+			if(!depth_side_damage(layers, i, &layers->sides[i], &sides[i], &damages[num_damages][0], &damages[num_damages][1])) continue;
+			++num_damages;
+		}
+		if(layers->paths[i]) cairo_path_destroy(layers->paths[i]);
+		layers->paths[i] = depth_side_build_path(cr, layers, &sides[i], edges[i]);
+		layers->sides[i] = sides[i];
+	}
+	
+	if(full_redraw) {
+		cairo_set_source_rgba(cr, 0, 0, 0, 1);
+		cairo_paint(cr);
+		depth_fill(cr, layers);
+		layers->full_redraw = 0;
+		++state->num_full_redraws;
+		gtk_widget_queue_draw(panel->chart_ctx.da);
+	}else if(num_damages > 0) {
+		// the unchanged side is replayed from its cached path, clipped to the damage
+		for(int i = 0; i < num_damages; ++i) {
+			double left = damages[i][0], width = damages[i][1] - damages[i][0];
+			cairo_save(cr);
+			cairo_rectangle(cr, left, 0, width, PANEL_CHART_IMAGE_HEIGHT);
+			cairo_clip(cr);
+			cairo_set_source_rgba(cr, 0, 0, 0, 1);
+			cairo_paint(cr);
+			depth_fill(cr, layers);
+			cairo_restore(cr);
+			chart_queue_damage(panel, left, 0, width, PANEL_CHART_IMAGE_HEIGHT);
+		}
+		chart_queue_damage(panel, LABELS_X, 0, LABELS_WIDTH, PANEL_CHART_IMAGE_HEIGHT);
+		++state->num_damage_redraws;
+	}
+	cairo_destroy(cr);
+}
+
+static void depth_overlay(const struct chart_layers * layers, cairo_t * cr)
+{
+	const struct depth_side * asks = &layers->sides[depth_side_asks];
+	const struct depth_side * bids = &layers->sides[depth_side_bids];
+	if(asks->count == 0 && bids->count == 0) return;
+	
+	char title[100] = "";
+	cairo_save(cr);
+	cairo_select_font_face(cr, "Mono", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
+	cairo_set_font_size(cr, 16);
+	
+	// the ranges (only change on a full redraw)
+	cairo_set_source_rgba(cr, 1, 1, 1, 1);
+	snprintf(title, sizeof(title), "%.0f", layers->min_rate);
+	cairo_move_to(cr, 0, PANEL_CHART_BASELINE + 40);
+	cairo_show_text(cr, title);
+	snprintf(title, sizeof(title), "%.0f", layers->max_rate);
+	cairo_move_to(cr, PANEL_CHART_PLOT_WIDTH - 100, PANEL_CHART_BASELINE + 40);
+	cairo_show_text(cr, title);
+	snprintf(title, sizeof(title), "total: %.4f", layers->max_total);
+	cairo_move_to(cr, 0, PANEL_CHART_BASELINE - PANEL_CHART_RANGE - 24);
+	cairo_show_text(cr, title);
+	
+	// best levels, in the label strip
+	cairo_set_font_size(cr, 18);
+	double ask = (asks->count > 0)?asks->rate[0]:0;
+	double bid = (bids->count > 0)?bids->rate[0]:0;
+	cairo_set_source(cr, layers->down);
+	snprintf(title, sizeof(title), "ask: %.0f", ask);
+	cairo_move_to(cr, LABELS_X + 8, 200);
+	cairo_show_text(cr, title);
+	cairo_set_source(cr, layers->up);
+	snprintf(title, sizeof(title), "bid: %.0f", bid);
+	cairo_move_to(cr, LABELS_X + 8, 230);
+	cairo_show_text(cr, title);
+	if(asks->count > 0 && bids->count > 0) {
+		cairo_set_source_rgba(cr, 1, 1, 1, 1);
+		snprintf(title, sizeof(title), "spread: %.0f", ask - bid);
+		cairo_move_to(cr, LABELS_X + 8, 260);
+		cairo_show_text(cr, title);
+	}
+	cairo_new_path(cr);
+	cairo_restore(cr);
+}
+
+/*****************************************************
+ * frame scheduling
+*****************************************************/
+static void draw_charts_render(panel_view_t * panel)
+{
+	struct panel_chart_state * state = panel->chart_ctx.state;
+	struct chart_layers * layers = chart_layers_get(panel);
+	app_timer_t timer[1];
+	app_timer_start(timer);
+	
+	layers->dirty = 0;
+	switch(state->mode)
+	{
+	case panel_chart_mode_candles: candles_update(panel); break;
+	case panel_chart_mode_depth: depth_update(panel); break;
+	default: draw_tickers(panel); break;
+	}
+	
+	double elapsed = app_timer_stop(timer);
+	++state->num_frames;
+	perf_stats_update(state->frame_stats, elapsed);
+	if(elapsed > PANEL_CHART_FRAME_BUDGET) {
+		++state->num_over_budget;
+		debug_printf("%s(mode=%d): %.3f ms, over the frame budget", __FUNCTION__, (int)state->mode, elapsed * 1000.0);
+	}
+}
+
+// (PANEL_UI_SLOT_chart) after the other sources of the frame have been applied
+void draw_charts_frame(panel_view_t * panel)
+{
+	struct chart_layers * layers = panel->chart_ctx.state->layers;
+	if(layers && layers->dirty) draw_charts_render(panel);
+}
+
+void draw_charts_invalidate(panel_view_t * panel, unsigned int sources)
+{
+	struct panel_chart_state * state = panel->chart_ctx.state;
+	if(0 == (sources & s_mode_sources[state->mode])) return;	// not shown in this mode
+	
+	struct chart_layers * layers = chart_layers_get(panel);
+	if(layers->dirty) ++state->num_coalesced;
+	layers->dirty |= sources;
+	
+	if(NULL == panel->chart_ctx.da) return;
+	ui_scheduler_request(panel->ui, PANEL_UI_SLOT_chart);
+}
+
+void draw_charts_set_mode(panel_view_t * panel, enum panel_chart_mode mode)
+{
+	assert(mode >= 0 && mode < panel_chart_modes_count);
+	struct panel_chart_state * state = panel->chart_ctx.state;
+	if(mode == state->mode) return;
+	
+	struct chart_layers * layers = chart_layers_get(panel);
+	state->mode = mode;
+	state->count = 0;	// line: full redraw
+	layers->full_redraw = 1;
+	draw_charts_invalidate(panel, s_mode_sources[mode]);
+}
+
+void draw_charts_set_resolution(panel_view_t * panel, enum candle_resolution resolution)
+{
+	assert(resolution >= 0 && resolution < CANDLE_RESOLUTIONS_COUNT);
+	struct panel_chart_state * state = panel->chart_ctx.state;
+	if(resolution == state->resolution) return;
+	
+	struct chart_layers * layers = chart_layers_get(panel);
+	state->resolution = resolution;
+	layers->full_redraw = 1;
+	draw_charts_invalidate(panel, PANEL_CHART_SOURCE_candles);
+}
+
+void draw_charts_overlay(panel_view_t * panel, cairo_t * cr)
+{
+	const struct panel_chart_state * state = panel->chart_ctx.state;
+	const struct chart_layers * layers = state->layers;
+	switch(state->mode)
+	{
+	case panel_chart_mode_candles: if(layers) candles_overlay(state, layers, cr); break;
+	case panel_chart_mode_depth: if(layers) depth_overlay(layers, cr); break;
+	default: draw_tickers_overlay(panel, cr); break;
+	}
+}
+
+// before the drawing area is destroyed
+void draw_charts_cleanup(panel_view_t * panel)
+{
+	struct panel_chart_state * state = panel->chart_ctx.state;
+	struct chart_layers * layers = state->layers;
+	if(NULL == layers) return;
+	
+	cairo_pattern_destroy(layers->up);
+	cairo_pattern_destroy(layers->down);
+	for(int i = 0; i < depth_sides_count; ++i) {
+		cairo_pattern_destroy(layers->fills[i]);
+		if(layers->paths[i]) cairo_path_destroy(layers->paths[i]);
+	}
+	free(layers);
+	state->layers = NULL;
+}
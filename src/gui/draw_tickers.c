@@ -34,12 +34,151 @@
 
 #include "coincheck-gui.h"
 
-static const int s_window_size = 2400;
-static const int s_max_tickers = 2000;
-static const int s_image_width = s_window_size;
-static const int s_image_height = 600;
+/*****************************************************
+ * draw_tickers: incremental
+ *   the surface only holds the line, one pixel per ticker,
+ *   the labels and the min / max lines are drawn over it by draw_tickers_overlay().
+ *
+ *   on a new ticker the plotted line is scrolled left (when the window is full)
+ *   and only the new segment is stroked, the whole line is redrawn
+ *   when the y-range (min of low, max of high) changes.
+*****************************************************/
+static const int s_max_tickers = PANEL_CHART_PLOT_WIDTH;
+static const int s_image_width = PANEL_CHART_IMAGE_WIDTH;
+static const int s_image_height = PANEL_CHART_IMAGE_HEIGHT;
 
-void draw_tickers(panel_view_t * panel)
+#define CHART_RANGE PANEL_CHART_RANGE		// pixels between min_tick and max_tick
+#define CHART_BASELINE PANEL_CHART_BASELINE	// y of min_tick
+#define CHART_LINE_WIDTH (2.0)
+
+static inline double chart_y(const struct panel_chart_state * state, double value)
+{
+	return CHART_BASELINE - (value - state->min_tick) * state->tick_scale;
+}
+
+static void chart_stroke(cairo_t * cr, const struct panel_chart_state * state,
+	const struct ticker_history_view * tickers, ssize_t begin, ssize_t end)
+{
+	cairo_set_line_width(cr, CHART_LINE_WIDTH);
+	cairo_set_source_rgba(cr, 1.0, 1.0, 0.0, 1.0);
+	cairo_move_to(cr, begin, chart_y(state, tickers->last[begin]));
+	for(ssize_t i = begin + 1; i < end; ++i) {
+		cairo_line_to(cr, i, chart_y(state, tickers->last[i]));
+	}
+	cairo_stroke(cr);
+}
+
+// move the plotted columns @dx pixels to the left, the freed columns are painted black
+static void chart_scroll_left(cairo_surface_t * surface, int dx)
+{
+	cairo_surface_flush(surface);
+	unsigned char * data = cairo_image_surface_get_data(surface);
+	int stride = cairo_image_surface_get_stride(surface);
+	int height = cairo_image_surface_get_height(surface);
+	int width = s_max_tickers + (int)CHART_LINE_WIDTH + 1;	// nothing is drawn beyond the last ticker
+	if(width > cairo_image_surface_get_width(surface)) width = cairo_image_surface_get_width(surface);
+	if(dx > width) dx = width;
+	
+	for(int y = 0; y < height; ++y) {
+		uint32_t * row = (uint32_t *)(data + (size_t)y * stride);
+		memmove(row, row + dx, (size_t)(width - dx) * sizeof(*row));
+		for(int x = width - dx; x < width; ++x) row[x] = 0xff000000;	// opaque black
+	}
+	cairo_surface_mark_dirty(surface);
+}
+
+static void chart_set_range(struct panel_chart_state * state, double min_tick, double max_tick)
+{
+	state->min_tick = min_tick;
+	state->max_tick = max_tick;
+	state->tick_scale = 1.0;
+	if(max_tick - min_tick > CHART_RANGE) state->tick_scale = CHART_RANGE / (max_tick - min_tick);
+}
+
+static void chart_scan_range(const struct ticker_history_view * tickers, ssize_t begin, ssize_t end,
+	double * p_min, double * p_max)
+{
+	double min_tick = *p_min, max_tick = *p_max;
+	for(ssize_t i = begin; i < end; ++i) {
+		if(tickers->low[i] < min_tick) min_tick = tickers->low[i];
+		if(tickers->high[i] > max_tick) max_tick = tickers->high[i];
+	}
+	*p_min = min_tick;
+	*p_max = max_tick;
+}
+
+static void chart_redraw_full(panel_view_t * panel, const struct ticker_history_view * tickers, ssize_t begin, ssize_t end)
+{
+	struct panel_chart_state * state = panel->chart_ctx.state;
+	cairo_t * cr = cairo_create(panel->chart_ctx.surface);
+	cairo_set_source_rgba(cr, 0, 0, 0, 1);
+	cairo_paint(cr);
+	
+	// x = index in the window
+	cairo_translate(cr, -begin, 0);
+	if(end > begin) chart_stroke(cr, state, tickers, begin, end);
+	cairo_destroy(cr);
+	++state->num_full_redraws;
+}
+
+/*****************************************************
+ * span mode: decimated history, redrawn on every update in O(pixels)
+ *   each pixel column shows the first / min / max / last of its bucket
+*****************************************************/
+static void draw_tickers_decimated(panel_view_t * panel)
+{
+	struct panel_chart_state * state = panel->chart_ctx.state;
+	ticker_history_t * history = panel->ticker_ctx->history;
+	if(NULL == state->buckets) {
+		state->buckets = calloc(s_max_tickers, sizeof(*state->buckets));
+		assert(state->buckets);
+	}
+	
+	struct ticker_history_view latest[1];
+	ssize_t num_buckets = 0;
+	if(ticker_history_get_latest(history, 1, latest) == 1) {
+		uint64_t begin = ticker_history_find(history, latest->timestamp[0] - state->span_ms);
+		uint64_t span = history->total - begin;
+		num_buckets = (span < (uint64_t)s_max_tickers)?(ssize_t)span:s_max_tickers;
+		num_buckets = ticker_history_decimate(history, begin, history->total, num_buckets, state->buckets);
+	}
+	
+	const struct ticker_history_bucket * buckets = state->buckets;
+	double min_tick = 0, max_tick = 0;
+	for(ssize_t i = 0; i < num_buckets; ++i) {
+		if(i == 0 || buckets[i].min < min_tick) min_tick = buckets[i].min;
+		if(i == 0 || buckets[i].max > max_tick) max_tick = buckets[i].max;
+	}
+	chart_set_range(state, min_tick, max_tick);
+	
+	cairo_t * cr = cairo_create(panel->chart_ctx.surface);
+	cairo_set_source_rgba(cr, 0, 0, 0, 1);
+	cairo_paint(cr);
+	if(num_buckets > 0) {
+		// spread over the same width as the per-ticker mode
+		double dx = (double)s_max_tickers / (double)num_buckets;
+		cairo_set_line_width(cr, CHART_LINE_WIDTH);
+		cairo_set_source_rgba(cr, 1.0, 1.0, 0.0, 1.0);
+		cairo_move_to(cr, 0, chart_y(state, buckets[0].first));
+		for(ssize_t i = 0; i < num_buckets; ++i) {
+			double x = i * dx;
+			cairo_line_to(cr, x, chart_y(state, buckets[i].first));
+			cairo_line_to(cr, x, chart_y(state, buckets[i].min));
+			cairo_line_to(cr, x, chart_y(state, buckets[i].max));
+			cairo_line_to(cr, x, chart_y(state, buckets[i].last));
+		}
+		cairo_stroke(cr);
+		state->last = buckets[num_buckets - 1].last;
+	}
+	cairo_destroy(cr);
+	
+	state->count = (num_buckets > 0)?s_max_tickers:0;
+	state->total = history->total;
+	++state->num_full_redraws;
+}
+
+// the surface shared by all the chart modes, created on first use
+cairo_surface_t * panel_chart_get_surface(panel_view_t * panel)
 {
 	cairo_surface_t * surface = panel->chart_ctx.surface;
 	if(NULL == surface) {
@@ -50,34 +189,112 @@ void draw_tickers(panel_view_t * panel)
 		panel->chart_ctx.surface = surface;
 		panel->chart_ctx.image_width = s_image_width;
 		panel->chart_ctx.image_height = s_image_height;
+		panel->chart_ctx.state->count = 0;	// full redraw
 	}
+	return surface;
+}
+
+void draw_tickers(panel_view_t * panel)
+{
+	app_timer_t timer[1];
+	app_timer_start(timer);
 	
-	cairo_t * cr = NULL;
-	cr = cairo_create(surface);
-	cairo_set_source_rgba(cr, 0, 0, 0, 1);
-	cairo_paint(cr);
+	cairo_surface_t * surface = panel_chart_get_surface(panel);
+	struct panel_chart_state * state = panel->chart_ctx.state;
+	
+	if(state->span_ms > 0) {
+		draw_tickers_decimated(panel);
+		perf_stats_update(state->full_redraw_stats, app_timer_stop(timer));
+		gtk_widget_queue_draw(panel->chart_ctx.da);
+		return;
+	}
+	
+	// the window: the latest (count) tickers, plus the (shift) tickers which left it since the last call
+	const ticker_history_t * history = panel->ticker_ctx->history;
+	uint64_t total = history->total;
+	ssize_t count = (history->length < (size_t)s_max_tickers)?(ssize_t)history->length:s_max_tickers;
+	ssize_t num_new = (ssize_t)(total - state->total);
+	ssize_t shift = (ssize_t)((total - count) - (state->total - state->count));
+	int incremental = (state->count > 0 && count > 0 && num_new >= 0 && shift >= 0 && num_new < count
+		&& (size_t)(count + shift) <= history->length);
 	
-	struct coincheck_ticker * tickers = NULL;
-	ssize_t count = panel_ticker_get_lastest_history(panel->ticker_ctx, s_max_tickers, &tickers);
-	if(count <= 0) {
-		if(tickers) free(tickers);
+	struct ticker_history_view tickers[1];
+	memset(tickers, 0, sizeof(tickers));
+	ssize_t length = panel_ticker_get_lastest_history(panel->ticker_ctx, incremental?(count + shift):count, tickers);
+	if(length <= 0) {
+		chart_redraw_full(panel, tickers, 0, 0);
+		state->count = 0;
+		state->total = total;
+		gtk_widget_queue_draw(panel->chart_ctx.da);
 		return;
 	}
-	double min_tick = tickers[0].low;
-	double max_tick = tickers[0].high;
-	double tick_scale = 1.0;
-	for(ssize_t i = 1; i < count; ++i) {
-		if(tickers[i].low < min_tick) min_tick = tickers[i].low;
-		if(tickers[i].high > max_tick) max_tick = tickers[i].high;
+	if(length != (incremental?(count + shift):count)) incremental = 0;
+	ssize_t begin = length - count;	// first ticker of the window
+	
+	if(incremental && num_new == 0) return;		// nothing new (e.g. a failed request)
+	
+	// y-range: extended by the new tickers, rescanned only if a ticker holding min / max left the window
+	double min_tick = state->min_tick, max_tick = state->max_tick;
+	if(incremental) {
+		for(ssize_t i = 0; i < shift; ++i) {
+			if(tickers->low[i] <= min_tick || tickers->high[i] >= max_tick) { incremental = 0; break; }
+		}
+	}
+	if(incremental) {
+		chart_scan_range(tickers, length - num_new, length, &min_tick, &max_tick);
+		if(min_tick != state->min_tick || max_tick != state->max_tick) incremental = 0;
+	}
+	if(!incremental) {
+		min_tick = tickers->low[begin];
+		max_tick = tickers->high[begin];
+		chart_scan_range(tickers, begin + 1, length, &min_tick, &max_tick);
 	}
 	
-	double range = 400;
-	if(max_tick - min_tick > range) {
-		tick_scale = range / (max_tick - min_tick);
+	if(incremental) {
+		if(shift) chart_scroll_left(surface, (int)shift);
+		
+		// from the last plotted ticker
+		cairo_t * cr = cairo_create(surface);
+		cairo_translate(cr, -begin, 0);
+		chart_stroke(cr, state, tickers, length - num_new - 1, length);
+		cairo_destroy(cr);
+		++state->num_incremental_redraws;
+	}else {
+		chart_set_range(state, min_tick, max_tick);
+		chart_redraw_full(panel, tickers, begin, length);
 	}
 	
+	state->total = total;
+	state->count = count;
+	state->last = tickers->last[length - 1];
+	
+	double elapsed = app_timer_stop(timer);
+	perf_stats_update(incremental?state->incremental_stats:state->full_redraw_stats, elapsed);
 	
-	cairo_translate(cr, 0, range + 100);
+	gtk_widget_queue_draw(panel->chart_ctx.da);
+	return;
+}
+
+// (GTK main thread) span_ms <= 0: back to one pixel per ticker
+void draw_tickers_set_span(panel_view_t * panel, int64_t span_ms)
+{
+	struct panel_chart_state * state = panel->chart_ctx.state;
+	if(span_ms < 0) span_ms = 0;
+	if(span_ms == state->span_ms) return;
+	
+	state->span_ms = span_ms;
+	state->count = 0;	// full redraw
+	draw_tickers(panel);
+}
+
+// (da "draw" handler) in image coordinates
+void draw_tickers_overlay(panel_view_t * panel, cairo_t * cr)
+{
+	const struct panel_chart_state * state = panel->chart_ctx.state;
+	if(state->count <= 0) return;
+	
+	cairo_save(cr);
+	cairo_translate(cr, 0, CHART_BASELINE);
 	
 	cairo_set_font_size(cr, 16);
 	cairo_select_font_face(cr, "Mono", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
@@ -85,13 +302,13 @@ void draw_tickers(panel_view_t * panel)
 	double dashes[2] = { 2, 1 };
 	
 	// draw min_tick line
-	cairo_move_to(cr, 0, 0);
 	cairo_set_source_rgba(cr, 1, 1, 1, 1);
-	snprintf(title, sizeof(title), "low: %f", min_tick);
+	snprintf(title, sizeof(title), "low: %f", state->min_tick);
 	cairo_move_to(cr, 0, 20 + 20);
 	cairo_show_text(cr, title);
-	cairo_stroke(cr);
+	cairo_new_path(cr);
 	
+	cairo_set_line_width(cr, 2);
 	cairo_set_source_rgba(cr, 0, 1, 1, 1);
 	cairo_set_dash(cr, dashes, 2, 0);
 	cairo_move_to(cr, 0, 0);
@@ -100,41 +317,34 @@ void draw_tickers(panel_view_t * panel)
 	
 	// draw max_tick line
 	cairo_set_dash(cr, NULL, 0, 0);
-	cairo_move_to(cr, 0, -(range + 20 + 4));
-	snprintf(title, sizeof(title), "high: %f", max_tick);
+	cairo_move_to(cr, 0, -(CHART_RANGE + 20 + 4));
+	snprintf(title, sizeof(title), "high: %f", state->max_tick);
 	cairo_set_source_rgba(cr, 1, 1, 1, 1);
 	cairo_show_text(cr, title);
-	cairo_stroke(cr);
+	cairo_new_path(cr);
 	
 	cairo_set_dash(cr, dashes, 2, 0);
 	cairo_set_source_rgba(cr, 0, 1, 1, 1);
-	cairo_move_to(cr, 0, -(range));
-	cairo_line_to(cr, s_image_width, -range);
+	cairo_move_to(cr, 0, -CHART_RANGE);
+	cairo_line_to(cr, s_image_width, -CHART_RANGE);
 	cairo_stroke(cr);
 	
-	// draw ticker
-	cairo_set_dash(cr, NULL, 0, 0);
-	cairo_set_line_width(cr, 2);
-	cairo_set_source_rgba(cr, 1.0, 1.0, 0.0, 1.0);
-	cairo_move_to(cr, 0, -(tickers[0].last - min_tick) * tick_scale);
-	for(ssize_t i = 1; i < count; ++i) {
-		cairo_line_to(cr, i, -(tickers[i].last - min_tick) * tick_scale);
-	}
-	cairo_stroke(cr);
-	if(count > 0) {
-		cairo_set_line_width(cr, 1);
-		cairo_set_font_size(cr, 18);
-		snprintf(title, sizeof(title), "%.2f", tickers[count - 1].last);
-		cairo_set_source_rgba(cr, 0, 1, 0, 1);
-		cairo_line_to(cr, count, -(tickers[count - 1].last - min_tick) * tick_scale);
+	if(state->span_ms > 0) {
+		snprintf(title, sizeof(title), "span: %.1f h", state->span_ms / 3600000.0);
+		cairo_set_source_rgba(cr, 1, 1, 1, 1);
+		cairo_move_to(cr, s_max_tickers / 2, -(CHART_RANGE + 20 + 4));
 		cairo_show_text(cr, title);
-		cairo_stroke(cr);
+		cairo_new_path(cr);
 	}
 	
-	cairo_destroy(cr);
+	// the last price, right of the line
+	cairo_set_dash(cr, NULL, 0, 0);
+	cairo_set_font_size(cr, 18);
+	snprintf(title, sizeof(title), "%.2f", state->last);
+	cairo_set_source_rgba(cr, 0, 1, 0, 1);
+	cairo_move_to(cr, state->count, chart_y(state, state->last) - CHART_BASELINE);
+	cairo_show_text(cr, title);
+	cairo_new_path(cr);
 	
-	free(tickers);
-	gtk_widget_queue_draw(panel->chart_ctx.da);
-	return;
+	cairo_restore(cr);
 }
-
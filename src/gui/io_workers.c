@@ -0,0 +1,515 @@
+/*
+ * io_workers.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <gtk/gtk.h>
+
+#include "io_workers.h"
+#include "utils.h"
+
+#define AUTO_UNLOCK_MUTEX_PTR __attribute__((cleanup(auto_unlock_mutex_ptr)))
+static void auto_unlock_mutex_ptr(void * ptr)
+{
+	pthread_mutex_t ** p_mutex = ptr;
+	if(p_mutex && *p_mutex) pthread_mutex_unlock(*p_mutex);
+	return;
+}
+
+/************************************************
+ * io_workers_private
+************************************************/
+#define IO_WORKERS_MAX_KEYS (64)
+typedef struct io_workers_private
+{
+	io_workers_context_t * io;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+
+	struct io_job * head;
+	struct io_job * tail;
+
+	int num_threads;
+	pthread_t * threads;
+
+	// keys of the queued or running jobs
+	int num_keys;
+	const void * keys[IO_WORKERS_MAX_KEYS];
+
+	// fetched, waiting for apply() on the GTK main thread
+	struct io_job * completed_head;
+	struct io_job * completed_tail;
+	guint idle_id;			// on_jobs_completed() is scheduled
+	int num_agency_jobs;	// submitted to an agency's event loop and not completed yet
+}io_workers_private_t;
+
+static io_workers_private_t * io_workers_private_new(io_workers_context_t * io)
+{
+	io_workers_private_t * priv = calloc(1, sizeof(*priv));
+	assert(priv);
+
+	priv->io = io;
+	io->priv = priv;
+
+	int rc = 0;
+	rc = pthread_mutex_init(&priv->mutex, NULL);
+	assert(0 == rc);
+	rc = pthread_cond_init(&priv->cond, NULL);
+	assert(0 == rc);
+	return priv;
+}
+
+static void io_workers_private_free(io_workers_private_t * priv)
+{
+	if(NULL == priv) return;
+	pthread_cond_destroy(&priv->cond);
+	pthread_mutex_destroy(&priv->mutex);
+	free(priv->threads);
+	free(priv);
+	return;
+}
+
+// (locked)
+static int find_key(io_workers_private_t * priv, const void * key)
+{
+	for(int i = 0; i < priv->num_keys; ++i) {
+		if(priv->keys[i] == key) return i;
+	}
+	return -1;
+}
+
+static void remove_key(io_workers_private_t * priv, const void * key)
+{
+	if(NULL == key) return;
+	AUTO_UNLOCK_MUTEX_PTR pthread_mutex_t * mutex = &priv->mutex;
+	pthread_mutex_lock(mutex);
+
+	int index = find_key(priv, key);
+	if(index < 0) return;
+
+	--priv->num_keys;
+	if(index < priv->num_keys) priv->keys[index] = priv->keys[priv->num_keys];
+	priv->keys[priv->num_keys] = NULL;
+	return;
+}
+
+static void io_job_free(struct io_job * job)
+{
+	if(NULL == job) return;
+	if(job->free_job) job->free_job(job);
+	else free(job);
+	return;
+}
+
+/************************************************
+ * GTK main thread
+************************************************/
+static void apply_job(io_workers_context_t * io, struct io_job * job)
+{
+	if(!io->quit && job->apply) {
+		app_timer_t timer[1];
+		app_timer_start(timer);
+		job->apply(job);
+		double elapsed = app_timer_stop(timer);
+
+		perf_stats_update(io->frame_stats, elapsed);
+		if(elapsed > IO_WORKERS_FRAME_BUDGET) {
+			debug_printf("apply(key=%p) took %.3f ms (avg: %.3f ms, max: %.3f ms)",
+				job->key, elapsed * 1000.0,
+				perf_stats_average(io->frame_stats) * 1000.0,
+				io->frame_stats->max * 1000.0);
+		}
+	}
+
+	remove_key(io->priv, job->key);
+	io_job_free(job);
+	return;
+}
+
+// (locked)
+static struct io_job * pop_completed(io_workers_private_t * priv)
+{
+	struct io_job * job = priv->completed_head;
+	if(NULL == job) return NULL;
+	priv->completed_head = job->next;
+	if(NULL == priv->completed_head) priv->completed_tail = NULL;
+	job->next = NULL;
+	return job;
+}
+
+// one idle source for all the completed jobs, applied until the frame budget is used up
+static gboolean on_jobs_completed(io_workers_private_t * priv)
+{
+	io_workers_context_t * io = priv->io;
+	app_timer_t timer[1];
+	app_timer_start(timer);
+
+	while(1) {
+		pthread_mutex_lock(&priv->mutex);
+		struct io_job * job = pop_completed(priv);
+		if(NULL == job) {
+			priv->idle_id = 0;
+			pthread_mutex_unlock(&priv->mutex);
+			return G_SOURCE_REMOVE;
+		}
+		pthread_mutex_unlock(&priv->mutex);
+
+		apply_job(io, job);
+		if(app_timer_stop(timer) > IO_WORKERS_FRAME_BUDGET) break;
+	}
+	return G_SOURCE_CONTINUE;	// the remaining jobs: next main loop iteration
+}
+
+// (any thread) once the loop has quit, the jobs are released by io_workers_context_cleanup()
+static void push_completed(io_workers_private_t * priv, struct io_job * job)
+{
+	job->next = NULL;
+	pthread_mutex_lock(&priv->mutex);
+	if(priv->completed_tail) priv->completed_tail->next = job;
+	else priv->completed_head = job;
+	priv->completed_tail = job;
+
+	if(0 == priv->idle_id && !priv->io->quit) priv->idle_id = g_idle_add((GSourceFunc)on_jobs_completed, priv);
+	pthread_mutex_unlock(&priv->mutex);
+	return;
+}
+
+/************************************************
+ * worker threads
+************************************************/
+static struct io_job * pop_job(io_workers_private_t * priv)
+{
+	io_workers_context_t * io = priv->io;
+	AUTO_UNLOCK_MUTEX_PTR pthread_mutex_t * mutex = &priv->mutex;
+	pthread_mutex_lock(mutex);
+
+	while(!io->quit && NULL == priv->head) {
+		pthread_cond_wait(&priv->cond, &priv->mutex);
+	}
+	if(io->quit) return NULL;
+
+	struct io_job * job = priv->head;
+	priv->head = job->next;
+	if(NULL == priv->head) priv->tail = NULL;
+	job->next = NULL;
+	return job;
+}
+
+static void run_fetch(io_workers_private_t * priv, struct io_job * job)
+{
+	io_workers_context_t * io = priv->io;
+
+	app_timer_t timer[1];
+	app_timer_start(timer);
+	job->rc = job->fetch?job->fetch(job):0;
+	double elapsed = app_timer_stop(timer);
+
+	pthread_mutex_lock(&priv->mutex);
+	perf_stats_update(io->fetch_stats, elapsed);
+	pthread_mutex_unlock(&priv->mutex);
+	return;
+}
+
+static void * worker_thread(void * user_data)
+{
+	io_workers_private_t * priv = user_data;
+	assert(priv && priv->io);
+	io_workers_context_t * io = priv->io;
+
+	while(!io->quit) {
+		struct io_job * job = pop_job(priv);
+		if(NULL == job) break;
+
+		run_fetch(priv, job);
+		push_completed(priv, job);
+	}
+	pthread_exit((void *)(intptr_t)0);
+}
+
+/************************************************
+ * agency's event loop
+************************************************/
+struct agency_job
+{
+	struct trading_agency_job base[1];
+	struct io_job * job;
+};
+
+static int agency_job_execute(struct trading_agency_job * base)
+{
+	struct io_job * job = ((struct agency_job *)base)->job;
+	assert(job && job->io);
+	if(job->fetch_async) {
+		job->agency_job = base;
+		int rc = job->fetch_async(job);
+		if(0 == rc) return TRADING_AGENCY_JOB_PENDING;	// ==> io_job_fetched()
+		job->agency_job = NULL;
+		job->rc = rc;
+		return rc;
+	}
+	run_fetch(job->io->priv, job);
+	return job->rc;
+}
+
+static void agency_job_completed(struct trading_agency_job * base)
+{
+	struct io_job * job = ((struct agency_job *)base)->job;
+	io_workers_private_t * priv = job->io->priv;
+	push_completed(priv, job);
+
+	pthread_mutex_lock(&priv->mutex);
+	--priv->num_agency_jobs;
+	pthread_cond_broadcast(&priv->cond);
+	pthread_mutex_unlock(&priv->mutex);
+	return;
+}
+
+static int submit_to_agency(struct io_job * job)
+{
+	trading_agency_t * agent = job->agent;
+	if(NULL == agent || !trading_agency_is_running(agent)) return -1;
+
+	struct agency_job * ajob = (struct agency_job *)trading_agency_job_new(sizeof(*ajob),
+		agency_job_execute, agency_job_completed, NULL);
+	ajob->job = job;
+
+	io_workers_private_t * priv = job->io->priv;
+	pthread_mutex_lock(&priv->mutex);
+	++priv->num_agency_jobs;
+	pthread_mutex_unlock(&priv->mutex);
+
+	int rc = trading_agency_submit(agent, ajob->base);
+	if(rc) {
+		free(ajob);
+		pthread_mutex_lock(&priv->mutex);
+		--priv->num_agency_jobs;
+		pthread_mutex_unlock(&priv->mutex);
+	}
+	return rc;
+}
+
+/************************************************
+ * io_workers_context::member functions
+************************************************/
+static int io_workers_run(struct io_workers_context * io)
+{
+	assert(io && io->priv);
+	io_workers_private_t * priv = io->priv;
+
+	if(io->is_running) return 0;
+
+	int num_workers = io->num_workers;
+	if(num_workers <= 0) num_workers = IO_WORKERS_DEFAULT_THREADS;
+
+	pthread_t * threads = calloc(num_workers, sizeof(*threads));
+	assert(threads);
+
+	io->quit = 0;
+	io->is_running = 1;
+	for(int i = 0; i < num_workers; ++i) {
+		int rc = pthread_create(&threads[i], NULL, worker_thread, priv);
+		assert(0 == rc);
+	}
+	priv->threads = threads;
+	priv->num_threads = num_workers;
+	return 0;
+}
+
+static int io_workers_stop(struct io_workers_context * io)
+{
+	assert(io && io->priv);
+	io_workers_private_t * priv = io->priv;
+	if(!io->is_running) return -1;
+
+	pthread_mutex_lock(&priv->mutex);
+	io->quit = 1;
+	pthread_cond_broadcast(&priv->cond);
+	pthread_mutex_unlock(&priv->mutex);
+
+	for(int i = 0; i < priv->num_threads; ++i) {
+		void * exit_code = NULL;
+		pthread_join(priv->threads[i], &exit_code);
+	}
+	free(priv->threads);
+	priv->threads = NULL;
+	priv->num_threads = 0;
+
+	// drop pending jobs
+	struct io_job * job = priv->head;
+	priv->head = priv->tail = NULL;
+	while(job) {
+		struct io_job * next = job->next;
+		io_job_free(job);
+		job = next;
+	}
+	priv->num_keys = 0;
+
+	io->is_running = 0;
+	return 0;
+}
+
+static int io_workers_submit(struct io_workers_context * io, struct io_job * job)
+{
+	assert(io && io->priv && job);
+	io_workers_private_t * priv = io->priv;
+
+	job->io = io;
+	job->next = NULL;
+
+	pthread_mutex_lock(&priv->mutex);
+	if(io->quit || (job->key && find_key(priv, job->key) >= 0)) {
+		// the previous request is still in flight
+		++io->num_skipped;
+		pthread_mutex_unlock(&priv->mutex);
+		io_job_free(job);
+		return 1;
+	}
+
+	if(job->key) {
+		assert(priv->num_keys < IO_WORKERS_MAX_KEYS);
+		priv->keys[priv->num_keys++] = job->key;
+	}
+	pthread_mutex_unlock(&priv->mutex);
+
+	if(0 == submit_to_agency(job)) return 0;
+
+	// fallback: the agency's event loop is not running
+	pthread_mutex_lock(&priv->mutex);
+	if(priv->tail) priv->tail->next = job;
+	else priv->head = job;
+	priv->tail = job;
+
+	pthread_cond_signal(&priv->cond);
+	pthread_mutex_unlock(&priv->mutex);
+	return 0;
+}
+
+/************************************************
+ * public interfaces
+************************************************/
+io_workers_context_t * io_workers_context_init(io_workers_context_t * io, int num_workers, void * user_data)
+{
+	if(NULL == io) io = calloc(1, sizeof(*io));
+	assert(io);
+
+	io->user_data = user_data;
+	io->num_workers = (num_workers > 0)?num_workers:IO_WORKERS_DEFAULT_THREADS;
+
+	io->run = io_workers_run;
+	io->stop = io_workers_stop;
+	io->submit = io_workers_submit;
+
+	io_workers_private_t * priv = io_workers_private_new(io);
+	assert(priv && priv == io->priv);
+	return io;
+}
+
+void io_workers_context_cleanup(io_workers_context_t * io)
+{
+	if(NULL == io) return;
+	if(io->is_running) io->stop(io);
+
+	io_workers_private_t * priv = io->priv;
+	if(NULL == priv) return;
+
+	// the agencies complete (or drop) their jobs when they stop, wait for the callbacks
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += IO_WORKERS_DRAIN_TIMEOUT;
+
+	pthread_mutex_lock(&priv->mutex);
+	io->quit = 1;
+	int rc = 0;
+	while(priv->num_agency_jobs > 0 && 0 == rc) {
+		rc = pthread_cond_timedwait(&priv->cond, &priv->mutex, &deadline);
+	}
+	int num_agency_jobs = priv->num_agency_jobs;
+
+	// never applied: the main loop has quit
+	if(priv->idle_id) g_source_remove(priv->idle_id);
+	priv->idle_id = 0;
+	struct io_job * job = priv->completed_head;
+	priv->completed_head = priv->completed_tail = NULL;
+	pthread_mutex_unlock(&priv->mutex);
+
+	while(job) {
+		struct io_job * next = job->next;
+		io_job_free(job);
+		job = next;
+	}
+
+	if(num_agency_jobs > 0) {
+		// still referenced by an agency's event loop, keep the private data alive
+		fprintf(stderr, "[WARNING]: %s(): %d agency job(s) still in flight, leaked\n", __FUNCTION__, num_agency_jobs);
+		io->priv = NULL;
+		return;
+	}
+
+	io_workers_private_free(priv);
+	io->priv = NULL;
+	return;
+}
+
+int io_workers_complete(io_workers_context_t * io, struct io_job * job)
+{
+	assert(io && io->priv && job);
+	job->io = io;
+	push_completed(io->priv, job);
+	return 0;
+}
+
+void io_job_fetched(struct io_job * job, int rc)
+{
+	assert(job && job->agency_job);
+	struct trading_agency_job * base = job->agency_job;
+	job->agency_job = NULL;
+	job->rc = rc;
+	trading_agency_job_complete(base, rc);	// ==> agency_job_completed()
+	return;
+}
+
+struct io_job * io_job_new(size_t size, const void * key,
+	int (* fetch)(struct io_job *), void (* apply)(struct io_job *),
+	void * user_data)
+{
+	if(size < sizeof(struct io_job)) size = sizeof(struct io_job);
+	struct io_job * job = calloc(1, size);
+	assert(job);
+
+	job->key = key;
+	job->fetch = fetch;
+	job->apply = apply;
+	job->user_data = user_data;
+	return job;
+}
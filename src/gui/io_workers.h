@@ -0,0 +1,88 @@
+#ifndef BTC_TRADER_IO_WORKERS_H_
+#define BTC_TRADER_IO_WORKERS_H_
+
+#include <stdio.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "trading_agency.h"
+#include "utils.h"
+
+/*****************************************************
+ * io_workers:
+ *   background threads for exchange I/O.
+ *
+ *   job->fetch() runs on a worker thread (blocking curl calls are allowed),
+ *   job->apply() runs on the GTK main thread (via g_idle_add)
+ *   and should only copy the prepared model into the widgets.
+ *
+ *   if job->agent is set and the agency's event loop is running,
+ *   fetch() is executed on the agency thread instead of the io_workers.
+ *   a job with fetch_async() does not block the agency thread there:
+ *   it starts a non-blocking request (e.g. trading_agency_async_get()), 
+ *   and the response handler calls io_job_fetched().
+*****************************************************/
+#define IO_WORKERS_DEFAULT_THREADS (2) // fallback only, requests normally run on the agency's event loop
+#define IO_WORKERS_FRAME_BUDGET (0.016) // 16 ms
+#define IO_WORKERS_DRAIN_TIMEOUT (5) // seconds, cleanup() waits for the jobs still on an agency's event loop
+
+struct io_workers_context;
+struct io_job
+{
+	struct io_job * next;
+	struct io_workers_context * io;
+	trading_agency_t * agent;	// (nullable) run fetch() on the agency's event loop
+
+	const void * key;	// (nullable) jobs with the same key are not queued twice
+	void * user_data;
+	int rc;
+
+	int (* fetch)(struct io_job * job);		// worker thread
+	int (* fetch_async)(struct io_job * job);	// (nullable) agency thread, 0: io_job_fetched() will be called
+	void (* apply)(struct io_job * job);	// GTK main thread
+	void (* free_job)(struct io_job * job);	// (nullable) default: free(job)
+	
+	struct trading_agency_job * agency_job;	// (private) fetch_async() in flight
+};
+
+typedef struct io_workers_context
+{
+	void * priv;
+	void * user_data;
+
+	int num_workers;
+	int quit;
+	int is_running;
+
+	// statistics
+	perf_stats_t fetch_stats[1];	// workers
+	perf_stats_t frame_stats[1];	// time spent in job->apply() on the GTK main thread
+	int64_t num_skipped;			// jobs dropped because the same key was still in flight
+
+	int (* run)(struct io_workers_context * io);
+	int (* stop)(struct io_workers_context * io);
+	int (* submit)(struct io_workers_context * io, struct io_job * job);
+}io_workers_context_t;
+
+io_workers_context_t * io_workers_context_init(io_workers_context_t * io, int num_workers, void * user_data);
+void io_workers_context_cleanup(io_workers_context_t * io);
+
+struct io_job * io_job_new(size_t size, const void * key,
+	int (* fetch)(struct io_job *), void (* apply)(struct io_job *),
+	void * user_data);
+
+// hand over a job whose request was completed elsewhere (e.g. a trading_agency_command)
+// to the GTK main thread, job->apply() will be called there.
+// (after stop()) the job is not applied, io_workers_context_cleanup() releases it.
+int io_workers_complete(io_workers_context_t * io, struct io_job * job);
+
+// (agency thread) the request started by job->fetch_async() has been handled
+void io_job_fetched(struct io_job * job, int rc);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
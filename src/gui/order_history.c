@@ -31,10 +31,12 @@
 #include <string.h>
 #include <assert.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <json-c/json.h>
 #include <time.h>
 
 #include "order_history.h"
+#include "array_model.h"
 #include "utils.h"
 #include "trading_agency_coincheck.h"
 
@@ -86,11 +88,8 @@ static json_object * get_order_history(trading_agency_t * agent)
 	return jorders;
 }
 
-static int order_details_compare(const void * pa, const void * pb)
+static int order_details_cmp(const struct order_details * a, const struct order_details * b)
 {
-	const struct order_details * a = *(const void **)pa;
-	const struct order_details * b = *(const void **)pb;
-	
 	// order by order_id DESC
 	if(a->order_id > b->order_id) return -1;
 	if(a->order_id < b->order_id) return 1;
@@ -99,9 +98,17 @@ static int order_details_compare(const void * pa, const void * pb)
 	if(a->created_at > b->created_at) return -1;
 	if(a->created_at < b->created_at) return 1;
 	
+	// order by id DESC (a total order: the tree model merges the lists by it)
+	if(a->id > b->id) return -1;
+	if(a->id < b->id) return 1;
 	return 0;
 }
 
+static int order_details_compare(const void * pa, const void * pb)
+{
+	return order_details_cmp(*(const void **)pa, *(const void **)pb);
+}
+
 static int parse_json_orders(struct order_history * history, json_object * jorders)
 {
 	assert(history);
@@ -195,11 +202,8 @@ static json_object * get_unsettled_orders(trading_agency_t * agent)
 	return jorders;
 }
 
-static int unsettled_order_details_compare(const void * pa, const void * pb)
+static int unsettled_order_details_cmp(const struct unsettled_order_details * a, const struct unsettled_order_details * b)
 {
-	const struct unsettled_order_details * a = *(const void **)pa;
-	const struct unsettled_order_details * b = *(const void **)pb;
-	
 	// order by order_id DESC
 	if(a->order_id > b->order_id) return -1;
 	if(a->order_id < b->order_id) return 1;
@@ -211,6 +215,11 @@ static int unsettled_order_details_compare(const void * pa, const void * pb)
 	return 0;
 }
 
+static int unsettled_order_details_compare(const void * pa, const void * pb)
+{
+	return unsettled_order_details_cmp(*(const void **)pa, *(const void **)pb);
+}
+
 static int parse_json_unsettled_orders(struct order_history * history, json_object * junsettled_orders)
 {
 	assert(history);
@@ -267,6 +276,7 @@ static void clear_orders_list(struct order_history * history)
 			free(history->orders[i]);
 			history->orders[i] = NULL;
 		}
+		free(history->orders);
 		history->orders = NULL;
 	}
 	history->num_orders = 0;
@@ -286,6 +296,7 @@ static void clear_unsettled_order_list(struct order_history * history)
 			free(history->unsettled_orders[i]);
 			history->unsettled_orders[i] = NULL;
 		}
+		free(history->unsettled_orders);
 		history->unsettled_orders = NULL;
 	}
 	history->num_unsettled_orders = 0;
@@ -324,6 +335,17 @@ struct order_history * order_history_init(struct order_history * history)
 	history->get_orders = order_history_get_orders;
 	return history;
 }
+int order_history_load_json(struct order_history * history, json_object * jorders, json_object * junsettled_orders)
+{
+	assert(history);
+	clear_orders_list(history);
+	parse_json_orders(history, jorders);
+	
+	clear_unsettled_order_list(history);
+	parse_json_unsettled_orders(history, junsettled_orders);
+	return 0;
+}
+
 void order_history_cleanup(struct order_history * history)
 {
 	if(NULL == history) return;
@@ -353,35 +375,161 @@ const char * order_history_colname(enum ORDER_HISTORY_COLUMN col_id)
 	return s_order_history_colnames[col_id];
 }
 
+/*
+ * the tree models read the order lists directly (array_model),
+ * a list must stay valid until the next order_history_update() has returned.
+ */
+static const void * get_order_row(const void * data, int index)
+{
+	return ((struct order_details * const *)data)[index];
+}
+
+static void get_order_value(const void * row, int column, GValue * value)
+{
+	const struct order_details * order = row;
+	switch(column)
+	{
+	case ORDER_HISTORY_COLUMN_order_id: g_value_set_int64(value, order->order_id); break;
+	case ORDER_HISTORY_COLUMN_funds_btc: g_value_set_static_string(value, order->btc); break;
+	case ORDER_HISTORY_COLUMN_funds_jpy: g_value_set_static_string(value, order->jpy); break;
+	case ORDER_HISTORY_COLUMN_rate: g_value_set_static_string(value, order->rate); break;
+	case ORDER_HISTORY_COLUMN_side: g_value_set_static_string(value, order->side); break;
+	case ORDER_HISTORY_COLUMN_liquidity: g_value_set_static_string(value, order->liquidity); break;
+	case ORDER_HISTORY_COLUMN_created_at: g_value_set_static_string(value, order->sz_created_at); break;	// UTC, shown by set_local_time()
+	default: break;		// data_ptr: parent rows only
+	}
+}
+
+// parent rows (one per order_id) only carry data_ptr: the latest transaction
+static void get_order_group_value(const void * first_row, int column, GValue * value)
+{
+	if(column == ORDER_HISTORY_COLUMN_data_ptr) g_value_set_pointer(value, (gpointer)first_row);
+}
+
+static int compare_orders(const void * a, const void * b)
+{
+	return order_details_cmp(a, b);
+}
+
+static int compare_order_ids(const void * a, const void * b)
+{
+	const struct order_details * order_a = a;
+	const struct order_details * order_b = b;
+	if(order_a->order_id > order_b->order_id) return -1;
+	if(order_a->order_id < order_b->order_id) return 1;
+	return 0;
+}
+
+// a transaction does not change once reported
+static int orders_equal(const void * a, const void * b)
+{
+	const struct order_details * order_a = a;
+	const struct order_details * order_b = b;
+	return order_a->created_at == order_b->created_at 
+		&& strcmp(order_a->btc, order_b->btc) == 0
+		&& strcmp(order_a->jpy, order_b->jpy) == 0;
+}
+
+static const GType s_order_history_types[ORDER_HISTORY_COLUMNS_COUNT] = {
+	[ORDER_HISTORY_COLUMN_order_id] = G_TYPE_INT64,
+	[ORDER_HISTORY_COLUMN_funds_btc] = G_TYPE_STRING,
+	[ORDER_HISTORY_COLUMN_funds_jpy] = G_TYPE_STRING,
+	[ORDER_HISTORY_COLUMN_rate] = G_TYPE_STRING,
+	[ORDER_HISTORY_COLUMN_side] = G_TYPE_STRING,
+	[ORDER_HISTORY_COLUMN_liquidity] = G_TYPE_STRING,
+	[ORDER_HISTORY_COLUMN_created_at] = G_TYPE_STRING,
+	[ORDER_HISTORY_COLUMN_data_ptr] = G_TYPE_POINTER,
+};
+
+static const struct array_model_spec s_order_history_spec = {
+	.n_columns = ORDER_HISTORY_COLUMNS_COUNT,
+	.column_types = s_order_history_types,
+	.get_row = get_order_row,
+	.get_value = get_order_value,
+	.compare_rows = compare_orders,
+	.rows_equal = orders_equal,
+	.compare_groups = compare_order_ids,
+	.get_group_value = get_order_group_value,
+};
+
+static const void * get_unsettled_order_row(const void * data, int index)
+{
+	return ((struct unsettled_order_details * const *)data)[index];
+}
+
+static void get_unsettled_order_value(const void * row, int column, GValue * value)
+{
+	const struct unsettled_order_details * order = row;
+	switch(column)
+	{
+	case UNSETTLED_LIST_COLUMN_order_id: g_value_set_int64(value, order->order_id); break;
+	case UNSETTLED_LIST_COLUMN_order_type: g_value_set_static_string(value, order->order_type); break;
+	case UNSETTLED_LIST_COLUMN_rate: g_value_set_static_string(value, order->rate); break;
+	case UNSETTLED_LIST_COLUMN_pending_amount: g_value_set_static_string(value, order->pending_amount); break;
+	case UNSETTLED_LIST_COLUMN_created_at: g_value_set_static_string(value, order->sz_created_at); break;
+	case UNSETTLED_LIST_COLUMN_data_ptr: g_value_set_pointer(value, (gpointer)order); break;
+	default: break;
+	}
+}
+
+static int compare_unsettled_orders(const void * a, const void * b)
+{
+	return unsettled_order_details_cmp(a, b);
+}
+
+static int unsettled_orders_equal(const void * a, const void * b)
+{
+	const struct unsettled_order_details * order_a = a;
+	const struct unsettled_order_details * order_b = b;
+	return strcmp(order_a->pending_amount, order_b->pending_amount) == 0
+		&& strcmp(order_a->rate, order_b->rate) == 0
+		&& strcmp(order_a->order_type, order_b->order_type) == 0;
+}
+
+static const GType s_unsettled_list_types[UNSETTLED_LIST_COLUMNS_COUNT] = {
+	[UNSETTLED_LIST_COLUMN_order_id] = G_TYPE_INT64,
+	[UNSETTLED_LIST_COLUMN_order_type] = G_TYPE_STRING,
+	[UNSETTLED_LIST_COLUMN_rate] = G_TYPE_STRING,
+	[UNSETTLED_LIST_COLUMN_pending_amount] = G_TYPE_STRING,
+	[UNSETTLED_LIST_COLUMN_created_at] = G_TYPE_STRING,
+	[UNSETTLED_LIST_COLUMN_data_ptr] = G_TYPE_POINTER,
+	[ORDER_HISTORY_COLUMN_cancel_button] = G_TYPE_STRING,	// icon-name, unset
+};
+
+static const struct array_model_spec s_unsettled_list_spec = {
+	.n_columns = UNSETTLED_LIST_COLUMNS_COUNT,
+	.column_types = s_unsettled_list_types,
+	.get_row = get_unsettled_order_row,
+	.get_value = get_unsettled_order_value,
+	.compare_rows = compare_unsettled_orders,
+	.rows_equal = unsettled_orders_equal,
+};
+
 static void set_details_or_order_id(GtkTreeViewColumn *col, 
 	GtkCellRenderer *cr,
 	GtkTreeModel *model,
 	GtkTreeIter *iter,
 	gpointer user_data)
 {
-	void * data_ptr = NULL;
-	char * side = NULL;
-	
 	gint col_id = GPOINTER_TO_INT(user_data);
-	gtk_tree_model_get(model, iter, 
-		ORDER_HISTORY_COLUMN_side, &side,
-		ORDER_HISTORY_COLUMN_data_ptr, &data_ptr, -1);
-	if(data_ptr) {
+	gboolean is_group = FALSE;
+	const struct order_details * order = array_model_get_row(ARRAY_MODEL(model), iter, &is_group);
+	if(NULL == order) return;
+	
+	if(is_group) {
 		if(col_id != ORDER_HISTORY_COLUMN_rate) return;
 		
 		char text[100] = "";
-		snprintf(text, sizeof(text), "id: %lu", (unsigned long)((struct order_details *)data_ptr)->order_id);
+		snprintf(text, sizeof(text), "id: %lu", (unsigned long)order->order_id);
 		g_object_set(cr, 
 			"text", text, 
 			"foreground", "black",
 			NULL);
 	}else {
-		char * text = NULL;
-		assert(col_id != ORDER_HISTORY_COLUMN_order_id && col_id < ORDER_HISTORY_COLUMNS_COUNT);
-		gtk_tree_model_get(model, iter, col_id, &text, -1);
-		
+		assert(col_id == ORDER_HISTORY_COLUMN_rate || col_id == ORDER_HISTORY_COLUMN_side);
+		const char * text = (col_id == ORDER_HISTORY_COLUMN_rate)?order->rate:order->side;
 		if(NULL == text) text = "";
-		int is_buy_order = (strcasecmp(side, "buy") == 0);
+		int is_buy_order = (order->side && strcasecmp(order->side, "buy") == 0);
 		
 		g_object_set(cr, 
 			"text", text, 
@@ -391,19 +539,25 @@ static void set_details_or_order_id(GtkTreeViewColumn *col,
 	return;
 }
 
-static inline GtkTreeStore * new_order_history_store(void)
+// user_data: offsetof(row, created_at); empty on parent rows
+static void set_local_time(GtkTreeViewColumn *col, 
+	GtkCellRenderer *cr,
+	GtkTreeModel *model,
+	GtkTreeIter *iter,
+	gpointer user_data)
 {
-	GtkTreeStore * store = gtk_tree_store_new(ORDER_HISTORY_COLUMNS_COUNT, 
-		G_TYPE_INT64, 	// order_id
-		G_TYPE_STRING, 	// btc
-		G_TYPE_STRING, 	// jpy
-		G_TYPE_STRING, 	// rate
-		G_TYPE_STRING, 	// side
-		G_TYPE_STRING,	// liquidity
-		G_TYPE_STRING,	// created_at
-		G_TYPE_POINTER 	// data_ptr
-	);
-	return store;
+	char timestamp[100] = "";
+	gboolean is_group = FALSE;
+	const char * row = array_model_get_row(ARRAY_MODEL(model), iter, &is_group);
+	if(row && !is_group) {
+		/* convert gmtime to localtime */
+		time_t created_at = *(const time_t *)(row + GPOINTER_TO_INT(user_data));
+		struct tm t[1];
+		memset(t, 0, sizeof(t));
+		localtime_r(&created_at, t);
+		strftime(timestamp, sizeof(timestamp), "%Y/%m/%d %H:%M:%S %Z", t);
+	}
+	g_object_set(cr, "text", timestamp, NULL);
 }
 
 void init_order_history_tree(GtkTreeView * tree)
@@ -447,12 +601,13 @@ void init_order_history_tree(GtkTreeView * tree)
 	col = gtk_tree_view_column_new_with_attributes("timestamp", cr, "text", ORDER_HISTORY_COLUMN_created_at, NULL);
 	gtk_tree_view_column_set_resizable(col, TRUE);
 	gtk_tree_view_column_set_reorderable(col, TRUE);
+	gtk_tree_view_column_set_cell_data_func(col, cr, set_local_time, GINT_TO_POINTER(offsetof(struct order_details, created_at)), NULL);
 	gtk_tree_view_append_column(tree, col);
 	gtk_tree_view_column_set_expand(col, TRUE);
 	
-	GtkTreeStore * store = new_order_history_store();
-	gtk_tree_view_set_model(tree, GTK_TREE_MODEL(store));
-	g_object_unref(store);
+	ArrayModel * model = array_model_new(&s_order_history_spec);
+	gtk_tree_view_set_model(tree, GTK_TREE_MODEL(model));
+	g_object_unref(model);
 	return;
 }
 
@@ -468,20 +623,6 @@ void init_order_history_tree(GtkTreeView * tree)
 	//~ UNSETTLED_LIST_COLUMNS_COUNT
 //~ };
 
-static inline GtkListStore * new_unsettled_orders_store(void)
-{
-	GtkListStore * store = gtk_list_store_new(UNSETTLED_LIST_COLUMNS_COUNT, 
-		G_TYPE_INT64, 	// order_id
-		G_TYPE_STRING, 	// order_type
-		G_TYPE_STRING, 	// rate
-		G_TYPE_STRING, 	// pending_amount
-		G_TYPE_STRING,	// created_at
-		G_TYPE_POINTER, 	// data_ptr
-		G_TYPE_STRING	// icon-name of the cancel_button
-	);
-	return store;
-}
-
 void init_unsettled_list_tree(GtkTreeView * tree)
 {
 	GtkTreeViewColumn * col = NULL;
@@ -526,13 +667,13 @@ void init_unsettled_list_tree(GtkTreeView * tree)
 	col = gtk_tree_view_column_new_with_attributes("timestamp", cr, "text", UNSETTLED_LIST_COLUMN_created_at, NULL); 
 	gtk_tree_view_column_set_resizable(col, TRUE);
 	gtk_tree_view_column_set_reorderable(col, TRUE);
+	gtk_tree_view_column_set_cell_data_func(col, cr, set_local_time, GINT_TO_POINTER(offsetof(struct unsettled_order_details, created_at)), NULL);
 	gtk_tree_view_append_column(tree, col);
 	gtk_tree_view_column_set_expand(col, TRUE);
 	
-	
-	GtkListStore * store = new_unsettled_orders_store();
-	gtk_tree_view_set_model(tree, GTK_TREE_MODEL(store));
-	g_object_unref(store);
+	ArrayModel * model = array_model_new(&s_unsettled_list_spec);
+	gtk_tree_view_set_model(tree, GTK_TREE_MODEL(model));
+	g_object_unref(model);
 	
 	gtk_tree_view_set_activate_on_single_click(tree, TRUE);
 	
@@ -540,83 +681,22 @@ void init_unsettled_list_tree(GtkTreeView * tree)
 }
 
 
+// the models switch to @history's lists, the previous lists must still be valid (released afterwards)
 void order_history_update(struct order_history * history, GtkTreeView * orders_tree, GtkTreeView * unsettled_tree)
 {
 	if(orders_tree) {
-		GtkTreeStore * store = new_order_history_store();
-		GtkTreeIter parent, iter;
-		
-		int64_t prev_order_id = -1;
-		for(int i = 0; i < history->num_orders; ++i) {
-			struct order_details * order = history->orders[i];
-			assert(order);
-			if(prev_order_id != order->order_id) {
-				prev_order_id = order->order_id;
-				
-				gtk_tree_store_append(store, &parent, NULL);
-				gtk_tree_store_set(store, &parent, 
-					ORDER_HISTORY_COLUMN_data_ptr, order, 
-					-1);
-
-			}
-			
-			/* convert gmtime to localtime */
-			char timestamp[100] = "";
-			struct tm t[1];
-			memset(t, 0, sizeof(t));
-			localtime_r(&order->created_at, t);
-			strftime(timestamp, sizeof(timestamp), "%Y/%m/%d %H:%M:%S %Z", t);
-			
-			gtk_tree_store_append(store, &iter, &parent);
-			gtk_tree_store_set(store, &iter, 
-				ORDER_HISTORY_COLUMN_order_id, order->order_id,
-				ORDER_HISTORY_COLUMN_created_at, timestamp,
-				ORDER_HISTORY_COLUMN_funds_btc, order->btc,
-				ORDER_HISTORY_COLUMN_funds_jpy, order->jpy, 
-				ORDER_HISTORY_COLUMN_side, order->side,
-				ORDER_HISTORY_COLUMN_rate, order->rate,
-				ORDER_HISTORY_COLUMN_liquidity, order->liquidity,
-				-1);
-		}
-		gtk_tree_view_set_model(orders_tree, GTK_TREE_MODEL(store));
-		g_object_unref(store);
+		GtkTreeModel * model = gtk_tree_view_get_model(orders_tree);
+		assert(model && IS_ARRAY_MODEL(model));
 		
-		gtk_tree_view_expand_all(orders_tree);
+		struct array_model_changes changes[1];
+		array_model_set_data(ARRAY_MODEL(model), history->orders, history->num_orders, changes);
+		if(changes->num_groups_inserted > 0) gtk_tree_view_expand_all(orders_tree);
 	}
 	
 	if(unsettled_tree) {
-		GtkListStore * store = new_unsettled_orders_store();
-		GtkTreeIter iter;
-		
-		for(int i = 0; i < history->num_unsettled_orders; ++i) {
-			struct unsettled_order_details * unsettled = history->unsettled_orders[i];
-			assert(unsettled);
-			
-			char timestamp[100] = "";
-			struct tm t[1];
-			memset(t, 0, sizeof(t));
-			localtime_r(&unsettled->created_at, t);
-			strftime(timestamp, sizeof(timestamp), "%Y/%m/%d %H:%M:%S %Z", t);
-			
-			gtk_list_store_append(store, &iter);
-			gtk_list_store_set(store, &iter,
-				UNSETTLED_LIST_COLUMN_order_type, unsettled->order_type,
-				UNSETTLED_LIST_COLUMN_order_id, unsettled->order_id,
-				UNSETTLED_LIST_COLUMN_rate, unsettled->rate,
-				UNSETTLED_LIST_COLUMN_pending_amount, unsettled->pending_amount,
-				UNSETTLED_LIST_COLUMN_created_at, timestamp,
-				UNSETTLED_LIST_COLUMN_data_ptr, unsettled,
-				-1);
-		}
-		
-		gtk_tree_view_set_model(unsettled_tree, GTK_TREE_MODEL(store));
-		g_object_unref(store);
+		GtkTreeModel * model = gtk_tree_view_get_model(unsettled_tree);
+		assert(model && IS_ARRAY_MODEL(model));
+		array_model_set_data(ARRAY_MODEL(model), history->unsettled_orders, history->num_unsettled_orders, NULL);
 	}
 	return;
 }
-
-
-
-
-
-
@@ -50,6 +50,8 @@ struct order_history
 };
 struct order_history * order_history_init(struct order_history * history);
 void order_history_cleanup(struct order_history * history);
+// rebuild the lists from previously fetched arrays (e.g. a snapshot), takes a reference of each
+int order_history_load_json(struct order_history * history, json_object * jorders, json_object * junsettled_orders);
 
 
 /********************************
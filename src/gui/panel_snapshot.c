@@ -0,0 +1,502 @@
+/*
+ * panel_snapshot.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "panel_snapshot.h"
+#include "utils.h"
+
+/*****************************************************
+ * file format
+*****************************************************/
+struct panel_snapshot_header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t num_sections;
+	int64_t saved_at;
+	uint32_t body_size;
+	uint32_t checksum;	// FNV-1a of the body
+}__attribute__((packed));
+
+struct panel_snapshot_section
+{
+	uint32_t type;		// enum PANEL_SNAPSHOT_SECTION
+	uint32_t length;
+}__attribute__((packed));
+
+struct snapshot_ticker
+{
+	double last;
+	double bid;
+	double ask;
+	double high;
+	double low;
+	double volume;
+	int64_t timestamp;
+}__attribute__((packed));
+
+static uint32_t fnv1a(const unsigned char * data, size_t length)
+{
+	uint32_t hash = 2166136261u;
+	for(size_t i = 0; i < length; ++i) {
+		hash ^= data[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/*****************************************************
+ * encoder
+*****************************************************/
+static int push_string(auto_buffer_t * buf, const char * str)
+{
+	if(NULL == str) str = "";
+	size_t length = strlen(str);
+	if(length > UINT16_MAX) return -1;
+	
+	uint16_t cb = length;
+	int rc = auto_buffer_push(buf, &cb, sizeof(cb));
+	if(0 == rc && length > 0) rc = auto_buffer_push(buf, str, length);
+	if(0 == rc) rc = auto_buffer_push(buf, "", 1);	// auto_buffer_push() treats -1 as strlen
+	return rc;
+}
+
+static inline void push_nul(auto_buffer_t * buf)
+{
+	static const unsigned char nul = 0;
+	auto_buffer_push(buf, &nul, 1);
+	return;
+}
+
+// reserve the section header, return its offset
+static size_t begin_section(auto_buffer_t * buf, uint32_t type)
+{
+	size_t offset = buf->length;
+	struct panel_snapshot_section section = { .type = type };
+	auto_buffer_push(buf, &section, sizeof(section));
+	return offset;
+}
+
+static void end_section(auto_buffer_t * buf, size_t offset)
+{
+	struct panel_snapshot_section * section = (void *)(buf->data + buf->start_pos + offset);
+	section->length = buf->length - offset - sizeof(*section);
+	return;
+}
+
+static int push_json(auto_buffer_t * buf, json_object * jobject)
+{
+	const char * text = json_object_to_json_string_ext(jobject, JSON_C_TO_STRING_PLAIN);
+	if(NULL == text) return -1;
+	int rc = auto_buffer_push(buf, text, strlen(text));
+	if(0 == rc) push_nul(buf);
+	return rc;
+}
+
+int panel_snapshot_serialize(const struct panel_snapshot * snapshot, auto_buffer_t * buf)
+{
+	assert(snapshot && buf);
+	size_t header_offset = buf->length;
+	struct panel_snapshot_header hdr = {
+		.magic = PANEL_SNAPSHOT_MAGIC,
+		.version = PANEL_SNAPSHOT_VERSION,
+		.saved_at = snapshot->saved_at,
+	};
+	int rc = auto_buffer_push(buf, &hdr, sizeof(hdr));
+	if(rc) return rc;
+	
+	size_t offset = 0;
+	uint32_t num_sections = 0;
+	unsigned int sections = snapshot->sections;
+	
+	if(sections & PANEL_SNAPSHOT_SECTION_ticker) {
+		struct snapshot_ticker ticker = {
+			.last = snapshot->ticker.last, .bid = snapshot->ticker.bid, .ask = snapshot->ticker.ask,
+			.high = snapshot->ticker.high, .low = snapshot->ticker.low, .volume = snapshot->ticker.volume,
+			.timestamp = snapshot->ticker.timestamp,
+		};
+		offset = begin_section(buf, PANEL_SNAPSHOT_SECTION_ticker);
+		auto_buffer_push(buf, &ticker, sizeof(ticker));
+		end_section(buf, offset);
+		++num_sections;
+	}
+	
+	if(sections & PANEL_SNAPSHOT_SECTION_balance) {
+		offset = begin_section(buf, PANEL_SNAPSHOT_SECTION_balance);
+		push_string(buf, snapshot->balance.btc);
+		push_string(buf, snapshot->balance.jpy);
+		push_string(buf, snapshot->balance.btc_reserved);
+		push_string(buf, snapshot->balance.jpy_reserved);
+		end_section(buf, offset);
+		++num_sections;
+	}
+	
+	if(sections & PANEL_SNAPSHOT_SECTION_order_book) {
+		uint32_t counts[2] = { snapshot->num_asks, snapshot->num_bids };
+		offset = begin_section(buf, PANEL_SNAPSHOT_SECTION_order_book);
+		auto_buffer_push(buf, counts, sizeof(counts));
+		for(int i = 0; i < snapshot->num_asks; ++i) {
+			push_string(buf, snapshot->asks[i].rate);
+			push_string(buf, snapshot->asks[i].amount);
+		}
+		for(int i = 0; i < snapshot->num_bids; ++i) {
+			push_string(buf, snapshot->bids[i].rate);
+			push_string(buf, snapshot->bids[i].amount);
+		}
+		end_section(buf, offset);
+		++num_sections;
+	}
+	
+	if((sections & PANEL_SNAPSHOT_SECTION_orders) && snapshot->jorders && snapshot->junsettled_orders) {
+		offset = begin_section(buf, PANEL_SNAPSHOT_SECTION_orders);
+		rc = push_json(buf, snapshot->jorders);
+		if(0 == rc) rc = push_json(buf, snapshot->junsettled_orders);
+		if(rc) {
+			buf->length = offset;	// drop the section
+		}else {
+			end_section(buf, offset);
+			++num_sections;
+		}
+	}
+	
+	// fill the header
+	struct panel_snapshot_header * p_hdr = (void *)(buf->data + buf->start_pos + header_offset);
+	const unsigned char * body = (const unsigned char *)(p_hdr + 1);
+	p_hdr->num_sections = num_sections;
+	p_hdr->body_size = buf->length - header_offset - sizeof(hdr);
+	p_hdr->checksum = fnv1a(body, p_hdr->body_size);
+	return 0;
+}
+
+int panel_snapshot_save(const char * path, const void * data, size_t length)
+{
+	assert(path && data);
+	char tmp_file[PATH_MAX] = "";
+	int cb = snprintf(tmp_file, sizeof(tmp_file), "%s.tmp", path);
+	if(cb <= 0 || cb >= sizeof(tmp_file)) return -1;
+	
+	int fd = open(tmp_file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if(fd < 0) {
+		perror("panel_snapshot_save::open()");
+		return -1;
+	}
+	
+	const unsigned char * p = data;
+	size_t left = length;
+	while(left > 0) {
+		ssize_t n = write(fd, p, left);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) break;
+		p += n;
+		left -= n;
+	}
+	
+	int rc = (0 == left)?fdatasync(fd):-1;
+	close(fd);
+	if(0 == rc) rc = rename(tmp_file, path);
+	if(rc) {
+		perror("panel_snapshot_save()");
+		unlink(tmp_file);
+		return -1;
+	}
+	return 0;
+}
+
+/*****************************************************
+ * decoder
+*****************************************************/
+struct reader
+{
+	const unsigned char * p;
+	const unsigned char * p_end;
+};
+
+static const char * read_string(struct reader * reader)
+{
+	uint16_t cb = 0;
+	if((reader->p + sizeof(cb)) > reader->p_end) return NULL;
+	memcpy(&cb, reader->p, sizeof(cb));
+	
+	const char * str = (const char *)reader->p + sizeof(cb);
+	if((reader->p + sizeof(cb) + cb + 1) > reader->p_end || str[cb] != '\0') return NULL;
+	reader->p += sizeof(cb) + cb + 1;
+	return str;
+}
+
+static json_object * read_json(struct reader * reader)
+{
+	const unsigned char * nul = memchr(reader->p, '\0', reader->p_end - reader->p);
+	if(NULL == nul) return NULL;
+	json_object * jobject = json_tokener_parse((const char *)reader->p);
+	reader->p = nul + 1;
+	
+	if(jobject && !json_object_is_type(jobject, json_type_array)) {
+		json_object_put(jobject);
+		jobject = NULL;
+	}
+	return jobject;
+}
+
+static int parse_levels(struct reader * reader, int count, struct panel_snapshot_level ** p_levels)
+{
+	if(count <= 0) return 0;
+	struct panel_snapshot_level * levels = calloc(count, sizeof(*levels));
+	assert(levels);
+	*p_levels = levels;
+	
+	for(int i = 0; i < count; ++i) {
+		levels[i].rate = read_string(reader);
+		levels[i].amount = read_string(reader);
+		if(NULL == levels[i].rate || NULL == levels[i].amount) return -1;
+	}
+	return 0;
+}
+
+static int parse_section(struct panel_snapshot * snapshot, uint32_t type, struct reader * reader)
+{
+	switch(type) {
+	case PANEL_SNAPSHOT_SECTION_ticker: {
+		struct snapshot_ticker ticker;
+		if((reader->p + sizeof(ticker)) > reader->p_end) return -1;
+		memcpy(&ticker, reader->p, sizeof(ticker));
+		snapshot->ticker.last = ticker.last;
+		snapshot->ticker.bid = ticker.bid;
+		snapshot->ticker.ask = ticker.ask;
+		snapshot->ticker.high = ticker.high;
+		snapshot->ticker.low = ticker.low;
+		snapshot->ticker.volume = ticker.volume;
+		snapshot->ticker.timestamp = ticker.timestamp;
+		break;
+	}
+	case PANEL_SNAPSHOT_SECTION_balance:
+		snapshot->balance.btc = read_string(reader);
+		snapshot->balance.jpy = read_string(reader);
+		snapshot->balance.btc_reserved = read_string(reader);
+		snapshot->balance.jpy_reserved = read_string(reader);
+		if(NULL == snapshot->balance.jpy_reserved) return -1;
+		break;
+	case PANEL_SNAPSHOT_SECTION_order_book: {
+		uint32_t counts[2];
+		if((reader->p + sizeof(counts)) > reader->p_end) return -1;
+		memcpy(counts, reader->p, sizeof(counts));
+		reader->p += sizeof(counts);
+		
+		// each level takes at least 6 bytes
+		size_t left = reader->p_end - reader->p;
+		if(counts[0] > left / 6 || counts[1] > left / 6) return -1;
+		
+		snapshot->num_asks = counts[0];
+		snapshot->num_bids = counts[1];
+		if(parse_levels(reader, snapshot->num_asks, &snapshot->asks)) return -1;
+		if(parse_levels(reader, snapshot->num_bids, &snapshot->bids)) return -1;
+		break;
+	}
+	case PANEL_SNAPSHOT_SECTION_orders:
+		snapshot->jorders = read_json(reader);
+		snapshot->junsettled_orders = read_json(reader);
+		if(NULL == snapshot->jorders || NULL == snapshot->junsettled_orders) return -1;
+		break;
+	default:
+		return 1;	// unknown section (newer writer), skip it
+	}
+	return 0;
+}
+
+static int parse_owned(struct panel_snapshot * snapshot, void * data, size_t length)
+{
+	memset(snapshot, 0, sizeof(*snapshot));
+	snapshot->data = data;
+	snapshot->length = length;
+	
+	struct panel_snapshot_header hdr;
+	if(length < sizeof(hdr)) return -1;
+	memcpy(&hdr, data, sizeof(hdr));
+	if(memcmp(hdr.magic, PANEL_SNAPSHOT_MAGIC, sizeof(hdr.magic)) != 0
+		|| hdr.version != PANEL_SNAPSHOT_VERSION
+		|| hdr.body_size != (length - sizeof(hdr))) return -1;
+	
+	const unsigned char * body = (unsigned char *)data + sizeof(hdr);
+	if(fnv1a(body, hdr.body_size) != hdr.checksum) return -1;
+	
+	snapshot->saved_at = hdr.saved_at;
+	const unsigned char * p_end = body + hdr.body_size;
+	const unsigned char * p = body;
+	for(uint32_t i = 0; i < hdr.num_sections; ++i) {
+		struct panel_snapshot_section section;
+		if((p + sizeof(section)) > p_end) return -1;
+		memcpy(&section, p, sizeof(section));
+		p += sizeof(section);
+		if(section.length > (p_end - p)) return -1;
+		
+		struct reader reader = { .p = p, .p_end = p + section.length };
+		int rc = parse_section(snapshot, section.type, &reader);
+		if(rc < 0) return -1;
+		if(0 == rc) snapshot->sections |= section.type;
+		p += section.length;
+	}
+	return 0;
+}
+
+int panel_snapshot_parse(struct panel_snapshot * snapshot, const void * data, size_t length)
+{
+	assert(snapshot && data);
+	void * copy = malloc(length + 1);
+	assert(copy);
+	memcpy(copy, data, length);
+	
+	int rc = parse_owned(snapshot, copy, length);
+	if(rc) panel_snapshot_cleanup(snapshot);
+	return rc;
+}
+
+int panel_snapshot_load(struct panel_snapshot * snapshot, const char * path)
+{
+	assert(snapshot && path);
+	memset(snapshot, 0, sizeof(*snapshot));
+	
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0) return -1;
+	
+	struct stat st[1];
+	memset(st, 0, sizeof(st));
+	if(fstat(fd, st) != 0 || st->st_size <= 0 || st->st_size > PANEL_SNAPSHOT_MAX_SIZE) {
+		close(fd);
+		return -1;
+	}
+	
+	size_t length = st->st_size;
+	unsigned char * data = malloc(length + 1);
+	assert(data);
+	size_t offset = 0;
+	while(offset < length) {
+		ssize_t n = read(fd, data + offset, length - offset);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) break;
+		offset += n;
+	}
+	close(fd);
+	
+	if(offset != length) {
+		free(data);
+		return -1;
+	}
+	
+	int rc = parse_owned(snapshot, data, length);
+	if(rc) {
+		fprintf(stderr, "[WARNING]: '%s' is not a valid snapshot, ignored.\n", path);
+		panel_snapshot_cleanup(snapshot);
+	}
+	return rc;
+}
+
+void panel_snapshot_cleanup(struct panel_snapshot * snapshot)
+{
+	if(NULL == snapshot) return;
+	free(snapshot->asks);
+	free(snapshot->bids);
+	if(snapshot->jorders) json_object_put(snapshot->jorders);
+	if(snapshot->junsettled_orders) json_object_put(snapshot->junsettled_orders);
+	free(snapshot->data);
+	memset(snapshot, 0, sizeof(*snapshot));
+	return;
+}
+
+
+#if defined(_TEST_PANEL_SNAPSHOT) && defined(_STAND_ALONE)
+int main(int argc, char ** argv)
+{
+	const char * path = (argc > 1)?argv[1]:"/tmp/test_panel_snapshot.bin";
+	
+	struct panel_snapshot_level asks[] = { {"4000010.0", "0.5"}, {"4000020.0", "1.25"} };
+	struct panel_snapshot_level bids[] = { {"3999990.0", "0.01"} };
+	struct panel_snapshot snapshot = {
+		.saved_at = (int64_t)time(NULL) * 1000,
+		.sections = PANEL_SNAPSHOT_SECTION_all,
+		.ticker = { .last = 4000000.0, .bid = 3999990.0, .ask = 4000010.0, .timestamp = time(NULL) },
+		.balance = { .btc = "0.1", .jpy = "100000", .btc_reserved = "0.0", .jpy_reserved = "500.0" },
+		.num_asks = 2, .asks = asks,
+		.num_bids = 1, .bids = bids,
+		.jorders = json_tokener_parse("[{\"id\": 1, \"order_id\": 2, \"rate\": \"4000000.0\"}]"),
+		.junsettled_orders = json_tokener_parse("[]"),
+	};
+	
+	auto_buffer_t buf[1];
+	auto_buffer_init(buf, 0);
+	int rc = panel_snapshot_serialize(&snapshot, buf);
+	assert(0 == rc);
+	printf("snapshot size: %ld bytes\n", (long)buf->length);
+	
+	rc = panel_snapshot_save(path, buf->data + buf->start_pos, buf->length);
+	assert(0 == rc);
+	
+	app_timer_t timer[1];
+	app_timer_start(timer);
+	struct panel_snapshot loaded[1];
+	rc = panel_snapshot_load(loaded, path);
+	double elapsed = app_timer_stop(timer);
+	assert(0 == rc);
+	printf("load: %.3f ms\n", elapsed * 1000.0);
+	
+	assert(loaded->sections == PANEL_SNAPSHOT_SECTION_all);
+	assert(loaded->saved_at == snapshot.saved_at);
+	assert(loaded->ticker.last == snapshot.ticker.last);
+	assert(0 == strcmp(loaded->balance.jpy_reserved, "500.0"));
+	assert(loaded->num_asks == 2 && loaded->num_bids == 1);
+	assert(0 == strcmp(loaded->asks[1].amount, "1.25"));
+	assert(0 == strcmp(loaded->bids[0].rate, "3999990.0"));
+	assert(json_object_array_length(loaded->jorders) == 1);
+	assert(json_object_array_length(loaded->junsettled_orders) == 0);
+	panel_snapshot_cleanup(loaded);
+	
+	// a corrupted snapshot must be rejected
+	buf->data[buf->start_pos + buf->length - 3] ^= 0x5a;
+	rc = panel_snapshot_parse(loaded, buf->data + buf->start_pos, buf->length);
+	assert(rc != 0);
+	
+	// a truncated one too
+	rc = panel_snapshot_parse(loaded, buf->data + buf->start_pos, buf->length / 2);
+	assert(rc != 0);
+	
+	json_object_put(snapshot.jorders);
+	json_object_put(snapshot.junsettled_orders);
+	auto_buffer_cleanup(buf);
+	unlink(path);
+	printf("OK\n");
+	return 0;
+}
+#endif
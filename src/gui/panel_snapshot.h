@@ -0,0 +1,101 @@
+#ifndef BTC_TRADER_PANEL_SNAPSHOT_H_
+#define BTC_TRADER_PANEL_SNAPSHOT_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <json-c/json.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "auto_buffer.h"
+
+/*****************************************************
+ * panel_snapshot:
+ *   warm-start state of a panel (ticker, balance, order book, orders),
+ *   written periodically and restored at startup before the first request.
+ *
+ *   file layout (native byte order, the file never leaves this host):
+ *     header { magic "PNLSNAP1", version, num_sections, saved_at, body_size, checksum }
+ *     sections { uint32 type, uint32 length, payload[length] } ...
+ *
+ *   strings are stored as (uint16 length, bytes, '\0'),
+ *   a loaded snapshot points into its own file buffer, nothing is copied.
+ *   orders / unsettled orders are kept as the server's json text.
+ *
+ *   the sections are also used as the panel's 'stale' bits:
+ *   restored data is shown dimmed until the first response replaces it.
+*****************************************************/
+#define PANEL_SNAPSHOT_MAGIC "PNLSNAP1"
+#define PANEL_SNAPSHOT_VERSION (1)
+#define PANEL_SNAPSHOT_INTERVAL (10)	// seconds
+#define PANEL_SNAPSHOT_MAX_SIZE (64 * 1024 * 1024)
+
+enum PANEL_SNAPSHOT_SECTION
+{
+	PANEL_SNAPSHOT_SECTION_ticker = 1 << 0,
+	PANEL_SNAPSHOT_SECTION_balance = 1 << 1,
+	PANEL_SNAPSHOT_SECTION_order_book = 1 << 2,
+	PANEL_SNAPSHOT_SECTION_orders = 1 << 3,	// order history + unsettled orders
+	PANEL_SNAPSHOT_SECTION_all = (1 << 4) - 1,
+};
+
+struct panel_snapshot_level
+{
+	const char * rate;
+	const char * amount;
+};
+
+struct panel_snapshot
+{
+	int64_t saved_at;		// ms
+	unsigned int sections;	// PANEL_SNAPSHOT_SECTION_xxx present
+
+	struct {
+		double last;
+		double bid;
+		double ask;
+		double high;
+		double low;
+		double volume;
+		int64_t timestamp;
+	}ticker;
+
+	struct {
+		const char * btc;
+		const char * jpy;
+		const char * btc_reserved;
+		const char * jpy_reserved;
+	}balance;
+
+	int num_asks;
+	int num_bids;
+	struct panel_snapshot_level * asks;
+	struct panel_snapshot_level * bids;
+
+	json_object * jorders;				// (nullable) transactions array
+	json_object * junsettled_orders;	// (nullable) unsettled orders array
+
+	// (loaded snapshot only) owned data
+	void * data;
+	size_t length;
+};
+
+// encode @snapshot (only the sections in snapshot->sections) and append it to @buf
+int panel_snapshot_serialize(const struct panel_snapshot * snapshot, auto_buffer_t * buf);
+
+// write to '<path>.tmp', sync and rename to @path, so a crash never leaves a torn snapshot
+int panel_snapshot_save(const char * path, const void * data, size_t length);
+
+// (thread-safe, no GTK calls)
+int panel_snapshot_load(struct panel_snapshot * snapshot, const char * path);
+int panel_snapshot_parse(struct panel_snapshot * snapshot, const void * data, size_t length);
+
+// release a snapshot returned by panel_snapshot_load() / panel_snapshot_parse()
+void panel_snapshot_cleanup(struct panel_snapshot * snapshot);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
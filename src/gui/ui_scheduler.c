@@ -0,0 +1,159 @@
+/*
+ * ui_scheduler.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <gtk/gtk.h>
+
+#include "ui_scheduler.h"
+#include "utils.h"
+
+static void apply_slot(ui_scheduler_t * ui, struct ui_scheduler_slot * slot, gint64 frame_time)
+{
+	app_timer_t timer[1];
+	app_timer_start(timer);
+	
+	slot->pending = 0;
+	slot->throttled = 0;
+	slot->last_applied = frame_time;
+	slot->apply(slot->user_data);
+	
+	++slot->num_applied;
+	perf_stats_update(slot->apply_stats, app_timer_stop(timer));
+}
+
+// return the number of slots still pending
+static int dispatch_slots(ui_scheduler_t * ui, gint64 frame_time, int force)
+{
+	app_timer_t timer[1];
+	app_timer_start(timer);
+	
+	int num_applied = 0;
+	for(int i = 0; i < ui->num_slots; ++i) {
+		struct ui_scheduler_slot * slot = &ui->slots[i];
+		if(!slot->pending) continue;
+		
+		if(!force) {
+			if(slot->last_applied && (frame_time - slot->last_applied) < slot->min_interval) {
+				slot->throttled = 1;
+				continue;
+			}
+			if(num_applied > 0 && app_timer_stop(timer) > UI_SCHEDULER_FRAME_BUDGET) {
+				++ui->num_deferred;
+				continue;
+			}
+		}
+		apply_slot(ui, slot, frame_time);
+		++num_applied;
+	}
+	
+	if(num_applied > 0) {
+		++ui->num_frames;
+		perf_stats_update(ui->frame_stats, app_timer_stop(timer));
+	}
+	
+	// the apply() callbacks may have requested earlier slots
+	int num_pending = 0;
+	for(int i = 0; i < ui->num_slots; ++i) if(ui->slots[i].pending) ++num_pending;
+	return num_pending;
+}
+
+static gboolean on_ui_frame(GtkWidget * widget, GdkFrameClock * clock, gpointer user_data)
+{
+	ui_scheduler_t * ui = user_data;
+	if(dispatch_slots(ui, gdk_frame_clock_get_frame_time(clock), 0) > 0) return G_SOURCE_CONTINUE;
+	
+	ui->tick_id = 0;
+	return G_SOURCE_REMOVE;
+}
+
+ui_scheduler_t * ui_scheduler_init(ui_scheduler_t * ui, GtkWidget * widget)
+{
+	if(NULL == ui) ui = calloc(1, sizeof(*ui));
+	else memset(ui, 0, sizeof(*ui));
+	assert(ui);
+	
+	ui->widget = widget;
+	return ui;
+}
+
+void ui_scheduler_cleanup(ui_scheduler_t * ui)
+{
+	if(NULL == ui) return;
+	if(ui->tick_id && ui->widget) gtk_widget_remove_tick_callback(ui->widget, ui->tick_id);
+	ui->tick_id = 0;
+	for(int i = 0; i < ui->num_slots; ++i) ui->slots[i].pending = 0;
+	return;
+}
+
+int ui_scheduler_add_slot(ui_scheduler_t * ui, const char * name, double min_interval,
+	void (* apply)(void * user_data), void * user_data)
+{
+	assert(ui && apply);
+	if(ui->num_slots >= UI_SCHEDULER_MAX_SLOTS) return -1;
+	
+	int slot_id = ui->num_slots++;
+	struct ui_scheduler_slot * slot = &ui->slots[slot_id];
+	memset(slot, 0, sizeof(*slot));
+	slot->name = name;
+	slot->apply = apply;
+	slot->user_data = user_data;
+	slot->min_interval = (gint64)(min_interval * 1000000.0);
+	return slot_id;
+}
+
+void ui_scheduler_request(ui_scheduler_t * ui, int slot_id)
+{
+	assert(ui && slot_id >= 0 && slot_id < ui->num_slots);
+	struct ui_scheduler_slot * slot = &ui->slots[slot_id];
+	
+	++slot->num_requests;
+	if(slot->pending) {
+		if(slot->throttled) ++slot->num_dropped;
+		else ++slot->num_coalesced;
+		return;
+	}
+	
+	slot->pending = 1;
+	if(NULL == ui->widget) {
+		apply_slot(ui, slot, g_get_monotonic_time());
+		return;
+	}
+	if(0 == ui->tick_id) ui->tick_id = gtk_widget_add_tick_callback(ui->widget, on_ui_frame, ui, NULL);
+	return;
+}
+
+void ui_scheduler_flush(ui_scheduler_t * ui)
+{
+	assert(ui);
+	dispatch_slots(ui, g_get_monotonic_time(), 1);
+	return;
+}
@@ -0,0 +1,78 @@
+#ifndef BTC_TRADER_UI_SCHEDULER_H_
+#define BTC_TRADER_UI_SCHEDULER_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <gtk/gtk.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "utils.h"
+
+/*****************************************************
+ * ui_scheduler: (GTK main thread)
+ *   widget updates applied once per frame (GdkFrameClock).
+ *
+ *   the data sources (io_job->apply(), pushed messages, ...) only store
+ *   the new state and call ui_scheduler_request(), the slot's apply()
+ *   copies the latest state into its widgets on the next frame,
+ *   every request made in between is merged into that one update.
+ *
+ *   slots are applied in the order they were added (a slot can request
+ *   a later one, e.g. the order book invalidates the chart, in the same frame).
+ *   min_interval throttles a slot: requests made before it has elapsed
+ *   stay pending, the intermediate states are never shown.
+ *   when a frame is over UI_SCHEDULER_FRAME_BUDGET the remaining slots
+ *   are carried over to the next frame.
+*****************************************************/
+#define UI_SCHEDULER_MAX_SLOTS (16)
+#define UI_SCHEDULER_FRAME_BUDGET (0.016)	// same as IO_WORKERS_FRAME_BUDGET
+
+struct ui_scheduler_slot
+{
+	const char * name;
+	void (* apply)(void * user_data);
+	void * user_data;
+	gint64 min_interval;	// us
+	gint64 last_applied;	// frame time, us
+	int pending;
+	int throttled;			// pending, held back by min_interval
+
+	// statistics
+	int64_t num_requests;
+	int64_t num_applied;
+	int64_t num_coalesced;	// merged into an update already pending for the next frame
+	int64_t num_dropped;	// superseded while throttled
+	perf_stats_t apply_stats[1];
+};
+
+typedef struct ui_scheduler
+{
+	GtkWidget * widget;		// (nullable) frame clock, NULL: requests are applied immediately
+	guint tick_id;
+	int num_slots;
+	struct ui_scheduler_slot slots[UI_SCHEDULER_MAX_SLOTS];
+
+	// statistics
+	int64_t num_frames;		// frames which applied at least one slot
+	int64_t num_deferred;	// slots carried over because of the frame budget
+	perf_stats_t frame_stats[1];
+}ui_scheduler_t;
+
+ui_scheduler_t * ui_scheduler_init(ui_scheduler_t * ui, GtkWidget * widget);
+void ui_scheduler_cleanup(ui_scheduler_t * ui);	// before @widget is destroyed, pending updates are discarded
+
+// return the slot id (0, 1, ...), min_interval: seconds, 0: every frame
+int ui_scheduler_add_slot(ui_scheduler_t * ui, const char * name, double min_interval,
+	void (* apply)(void * user_data), void * user_data);
+void ui_scheduler_request(ui_scheduler_t * ui, int slot_id);
+
+// apply the pending slots now, ignoring min_interval (e.g. before saving a snapshot)
+void ui_scheduler_flush(ui_scheduler_t * ui);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,914 @@
+/*
+ * order_journal.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "order_journal.h"
+#include "utils.h"
+
+/************************************************
+ * on-disk layout (native byte order)
+************************************************/
+struct order_journal_record
+{
+	uint32_t checksum;	// FNV-1a of the remaining bytes
+	uint16_t type;		// enum order_journal_record_type
+	uint16_t reserved;
+	int64_t id;			// journal id (0: look up by order_id)
+	int64_t timestamp;	// ms
+	int32_t rc;
+	uint32_t reserved2;
+	char pair[ORDER_JOURNAL_PAIR_SIZE];
+	char order_type[16];
+	double rate;
+	double amount;
+	char order_id[ORDER_JOURNAL_ORDER_ID_SIZE];
+}__attribute__((packed));
+
+static uint32_t fnv1a(const unsigned char * data, size_t length)
+{
+	uint32_t hash = 2166136261u;
+	for(size_t i = 0; i < length; ++i) {
+		hash ^= data[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static inline uint32_t record_checksum(const struct order_journal_record * record)
+{
+	return fnv1a((const unsigned char *)record + sizeof(record->checksum), sizeof(*record) - sizeof(record->checksum));
+}
+
+static inline int64_t get_realtime_ms(void)
+{
+	struct timespec ts[1];
+	clock_gettime(CLOCK_REALTIME, ts);
+	return (int64_t)ts->tv_sec * 1000 + ts->tv_nsec / 1000000;
+}
+
+/************************************************
+ * order_journal_private
+************************************************/
+typedef struct order_journal_private
+{
+	order_journal_t * journal;
+	int fd;
+	
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;		// wakes up the writer
+	pthread_cond_t done_cond;	// replay finished / records committed
+	pthread_t th;
+	int quit;
+	int replayed;
+	int error;	// errno of the last failed group commit, 0 once a retry succeeds
+	
+	// queued records (swapped with the writer's buffer)
+	struct order_journal_record * pending;
+	size_t num_pending;
+	size_t max_pending;
+	int64_t queued_lsn;
+	int64_t durable_lsn;
+	
+	int64_t next_id;
+	
+	// orders not closed yet, sorted by id
+	struct order_journal_order * orders;
+	size_t num_orders;
+	size_t max_orders;
+}order_journal_private_t;
+
+static order_journal_private_t * order_journal_private_new(order_journal_t * journal)
+{
+	order_journal_private_t * priv = calloc(1, sizeof(*priv));
+	assert(priv);
+	priv->journal = journal;
+	priv->fd = -1;
+	priv->next_id = 1;
+	journal->priv = priv;
+	
+	int rc = pthread_mutex_init(&priv->mutex, NULL);
+	assert(0 == rc);
+	rc = pthread_cond_init(&priv->cond, NULL);
+	assert(0 == rc);
+	rc = pthread_cond_init(&priv->done_cond, NULL);
+	assert(0 == rc);
+	return priv;
+}
+
+static void order_journal_private_free(order_journal_private_t * priv)
+{
+	if(NULL == priv) return;
+	if(priv->fd >= 0) close(priv->fd);
+	free(priv->pending);
+	free(priv->orders);
+	pthread_cond_destroy(&priv->done_cond);
+	pthread_cond_destroy(&priv->cond);
+	pthread_mutex_destroy(&priv->mutex);
+	free(priv);
+	return;
+}
+
+/************************************************
+ * in-memory state (locked)
+************************************************/
+static struct order_journal_order * find_order_by_id(order_journal_private_t * priv, int64_t id)
+{
+	ssize_t left = 0, right = (ssize_t)priv->num_orders - 1;
+	while(left <= right) {
+		ssize_t mid = (left + right) / 2;
+		if(priv->orders[mid].id == id) return &priv->orders[mid];
+		if(priv->orders[mid].id < id) left = mid + 1;
+		else right = mid - 1;
+	}
+	return NULL;
+}
+
+static struct order_journal_order * find_order(order_journal_private_t * priv, const struct order_journal_record * record)
+{
+	if(record->id > 0) return find_order_by_id(priv, record->id);
+	if(!record->order_id[0]) return NULL;
+	for(size_t i = 0; i < priv->num_orders; ++i) {
+		if(strcmp(priv->orders[i].order_id, record->order_id) == 0) return &priv->orders[i];
+	}
+	return NULL;
+}
+
+static void remove_order(order_journal_private_t * priv, struct order_journal_order * order)
+{
+	size_t index = order - priv->orders;
+	assert(index < priv->num_orders);
+	--priv->num_orders;
+	if(index < priv->num_orders) memmove(order, order + 1, (priv->num_orders - index) * sizeof(*order));
+	return;
+}
+
+static void add_order(order_journal_private_t * priv, const struct order_journal_record * record)
+{
+	if(priv->num_orders >= priv->max_orders) {
+		size_t new_size = priv->max_orders?(priv->max_orders * 2):64;
+		struct order_journal_order * orders = realloc(priv->orders, new_size * sizeof(*orders));
+		assert(orders);
+		priv->orders = orders;
+		priv->max_orders = new_size;
+	}
+	
+	// ids are increasing, insert from the back
+	size_t index = priv->num_orders;
+	while(index > 0 && priv->orders[index - 1].id > record->id) --index;
+	if(index < priv->num_orders && priv->orders[index].id == record->id) return;	// duplicated
+	if(index < priv->num_orders) memmove(&priv->orders[index + 1], &priv->orders[index], (priv->num_orders - index) * sizeof(*priv->orders));
+	
+	struct order_journal_order * order = &priv->orders[index];
+	memset(order, 0, sizeof(*order));
+	order->id = record->id;
+	order->state = order_journal_order_state_in_doubt;
+	memcpy(order->pair, record->pair, sizeof(order->pair));
+	memcpy(order->order_type, record->order_type, sizeof(order->order_type));
+	order->rate = record->rate;
+	order->amount = record->amount;
+	order->created_at = order->updated_at = record->timestamp;
+	++priv->num_orders;
+	return;
+}
+
+static void apply_record(order_journal_private_t * priv, const struct order_journal_record * record)
+{
+	if(record->type == order_journal_record_type_intent) {
+		add_order(priv, record);
+		if(record->id >= priv->next_id) priv->next_id = record->id + 1;
+		return;
+	}
+	if(record->type == order_journal_record_type_checkpoint) {
+		if(record->id > priv->next_id) priv->next_id = record->id;
+		return;
+	}
+	
+	struct order_journal_order * order = find_order(priv, record);
+	if(NULL == order) return;	// closed already, or placed without the journal
+	order->updated_at = record->timestamp;
+	
+	switch(record->type) {
+	case order_journal_record_type_ack:
+		order->state = order_journal_order_state_open;
+		memcpy(order->order_id, record->order_id, sizeof(order->order_id));
+		break;
+	case order_journal_record_type_cancel:
+		order->state = order_journal_order_state_cancelling;
+		break;
+	case order_journal_record_type_cancel_ack:
+		if(0 == record->rc) remove_order(priv, order);
+		else order->state = order_journal_order_state_open;
+		break;
+	case order_journal_record_type_reject:
+	case order_journal_record_type_fill:
+		remove_order(priv, order);
+		break;
+	default:
+		break;
+	}
+	return;
+}
+
+// queue a record and apply it, return its lsn
+static int64_t append_locked(order_journal_private_t * priv, struct order_journal_record * record)
+{
+	if(0 == record->timestamp) record->timestamp = get_realtime_ms();
+	record->checksum = record_checksum(record);
+	
+	if(priv->num_pending >= priv->max_pending) {
+		size_t new_size = priv->max_pending?(priv->max_pending * 2):64;
+		struct order_journal_record * pending = realloc(priv->pending, new_size * sizeof(*pending));
+		assert(pending);
+		priv->pending = pending;
+		priv->max_pending = new_size;
+	}
+	priv->pending[priv->num_pending++] = *record;
+	apply_record(priv, record);
+	
+	pthread_cond_signal(&priv->cond);
+	return ++priv->queued_lsn;
+}
+
+static void wait_replayed(order_journal_private_t * priv)
+{
+	while(!priv->replayed) pthread_cond_wait(&priv->done_cond, &priv->mutex);
+	return;
+}
+
+/************************************************
+ * replay / compaction (writer thread)
+************************************************/
+static int write_all(int fd, const void * data, size_t length)
+{
+	const unsigned char * p = data;
+	while(length > 0) {
+		ssize_t cb = write(fd, p, length);
+		if(cb < 0 && errno == EINTR) continue;
+		if(cb <= 0) return -1;
+		p += cb;
+		length -= cb;
+	}
+	return 0;
+}
+
+// rewrite the journal with the orders which are not closed
+static int compact(order_journal_private_t * priv)
+{
+	order_journal_t * journal = priv->journal;
+	char tmp_file[PATH_MAX] = "";
+	snprintf(tmp_file, sizeof(tmp_file), "%s.tmp", journal->path);
+	
+	int fd = open(tmp_file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if(fd < 0) return -1;
+	
+	size_t max_records = 1 + priv->num_orders * 3;
+	struct order_journal_record * records = calloc(max_records, sizeof(*records));
+	assert(records);
+	
+	size_t count = 0;
+	int64_t now = get_realtime_ms();
+	records[count++] = (struct order_journal_record){ .type = order_journal_record_type_checkpoint, .id = priv->next_id, .timestamp = now };
+	for(size_t i = 0; i < priv->num_orders; ++i) {
+		const struct order_journal_order * order = &priv->orders[i];
+		struct order_journal_record * record = &records[count++];
+		record->type = order_journal_record_type_intent;
+		record->id = order->id;
+		record->timestamp = order->created_at;
+		memcpy(record->pair, order->pair, sizeof(record->pair));
+		memcpy(record->order_type, order->order_type, sizeof(record->order_type));
+		record->rate = order->rate;
+		record->amount = order->amount;
+		
+		if(order->state == order_journal_order_state_in_doubt) continue;
+		record = &records[count++];
+		record->type = order_journal_record_type_ack;
+		record->id = order->id;
+		record->timestamp = order->updated_at;
+		memcpy(record->order_id, order->order_id, sizeof(record->order_id));
+		
+		if(order->state != order_journal_order_state_cancelling) continue;
+		record = &records[count++];
+		record->type = order_journal_record_type_cancel;
+		record->id = order->id;
+		record->timestamp = order->updated_at;
+		memcpy(record->order_id, order->order_id, sizeof(record->order_id));
+	}
+	for(size_t i = 0; i < count; ++i) records[i].checksum = record_checksum(&records[i]);
+	
+	int rc = write_all(fd, records, count * sizeof(*records));
+	if(0 == rc) rc = fdatasync(fd);
+	close(fd);
+	free(records);
+	if(0 == rc) rc = rename(tmp_file, journal->path);
+	if(rc) {
+		unlink(tmp_file);
+		return -1;
+	}
+	
+	fd = open(journal->path, O_WRONLY | O_APPEND | O_CLOEXEC);
+	if(fd < 0) return -1;
+	close(priv->fd);
+	priv->fd = fd;
+	return 0;
+}
+
+static int replay(order_journal_private_t * priv)
+{
+	order_journal_t * journal = priv->journal;
+	int fd = open(journal->path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0) return -1;
+	
+	app_timer_t timer[1];
+	app_timer_start(timer);
+	
+	enum { BATCH_SIZE = 1024 };
+	struct order_journal_record * records = calloc(BATCH_SIZE, sizeof(*records));
+	assert(records);
+	
+	off_t offset = 0;
+	int64_t num_records = 0;
+	int torn = 0;
+	while(!torn) {
+		ssize_t cb = read(fd, records, BATCH_SIZE * sizeof(*records));
+		if(cb < 0 && errno == EINTR) continue;
+		if(cb <= 0) break;
+		
+		size_t count = cb / sizeof(*records);
+		if(count * sizeof(*records) != cb) torn = 1;	// partial record at the end
+		for(size_t i = 0; i < count; ++i) {
+			const struct order_journal_record * record = &records[i];
+			if(record->checksum != record_checksum(record) 
+				|| record->type <= order_journal_record_type_unknown
+				|| record->type > order_journal_record_type_checkpoint) {
+				torn = 1;
+				break;
+			}
+			apply_record(priv, record);
+			offset += sizeof(*record);
+			++num_records;
+		}
+	}
+	free(records);
+	
+	struct stat st[1];
+	memset(st, 0, sizeof(st));
+	fstat(fd, st);
+	close(fd);
+	
+	if(offset < st->st_size) {
+		fprintf(stderr, "[WARNING]: order_journal '%s': drop %ld bytes of a torn record.\n", 
+			journal->path, (long)(st->st_size - offset));
+		if(ftruncate(priv->fd, offset) != 0) perror("order_journal::replay::ftruncate()");
+	}
+	
+	if(num_records > ORDER_JOURNAL_COMPACT_THRESHOLD && priv->num_orders * 4 < num_records) {
+		if(compact(priv)) perror("order_journal::compact()");
+	}
+	
+	debug_printf("order_journal '%s': %ld records, %ld open orders, replayed in %.3f ms",
+		journal->path, (long)num_records, (long)priv->num_orders, app_timer_stop(timer) * 1000.0);
+	return 0;
+}
+
+static void * writer_thread(void * user_data)
+{
+	order_journal_private_t * priv = user_data;
+	order_journal_t * journal = priv->journal;
+	
+	pthread_mutex_lock(&priv->mutex);
+	replay(priv);
+	priv->replayed = 1;
+	pthread_cond_broadcast(&priv->done_cond);
+	
+	struct order_journal_record * records = NULL;
+	size_t max_records = 0;
+	while(1) {
+		while(!priv->quit && 0 == priv->num_pending) pthread_cond_wait(&priv->cond, &priv->mutex);
+		if(0 == priv->num_pending) break;	// quit and drained
+		
+		// swap the buffers, the appenders keep going while we are writing
+		struct order_journal_record * batch = priv->pending;
+		size_t batch_capacity = priv->max_pending;
+		size_t count = priv->num_pending;
+		priv->pending = records;
+		priv->max_pending = max_records;
+		priv->num_pending = 0;
+		int64_t lsn = priv->queued_lsn;
+		pthread_mutex_unlock(&priv->mutex);
+		
+		app_timer_t timer[1];
+		app_timer_start(timer);
+		int err = 0;
+		off_t offset = lseek(priv->fd, 0, SEEK_END);	// the end of the durable records
+		int rc = (offset < 0)?-1:write_all(priv->fd, batch, count * sizeof(*batch));
+		if(0 == rc) rc = fdatasync(priv->fd);
+		double elapsed = app_timer_stop(timer);
+		if(rc) {
+			err = errno?errno:EIO;
+			perror("order_journal::group commit");
+			// a partial batch would be a torn record in the middle of the file, 
+			// replay() stops there and drops every record after it
+			if(offset >= 0 && ftruncate(priv->fd, offset) != 0) perror("order_journal::group commit::ftruncate()");
+		}
+		
+		pthread_mutex_lock(&priv->mutex);
+		if(rc) {
+			// keep the batch queued in front of the records appended meanwhile
+			if(count + priv->num_pending > batch_capacity) {
+				batch_capacity = count + priv->num_pending;
+				batch = realloc(batch, batch_capacity * sizeof(*batch));
+				assert(batch);
+			}
+			memcpy(batch + count, priv->pending, priv->num_pending * sizeof(*batch));
+			records = priv->pending;
+			max_records = priv->max_pending;
+			priv->pending = batch;
+			priv->max_pending = batch_capacity;
+			priv->num_pending += count;
+			
+			priv->error = err;
+			++journal->num_failed_commits;
+			pthread_cond_broadcast(&priv->done_cond);	// sync() reports the error
+			
+			if(priv->quit) {
+				fprintf(stderr, "[ERROR]: order_journal '%s': %ld record(s) are not durable.\n", 
+					journal->path, (long)priv->num_pending);
+				break;
+			}
+			struct timespec deadline;
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			deadline.tv_sec += ORDER_JOURNAL_RETRY_INTERVAL_MS / 1000;
+			deadline.tv_nsec += (ORDER_JOURNAL_RETRY_INTERVAL_MS % 1000) * 1000000;
+			if(deadline.tv_nsec >= 1000000000) { ++deadline.tv_sec; deadline.tv_nsec -= 1000000000; }
+			int wait_rc = 0;
+			while(!priv->quit && ETIMEDOUT != wait_rc) wait_rc = pthread_cond_timedwait(&priv->cond, &priv->mutex, &deadline);
+			continue;
+		}
+		records = batch;
+		max_records = batch_capacity;
+		
+		priv->error = 0;
+		priv->durable_lsn = lsn;
+		journal->num_records += count;
+		++journal->num_commits;
+		perf_stats_update(journal->commit_stats, elapsed);
+		pthread_cond_broadcast(&priv->done_cond);
+	}
+	pthread_mutex_unlock(&priv->mutex);
+	free(records);
+	pthread_exit((void *)(intptr_t)0);
+}
+
+/************************************************
+ * order_journal::member functions
+************************************************/
+#define AUTO_UNLOCK_MUTEX_PTR __attribute__((cleanup(auto_unlock_mutex_ptr)))
+static void auto_unlock_mutex_ptr(void * ptr)
+{
+	pthread_mutex_t ** p_mutex = ptr;
+	if(p_mutex && *p_mutex) pthread_mutex_unlock(*p_mutex);
+	return;
+}
+
+static int64_t order_journal_new_order(struct order_journal * journal, const char * pair, const char * order_type, double rate, double amount)
+{
+	assert(journal && journal->priv && pair && order_type);
+	order_journal_private_t * priv = journal->priv;
+	
+	struct order_journal_record record = {
+		.type = order_journal_record_type_intent,
+		.rate = rate,
+		.amount = amount,
+	};
+	strncpy(record.pair, pair, sizeof(record.pair) - 1);
+	strncpy(record.order_type, order_type, sizeof(record.order_type) - 1);
+	
+	AUTO_UNLOCK_MUTEX_PTR pthread_mutex_t * mutex = &priv->mutex;
+	pthread_mutex_lock(mutex);
+	wait_replayed(priv);
+	record.id = priv->next_id;
+	append_locked(priv, &record);
+	return record.id;
+}
+
+static int append_outcome(struct order_journal * journal, enum order_journal_record_type type, 
+	int64_t id, const char * order_id, int rc)
+{
+	assert(journal && journal->priv);
+	order_journal_private_t * priv = journal->priv;
+	if(id <= 0 && (NULL == order_id || !order_id[0])) return -1;
+	
+	struct order_journal_record record = {
+		.type = type,
+		.id = id,
+		.rc = rc,
+	};
+	if(order_id) strncpy(record.order_id, order_id, sizeof(record.order_id) - 1);
+	
+	AUTO_UNLOCK_MUTEX_PTR pthread_mutex_t * mutex = &priv->mutex;
+	pthread_mutex_lock(mutex);
+	wait_replayed(priv);
+	append_locked(priv, &record);
+	return 0;
+}
+
+static int order_journal_acknowledge(struct order_journal * journal, int64_t id, const char * order_id)
+{
+	if(NULL == order_id || !order_id[0]) return -1;
+	return append_outcome(journal, order_journal_record_type_ack, id, order_id, 0);
+}
+
+static int order_journal_reject(struct order_journal * journal, int64_t id, int rc)
+{
+	return append_outcome(journal, order_journal_record_type_reject, id, NULL, rc);
+}
+
+static int order_journal_cancel(struct order_journal * journal, const char * order_id)
+{
+	return append_outcome(journal, order_journal_record_type_cancel, 0, order_id, 0);
+}
+
+static int order_journal_cancel_acknowledge(struct order_journal * journal, const char * order_id, int rc)
+{
+	return append_outcome(journal, order_journal_record_type_cancel_ack, 0, order_id, rc);
+}
+
+static int order_journal_fill(struct order_journal * journal, const char * order_id)
+{
+	return append_outcome(journal, order_journal_record_type_fill, 0, order_id, 0);
+}
+
+static int64_t order_journal_get_lsn(struct order_journal * journal)
+{
+	assert(journal && journal->priv);
+	order_journal_private_t * priv = journal->priv;
+	pthread_mutex_lock(&priv->mutex);
+	int64_t lsn = priv->queued_lsn;
+	pthread_mutex_unlock(&priv->mutex);
+	return lsn;
+}
+
+static int order_journal_sync(struct order_journal * journal, int64_t lsn)
+{
+	assert(journal && journal->priv);
+	order_journal_private_t * priv = journal->priv;
+	
+	AUTO_UNLOCK_MUTEX_PTR pthread_mutex_t * mutex = &priv->mutex;
+	pthread_mutex_lock(mutex);
+	if(lsn <= 0 || lsn > priv->queued_lsn) lsn = priv->queued_lsn;
+	while(priv->durable_lsn < lsn && !priv->error) pthread_cond_wait(&priv->done_cond, &priv->mutex);
+	return (priv->durable_lsn < lsn)?-1:0;
+}
+
+static ssize_t order_journal_get_orders(struct order_journal * journal, struct order_journal_order ** p_orders)
+{
+	assert(journal && journal->priv && p_orders);
+	order_journal_private_t * priv = journal->priv;
+	
+	AUTO_UNLOCK_MUTEX_PTR pthread_mutex_t * mutex = &priv->mutex;
+	pthread_mutex_lock(mutex);
+	wait_replayed(priv);
+	
+	*p_orders = NULL;
+	if(0 == priv->num_orders) return 0;
+	
+	struct order_journal_order * orders = calloc(priv->num_orders, sizeof(*orders));
+	assert(orders);
+	memcpy(orders, priv->orders, priv->num_orders * sizeof(*orders));
+	*p_orders = orders;
+	return priv->num_orders;
+}
+
+static int same_rate(double a, double b)
+{
+	return fabs(a - b) <= 1e-9 * fmax(fabs(a), fabs(b));
+}
+
+static int order_journal_reconcile(struct order_journal * journal,
+	const struct order_journal_exchange_order * exchange_orders, size_t count,
+	struct order_journal_reconcile_stats * p_stats)
+{
+	assert(journal && journal->priv);
+	order_journal_private_t * priv = journal->priv;
+	struct order_journal_reconcile_stats stats[1];
+	memset(stats, 0, sizeof(stats));
+	
+	AUTO_UNLOCK_MUTEX_PTR pthread_mutex_t * mutex = &priv->mutex;
+	pthread_mutex_lock(mutex);
+	wait_replayed(priv);
+	
+	char * matched = calloc(count + 1, 1);
+	assert(matched);
+	
+	// iterate over a copy, the records below remove closed orders from priv->orders
+	size_t num_orders = priv->num_orders;
+	struct order_journal_order * orders = NULL;
+	if(num_orders > 0) {
+		orders = calloc(num_orders, sizeof(*orders));
+		assert(orders);
+		memcpy(orders, priv->orders, num_orders * sizeof(*orders));
+	}
+	
+	// pass 1: orders known by their exchange id
+	for(size_t i = 0; i < num_orders; ++i) {
+		const struct order_journal_order * order = &orders[i];
+		if(order->state == order_journal_order_state_in_doubt) continue;
+		
+		ssize_t index = -1;
+		for(size_t j = 0; j < count; ++j) {
+			if(exchange_orders[j].order_id && strcmp(exchange_orders[j].order_id, order->order_id) == 0) {
+				index = j;
+				break;
+			}
+		}
+		if(index >= 0) {
+			matched[index] = 1;
+			++stats->num_open;
+			continue;
+		}
+		
+		struct order_journal_record record = { .type = order_journal_record_type_fill, .id = order->id };
+		memcpy(record.order_id, order->order_id, sizeof(record.order_id));
+		append_locked(priv, &record);
+		++stats->num_filled;
+	}
+	
+	// pass 2: in doubt orders, match the unclaimed exchange orders by (pair, side, rate)
+	for(size_t i = 0; i < num_orders; ++i) {
+		const struct order_journal_order * order = &orders[i];
+		if(order->state != order_journal_order_state_in_doubt) continue;
+		
+		ssize_t index = -1;
+		for(size_t j = 0; j < count; ++j) {
+			const struct order_journal_exchange_order * xorder = &exchange_orders[j];
+			if(matched[j] || NULL == xorder->order_id) continue;
+			if(xorder->pair && strcmp(xorder->pair, order->pair) != 0) continue;
+			if(xorder->order_type && strcasecmp(xorder->order_type, order->order_type) != 0) continue;
+			if(!same_rate(xorder->rate, order->rate)) continue;
+			index = j;
+			break;
+		}
+		
+		struct order_journal_record record = { .id = order->id };
+		if(index >= 0) {
+			matched[index] = 1;
+			record.type = order_journal_record_type_ack;
+			strncpy(record.order_id, exchange_orders[index].order_id, sizeof(record.order_id) - 1);
+			++stats->num_recovered;
+		}else {
+			// never reached the exchange, or was filled at once: check the order history
+			fprintf(stderr, "[WARNING]: order_journal: order #%ld (%s %s %.8f @ %.2f) is in doubt "
+				"and not unsettled at the exchange.\n",
+				(long)order->id, order->pair, order->order_type, order->amount, order->rate);
+			record.type = order_journal_record_type_fill;
+			++stats->num_lost;
+		}
+		append_locked(priv, &record);
+	}
+	
+	for(size_t j = 0; j < count; ++j) {
+		if(!matched[j]) ++stats->num_unknown;
+	}
+	free(matched);
+	free(orders);
+	
+	if(p_stats) *p_stats = *stats;
+	return 0;
+}
+
+/************************************************
+ * public interfaces
+************************************************/
+order_journal_t * order_journal_init(order_journal_t * journal, const char * path, void * user_data)
+{
+	assert(path);
+	if(strlen(path) >= sizeof(journal->path)) return NULL;
+	
+	int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+	if(fd < 0) {
+		perror("order_journal_init::open()");
+		return NULL;
+	}
+	
+	if(NULL == journal) journal = calloc(1, sizeof(*journal));
+	else memset(journal, 0, sizeof(*journal));
+	assert(journal);
+	
+	journal->user_data = user_data;
+	strncpy(journal->path, path, sizeof(journal->path) - 1);
+	
+	journal->new_order = order_journal_new_order;
+	journal->acknowledge = order_journal_acknowledge;
+	journal->reject = order_journal_reject;
+	journal->cancel = order_journal_cancel;
+	journal->cancel_acknowledge = order_journal_cancel_acknowledge;
+	journal->fill = order_journal_fill;
+	journal->get_lsn = order_journal_get_lsn;
+	journal->sync = order_journal_sync;
+	journal->get_orders = order_journal_get_orders;
+	journal->reconcile = order_journal_reconcile;
+	
+	order_journal_private_t * priv = order_journal_private_new(journal);
+	assert(priv && priv == journal->priv);
+	priv->fd = fd;
+	
+	// the writer replays the journal first
+	int rc = pthread_create(&priv->th, NULL, writer_thread, priv);
+	assert(0 == rc);
+	return journal;
+}
+
+void order_journal_cleanup(order_journal_t * journal)
+{
+	if(NULL == journal || NULL == journal->priv) return;
+	order_journal_private_t * priv = journal->priv;
+	
+	pthread_mutex_lock(&priv->mutex);
+	priv->quit = 1;
+	pthread_cond_broadcast(&priv->cond);
+	pthread_mutex_unlock(&priv->mutex);
+	
+	void * exit_code = NULL;
+	pthread_join(priv->th, &exit_code);
+	
+	order_journal_private_free(priv);
+	journal->priv = NULL;
+	return;
+}
+
+
+#if defined(_TEST_ORDER_JOURNAL) && defined(_STAND_ALONE)
+#include <signal.h>
+#include <sys/resource.h>
+static void * place_orders(void * user_data)
+{
+	order_journal_t * journal = user_data;
+	for(int i = 0; i < 1000; ++i) {
+		int64_t id = journal->new_order(journal, "btc_jpy", (i & 1)?"sell":"buy", 4000000.0 + i, 0.01);
+		assert(id > 0);
+		char order_id[64] = "";
+		snprintf(order_id, sizeof(order_id), "%ld", (long)(id * 10));
+		if(i % 10 == 9) continue;	// in doubt
+		journal->acknowledge(journal, id, order_id);
+		if(i % 3 == 0) journal->fill(journal, order_id);
+	}
+	return NULL;
+}
+
+int main(int argc, char ** argv)
+{
+	const char * path = (argc > 1)?argv[1]:"/tmp/test_order_journal.dat";
+	unlink(path);
+	
+	// 4 producers, group commit
+	order_journal_t journal[1];
+	order_journal_init(journal, path, NULL);
+	app_timer_t timer[1];
+	app_timer_start(timer);
+	pthread_t threads[4];
+	for(int i = 0; i < 4; ++i) pthread_create(&threads[i], NULL, place_orders, journal);
+	for(int i = 0; i < 4; ++i) pthread_join(threads[i], NULL);
+	int rc = journal->sync(journal, 0);
+	assert(0 == rc);
+	double elapsed = app_timer_stop(timer);
+	printf("%ld records, %ld commits, %.3f ms\n", 
+		(long)journal->num_records, (long)journal->num_commits, elapsed * 1000.0);
+	
+	struct order_journal_order * orders = NULL;
+	ssize_t num_orders = journal->get_orders(journal, &orders);
+	free(orders);
+	order_journal_cleanup(journal);
+	
+	// torn tail: append half a record
+	int fd = open(path, O_WRONLY | O_APPEND);
+	assert(fd >= 0);
+	char garbage[50];
+	memset(garbage, 0x5a, sizeof(garbage));
+	ssize_t cb = write(fd, garbage, sizeof(garbage));
+	assert(cb == sizeof(garbage));
+	close(fd);
+	
+	// recovery
+	order_journal_init(journal, path, NULL);
+	app_timer_start(timer);
+	ssize_t num_recovered = journal->get_orders(journal, &orders);
+	printf("recovered %ld / %ld open orders in %.3f ms\n", (long)num_recovered, (long)num_orders, app_timer_stop(timer) * 1000.0);
+	assert(num_recovered == num_orders);
+	
+	int num_in_doubt = 0;
+	for(ssize_t i = 0; i < num_recovered; ++i) {
+		if(orders[i].state == order_journal_order_state_in_doubt) ++num_in_doubt;
+	}
+	assert(num_in_doubt == 400);
+	
+	// reconcile: the exchange still has the first open order and one in doubt order
+	const struct order_journal_order * open_order = NULL, * in_doubt = NULL;
+	for(ssize_t i = 0; i < num_recovered; ++i) {
+		if(!open_order && orders[i].state == order_journal_order_state_open) open_order = &orders[i];
+		if(!in_doubt && orders[i].state == order_journal_order_state_in_doubt) in_doubt = &orders[i];
+	}
+	struct order_journal_exchange_order exchange_orders[] = {
+		{ .order_id = open_order->order_id, .pair = "btc_jpy", .order_type = open_order->order_type, .rate = open_order->rate },
+		{ .order_id = "99999999", .pair = "btc_jpy", .order_type = in_doubt->order_type, .rate = in_doubt->rate },
+		{ .order_id = "12345", .pair = "btc_jpy", .order_type = "buy", .rate = 1.0 },
+	};
+	
+	// silence the warnings about the lost orders
+	FILE * fp = freopen("/dev/null", "w", stderr);
+	(void)fp;
+	struct order_journal_reconcile_stats stats[1];
+	journal->reconcile(journal, exchange_orders, 3, stats);
+	printf("reconcile: open=%d, filled=%d, recovered=%d, lost=%d, unknown=%d\n", 
+		stats->num_open, stats->num_filled, stats->num_recovered, stats->num_lost, stats->num_unknown);
+	assert(stats->num_open == 1 && stats->num_recovered == 1 && stats->num_lost == 399 && stats->num_unknown == 1);
+	assert(stats->num_filled == num_recovered - num_in_doubt - 1);
+	free(orders);
+	
+	num_orders = journal->get_orders(journal, &orders);
+	assert(num_orders == 2);
+	assert(0 == strcmp(orders[1].order_id, "99999999"));
+	free(orders);
+	int64_t last_id = journal->new_order(journal, "btc_jpy", "buy", 1.0, 0.01);
+	order_journal_cleanup(journal);
+	
+	// compaction: only the open orders are kept, ids keep increasing
+	order_journal_init(journal, path, NULL);
+	num_orders = journal->get_orders(journal, &orders);
+	assert(num_orders == 3);
+	free(orders);
+	assert(journal->new_order(journal, "btc_jpy", "buy", 1.0, 0.01) == last_id + 1);
+	order_journal_cleanup(journal);
+	
+	struct stat st[1];
+	stat(path, st);
+	printf("compacted size: %ld bytes\n", (long)st->st_size);
+	assert(st->st_size == 7 * sizeof(struct order_journal_record));
+	
+	// failed group commit: the file size limit cuts the batch in the middle of a record
+	signal(SIGXFSZ, SIG_IGN);
+	struct rlimit limit[1];
+	getrlimit(RLIMIT_FSIZE, limit);
+	rlim_t max_size = limit->rlim_cur;
+	limit->rlim_cur = st->st_size + sizeof(struct order_journal_record) / 2;
+	setrlimit(RLIMIT_FSIZE, limit);
+	
+	order_journal_init(journal, path, NULL);
+	last_id = journal->new_order(journal, "btc_jpy", "sell", 2.0, 0.01);
+	rc = journal->sync(journal, 0);
+	assert(-1 == rc && journal->num_failed_commits >= 1);
+	stat(path, st);
+	assert(st->st_size == 7 * sizeof(struct order_journal_record));	// truncated
+	
+	limit->rlim_cur = max_size;
+	setrlimit(RLIMIT_FSIZE, limit);
+	while(journal->sync(journal, 0)) usleep(100 * 1000);	// the writer retries the batch
+	printf("failed commits: %ld, retried\n", (long)journal->num_failed_commits);
+	order_journal_cleanup(journal);
+	
+	order_journal_init(journal, path, NULL);
+	num_orders = journal->get_orders(journal, &orders);
+	assert(num_orders == 5 && orders[4].id == last_id);
+	free(orders);
+	order_journal_cleanup(journal);
+	
+	unlink(path);
+	printf("OK\n");
+	return 0;
+}
+#endif
@@ -0,0 +1,573 @@
+/*
+ * reactor.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "reactor.h"
+#include "utils.h"
+
+static inline int64_t get_monotonic_ms(void)
+{
+	struct timespec ts[1];
+	clock_gettime(CLOCK_MONOTONIC, ts);
+	return (int64_t)ts->tv_sec * 1000 + ts->tv_nsec / 1000000;
+}
+
+/************************************************
+ * reactor_private
+************************************************/
+struct reactor_watcher
+{
+	struct reactor_watcher * next;	// garbage list
+	int fd;
+	int events;
+	int removed;
+	reactor_fd_callback callback;
+	void * user_data;
+};
+
+struct reactor_timer
+{
+	struct reactor_timer * prev;
+	struct reactor_timer * next;
+	int slot;		// -1: not in the wheel
+	int firing;
+	int cancelled;
+	
+	int64_t expires_at;	// ms
+	int64_t interval_ms;
+	int repeat;
+	reactor_timer_callback callback;
+	void * user_data;
+};
+
+typedef struct reactor_private
+{
+	reactor_context_t * reactor;
+	int epfd;
+	int efd;	// eventfd for wakeup()
+	
+	// fd watchers (indexed by fd)
+	int max_fds;
+	struct reactor_watcher ** watchers;
+	struct reactor_watcher * garbage;	// removed during dispatch, freed afterwards
+	
+	// hashed timer wheel
+	int num_timers;
+	int64_t current_tick;	// ms, the last processed slot
+	struct reactor_timer * wheel[REACTOR_TIMER_WHEEL_SIZE];
+	int next_expiry_dirty;
+	int64_t next_expiry;	// INT64_MAX: no timers within one revolution
+}reactor_private_t;
+
+static int reactor_add_fd(struct reactor_context * reactor, int fd, int events, reactor_fd_callback callback, void * user_data);
+static void on_wakeup(struct reactor_context * reactor, int fd, int events, void * user_data)
+{
+	uint64_t value = 0;
+	ssize_t cb = read(fd, &value, sizeof(value));
+	(void)cb;
+	return;
+}
+
+static reactor_private_t * reactor_private_new(reactor_context_t * reactor)
+{
+	reactor_private_t * priv = calloc(1, sizeof(*priv));
+	assert(priv);
+	priv->reactor = reactor;
+	reactor->priv = priv;
+	
+	priv->epfd = epoll_create1(EPOLL_CLOEXEC);
+	assert(priv->epfd >= 0);
+	priv->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	assert(priv->efd >= 0);
+	
+	priv->current_tick = get_monotonic_ms();
+	priv->next_expiry = INT64_MAX;
+	return priv;
+}
+
+static void reactor_private_free(reactor_private_t * priv)
+{
+	if(NULL == priv) return;
+	for(int i = 0; i < priv->max_fds; ++i) {
+		free(priv->watchers[i]);
+	}
+	free(priv->watchers);
+	
+	while(priv->garbage) {
+		struct reactor_watcher * next = priv->garbage->next;
+		free(priv->garbage);
+		priv->garbage = next;
+	}
+	
+	for(int i = 0; i < REACTOR_TIMER_WHEEL_SIZE; ++i) {
+		struct reactor_timer * timer = priv->wheel[i];
+		while(timer) {
+			struct reactor_timer * next = timer->next;
+			free(timer);
+			timer = next;
+		}
+	}
+	
+	close(priv->efd);
+	close(priv->epfd);
+	free(priv);
+	return;
+}
+
+/************************************************
+ * fd watchers
+************************************************/
+static inline uint32_t to_epoll_events(int events)
+{
+	uint32_t flags = 0;
+	if(events & REACTOR_EVENT_READ) flags |= EPOLLIN;
+	if(events & REACTOR_EVENT_WRITE) flags |= EPOLLOUT;
+	return flags;
+}
+
+static inline int from_epoll_events(uint32_t flags)
+{
+	int events = 0;
+	if(flags & EPOLLIN) events |= REACTOR_EVENT_READ;
+	if(flags & EPOLLOUT) events |= REACTOR_EVENT_WRITE;
+	if(flags & (EPOLLERR | EPOLLHUP)) events |= REACTOR_EVENT_ERROR;
+	return events;
+}
+
+static int reactor_add_fd(struct reactor_context * reactor, int fd, int events, reactor_fd_callback callback, void * user_data)
+{
+	assert(reactor && reactor->priv && fd >= 0 && callback);
+	reactor_private_t * priv = reactor->priv;
+	
+	if(fd >= priv->max_fds) {
+		int max_fds = priv->max_fds?priv->max_fds:64;
+		while(max_fds <= fd) max_fds *= 2;
+		struct reactor_watcher ** watchers = realloc(priv->watchers, max_fds * sizeof(*watchers));
+		assert(watchers);
+		memset(watchers + priv->max_fds, 0, (max_fds - priv->max_fds) * sizeof(*watchers));
+		priv->watchers = watchers;
+		priv->max_fds = max_fds;
+	}
+	if(priv->watchers[fd]) return -1;	// already exists
+	
+	struct reactor_watcher * watcher = calloc(1, sizeof(*watcher));
+	assert(watcher);
+	watcher->fd = fd;
+	watcher->events = events;
+	watcher->callback = callback;
+	watcher->user_data = user_data;
+	
+	struct epoll_event ev = { .events = to_epoll_events(events), .data.ptr = watcher };
+	int rc = epoll_ctl(priv->epfd, EPOLL_CTL_ADD, fd, &ev);
+	if(rc) {
+		perror("reactor::add_fd::epoll_ctl()");
+		free(watcher);
+		return -1;
+	}
+	priv->watchers[fd] = watcher;
+	return 0;
+}
+
+static int reactor_modify_fd(struct reactor_context * reactor, int fd, int events)
+{
+	assert(reactor && reactor->priv);
+	reactor_private_t * priv = reactor->priv;
+	if(fd < 0 || fd >= priv->max_fds || NULL == priv->watchers[fd]) return -1;
+	
+	struct reactor_watcher * watcher = priv->watchers[fd];
+	if(watcher->events == events) return 0;
+	
+	struct epoll_event ev = { .events = to_epoll_events(events), .data.ptr = watcher };
+	int rc = epoll_ctl(priv->epfd, EPOLL_CTL_MOD, fd, &ev);
+	if(rc) {
+		perror("reactor::modify_fd::epoll_ctl()");
+		return -1;
+	}
+	watcher->events = events;
+	return 0;
+}
+
+static int reactor_remove_fd(struct reactor_context * reactor, int fd)
+{
+	assert(reactor && reactor->priv);
+	reactor_private_t * priv = reactor->priv;
+	if(fd < 0 || fd >= priv->max_fds || NULL == priv->watchers[fd]) return -1;
+	
+	struct reactor_watcher * watcher = priv->watchers[fd];
+	priv->watchers[fd] = NULL;
+	
+	// the fd might be closed already
+	epoll_ctl(priv->epfd, EPOLL_CTL_DEL, fd, NULL);
+	
+	// pending events in the current batch may still point to the watcher
+	watcher->removed = 1;
+	watcher->next = priv->garbage;
+	priv->garbage = watcher;
+	return 0;
+}
+
+/************************************************
+ * timer wheel
+************************************************/
+static void wheel_insert(reactor_private_t * priv, struct reactor_timer * timer)
+{
+	// never schedule into a slot that has been processed in this tick
+	if(timer->expires_at <= priv->current_tick) timer->expires_at = priv->current_tick + 1;
+	
+	int slot = (int)(timer->expires_at & (REACTOR_TIMER_WHEEL_SIZE - 1));
+	timer->slot = slot;
+	timer->prev = NULL;
+	timer->next = priv->wheel[slot];
+	if(timer->next) timer->next->prev = timer;
+	priv->wheel[slot] = timer;
+	
+	if(timer->expires_at < priv->next_expiry) priv->next_expiry = timer->expires_at;
+	return;
+}
+
+static void wheel_unlink(reactor_private_t * priv, struct reactor_timer * timer)
+{
+	if(timer->slot < 0) return;
+	if(timer->prev) timer->prev->next = timer->next;
+	else priv->wheel[timer->slot] = timer->next;
+	if(timer->next) timer->next->prev = timer->prev;
+	
+	timer->prev = timer->next = NULL;
+	timer->slot = -1;
+	priv->next_expiry_dirty = 1;
+	return;
+}
+
+static struct reactor_timer * reactor_add_timer(struct reactor_context * reactor, int64_t timeout_ms, int repeat, 
+	reactor_timer_callback callback, void * user_data)
+{
+	assert(reactor && reactor->priv && callback);
+	reactor_private_t * priv = reactor->priv;
+	if(timeout_ms < 0) timeout_ms = 0;
+	
+	struct reactor_timer * timer = calloc(1, sizeof(*timer));
+	assert(timer);
+	timer->slot = -1;
+	timer->interval_ms = timeout_ms;
+	timer->repeat = repeat;
+	timer->callback = callback;
+	timer->user_data = user_data;
+	timer->expires_at = get_monotonic_ms() + timeout_ms;
+	
+	wheel_insert(priv, timer);
+	++priv->num_timers;
+	return timer;
+}
+
+static int reactor_remove_timer(struct reactor_context * reactor, struct reactor_timer * timer)
+{
+	assert(reactor && reactor->priv);
+	if(NULL == timer) return -1;
+	reactor_private_t * priv = reactor->priv;
+	
+	if(timer->firing) {	// will be freed after its callback returns
+		timer->cancelled = 1;
+		return 0;
+	}
+	wheel_unlink(priv, timer);
+	--priv->num_timers;
+	free(timer);
+	return 0;
+}
+
+static int process_timers(reactor_private_t * priv, int64_t now)
+{
+	reactor_context_t * reactor = priv->reactor;
+	if(priv->num_timers == 0) {
+		priv->current_tick = now;
+		return 0;
+	}
+	if(priv->next_expiry > now && !priv->next_expiry_dirty) return 0;
+	
+	// collect the expired timers first, callbacks may add or remove timers
+	struct reactor_timer * expired = NULL;
+	int64_t ticks = now - priv->current_tick;
+	if(ticks > REACTOR_TIMER_WHEEL_SIZE) ticks = REACTOR_TIMER_WHEEL_SIZE;
+	for(int64_t i = 1; i <= ticks; ++i) {
+		int slot = (int)((priv->current_tick + i) & (REACTOR_TIMER_WHEEL_SIZE - 1));
+		struct reactor_timer * timer = priv->wheel[slot];
+		while(timer) {
+			struct reactor_timer * next = timer->next;
+			if(timer->expires_at <= now) {
+				wheel_unlink(priv, timer);
+				timer->firing = 1;
+				timer->next = expired;
+				expired = timer;
+			}
+			timer = next;
+		}
+	}
+	priv->current_tick = now;
+	
+	int count = 0;
+	while(expired) {
+		struct reactor_timer * timer = expired;
+		expired = timer->next;
+		timer->next = NULL;
+		
+		int rc = 1;
+		if(!timer->cancelled) {
+			rc = timer->callback(reactor, timer->user_data);
+			++count;
+		}
+		timer->firing = 0;
+		
+		if(0 == rc && timer->repeat && !timer->cancelled) {
+			timer->expires_at = now + timer->interval_ms;
+			wheel_insert(priv, timer);
+		}else {
+			--priv->num_timers;
+			free(timer);
+		}
+	}
+	reactor->num_timer_events += count;
+	return count;
+}
+
+static int reactor_get_timeout(struct reactor_context * reactor)
+{
+	assert(reactor && reactor->priv);
+	reactor_private_t * priv = reactor->priv;
+	if(priv->num_timers == 0) return -1;
+	
+	int64_t now = get_monotonic_ms();
+	if(priv->next_expiry_dirty) {
+		// find the nearest timer within one revolution
+		int64_t next_expiry = INT64_MAX;
+		for(int64_t i = 1; i <= REACTOR_TIMER_WHEEL_SIZE; ++i) {
+			int64_t tick = priv->current_tick + i;
+			struct reactor_timer * timer = priv->wheel[tick & (REACTOR_TIMER_WHEEL_SIZE - 1)];
+			for(; timer; timer = timer->next) {
+				if(timer->expires_at < next_expiry) next_expiry = timer->expires_at;
+			}
+			if(next_expiry <= tick) break;
+		}
+		priv->next_expiry = next_expiry;
+		priv->next_expiry_dirty = 0;
+	}
+	
+	if(priv->next_expiry == INT64_MAX) return REACTOR_TIMER_WHEEL_SIZE;
+	int64_t timeout = priv->next_expiry - now;
+	if(timeout < 0) timeout = 0;
+	if(timeout > REACTOR_TIMER_WHEEL_SIZE) timeout = REACTOR_TIMER_WHEEL_SIZE;
+	return (int)timeout;
+}
+
+/************************************************
+ * reactor::member functions
+************************************************/
+static int reactor_dispatch(struct reactor_context * reactor, int timeout_ms)
+{
+	assert(reactor && reactor->priv);
+	reactor_private_t * priv = reactor->priv;
+	
+	int timer_timeout = reactor_get_timeout(reactor);
+	if(timeout_ms < 0 || (timer_timeout >= 0 && timer_timeout < timeout_ms)) timeout_ms = timer_timeout;
+	if(reactor->busy_poll) timeout_ms = 0;
+	
+	struct epoll_event events[REACTOR_MAX_EVENTS];
+	int n = epoll_wait(priv->epfd, events, REACTOR_MAX_EVENTS, timeout_ms);
+	if(n < 0) {
+		if(errno != EINTR) perror("reactor::dispatch::epoll_wait()");
+		n = 0;
+	}
+	if(n > 0) ++reactor->num_wakeups;
+	
+	for(int i = 0; i < n; ++i) {
+		struct reactor_watcher * watcher = events[i].data.ptr;
+		if(watcher->removed) continue;
+		watcher->callback(reactor, watcher->fd, from_epoll_events(events[i].events), watcher->user_data);
+	}
+	reactor->num_fd_events += n;
+	
+	while(priv->garbage) {
+		struct reactor_watcher * next = priv->garbage->next;
+		free(priv->garbage);
+		priv->garbage = next;
+	}
+	
+	return n + process_timers(priv, get_monotonic_ms());
+}
+
+static int reactor_run(struct reactor_context * reactor)
+{
+	assert(reactor && reactor->priv);
+	if(reactor->is_running) return -1;
+	
+	reactor->is_running = 1;
+	while(!reactor->quit) {
+		reactor_dispatch(reactor, -1);
+	}
+	reactor->is_running = 0;
+	return 0;
+}
+
+static int reactor_wakeup(struct reactor_context * reactor)
+{
+	assert(reactor && reactor->priv);
+	reactor_private_t * priv = reactor->priv;
+	
+	uint64_t value = 1;
+	ssize_t cb = write(priv->efd, &value, sizeof(value));
+	if(cb != sizeof(value) && errno != EAGAIN) return -1;
+	return 0;
+}
+
+static int reactor_stop(struct reactor_context * reactor)
+{
+	assert(reactor);
+	reactor->quit = 1;
+	return reactor_wakeup(reactor);
+}
+
+static int reactor_get_fd(struct reactor_context * reactor)
+{
+	assert(reactor && reactor->priv);
+	reactor_private_t * priv = reactor->priv;
+	return priv->epfd;
+}
+
+/************************************************
+ * public interfaces
+************************************************/
+reactor_context_t * reactor_context_init(reactor_context_t * reactor, void * user_data)
+{
+	if(NULL == reactor) reactor = calloc(1, sizeof(*reactor));
+	assert(reactor);
+	
+	reactor->user_data = user_data;
+	reactor->run = reactor_run;
+	reactor->stop = reactor_stop;
+	reactor->dispatch = reactor_dispatch;
+	reactor->wakeup = reactor_wakeup;
+	reactor->add_fd = reactor_add_fd;
+	reactor->modify_fd = reactor_modify_fd;
+	reactor->remove_fd = reactor_remove_fd;
+	reactor->add_timer = reactor_add_timer;
+	reactor->remove_timer = reactor_remove_timer;
+	reactor->get_fd = reactor_get_fd;
+	reactor->get_timeout = reactor_get_timeout;
+	
+	reactor_private_t * priv = reactor_private_new(reactor);
+	assert(priv && priv == reactor->priv);
+	
+	int rc = reactor_add_fd(reactor, priv->efd, REACTOR_EVENT_READ, on_wakeup, NULL);
+	assert(0 == rc);
+	return reactor;
+}
+
+void reactor_context_cleanup(reactor_context_t * reactor)
+{
+	if(NULL == reactor) return;
+	reactor_private_free(reactor->priv);
+	reactor->priv = NULL;
+	return;
+}
+
+
+#if defined(_TEST_REACTOR) && defined(_STAND_ALONE)
+#include <pthread.h>
+
+static int s_fired[3];
+static int on_timeout(struct reactor_context * reactor, void * user_data)
+{
+	int index = (int)(intptr_t)user_data;
+	++s_fired[index];
+	if(index == 2 && s_fired[index] >= 5) return 1;	// remove the repeating timer
+	return 0;
+}
+
+static int s_num_reads;
+static void on_pipe_read(struct reactor_context * reactor, int fd, int events, void * user_data)
+{
+	char buf[16];
+	ssize_t cb = read(fd, buf, sizeof(buf));
+	assert(cb > 0);
+	++s_num_reads;
+	reactor->remove_fd(reactor, fd);
+}
+
+static void * stop_thread(void * user_data)
+{
+	reactor_context_t * reactor = user_data;
+	usleep(100 * 1000);
+	reactor->stop(reactor);
+	return NULL;
+}
+
+int main(int argc, char ** argv)
+{
+	reactor_context_t * reactor = reactor_context_init(NULL, NULL);
+	
+	int fds[2];
+	int rc = pipe(fds);
+	assert(0 == rc);
+	reactor->add_fd(reactor, fds[0], REACTOR_EVENT_READ, on_pipe_read, NULL);
+	
+	reactor->add_timer(reactor, 10, 0, on_timeout, (void *)(intptr_t)0);
+	struct reactor_timer * cancelled = reactor->add_timer(reactor, 20, 0, on_timeout, (void *)(intptr_t)1);
+	reactor->add_timer(reactor, 5, 1, on_timeout, (void *)(intptr_t)2);
+	reactor->remove_timer(reactor, cancelled);
+	
+	ssize_t cb = write(fds[1], "x", 1);
+	assert(cb == 1);
+	
+	pthread_t th;
+	pthread_create(&th, NULL, stop_thread, reactor);
+	reactor->run(reactor);
+	pthread_join(th, NULL);
+	
+	printf("reads: %d, timers: %d/%d/%d, wakeups: %ld\n", 
+		s_num_reads, s_fired[0], s_fired[1], s_fired[2], (long)reactor->num_wakeups);
+	assert(s_num_reads == 1);
+	assert(s_fired[0] == 1 && s_fired[1] == 0 && s_fired[2] == 5);
+	
+	close(fds[0]);
+	close(fds[1]);
+	reactor_context_cleanup(reactor);
+	free(reactor);
+	return 0;
+}
+#endif
@@ -0,0 +1,236 @@
+/*
+ * reactor_curl.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <curl/curl.h>
+#include "reactor_curl.h"
+#include "utils.h"
+
+/************************************************
+ * reactor_curl_private
+************************************************/
+struct reactor_curl_request
+{
+	CURL * easy;
+	reactor_curl_completed_fn on_completed;
+	void * user_data;
+};
+
+typedef struct reactor_curl_private
+{
+	reactor_curl_context_t * rcurl;
+	struct reactor_timer * timer;	// CURLMOPT_TIMERFUNCTION
+}reactor_curl_private_t;
+
+static reactor_curl_private_t * reactor_curl_private_new(reactor_curl_context_t * rcurl)
+{
+	reactor_curl_private_t * priv = calloc(1, sizeof(*priv));
+	assert(priv);
+	priv->rcurl = rcurl;
+	rcurl->priv = priv;
+	return priv;
+}
+
+static void reactor_curl_private_free(reactor_curl_private_t * priv)
+{
+	if(NULL == priv) return;
+	reactor_curl_context_t * rcurl = priv->rcurl;
+	if(priv->timer && rcurl->reactor) rcurl->reactor->remove_timer(rcurl->reactor, priv->timer);
+	free(priv);
+	return;
+}
+
+/************************************************
+ * curl_multi callbacks
+************************************************/
+static void check_multi_info(reactor_curl_context_t * rcurl)
+{
+	CURLMsg * msg = NULL;
+	int msgs_left = 0;
+	while((msg = curl_multi_info_read(rcurl->multi, &msgs_left))) {
+		if(msg->msg != CURLMSG_DONE) continue;
+		
+		CURL * easy = msg->easy_handle;
+		CURLcode result = msg->data.result;
+		struct reactor_curl_request * request = NULL;
+		curl_easy_getinfo(easy, CURLINFO_PRIVATE, (char **)&request);
+		
+		curl_multi_remove_handle(rcurl->multi, easy);
+		curl_easy_setopt(easy, CURLOPT_PRIVATE, NULL);
+		
+		if(request) {
+			if(request->on_completed) request->on_completed(rcurl, easy, result, request->user_data);
+			free(request);
+		}
+	}
+	return;
+}
+
+static void on_socket_event(struct reactor_context * reactor, int fd, int events, void * user_data)
+{
+	reactor_curl_context_t * rcurl = user_data;
+	int flags = 0;
+	if(events & REACTOR_EVENT_READ) flags |= CURL_CSELECT_IN;
+	if(events & REACTOR_EVENT_WRITE) flags |= CURL_CSELECT_OUT;
+	if(events & REACTOR_EVENT_ERROR) flags |= CURL_CSELECT_ERR;
+	
+	curl_multi_socket_action(rcurl->multi, fd, flags, &rcurl->num_running);
+	check_multi_info(rcurl);
+	return;
+}
+
+static int on_timeout(struct reactor_context * reactor, void * user_data)
+{
+	reactor_curl_context_t * rcurl = user_data;
+	reactor_curl_private_t * priv = rcurl->priv;
+	priv->timer = NULL;	// one-shot, removed by the reactor
+	
+	curl_multi_socket_action(rcurl->multi, CURL_SOCKET_TIMEOUT, 0, &rcurl->num_running);
+	check_multi_info(rcurl);
+	return 1;
+}
+
+static int socket_function(CURL * easy, curl_socket_t s, int what, void * user_data, void * socket_data)
+{
+	reactor_curl_context_t * rcurl = user_data;
+	reactor_context_t * reactor = rcurl->reactor;
+	
+	if(what == CURL_POLL_REMOVE) {
+		reactor->remove_fd(reactor, s);
+		return 0;
+	}
+	
+	int events = 0;
+	if(what & CURL_POLL_IN) events |= REACTOR_EVENT_READ;
+	if(what & CURL_POLL_OUT) events |= REACTOR_EVENT_WRITE;
+	
+	// socket_data is used as an 'already registered' flag
+	if(NULL == socket_data) {
+		int rc = reactor->add_fd(reactor, s, events, on_socket_event, rcurl);
+		if(rc) return -1;
+		curl_multi_assign(rcurl->multi, s, rcurl);
+		return 0;
+	}
+	return reactor->modify_fd(reactor, s, events);
+}
+
+static int timer_function(CURLM * multi, long timeout_ms, void * user_data)
+{
+	reactor_curl_context_t * rcurl = user_data;
+	reactor_curl_private_t * priv = rcurl->priv;
+	reactor_context_t * reactor = rcurl->reactor;
+	
+	if(priv->timer) {
+		reactor->remove_timer(reactor, priv->timer);
+		priv->timer = NULL;
+	}
+	if(timeout_ms < 0) return 0;	// delete the timer
+	
+	priv->timer = reactor->add_timer(reactor, timeout_ms, 0, on_timeout, rcurl);
+	return 0;
+}
+
+/************************************************
+ * reactor_curl_context::member functions
+************************************************/
+static int reactor_curl_add_handle(struct reactor_curl_context * rcurl, CURL * easy, 
+	reactor_curl_completed_fn on_completed, void * user_data)
+{
+	assert(rcurl && rcurl->multi && easy);
+	struct reactor_curl_request * request = calloc(1, sizeof(*request));
+	assert(request);
+	request->easy = easy;
+	request->on_completed = on_completed;
+	request->user_data = user_data;
+	
+	curl_easy_setopt(easy, CURLOPT_PRIVATE, request);
+	CURLMcode ret = curl_multi_add_handle(rcurl->multi, easy);
+	if(ret != CURLM_OK) {
+		debug_printf("curl_multi_add_handle() failed: %s", curl_multi_strerror(ret));
+		curl_easy_setopt(easy, CURLOPT_PRIVATE, NULL);
+		free(request);
+		return -1;
+	}
+	return 0;
+}
+
+static int reactor_curl_remove_handle(struct reactor_curl_context * rcurl, CURL * easy)
+{
+	assert(rcurl && rcurl->multi && easy);
+	struct reactor_curl_request * request = NULL;
+	curl_easy_getinfo(easy, CURLINFO_PRIVATE, (char **)&request);
+	
+	CURLMcode ret = curl_multi_remove_handle(rcurl->multi, easy);
+	curl_easy_setopt(easy, CURLOPT_PRIVATE, NULL);
+	free(request);
+	return (ret == CURLM_OK)?0:-1;
+}
+
+/************************************************
+ * public interfaces
+************************************************/
+reactor_curl_context_t * reactor_curl_context_init(reactor_curl_context_t * rcurl, reactor_context_t * reactor, void * user_data)
+{
+	assert(reactor);
+	if(NULL == rcurl) rcurl = calloc(1, sizeof(*rcurl));
+	assert(rcurl);
+	
+	rcurl->user_data = user_data;
+	rcurl->reactor = reactor;
+	rcurl->add_handle = reactor_curl_add_handle;
+	rcurl->remove_handle = reactor_curl_remove_handle;
+	
+	reactor_curl_private_t * priv = reactor_curl_private_new(rcurl);
+	assert(priv && priv == rcurl->priv);
+	
+	CURLM * multi = curl_multi_init();
+	assert(multi);
+	curl_multi_setopt(multi, CURLMOPT_SOCKETFUNCTION, socket_function);
+	curl_multi_setopt(multi, CURLMOPT_SOCKETDATA, rcurl);
+	curl_multi_setopt(multi, CURLMOPT_TIMERFUNCTION, timer_function);
+	curl_multi_setopt(multi, CURLMOPT_TIMERDATA, rcurl);
+	rcurl->multi = multi;
+	return rcurl;
+}
+
+void reactor_curl_context_cleanup(reactor_curl_context_t * rcurl)
+{
+	if(NULL == rcurl) return;
+	if(rcurl->multi) {
+		curl_multi_cleanup(rcurl->multi);
+		rcurl->multi = NULL;
+	}
+	reactor_curl_private_free(rcurl->priv);
+	rcurl->priv = NULL;
+	return;
+}
@@ -37,6 +37,7 @@
 #include <json-c/json.h>
 
 #include "gui/coincheck-gui.h"
+#include "gui/io_workers.h"
 
 static int shell_load_config(struct shell_context * shell, json_object * jconfig);
 static int shell_init(struct shell_context * shell);
@@ -92,6 +93,11 @@ shell_context_t * shell_context_init(shell_context_t * shell, int argc, char **
 void shell_context_cleanup(shell_context_t * shell)
 {
 	if(NULL == shell) return;
+	if(shell->io_workers) {
+		io_workers_context_cleanup(shell->io_workers);
+		free(shell->io_workers);
+		shell->io_workers = NULL;
+	}
 	if(shell->priv) {
 		shell_private_free(shell->priv);
 		shell->priv = NULL;
@@ -118,10 +124,16 @@ static int shell_init(struct shell_context * shell)
 	assert(shell && shell->priv);
 	shell_private_t * priv = shell->priv;
 	json_object * jconfig = priv->jconfig;
+	int num_io_workers = 0;
 	if(jconfig) {
-		// ...
+		num_io_workers = json_get_value(jconfig, int, io_workers);
 	}
 	
+	io_workers_context_t * io = io_workers_context_init(NULL, num_io_workers, shell);
+	assert(io);
+	shell->io_workers = io;
+	io->run(io);
+	
 	init_windows(priv);
 	return 0;
 }
@@ -160,6 +172,42 @@ static int shell_run(struct shell_context * shell)
 	
 	shell->is_running = 0;
 	shell->quit = 1;
+	
+	io_workers_context_t * io = shell->io_workers;
+	if(io) {
+		debug_printf("io_workers: fetch(avg=%.3f ms, max=%.3f ms), apply(avg=%.3f ms, max=%.3f ms), skipped=%ld",
+			perf_stats_average(io->fetch_stats) * 1000.0, io->fetch_stats->max * 1000.0,
+			perf_stats_average(io->frame_stats) * 1000.0, io->frame_stats->max * 1000.0,
+			(long)io->num_skipped);
+		io->stop(io);
+	}
+	
+	const struct panel_chart_state * chart = priv->main_panel?priv->main_panel->chart_ctx.state:NULL;
+	if(chart) {
+		debug_printf("draw_tickers: full(n=%ld, avg=%.3f ms, max=%.3f ms), incremental(n=%ld, avg=%.3f ms, max=%.3f ms)",
+			(long)chart->num_full_redraws,
+			perf_stats_average(chart->full_redraw_stats) * 1000.0, chart->full_redraw_stats->max * 1000.0,
+			(long)chart->num_incremental_redraws,
+			perf_stats_average(chart->incremental_stats) * 1000.0, chart->incremental_stats->max * 1000.0);
+		debug_printf("draw_charts: frames(n=%ld, avg=%.3f ms, max=%.3f ms), coalesced=%ld, damage_redraws=%ld, over_budget=%ld",
+			(long)chart->num_frames,
+			perf_stats_average(chart->frame_stats) * 1000.0, chart->frame_stats->max * 1000.0,
+			(long)chart->num_coalesced, (long)chart->num_damage_redraws, (long)chart->num_over_budget);
+	}
+	
+	const ui_scheduler_t * ui = priv->main_panel?priv->main_panel->ui:NULL;
+	if(ui) {
+		debug_printf("ui_scheduler: frames(n=%ld, avg=%.3f ms, max=%.3f ms), deferred=%ld",
+			(long)ui->num_frames,
+			perf_stats_average(ui->frame_stats) * 1000.0, ui->frame_stats->max * 1000.0,
+			(long)ui->num_deferred);
+		for(int i = 0; i < ui->num_slots; ++i) {
+			debug_printf("  %s: requests=%ld, applied=%ld(avg=%.3f ms, max=%.3f ms), coalesced=%ld, dropped=%ld",
+				ui->slots[i].name, (long)ui->slots[i].num_requests, (long)ui->slots[i].num_applied,
+				perf_stats_average(ui->slots[i].apply_stats) * 1000.0, ui->slots[i].apply_stats->max * 1000.0,
+				(long)ui->slots[i].num_coalesced, (long)ui->slots[i].num_dropped);
+		}
+	}
 	return 0;
 }
 
@@ -168,9 +216,12 @@ static int shell_stop(struct shell_context * shell)
 	debug_printf("%s(%p)", __FUNCTION__, shell);
 	
 	assert(shell && shell->priv);
-	//~ shell_private_t * priv = shell->priv;
 	if(shell->quit || !shell->is_running) return -1;
 	
+	// keep the panel state for the next warm start
+	shell_private_t * priv = shell->priv;
+	if(priv->main_panel) panel_view_save_snapshot(priv->main_panel, 0);
+	
 	gtk_main_quit();
 	shell->is_running = 0;
 	
@@ -0,0 +1,436 @@
+/*
+ * tick_store.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+#include <endian.h>
+
+#include <db.h>
+#include "tick_store.h"
+#include "utils.h"
+
+/************************************************
+ * on-disk layout
+************************************************/
+struct tick_store_key
+{
+	char pair[TICK_STORE_PAIR_SIZE];
+	uint64_t timestamp;	// big-endian
+}__attribute__((packed));
+
+struct tick_store_record
+{
+	double last;
+	double bid;
+	double ask;
+	double high;
+	double low;
+	double volume;
+}__attribute__((packed));
+
+#define TICK_STORE_BULK_BUFFER_SIZE (1024 * 1024)	// must be a multiple of the page size
+
+static inline void tick_store_key_set(struct tick_store_key * key, const char * pair, int64_t timestamp)
+{
+	memset(key->pair, 0, sizeof(key->pair));
+	strncpy(key->pair, pair, sizeof(key->pair));
+	key->timestamp = htobe64((uint64_t)timestamp);
+	return;
+}
+
+static inline void tick_store_record_set(struct tick_store_record * record, const struct tick_data * tick)
+{
+	record->last = tick->last;
+	record->bid = tick->bid;
+	record->ask = tick->ask;
+	record->high = tick->high;
+	record->low = tick->low;
+	record->volume = tick->volume;
+	return;
+}
+
+static inline void tick_data_set(struct tick_data * tick, const struct tick_store_key * key, const struct tick_store_record * record)
+{
+	tick->timestamp = (int64_t)be64toh(key->timestamp);
+	tick->last = record->last;
+	tick->bid = record->bid;
+	tick->ask = record->ask;
+	tick->high = record->high;
+	tick->low = record->low;
+	tick->volume = record->volume;
+	return;
+}
+
+/************************************************
+ * tick_store_private
+************************************************/
+typedef struct tick_store_private
+{
+	tick_store_t * store;
+	
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;		// new ticks / quit
+	pthread_cond_t flushed;		// a group commit finished
+	pthread_t th;
+	int quit;
+	int flush_requested;
+	
+	// double buffer: append() fills 'pending', the writer thread swaps it with 'writing'
+	size_t num_pending;
+	struct tick_store_item * pending;
+	struct tick_store_item * writing;
+	int64_t num_appended;
+	int64_t num_written;	// appended ticks that have been committed (or failed)
+	
+	void * bulk_buffer;
+}tick_store_private_t;
+
+static void * writer_thread(void * user_data);
+static tick_store_private_t * tick_store_private_new(tick_store_t * store)
+{
+	tick_store_private_t * priv = calloc(1, sizeof(*priv));
+	assert(priv);
+	priv->store = store;
+	store->priv = priv;
+	
+	int rc = pthread_mutex_init(&priv->mutex, NULL);
+	assert(0 == rc);
+	rc = pthread_cond_init(&priv->cond, NULL);
+	assert(0 == rc);
+	rc = pthread_cond_init(&priv->flushed, NULL);
+	assert(0 == rc);
+	
+	priv->pending = calloc(TICK_STORE_MAX_PENDING, sizeof(*priv->pending));
+	priv->writing = calloc(TICK_STORE_MAX_PENDING, sizeof(*priv->writing));
+	assert(priv->pending && priv->writing);
+	
+	priv->bulk_buffer = malloc(TICK_STORE_BULK_BUFFER_SIZE);
+	assert(priv->bulk_buffer);
+	return priv;
+}
+
+static void tick_store_private_free(tick_store_private_t * priv)
+{
+	if(NULL == priv) return;
+	pthread_cond_destroy(&priv->flushed);
+	pthread_cond_destroy(&priv->cond);
+	pthread_mutex_destroy(&priv->mutex);
+	free(priv->pending);
+	free(priv->writing);
+	free(priv->bulk_buffer);
+	free(priv);
+	return;
+}
+
+/************************************************
+ * tick_store::member functions
+************************************************/
+static int write_batch(tick_store_t * store, void * bulk_buffer, const struct tick_store_item * items, size_t count)
+{
+	db_context_t * db = store->db;
+	DB * dbp = db->coincheck.tickers;
+	DB_TXN * txn = NULL;
+	
+	int rc = db->env->txn_begin(db->env, NULL, &txn, 0);
+	if(rc) return rc;
+	
+	size_t offset = 0;
+	while(0 == rc && offset < count) {
+		DBT bulk, unused;
+		memset(&bulk, 0, sizeof(bulk));
+		memset(&unused, 0, sizeof(unused));
+		bulk.data = bulk_buffer;
+		bulk.ulen = TICK_STORE_BULK_BUFFER_SIZE;
+		bulk.flags = DB_DBT_USERMEM | DB_DBT_BULK;
+		
+		void * p = NULL;
+		DB_MULTIPLE_WRITE_INIT(p, &bulk);
+		size_t num_items = 0;
+		for(; offset < count; ++offset, ++num_items) {
+			struct tick_store_key key;
+			struct tick_store_record record;
+			tick_store_key_set(&key, items[offset].pair, items[offset].tick.timestamp);
+			tick_store_record_set(&record, &items[offset].tick);
+			
+			DB_MULTIPLE_KEY_WRITE_NEXT(p, &bulk, &key, sizeof(key), &record, sizeof(record));
+			if(NULL == p) break;	// the buffer is full, write what we have
+		}
+		if(num_items == 0) { rc = DB_BUFFER_SMALL; break; }
+		rc = dbp->put(dbp, txn, &bulk, &unused, DB_MULTIPLE_KEY);
+	}
+	
+	if(rc) {
+		txn->abort(txn);
+		return rc;
+	}
+	return txn->commit(txn, 0);
+}
+
+static int tick_store_put_batch(struct tick_store * store, const struct tick_store_item * items, size_t count)
+{
+	assert(store && store->db);
+	if(count == 0) return 0;
+	
+	void * bulk_buffer = malloc(TICK_STORE_BULK_BUFFER_SIZE);
+	assert(bulk_buffer);
+	int rc = write_batch(store, bulk_buffer, items, count);
+	free(bulk_buffer);
+	if(rc) {
+		fprintf(stderr, "[ERROR]: %s(): %s\n", __FUNCTION__, db_strerror(rc));
+		return -1;
+	}
+	return 0;
+}
+
+static int tick_store_append(struct tick_store * store, const char * pair, const struct tick_data * tick)
+{
+	assert(store && store->priv && pair && tick);
+	tick_store_private_t * priv = store->priv;
+	
+	pthread_mutex_lock(&priv->mutex);
+	if(priv->quit || priv->num_pending >= TICK_STORE_MAX_PENDING) {
+		++store->num_dropped;
+		pthread_mutex_unlock(&priv->mutex);
+		return -1;
+	}
+	struct tick_store_item * item = &priv->pending[priv->num_pending++];
+	memset(item->pair, 0, sizeof(item->pair));
+	strncpy(item->pair, pair, sizeof(item->pair));
+	item->tick = *tick;
+	++priv->num_appended;
+	
+	// the first tick of a batch starts the commit interval, 
+	// a half-full queue is written without waiting for the interval.
+	if(priv->num_pending == 1 || priv->num_pending == TICK_STORE_MAX_PENDING / 2) pthread_cond_signal(&priv->cond);
+	pthread_mutex_unlock(&priv->mutex);
+	return 0;
+}
+
+static int tick_store_flush(struct tick_store * store)
+{
+	assert(store && store->priv);
+	tick_store_private_t * priv = store->priv;
+	
+	pthread_mutex_lock(&priv->mutex);
+	int64_t target = priv->num_appended;
+	priv->flush_requested = 1;
+	pthread_cond_signal(&priv->cond);
+	while(!priv->quit && priv->num_written < target) {
+		pthread_cond_wait(&priv->flushed, &priv->mutex);
+	}
+	pthread_mutex_unlock(&priv->mutex);
+	return 0;
+}
+
+static ssize_t tick_store_query(struct tick_store * store, const char * pair, int64_t begin_ms, int64_t end_ms, 
+	struct tick_data ** p_ticks)
+{
+	assert(store && store->db && pair && p_ticks);
+	DB * dbp = store->db->coincheck.tickers;
+	*p_ticks = NULL;
+	if(begin_ms >= end_ms) return 0;
+	
+	DBC * cursorp = NULL;
+	int rc = dbp->cursor(dbp, NULL, &cursorp, DB_READ_COMMITTED);
+	if(rc) {
+		fprintf(stderr, "[ERROR]: %s(): %s\n", __FUNCTION__, db_strerror(rc));
+		return -1;
+	}
+	
+	struct tick_store_key begin_key;
+	tick_store_key_set(&begin_key, pair, begin_ms);
+	
+	// the cursor overwrites begin_key with the key it is positioned at
+	char pair_id[sizeof(begin_key.pair)];
+	memcpy(pair_id, begin_key.pair, sizeof(pair_id));
+	
+	void * bulk_buffer = malloc(TICK_STORE_BULK_BUFFER_SIZE);
+	assert(bulk_buffer);
+	
+	DBT key, bulk;
+	memset(&key, 0, sizeof(key));
+	memset(&bulk, 0, sizeof(bulk));
+	key.data = &begin_key;
+	key.size = sizeof(begin_key);
+	key.ulen = sizeof(begin_key);
+	key.flags = DB_DBT_USERMEM;
+	bulk.data = bulk_buffer;
+	bulk.ulen = TICK_STORE_BULK_BUFFER_SIZE;
+	bulk.flags = DB_DBT_USERMEM;
+	
+	size_t max_ticks = 0;
+	size_t num_ticks = 0;
+	struct tick_data * ticks = NULL;
+	
+	int done = 0;
+	u_int32_t flags = DB_SET_RANGE | DB_MULTIPLE_KEY;	// position at the first key >= (pair, begin_ms)
+	while(!done && 0 == (rc = cursorp->get(cursorp, &key, &bulk, flags))) {
+		flags = DB_NEXT | DB_MULTIPLE_KEY;
+		
+		void * p = NULL;
+		DB_MULTIPLE_INIT(p, &bulk);
+		while(1) {
+			void * retkey = NULL, * retdata = NULL;
+			u_int32_t retklen = 0, retdlen = 0;
+			DB_MULTIPLE_KEY_NEXT(p, &bulk, retkey, retklen, retdata, retdlen);
+			if(NULL == p) break;
+			if(retklen != sizeof(struct tick_store_key) || retdlen != sizeof(struct tick_store_record)) continue;
+			
+			const struct tick_store_key * tkey = retkey;
+			if(memcmp(tkey->pair, pair_id, sizeof(tkey->pair)) != 0 
+				|| (int64_t)be64toh(tkey->timestamp) >= end_ms) 
+			{
+				done = 1;
+				break;
+			}
+			
+			if(num_ticks >= max_ticks) {
+				max_ticks = max_ticks?(max_ticks * 2):1024;
+				struct tick_data * new_ticks = realloc(ticks, max_ticks * sizeof(*ticks));
+				assert(new_ticks);
+				ticks = new_ticks;
+			}
+			tick_data_set(&ticks[num_ticks++], tkey, retdata);
+		}
+	}
+	cursorp->close(cursorp);
+	free(bulk_buffer);
+	
+	if(rc && rc != DB_NOTFOUND) {
+		fprintf(stderr, "[ERROR]: %s(): %s\n", __FUNCTION__, db_strerror(rc));
+		free(ticks);
+		return -1;
+	}
+	*p_ticks = ticks;
+	return (ssize_t)num_ticks;
+}
+
+/************************************************
+ * group commit
+************************************************/
+static void * writer_thread(void * user_data)
+{
+	tick_store_t * store = user_data;
+	assert(store && store->priv);
+	tick_store_private_t * priv = store->priv;
+	
+	pthread_mutex_lock(&priv->mutex);
+	while(1) {
+		while(!priv->quit && priv->num_pending == 0) {
+			pthread_cond_wait(&priv->cond, &priv->mutex);
+		}
+		
+		// collect more ticks until the commit interval elapses
+		struct timespec expires;
+		clock_gettime(CLOCK_REALTIME, &expires);
+		expires.tv_nsec += TICK_STORE_COMMIT_INTERVAL_MS * 1000000L;
+		expires.tv_sec += expires.tv_nsec / 1000000000L;
+		expires.tv_nsec %= 1000000000L;
+		
+		while(!priv->quit && !priv->flush_requested && priv->num_pending < TICK_STORE_MAX_PENDING / 2) {
+			int rc = pthread_cond_timedwait(&priv->cond, &priv->mutex, &expires);
+			if(rc == ETIMEDOUT) break;
+		}
+		priv->flush_requested = 0;
+		
+		size_t count = priv->num_pending;
+		if(count == 0) {
+			if(priv->quit) break;
+			continue;
+		}
+		
+		struct tick_store_item * items = priv->pending;
+		priv->pending = priv->writing;
+		priv->writing = items;
+		priv->num_pending = 0;
+		pthread_mutex_unlock(&priv->mutex);
+		
+		app_timer_t timer[1];
+		app_timer_start(timer);
+		int rc = write_batch(store, priv->bulk_buffer, items, count);
+		double elapsed = app_timer_stop(timer);
+		if(rc) fprintf(stderr, "[ERROR]: tick_store::group commit(%ld ticks): %s\n", (long)count, db_strerror(rc));
+		
+		pthread_mutex_lock(&priv->mutex);
+		perf_stats_update(store->commit_stats, elapsed);
+		if(0 == rc) store->num_committed += count;
+		priv->num_written += count;
+		pthread_cond_broadcast(&priv->flushed);
+	}
+	pthread_cond_broadcast(&priv->flushed);
+	pthread_mutex_unlock(&priv->mutex);
+	return NULL;
+}
+
+/************************************************
+ * public interfaces
+************************************************/
+tick_store_t * tick_store_init(tick_store_t * store, db_context_t * db, void * user_data)
+{
+	assert(db && db->env && db->coincheck.tickers);
+	if(NULL == store) store = calloc(1, sizeof(*store));
+	assert(store);
+	
+	store->user_data = user_data;
+	store->db = db;
+	store->append = tick_store_append;
+	store->flush = tick_store_flush;
+	store->put_batch = tick_store_put_batch;
+	store->query = tick_store_query;
+	
+	tick_store_private_t * priv = tick_store_private_new(store);
+	assert(priv && priv == store->priv);
+	
+	int rc = pthread_create(&priv->th, NULL, writer_thread, store);
+	assert(0 == rc);
+	return store;
+}
+
+void tick_store_cleanup(tick_store_t * store)
+{
+	if(NULL == store || NULL == store->priv) return;
+	tick_store_private_t * priv = store->priv;
+	
+	// the writer commits the remaining ticks before it exits
+	pthread_mutex_lock(&priv->mutex);
+	priv->quit = 1;
+	pthread_cond_signal(&priv->cond);
+	pthread_mutex_unlock(&priv->mutex);
+	pthread_join(priv->th, NULL);
+	
+	tick_store_private_free(priv);
+	store->priv = NULL;
+	return;
+}
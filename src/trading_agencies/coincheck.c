@@ -38,6 +38,7 @@
 #include "auto_buffer.h"
 
 #include "crypto/hmac.h"
+#include "crypto/hmac_signer.h"
 #include "utils.h"
 #include "trading_agency.h"
 #include "trading_agency_coincheck.h"
@@ -49,16 +50,31 @@ static const char * s_sz_pagination_order[coincheck_pagination_order_size] = {
 	[coincheck_pagination_order_ASC] = "asc",
 };
 
+// strictly increasing across threads: max(now, last + 1) ms
+static int64_t next_nonce_ms(const struct timespec * now)
+{
+	static int64_t s_last_nonce;
+	int64_t now_ms = (int64_t)now->tv_sec * 1000 + now->tv_nsec / 1000000;
+	int64_t last = __atomic_load_n(&s_last_nonce, __ATOMIC_RELAXED);
+	int64_t nonce = 0;
+	do {
+		nonce = (now_ms > last)?now_ms:(last + 1);
+	}while(!__atomic_compare_exchange_n(&s_last_nonce, &last, nonce, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+	return nonce;
+}
+
 /**
  * coincheck_auth_add_headers()
+ *   timestamp: NULL ==> a strictly increasing nonce, 
+ *   call it with the lease of trading_agency_lease_signed_http() so the requests are sent in nonce order.
  */
 struct curl_slist * coincheck_auth_add_headers(
 	struct curl_slist * headers, 
-	const char * api_key, const char * api_secret, 
+	const char * api_key, const hmac_signer_t * signer, 
 	const char * uri, const char * body, ssize_t cb_body,
 	const struct timespec * timestamp)
 {
-	assert(api_key && api_secret);
+	assert(api_key && signer && signer->algorithm == GNUTLS_MAC_SHA256);
 	struct timespec ts[1];
 	if(NULL == timestamp) {
 		memset(ts, 0, sizeof(ts));
@@ -67,30 +83,23 @@ struct curl_slist * coincheck_auth_add_headers(
 	}
 	assert(timestamp);
 	
-	hmac_sha256_t hmac[1];
-	unsigned char hash[32] = { 0 };
-	
-	auto_buffer_t message[1];
-	memset(message, 0, sizeof(message));
-	auto_buffer_init(message, 0);
-	
-	char * signature = NULL;
-	int64_t nonce_ms = (int64_t)timestamp->tv_sec * 1000 + (timestamp->tv_nsec / 1000000) % 1000;
+	char signature[32 * 2 + 1] = "";
+	int64_t nonce_ms = (timestamp == ts)?next_nonce_ms(ts):
+		(int64_t)timestamp->tv_sec * 1000 + (timestamp->tv_nsec / 1000000) % 1000;
 	char sz_nonce[100] = "";
 	int cb_nonce = snprintf(sz_nonce, sizeof(sz_nonce), "%lu", (unsigned long)nonce_ms);
 	assert(cb_nonce > 0);
 	
-	auto_buffer_push(message, sz_nonce, cb_nonce);
-	auto_buffer_push(message, uri, strlen(uri));
-	if(body) {
-		if(cb_body == -1 || cb_body == 0) cb_body = strlen(body);
-		if(cb_body > 0) auto_buffer_push(message, body, cb_body);
-	}
+	// message: nonce | uri | body
+	if(body && (cb_body == -1 || cb_body == 0)) cb_body = strlen(body);
+	struct iovec parts[3] = {
+		{ .iov_base = sz_nonce, .iov_len = cb_nonce },
+		{ .iov_base = (void *)uri, .iov_len = strlen(uri) },
+		{ .iov_base = (void *)body, .iov_len = (body && cb_body > 0)?cb_body:0 },
+	};
 	
-	hmac_sha256_init(hmac, (unsigned char *)api_secret, strlen(api_secret));
-	hmac_sha256_update(hmac, (unsigned char *)message->data, message->length);
-	hmac_sha256_final(hmac, hash);
-	bin2hex(hash, sizeof(hash), &signature);
+	int rc = hmac_signer_sign_hex(signer, parts, 3, signature);
+	assert(0 == rc);
 	
 	char line[1024] = "";
 	snprintf(line, sizeof(line), "ACCESS-KEY: %s", api_key);
@@ -114,8 +123,6 @@ struct curl_slist * coincheck_auth_add_headers(
 		//~ (unsigned long)nounce_ms,
 		//~ signature);
 	
-	free(signature);
-	auto_buffer_cleanup(message);
 	return headers;
 }
 
@@ -128,7 +135,7 @@ int coincheck_public_get_ticker(trading_agency_t * agent, json_object ** p_jresp
 	assert(agent);
 	
 	json_object * jresponse = NULL;
-	struct http_json_context * http = agent->http;
+	AUTO_RELEASE_HTTP struct http_json_context * http = trading_agency_lease_http(agent);
 	struct json_response_context * response = http->response;
 
 	char url[PATH_MAX] = "";
@@ -154,7 +161,7 @@ int coincheck_public_get_trades(trading_agency_t * agent, const char * pair, con
 	assert(agent && pair);
 	
 	json_object * jresponse = NULL;
-	struct http_json_context * http = agent->http;
+	AUTO_RELEASE_HTTP struct http_json_context * http = trading_agency_lease_http(agent);
 	struct json_response_context * response = http->response;
 
 	char url[PATH_MAX] = "";
@@ -202,7 +209,7 @@ int coincheck_public_get_order_book(trading_agency_t * agent, json_object ** p_j
 	assert(agent);
 	
 	json_object * jresponse = NULL;
-	struct http_json_context * http = agent->http;
+	AUTO_RELEASE_HTTP struct http_json_context * http = trading_agency_lease_http(agent);
 	struct json_response_context * response = http->response;
 
 	char url[PATH_MAX] = "";
@@ -215,6 +222,30 @@ int coincheck_public_get_order_book(trading_agency_t * agent, json_object ** p_j
 	return response->err_code;
 }
 
+/**
+ * (agency thread) non-blocking versions of the public APIs above, 
+ * sent on the agency's curl_multi handle, see trading_agency_async_get().
+**/
+int coincheck_public_async_get_ticker(trading_agency_t * agent, trading_agency_response_fn on_response, void * user_data)
+{
+	static const char * end_point = "api/ticker";
+	assert(agent);
+	
+	char url[PATH_MAX] = "";
+	snprintf(url, sizeof(url), "%s/%s", agent->base_url, end_point); 
+	return trading_agency_async_get(agent, url, on_response, user_data);
+}
+
+int coincheck_public_async_get_order_book(trading_agency_t * agent, trading_agency_response_fn on_response, void * user_data)
+{
+	static const char * end_point = "api/order_books";
+	assert(agent);
+	
+	char url[PATH_MAX] = "";
+	snprintf(url, sizeof(url), "%s/%s", agent->base_url, end_point); 
+	return trading_agency_async_get(agent, url, on_response, user_data);
+}
+
 /**
  * Calc Rate
  * To calculate the rate from the order of the exchange.
@@ -234,7 +265,7 @@ int coincheck_public_calc_rate(trading_agency_t * agent, const char * pair, cons
 	assert(pair && order_type);
 	
 	json_object * jresponse = NULL;
-	struct http_json_context * http = agent->http;
+	AUTO_RELEASE_HTTP struct http_json_context * http = trading_agency_lease_http(agent);
 	struct json_response_context * response = http->response;
 
 	char url[PATH_MAX] = "";
@@ -277,7 +308,7 @@ int coincheck_public_get_buy_rate(trading_agency_t * agent, const char * pair, j
 	assert(agent && pair);
 	
 	json_object * jresponse = NULL;
-	struct http_json_context * http = agent->http;
+	AUTO_RELEASE_HTTP struct http_json_context * http = trading_agency_lease_http(agent);
 	struct json_response_context * response = http->response;
 
 	char url[PATH_MAX] = "";
@@ -307,12 +338,12 @@ int coincheck_new_order(trading_agency_t * agent, const char * pair, const char
 	assert(amount >= COINCHECK_ORDER_BTC_AMOUNT_MIN);
 	
 	const char * api_key = NULL;
-	const char * api_secret = NULL;
-	rc = agent->get_credentials(agent, trading_agency_credentials_type_trade, &api_key, &api_secret);
-	assert(0 == rc && api_key && api_secret);
+	const struct hmac_signer * signer = NULL;
+	rc = agent->get_signer(agent, trading_agency_credentials_type_trade, GNUTLS_MAC_SHA256, &api_key, &signer);
+	assert(0 == rc && api_key && signer);
 	
 	json_object * jresponse = NULL;
-	struct http_json_context * http = agent->http;
+	AUTO_RELEASE_HTTP struct http_json_context * http = trading_agency_lease_signed_http(agent);
 	struct json_response_context * response = http->response;
 	
 	char url[4096] = "";
@@ -346,7 +377,7 @@ int coincheck_new_order(trading_agency_t * agent, const char * pair, const char
 	debug_printf("post_fields: %s", request_body);
 	
 	http->headers = coincheck_auth_add_headers(http->headers, 
-		api_key, api_secret, 
+		api_key, signer, 
 		url, 
 		request_body, cb_body, 
 		NULL);
@@ -371,19 +402,19 @@ int coincheck_get_unsettled_order_list(trading_agency_t * agent, json_object **
 	assert(agent);
 	
 	const char * api_key = NULL;
-	const char * api_secret = NULL;
-	rc = agent->get_credentials(agent, trading_agency_credentials_type_query, &api_key, &api_secret); // use query_key (the principle of least privilege )
-	assert(0 == rc && api_key && api_secret);
+	const struct hmac_signer * signer = NULL;
+	rc = agent->get_signer(agent, trading_agency_credentials_type_query, GNUTLS_MAC_SHA256, &api_key, &signer); // use query_key (the principle of least privilege )
+	assert(0 == rc && api_key && signer);
 	
 	json_object * jresponse = NULL;
-	struct http_json_context * http = agent->http;
+	AUTO_RELEASE_HTTP struct http_json_context * http = trading_agency_lease_signed_http(agent);
 	struct json_response_context * response = http->response;
 	
 	char url[4096] = "";
 	snprintf(url, sizeof(url), "%s/%s", agent->base_url, end_point);
 	
 	http->headers = coincheck_auth_add_headers(http->headers, 
-		api_key, api_secret, 
+		api_key, signer, 
 		url, 
 		NULL, 0, 
 		NULL);
@@ -410,19 +441,19 @@ int coincheck_cancel_order(trading_agency_t * agent, const char * order_id, json
 	assert(agent && order_id);
 	
 	const char * api_key = NULL;
-	const char * api_secret = NULL;
-	rc = agent->get_credentials(agent, trading_agency_credentials_type_trade, &api_key, &api_secret);
-	assert(0 == rc && api_key && api_secret);
+	const struct hmac_signer * signer = NULL;
+	rc = agent->get_signer(agent, trading_agency_credentials_type_trade, GNUTLS_MAC_SHA256, &api_key, &signer);
+	assert(0 == rc && api_key && signer);
 	
 	json_object * jresponse = NULL;
-	struct http_json_context * http = agent->http;
+	AUTO_RELEASE_HTTP struct http_json_context * http = trading_agency_lease_signed_http(agent);
 	struct json_response_context * response = http->response;
 	
 	char url[4096] = "";
 	snprintf(url, sizeof(url), "%s/%s/%s", agent->base_url, end_point, order_id);
 	
 	http->headers = coincheck_auth_add_headers(http->headers, 
-		api_key, api_secret, 
+		api_key, signer, 
 		url, NULL, 0, 
 		NULL);
 	
@@ -448,19 +479,19 @@ int coincheck_get_cancellation_status(trading_agency_t * agent, const char * ord
 	assert(agent && order_id);
 	
 	const char * api_key = NULL;
-	const char * api_secret = NULL;
-	rc = agent->get_credentials(agent, trading_agency_credentials_type_query, &api_key, &api_secret); // use query_key (the principle of least privilege )
-	assert(0 == rc && api_key && api_secret);
+	const struct hmac_signer * signer = NULL;
+	rc = agent->get_signer(agent, trading_agency_credentials_type_query, GNUTLS_MAC_SHA256, &api_key, &signer); // use query_key (the principle of least privilege )
+	assert(0 == rc && api_key && signer);
 	
 	json_object * jresponse = NULL;
-	struct http_json_context * http = agent->http;
+	AUTO_RELEASE_HTTP struct http_json_context * http = trading_agency_lease_signed_http(agent);
 	struct json_response_context * response = http->response;
 	
 	char url[4096] = "";
 	snprintf(url, sizeof(url), "%s/%s?id=%s", agent->base_url, end_point, order_id);
 	
 	http->headers = coincheck_auth_add_headers(http->headers, 
-		api_key, api_secret, 
+		api_key, signer, 
 		url, NULL, 0, 
 		NULL);
 	
@@ -484,12 +515,12 @@ int coincheck_get_order_history(trading_agency_t * agent, const struct coincheck
 	assert(agent);
 	
 	const char * api_key = NULL;
-	const char * api_secret = NULL;
-	rc = agent->get_credentials(agent, trading_agency_credentials_type_query, &api_key, &api_secret);	// use query_key (the principle of least privilege )
-	assert(0 == rc && api_key && api_secret);
+	const struct hmac_signer * signer = NULL;
+	rc = agent->get_signer(agent, trading_agency_credentials_type_query, GNUTLS_MAC_SHA256, &api_key, &signer);	// use query_key (the principle of least privilege )
+	assert(0 == rc && api_key && signer);
 	
 	json_object * jresponse = NULL;
-	struct http_json_context * http = agent->http;
+	AUTO_RELEASE_HTTP struct http_json_context * http = trading_agency_lease_signed_http(agent);
 	struct json_response_context * response = http->response;
 	
 	char url[4096] = "";
@@ -519,7 +550,7 @@ int coincheck_get_order_history(trading_agency_t * agent, const struct coincheck
 	}
 	
 	http->headers = coincheck_auth_add_headers(http->headers, 
-		api_key, api_secret, 
+		api_key, signer, 
 		url, NULL, 0, 
 		NULL);
 	
@@ -551,19 +582,19 @@ int coincheck_account_get_balance(trading_agency_t * agent, json_object ** p_jre
 	assert(agent);
 	
 	const char * api_key = NULL;
-	const char * api_secret = NULL;
-	rc = agent->get_credentials(agent, trading_agency_credentials_type_query, &api_key, &api_secret); // use query_key (the principle of least privilege )
-	assert(0 == rc && api_key && api_secret);
+	const struct hmac_signer * signer = NULL;
+	rc = agent->get_signer(agent, trading_agency_credentials_type_query, GNUTLS_MAC_SHA256, &api_key, &signer); // use query_key (the principle of least privilege )
+	assert(0 == rc && api_key && signer);
 	
 	json_object * jresponse = NULL;
-	struct http_json_context * http = agent->http;
+	AUTO_RELEASE_HTTP struct http_json_context * http = trading_agency_lease_signed_http(agent);
 	struct json_response_context * response = http->response;
 	
 	char url[4096] = "";
 	snprintf(url, sizeof(url), "%s/%s", agent->base_url, end_point);
 	
 	http->headers = coincheck_auth_add_headers(http->headers, 
-		api_key, api_secret, 
+		api_key, signer, 
 		url, NULL, 0, 
 		NULL);
 	
@@ -589,19 +620,19 @@ int coincheck_account_get_info(trading_agency_t * agent, json_object ** p_jrespo
 	assert(agent);
 	
 	const char * api_key = NULL;
-	const char * api_secret = NULL;
-	rc = agent->get_credentials(agent, trading_agency_credentials_type_query, &api_key, &api_secret); // use query_key (the principle of least privilege )
-	assert(0 == rc && api_key && api_secret);
+	const struct hmac_signer * signer = NULL;
+	rc = agent->get_signer(agent, trading_agency_credentials_type_query, GNUTLS_MAC_SHA256, &api_key, &signer); // use query_key (the principle of least privilege )
+	assert(0 == rc && api_key && signer);
 	
 	json_object * jresponse = NULL;
-	struct http_json_context * http = agent->http;
+	AUTO_RELEASE_HTTP struct http_json_context * http = trading_agency_lease_signed_http(agent);
 	struct json_response_context * response = http->response;
 	
 	char url[4096] = "";
 	snprintf(url, sizeof(url), "%s/%s", agent->base_url, end_point);
 	
 	http->headers = coincheck_auth_add_headers(http->headers, 
-		api_key, api_secret, 
+		api_key, signer, 
 		url, NULL, 0, 
 		NULL);
 	
@@ -625,19 +656,19 @@ int coincheck_get_bank_accounts(trading_agency_t * agent, json_object ** p_jresp
 	assert(agent);
 	
 	const char * api_key = NULL;
-	const char * api_secret = NULL;
-	rc = agent->get_credentials(agent, trading_agency_credentials_type_query, &api_key, &api_secret); // use query_key (the principle of least privilege )
-	assert(0 == rc && api_key && api_secret);
+	const struct hmac_signer * signer = NULL;
+	rc = agent->get_signer(agent, trading_agency_credentials_type_query, GNUTLS_MAC_SHA256, &api_key, &signer); // use query_key (the principle of least privilege )
+	assert(0 == rc && api_key && signer);
 	
 	json_object * jresponse = NULL;
-	struct http_json_context * http = agent->http;
+	AUTO_RELEASE_HTTP struct http_json_context * http = trading_agency_lease_signed_http(agent);
 	struct json_response_context * response = http->response;
 	
 	char url[4096] = "";
 	snprintf(url, sizeof(url), "%s/%s", agent->base_url, end_point);
 	
 	http->headers = coincheck_auth_add_headers(http->headers, 
-		api_key, api_secret, 
+		api_key, signer, 
 		url, NULL, 0, 
 		NULL);
 
@@ -656,12 +687,12 @@ int coincheck_bank_account_add_json(trading_agency_t * agent, json_object * jban
 	assert(jbank_info);
 	
 	const char * api_key = NULL;
-	const char * api_secret = NULL;
-	rc = agent->get_credentials(agent, trading_agency_credentials_type_withdraw, &api_key, &api_secret); 
-	assert(0 == rc && api_key && api_secret);
+	const struct hmac_signer * signer = NULL;
+	rc = agent->get_signer(agent, trading_agency_credentials_type_withdraw, GNUTLS_MAC_SHA256, &api_key, &signer); 
+	assert(0 == rc && api_key && signer);
 	
 	json_object * jresponse = NULL;
-	struct http_json_context * http = agent->http;
+	AUTO_RELEASE_HTTP struct http_json_context * http = trading_agency_lease_signed_http(agent);
 	struct json_response_context * response = http->response;
 	
 	char url[4096] = "";
@@ -671,7 +702,7 @@ int coincheck_bank_account_add_json(trading_agency_t * agent, json_object * jban
 	int cb_query = strlen(query_str);
 	assert(query_str && cb_query > 0);
 	
-	http->headers = coincheck_auth_add_headers(http->headers, api_key, api_secret, 
+	http->headers = coincheck_auth_add_headers(http->headers, api_key, signer, 
 		url, query_str, cb_query,
 		NULL);
 	
@@ -714,18 +745,18 @@ int coincheck_bank_account_remove(trading_agency_t * agent, long bank_account_id
 	assert(agent);
 
 	const char * api_key = NULL;
-	const char * api_secret = NULL;
-	rc = agent->get_credentials(agent, trading_agency_credentials_type_withdraw, &api_key, &api_secret); 
-	assert(0 == rc && api_key && api_secret);
+	const struct hmac_signer * signer = NULL;
+	rc = agent->get_signer(agent, trading_agency_credentials_type_withdraw, GNUTLS_MAC_SHA256, &api_key, &signer); 
+	assert(0 == rc && api_key && signer);
 	
 	json_object * jresponse = NULL;
-	struct http_json_context * http = agent->http;
+	AUTO_RELEASE_HTTP struct http_json_context * http = trading_agency_lease_signed_http(agent);
 	struct json_response_context * response = http->response;
 	
 	char url[4096] = "";
 	snprintf(url, sizeof(url), "%s/%s/%ld", agent->base_url, end_point, (long)bank_account_id);
 	http->headers = coincheck_auth_add_headers(http->headers, 
-		api_key, api_secret, 
+		api_key, signer, 
 		url, NULL, 0, 
 		NULL);
 
@@ -743,12 +774,12 @@ int coincheck_get_withdraws_history(trading_agency_t * agent, const struct coinc
 	assert(agent);
 	
 	const char * api_key = NULL;
-	const char * api_secret = NULL;
-	rc = agent->get_credentials(agent, trading_agency_credentials_type_query, &api_key, &api_secret); // use query_key (the principle of least privilege )
-	assert(0 == rc && api_key && api_secret);
+	const struct hmac_signer * signer = NULL;
+	rc = agent->get_signer(agent, trading_agency_credentials_type_query, GNUTLS_MAC_SHA256, &api_key, &signer); // use query_key (the principle of least privilege )
+	assert(0 == rc && api_key && signer);
 	
 	json_object * jresponse = NULL;
-	struct http_json_context * http = agent->http;
+	AUTO_RELEASE_HTTP struct http_json_context * http = trading_agency_lease_signed_http(agent);
 	struct json_response_context * response = http->response;
 	
 	char url[4096] = "";
@@ -778,7 +809,7 @@ int coincheck_get_withdraws_history(trading_agency_t * agent, const struct coinc
 	}
 	
 	http->headers = coincheck_auth_add_headers(http->headers, 
-		api_key, api_secret, 
+		api_key, signer, 
 		url, NULL, 0, 
 		NULL);
 
@@ -798,12 +829,12 @@ int coincheck_withdraw_request(trading_agency_t * agent, long bank_account_id, c
 	if(NULL == currency) currency = "JPY";
 	
 	const char * api_key = NULL;
-	const char * api_secret = NULL;
-	rc = agent->get_credentials(agent, trading_agency_credentials_type_withdraw, &api_key, &api_secret); 
-	assert(0 == rc && api_key && api_secret);
+	const struct hmac_signer * signer = NULL;
+	rc = agent->get_signer(agent, trading_agency_credentials_type_withdraw, GNUTLS_MAC_SHA256, &api_key, &signer); 
+	assert(0 == rc && api_key && signer);
 	
 	json_object * jresponse = NULL;
-	struct http_json_context * http = agent->http;
+	AUTO_RELEASE_HTTP struct http_json_context * http = trading_agency_lease_signed_http(agent);
 	struct json_response_context * response = http->response;
 	
 	char url[4096] = "";
@@ -819,7 +850,7 @@ int coincheck_withdraw_request(trading_agency_t * agent, long bank_account_id, c
 	int cb_query = strlen(query_str);
 	assert(query_str && cb_query > 0);
 	
-	http->headers = coincheck_auth_add_headers(http->headers, api_key, api_secret, 
+	http->headers = coincheck_auth_add_headers(http->headers, api_key, signer, 
 		url, query_str, cb_query,
 		NULL);
 	
@@ -841,18 +872,18 @@ int coincheck_withdraw_cancel(trading_agency_t * agent, long widthdraw_id, json_
 	assert(agent);
 
 	const char * api_key = NULL;
-	const char * api_secret = NULL;
-	rc = agent->get_credentials(agent, trading_agency_credentials_type_withdraw, &api_key, &api_secret); 
-	assert(0 == rc && api_key && api_secret);
+	const struct hmac_signer * signer = NULL;
+	rc = agent->get_signer(agent, trading_agency_credentials_type_withdraw, GNUTLS_MAC_SHA256, &api_key, &signer); 
+	assert(0 == rc && api_key && signer);
 	
 	json_object * jresponse = NULL;
-	struct http_json_context * http = agent->http;
+	AUTO_RELEASE_HTTP struct http_json_context * http = trading_agency_lease_signed_http(agent);
 	struct json_response_context * response = http->response;
 	
 	char url[4096] = "";
 	snprintf(url, sizeof(url), "%s/%s/%ld", agent->base_url, end_point, (long)widthdraw_id);
 	http->headers = coincheck_auth_add_headers(http->headers, 
-		api_key, api_secret, 
+		api_key, signer, 
 		url, NULL, 0, 
 		NULL);
 
@@ -863,3 +894,41 @@ int coincheck_withdraw_cancel(trading_agency_t * agent, long widthdraw_id, json_
 	return response->err_code;
 }
 
+
+/****************************************
+ * coincheck_execute_command()
+ *   agent->execute_command, runs on the agency's event loop
+****************************************/
+int coincheck_execute_command(trading_agency_t * agent, const struct trading_agency_command * cmd, json_object ** p_jresult)
+{
+	assert(agent && cmd);
+	const char * pair = cmd->pair[0]?cmd->pair:"btc_jpy";
+	
+	switch(cmd->type) 
+	{
+	case trading_agency_command_type_new_order:
+		return coincheck_new_order(agent, pair, cmd->order.order_type, cmd->order.rate, cmd->order.amount, p_jresult);
+	case trading_agency_command_type_cancel_order:
+		return coincheck_cancel_order(agent, cmd->cancel.order_id, p_jresult);
+	case trading_agency_command_type_query:
+		switch(cmd->query.type)
+		{
+		case trading_agency_query_type_balance: 
+			return coincheck_account_get_balance(agent, p_jresult);
+		case trading_agency_query_type_unsettled_orders: 
+			return coincheck_get_unsettled_order_list(agent, p_jresult);
+		case trading_agency_query_type_order_history: 
+			return coincheck_get_order_history(agent, NULL, p_jresult);
+		case trading_agency_query_type_ticker: 
+			return coincheck_public_get_ticker(agent, p_jresult);
+		case trading_agency_query_type_order_book: 
+			return coincheck_public_get_order_book(agent, p_jresult);
+		default:
+			break;
+		}
+		break;
+	default:
+		break;
+	}
+	return -1;
+}
@@ -41,6 +41,7 @@
 
 #include "auto_buffer.h"
 #include "crypto/hmac.h"
+#include "crypto/hmac_signer.h"
 #include "utils.h"
 
 static void auto_buffer_add_fmt(auto_buffer_t * buf, const char * fmt, ...)
@@ -64,18 +65,18 @@ static void auto_buffer_add_fmt(auto_buffer_t * buf, const char * fmt, ...)
  */
 struct curl_slist * zaif_auth_add_headers(
 	struct curl_slist * headers, 
-	const char * api_key, const char * api_secret, 
+	const char * api_key, const hmac_signer_t * signer, 
 	const char * post_fields, ssize_t length)
 {
-	assert(api_key && api_secret);
+	assert(api_key && signer && signer->algorithm == GNUTLS_MAC_SHA512);
 	assert(post_fields);
 	
-	unsigned char hash[64] = { 0 };
-	hmac_sha512_hash(api_secret, strlen(api_secret), post_fields, length, hash);
+	if(length == -1 || length == 0) length = strlen(post_fields);
+	struct iovec parts[1] = { { .iov_base = (void *)post_fields, .iov_len = length } };
 	
-	char * signature = NULL;
-	ssize_t cb_signature = bin2hex(hash, 64, &signature);
-	assert(cb_signature == 128);
+	char signature[64 * 2 + 1] = "";
+	int rc = hmac_signer_sign_hex(signer, parts, 1, signature);
+	assert(0 == rc);
 	
 	char line[1024] = "";
 	snprintf(line, sizeof(line), "key: %s", api_key);
@@ -87,7 +88,6 @@ struct curl_slist * zaif_auth_add_headers(
 	headers = curl_slist_append(headers, line);
 	debug_printf("line: %s", line);
 	
-	free(signature);
 	return headers;
 }
 
@@ -100,7 +100,7 @@ int zaif_public_get_currency(trading_agency_t * agent, const char * currency, js
 	static const char * end_point = "currencies";
 
 	json_object * jresponse = NULL;
-	struct http_json_context * http = agent->http;
+	AUTO_RELEASE_HTTP struct http_json_context * http = trading_agency_lease_http(agent);
 	struct json_response_context * response = http->response;
 	
 	if(NULL == currency) currency = "all";
@@ -119,29 +119,47 @@ int zaif_public_get_currency(trading_agency_t * agent, const char * currency, js
 /****************************************
  * zaif trade APIs
 ****************************************/
-static inline double nonce_generate(const struct timespec * timestamp) 
+// strictly increasing across threads: max(now, last + 1) ms
+static int64_t next_nonce_ms(void)
 {
+	static int64_t s_last_nonce;
 	struct timespec ts[1];
-	if(NULL == timestamp) {
-		memset(ts, 0, sizeof(ts));
-		clock_gettime(CLOCK_REALTIME, ts);
-		timestamp = ts;
-	}
-	//~ int64_t nonce = timestamp->tv_sec;
-	//~ return nonce;
-	
-	double nonce = (double)timestamp->tv_sec +  (double)timestamp->tv_nsec / 1000000000.0;
+	memset(ts, 0, sizeof(ts));
+	clock_gettime(CLOCK_REALTIME, ts);
+	
+	int64_t now_ms = (int64_t)ts->tv_sec * 1000 + ts->tv_nsec / 1000000;
+	int64_t last = __atomic_load_n(&s_last_nonce, __ATOMIC_RELAXED);
+	int64_t nonce = 0;
+	do {
+		nonce = (now_ms > last)?now_ms:(last + 1);
+	}while(!__atomic_compare_exchange_n(&s_last_nonce, &last, nonce, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
 	return nonce;
 }
 
+// the nonce is filled by send_request() after the signed lease is held, 
+// so the requests reach zaif in nonce order
+#define ZAIF_NONCE_PREFIX "nonce="
+#define ZAIF_NONCE_PLACEHOLDER "0000000000.000"	// %010ld.%03ld (sec.ms)
 static int init_post_fields(auto_buffer_t * post_fields, const char * method)
 {
-	double nonce = nonce_generate(NULL);
 	auto_buffer_init(post_fields, 0);
-	auto_buffer_add_fmt(post_fields, "nonce=%.3f&method=%s", (double)nonce, method);
+	auto_buffer_add_fmt(post_fields, ZAIF_NONCE_PREFIX ZAIF_NONCE_PLACEHOLDER "&method=%s", method);
 	return 0;
 }
 
+static void set_nonce(auto_buffer_t * post_fields)
+{
+	char sz_nonce[sizeof(ZAIF_NONCE_PLACEHOLDER)] = "";
+	int64_t nonce_ms = next_nonce_ms();
+	int cb = snprintf(sz_nonce, sizeof(sz_nonce), "%010ld.%03ld", (long)(nonce_ms / 1000), (long)(nonce_ms % 1000));
+	assert(cb == (int)sizeof(ZAIF_NONCE_PLACEHOLDER) - 1);
+	
+	char * data = (char *)post_fields->data;
+	assert(post_fields->length > sizeof(ZAIF_NONCE_PREFIX ZAIF_NONCE_PLACEHOLDER) - 1);
+	assert(0 == strncmp(data, ZAIF_NONCE_PREFIX, sizeof(ZAIF_NONCE_PREFIX) - 1));
+	memcpy(data + sizeof(ZAIF_NONCE_PREFIX) - 1, sz_nonce, cb);
+}
+
 static int send_request(trading_agency_t * agent, 
 	enum trading_agency_credentials_type credentials_type, 
 	auto_buffer_t * post_fields, 
@@ -152,16 +170,17 @@ static int send_request(trading_agency_t * agent,
 	
 	int rc = 0;
 	const char * api_key = NULL;
-	const char * api_secret = NULL;
-	rc = agent->get_credentials(agent, credentials_type, &api_key, &api_secret);
-	assert(0 == rc && api_key && api_secret);
+	const struct hmac_signer * signer = NULL;
+	rc = agent->get_signer(agent, credentials_type, GNUTLS_MAC_SHA512, &api_key, &signer);
+	assert(0 == rc && api_key && signer);
 	
 	const char * url = agent->base_url;
 	json_object * jresponse = NULL;
-	struct http_json_context * http = agent->http;
+	AUTO_RELEASE_HTTP struct http_json_context * http = trading_agency_lease_signed_http(agent);
 	struct json_response_context * response = http->response;
 	
-	http->headers = zaif_auth_add_headers(http->headers, api_key, api_secret, (char *)post_fields->data, post_fields->length);
+	set_nonce(post_fields);
+	http->headers = zaif_auth_add_headers(http->headers, api_key, signer, (char *)post_fields->data, post_fields->length);
 	jresponse = http->post(http, url, (char *)post_fields->data, post_fields->length);
 	auto_buffer_cleanup(post_fields);
 	
@@ -326,7 +345,7 @@ int zaif_trade_buy(trading_agency_t * agent, const char * currency_pair,
 		auto_buffer_add_fmt(post_fields, "&limit=%f", limit);
 	}
 	if(comment) {
-		CURL * curl = agent->http->curl;
+		CURL * curl = NULL;	// the handle is not used by curl_easy_escape()
 		char * encoded_str = curl_easy_escape(curl, comment, strlen(comment));
 		if(encoded_str) {
 			auto_buffer_add_fmt(post_fields, "&comment=%s", encoded_str);
@@ -358,7 +377,7 @@ int zaif_trade_sell(trading_agency_t * agent, const char * currency_pair,
 		auto_buffer_add_fmt(post_fields, "&limit=%f", limit);
 	}
 	if(comment) {
-		CURL * curl = agent->http->curl;
+		CURL * curl = NULL;	// the handle is not used by curl_easy_escape()
 		char * encoded_str = curl_easy_escape(curl, comment, strlen(comment));
 		if(encoded_str) {
 			auto_buffer_add_fmt(post_fields, "&comment=%s", encoded_str);
@@ -396,6 +415,44 @@ int zaif_trade_cancel_order(trading_agency_t * agent, const char * order_id, con
 	return rc;
 }
 
-
-
-
+/****************************************
+ * zaif_execute_command()
+ *   agent->execute_command, runs on the agency's event loop
+****************************************/
+int zaif_execute_command(trading_agency_t * agent, const struct trading_agency_command * cmd, json_object ** p_jresult)
+{
+	assert(agent && cmd);
+	const char * pair = cmd->pair[0]?cmd->pair:"btc_jpy";
+	
+	switch(cmd->type) 
+	{
+	case trading_agency_command_type_new_order:
+		if(strcasecmp(cmd->order.order_type, "buy") == 0) {
+			return zaif_trade_buy(agent, pair, cmd->order.rate, cmd->order.amount, 0, NULL, p_jresult);
+		}
+		if(strcasecmp(cmd->order.order_type, "sell") == 0) {
+			return zaif_trade_sell(agent, pair, cmd->order.rate, cmd->order.amount, 0, NULL, p_jresult);
+		}
+		break;
+	case trading_agency_command_type_cancel_order:
+		return zaif_trade_cancel_order(agent, cmd->cancel.order_id, pair, 0, p_jresult);
+	case trading_agency_command_type_query:
+		switch(cmd->query.type)
+		{
+		case trading_agency_query_type_balance: 
+			return zaif_trade_get_info2(agent, p_jresult);
+		case trading_agency_query_type_unsettled_orders: 
+			return zaif_trade_active_orders(agent, pair, 0, 0, p_jresult);
+		case trading_agency_query_type_order_history: 
+			return zaif_trade_get_trade_history(agent, p_jresult);
+		case trading_agency_query_type_ticker: 
+			return zaif_public_get_last_price(agent, pair, p_jresult);
+		default:
+			break;
+		}
+		break;
+	default:
+		break;
+	}
+	return -1;
+}
@@ -32,6 +32,10 @@
 #include <assert.h>
 
 #include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/eventfd.h>
 
 #include "trading_agency.h"
 #include <json-c/json.h>
@@ -39,6 +43,12 @@
 
 #include "json-response.h"
 #include "utils.h"
+#include "mpsc_queue.h"
+#include "reactor.h"
+#include "reactor_curl.h"
+#include "order_journal.h"
+#include "crypto/hmac_signer.h"
+#include "credentials_vault.h"
 
 #define AUTO_UNLOCK_MUTEX_PTR __attribute__((cleanup(auto_unlock_mutex_ptr)))
 static void auto_unlock_mutex_ptr(void * ptr)
@@ -56,6 +66,12 @@ static void trading_agency_cleanup(struct trading_agency * agent);
 static int trading_agency_get_credentials(struct trading_agency * agent, 
 		enum trading_agency_credentials_type type, 
 		const char ** p_api_key, const char ** p_api_secret);
+static int trading_agency_get_signer(struct trading_agency * agent, 
+		enum trading_agency_credentials_type type, gnutls_mac_algorithm_t algorithm,
+		const char ** p_api_key, const struct hmac_signer ** p_signer);
+static int trading_agency_execute_command(struct trading_agency * agent, 
+		const struct trading_agency_command * cmd, 
+		json_object ** p_jresult);
 	
 /************************************************
  * plugins manager:
@@ -80,6 +96,8 @@ int trading_agency_class_init(trading_agency_t * agent)
 	agent->cleanup = trading_agency_cleanup;
 	
 	agent->get_credentials = trading_agency_get_credentials;
+	agent->get_signer = trading_agency_get_signer;
+	agent->execute_command = trading_agency_execute_command;
 	
 	return 0;
 }
@@ -94,6 +112,15 @@ int trading_agency_class_init(trading_agency_t * agent)
  * trading_agency_private
 ************************************************/
 #define TRADING_AGENCY_MAX_KEY_SIZE (100)
+#define TRADING_AGENCY_MAX_TIMERS (32)
+struct trading_agency_timer
+{
+	int id;
+	int64_t interval_ms;
+	int64_t expires_at;	// CLOCK_MONOTONIC, ms
+	trading_agency_timer_fn on_timeout;
+	void * user_data;
+};
 typedef struct trading_agency_private
 {
 	trading_agency_t * agent;
@@ -109,6 +136,15 @@ typedef struct trading_agency_private
 	char api_withdraw_key[TRADING_AGENCY_MAX_KEY_SIZE];
 	char api_withdraw_secret[TRADING_AGENCY_MAX_KEY_SIZE];
 	
+	credentials_vault_t * vault;	// (nullable) replaces the api_xxx fields above
+	
+	// one signer per credentials type, built by the first get_signer() (the vault keeps its own)
+	pthread_mutex_t signers_mutex;
+	struct {
+		int ready;
+		hmac_signer_t signer[1];
+	}signers[credentials_vault_types_count];
+	
 	pthread_t th;
 	pthread_mutex_t mutex;
 	
@@ -121,6 +157,48 @@ typedef struct trading_agency_private
 	
 	int is_running;
 	int quit;
+	
+	// event loop
+	reactor_context_t reactor[1];	// epoll set shared by the eventfd, curl_multi and websocket sockets
+	reactor_curl_context_t rcurl[1];
+	struct trading_agency_async_request * requests;	// in flight on rcurl (agency thread only)
+	int efd;	// eventfd, wakes up the worker thread
+	struct trading_agency_job * jobs_head;
+	struct trading_agency_job * jobs_tail;
+	
+	int num_timers;
+	int next_timer_id;
+	struct trading_agency_timer timers[TRADING_AGENCY_MAX_TIMERS];
+	
+	perf_stats_t exec_stats[1];
+	perf_stats_t wait_stats[1];
+	
+	// http pool
+	struct {
+		pthread_mutex_t signed_mutex;	// held from trading_agency_lease_signed_http() to the release
+		struct http_json_context * signed_http;
+		pthread_mutex_t mutex;
+		pthread_cond_t cond;
+		int size;		// max contexts
+		int num_created;
+		int num_idle;
+		struct http_json_context * contexts[TRADING_AGENCY_MAX_HTTP_POOL_SIZE];
+		struct http_json_context * idle[TRADING_AGENCY_MAX_HTTP_POOL_SIZE];	// stack
+		double leased_at[TRADING_AGENCY_MAX_HTTP_POOL_SIZE];
+		
+		int max_in_use;
+		double created_at;
+		double busy_time;
+		perf_stats_t lease_wait[1];
+	}http_pool;
+	
+	// commands (lock-free, multi-producer / single-consumer)
+	mpsc_queue_t * commands;
+	int64_t command_seq;
+	int64_t num_dropped_commands;	// queue was full
+	perf_stats_t command_stats[1];
+	
+	order_journal_t * journal;	// (nullable)
 }trading_agency_private_t;
 static trading_agency_private_t * trading_agency_private_new(trading_agency_t * agent)
 {
@@ -133,16 +211,57 @@ static trading_agency_private_t * trading_agency_private_new(trading_agency_t *
 	
 	int rc = 0;
 	rc = pthread_mutex_init(&priv->mutex, NULL);
+	rc = pthread_mutex_init(&priv->signers_mutex, NULL);
 	rc = pthread_mutex_init(&priv->worker_cond_mutex.mutex, NULL);
 	rc = pthread_cond_init(&priv->worker_cond_mutex.cond, NULL);
 	assert(0 == rc);
 	
 	priv->query_inteval_ms = 200;	// 200 ms (0.2s)
+	
+	priv->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	assert(priv->efd >= 0);
+	
+	reactor_context_init(priv->reactor, agent);
+	reactor_curl_context_init(priv->rcurl, priv->reactor, agent);
+	
+	priv->commands = mpsc_queue_init(NULL, TRADING_AGENCY_COMMAND_QUEUE_SIZE, sizeof(struct trading_agency_command));
+	assert(priv->commands);
+	
+	rc = pthread_mutex_init(&priv->http_pool.mutex, NULL);
+	assert(0 == rc);
+	rc = pthread_mutex_init(&priv->http_pool.signed_mutex, NULL);
+	assert(0 == rc);
+	rc = pthread_cond_init(&priv->http_pool.cond, NULL);
+	assert(0 == rc);
+	
+	// agent->http is the first context of the pool, the others are created on demand
+	priv->http_pool.size = TRADING_AGENCY_DEFAULT_HTTP_POOL_SIZE;
+	priv->http_pool.contexts[0] = agent->http;
+	priv->http_pool.idle[0] = agent->http;
+	priv->http_pool.num_created = 1;
+	priv->http_pool.num_idle = 1;
+	
+	app_timer_t timer[1];
+	priv->http_pool.created_at = app_timer_start(timer);
 	return priv;
 }
+static ssize_t cancel_commands(trading_agency_private_t * priv);
 static void trading_agency_private_free(trading_agency_private_t * priv)
 {
 	if(NULL == priv) return;
+	// the signers of this agency (the event loop has stopped)
+	for(int type = 0; type < credentials_vault_types_count; ++type) {
+		if(priv->signers[type].ready) hmac_signer_cleanup(priv->signers[type].signer);
+		priv->signers[type].ready = 0;
+	}
+	pthread_mutex_destroy(&priv->signers_mutex);
+	
+	if(priv->vault) {
+		credentials_vault_cleanup(priv->vault);
+		free(priv->vault);
+		priv->vault = NULL;
+	}
+	
 	// clear secrets
 	memset(priv->api_query_key, 0, sizeof(priv->api_query_key));
 	memset(priv->api_query_secret, 0, sizeof(priv->api_query_secret));
@@ -157,6 +276,31 @@ static void trading_agency_private_free(trading_agency_private_t * priv)
 		json_object_put(priv->jconfig);
 		priv->jconfig = NULL;
 	}
+	reactor_curl_context_cleanup(priv->rcurl);
+	reactor_context_cleanup(priv->reactor);
+	if(priv->efd >= 0) {
+		close(priv->efd);
+		priv->efd = -1;
+	}
+	if(priv->commands) {
+		cancel_commands(priv);	// posted while the agency was stopping
+		mpsc_queue_cleanup(priv->commands);
+		free(priv->commands);
+		priv->commands = NULL;
+	}
+	
+	// contexts[0] (agent->http) is released by trading_agency_free()
+	for(int i = 1; i < priv->http_pool.num_created; ++i) {
+		http_json_context_cleanup(priv->http_pool.contexts[i]);
+		free(priv->http_pool.contexts[i]);
+		priv->http_pool.contexts[i] = NULL;
+	}
+	pthread_cond_destroy(&priv->http_pool.cond);
+	pthread_mutex_destroy(&priv->http_pool.mutex);
+	pthread_mutex_destroy(&priv->http_pool.signed_mutex);
+	pthread_cond_destroy(&priv->worker_cond_mutex.cond);
+	pthread_mutex_destroy(&priv->worker_cond_mutex.mutex);
+	pthread_mutex_destroy(&priv->mutex);
 	free(priv);
 	return;
 }
@@ -253,6 +397,23 @@ static int load_credentials_file(trading_agency_private_t * priv, const char * c
 	return 0;
 }
 
+// key_file: NULL ==> $BTC_TRADER_VAULT_KEY
+static int load_credentials_vault(trading_agency_private_t * priv, const char * vault_file, const char * key_file)
+{
+	assert(priv && vault_file);
+	unsigned char master_key[CREDENTIALS_VAULT_KEY_SIZE];
+	int rc = credentials_vault_load_key(key_file, master_key);
+	if(rc) return rc;
+	
+	if(priv->vault) {
+		credentials_vault_cleanup(priv->vault);
+		free(priv->vault);
+	}
+	priv->vault = credentials_vault_init(NULL, vault_file, master_key, priv->agent);
+	gnutls_memset(master_key, 0, sizeof(master_key));
+	return priv->vault?0:-1;
+}
+
 static int trading_agency_load_config(struct trading_agency * agent, json_object * jconfig)
 {
 	assert(agent && agent->priv);
@@ -275,9 +436,28 @@ static int trading_agency_load_config(struct trading_agency * agent, json_object
 		}
 	}
 	
+	int http_pool_size = json_get_value(jconfig, int, http_pool_size);
+	if(http_pool_size > 0) {
+		if(http_pool_size > TRADING_AGENCY_MAX_HTTP_POOL_SIZE) http_pool_size = TRADING_AGENCY_MAX_HTTP_POOL_SIZE;
+		pthread_mutex_lock(&priv->http_pool.mutex);
+		priv->http_pool.size = http_pool_size;
+		pthread_mutex_unlock(&priv->http_pool.mutex);
+	}
+	
+	json_object * jbusy_poll = NULL;
+	if(json_object_object_get_ex(jconfig, "busy_poll", &jbusy_poll)) {
+		priv->reactor->busy_poll = json_object_get_boolean(jbusy_poll);
+	}
+	
+	const char * credentials_vault = json_get_value(jconfig, string, credentials_vault);
 	const char * credentials_file = json_get_value(jconfig, string, credentials_file);
 	//~ assert(credentials_file);
-	if(credentials_file) {
+	if(credentials_vault) {
+		const char * key_file = json_get_value(jconfig, string, credentials_key_file);
+		int rc = load_credentials_vault(agent->priv, credentials_vault, key_file);
+		if(rc) fprintf(stderr, "[ERROR]::%s(%s): failed to open the credentials vault '%s'\n", 
+			__FUNCTION__, agent->exchange_name, credentials_vault);
+	}else if(credentials_file) {
 		load_credentials_file(agent->priv, credentials_file);
 	}
 	return 0;
@@ -288,25 +468,313 @@ static int trading_agency_init(struct trading_agency * agent)
 	return 0;
 }
 
+/************************************************
+ * event loop
+************************************************/
+static inline int64_t get_monotonic_ms(void)
+{
+	struct timespec ts[1];
+	clock_gettime(CLOCK_MONOTONIC, ts);
+	return (int64_t)ts->tv_sec * 1000 + ts->tv_nsec / 1000000;
+}
+
+static void wakeup_loop(trading_agency_private_t * priv)
+{
+	uint64_t value = 1;
+	if(priv->efd < 0) return;
+	ssize_t cb = write(priv->efd, &value, sizeof(value));
+	if(cb != sizeof(value) && errno != EAGAIN) {
+		perror("trading_agency::wakeup_loop()");
+	}
+	return;
+}
+
+static void trading_agency_job_free(struct trading_agency_job * job)
+{
+	if(NULL == job) return;
+	if(job->free_job) job->free_job(job);
+	else free(job);
+	return;
+}
+
+static void process_jobs(trading_agency_private_t * priv)
+{
+	struct trading_agency_job * job = NULL;
+	pthread_mutex_lock(&priv->mutex);
+	job = priv->jobs_head;
+	priv->jobs_head = priv->jobs_tail = NULL;
+	pthread_mutex_unlock(&priv->mutex);
+	
+	while(job) {
+		struct trading_agency_job * next = job->next;
+		job->next = NULL;
+		
+		app_timer_t timer[1];
+		double begin = app_timer_start(timer);
+		
+		job->rc = job->execute?job->execute(job):0;
+		double elapsed = app_timer_stop(timer);
+		
+		pthread_mutex_lock(&priv->mutex);
+		perf_stats_update(priv->wait_stats, begin - job->submitted_at);
+		perf_stats_update(priv->exec_stats, elapsed);
+		pthread_mutex_unlock(&priv->mutex);
+		
+		// in flight, completed by trading_agency_job_complete()
+		if(job->rc != TRADING_AGENCY_JOB_PENDING) trading_agency_job_complete(job, job->rc);
+		job = next;
+	}
+	return;
+}
+
+/************************************************
+ * async requests (curl_multi, agency thread)
+************************************************/
+struct trading_agency_async_request
+{
+	struct trading_agency_async_request * prev;
+	struct trading_agency_async_request * next;
+	trading_agency_t * agent;
+	struct http_json_context http[1];	// not in the http pool, the easy handle belongs to this request
+	trading_agency_response_fn on_response;
+	void * user_data;
+};
+
+static void async_request_unlink(trading_agency_private_t * priv, struct trading_agency_async_request * request)
+{
+	if(request->prev) request->prev->next = request->next;
+	else priv->requests = request->next;
+	if(request->next) request->next->prev = request->prev;
+	request->prev = request->next = NULL;
+	return;
+}
+
+static void async_request_free(struct trading_agency_async_request * request)
+{
+	if(NULL == request) return;
+	http_json_context_cleanup(request->http);
+	free(request);
+	return;
+}
+
+static void on_async_request_completed(struct reactor_curl_context * rcurl, CURL * easy, CURLcode result, void * user_data)
+{
+	struct trading_agency_async_request * request = user_data;
+	assert(request && request->http->curl == easy);
+	trading_agency_t * agent = request->agent;
+	async_request_unlink(agent->priv, request);
+	
+	struct json_response_context * response = request->http->response;
+	json_object * jresponse = NULL;
+	if(result != CURLE_OK) {
+		fprintf(stderr, "%s(%d)::async request failed: %s\n", __FILE__, __LINE__, curl_easy_strerror(result));
+	}else {
+		curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &response->response_code);
+		if(response->jresponse) jresponse = json_object_get(response->jresponse);
+	}
+	response->err_code = result;
+	
+	if(request->on_response) request->on_response(agent, result, jresponse, request->user_data);
+	else if(jresponse) json_object_put(jresponse);
+	async_request_free(request);
+	return;
+}
+
+// (agency thread, the loop has stopped) complete the requests still in flight without their responses
+static void cancel_async_requests(trading_agency_private_t * priv)
+{
+	struct trading_agency_async_request * request = NULL;
+	while((request = priv->requests)) {
+		async_request_unlink(priv, request);
+		priv->rcurl->remove_handle(priv->rcurl, request->http->curl);
+		if(request->on_response) request->on_response(priv->agent, TRADING_AGENCY_ERROR_STOPPED, NULL, request->user_data);
+		async_request_free(request);
+	}
+	return;
+}
+
+// 1: accepted, 0: refused by the exchange, -1: no answer (the order is in doubt)
+static int parse_order_result(json_object * jresult, char order_id[static ORDER_JOURNAL_ORDER_ID_SIZE])
+{
+	if(NULL == jresult) return -1;
+	json_object * jsuccess = NULL;
+	if(!json_object_object_get_ex(jresult, "success", &jsuccess) || NULL == jsuccess) return -1;
+	if(!json_object_get_boolean(jsuccess)) return 0;
+	
+	// coincheck: { "id": ... }, zaif: { "return": { "order_id": ... } }
+	json_object * jid = NULL;
+	json_object * jreturn = NULL;
+	if(!json_object_object_get_ex(jresult, "id", &jid) 
+		&& json_object_object_get_ex(jresult, "return", &jreturn)) {
+		json_object_object_get_ex(jreturn, "order_id", &jid);
+	}
+	if(jid) strncpy(order_id, json_object_get_string(jid), ORDER_JOURNAL_ORDER_ID_SIZE - 1);
+	return 1;
+}
+
+// queue the intent (never waits for the disk), return the journal id of a new order
+static int64_t journal_begin(order_journal_t * journal, const struct trading_agency_command * cmd)
+{
+	if(NULL == journal) return 0;
+	switch(cmd->type) {
+	case trading_agency_command_type_new_order:
+		return journal->new_order(journal, cmd->pair, cmd->order.order_type, cmd->order.rate, cmd->order.amount);
+	case trading_agency_command_type_cancel_order:
+		journal->cancel(journal, cmd->cancel.order_id);
+		break;
+	default:
+		break;
+	}
+	return 0;
+}
+
+static void journal_end(order_journal_t * journal, const struct trading_agency_command * cmd, 
+	int64_t id, int rc, json_object * jresult)
+{
+	if(NULL == journal) return;
+	char order_id[ORDER_JOURNAL_ORDER_ID_SIZE] = "";
+	int result = parse_order_result(jresult, order_id);
+	if(result < 0) return;	// in doubt, resolved by order_journal::reconcile()
+	
+	switch(cmd->type) {
+	case trading_agency_command_type_new_order:
+		if(0 == result) journal->reject(journal, id, rc?rc:-1);
+		else if(order_id[0]) journal->acknowledge(journal, id, order_id);
+		break;
+	case trading_agency_command_type_cancel_order:
+		journal->cancel_acknowledge(journal, cmd->cancel.order_id, result?0:-1);
+		break;
+	default:
+		break;
+	}
+	return;
+}
+
+// (the event loop has stopped) complete the queued commands without sending them
+static ssize_t cancel_commands(trading_agency_private_t * priv)
+{
+	struct trading_agency_command batch[TRADING_AGENCY_COMMAND_BATCH_SIZE];
+	ssize_t total = 0;
+	ssize_t count = 0;
+	while((count = mpsc_queue_pop_batch(priv->commands, batch, TRADING_AGENCY_COMMAND_BATCH_SIZE)) > 0) {
+		for(ssize_t i = 0; i < count; ++i) {
+			struct trading_agency_command * cmd = &batch[i];
+			if(cmd->on_completed) cmd->on_completed(cmd, TRADING_AGENCY_ERROR_STOPPED, NULL);
+		}
+		total += count;
+	}
+	return total;
+}
+
+// returns the number of commands executed
+static ssize_t process_commands(trading_agency_private_t * priv)
+{
+	trading_agency_t * agent = priv->agent;
+	struct trading_agency_command batch[TRADING_AGENCY_COMMAND_BATCH_SIZE];
+	
+	ssize_t count = mpsc_queue_pop_batch(priv->commands, batch, TRADING_AGENCY_COMMAND_BATCH_SIZE);
+	for(ssize_t i = 0; i < count; ++i) {
+		struct trading_agency_command * cmd = &batch[i];
+		json_object * jresult = NULL;
+		
+		int64_t journal_id = journal_begin(priv->journal, cmd);
+		
+		app_timer_t timer[1];
+		app_timer_start(timer);
+		int rc = agent->execute_command?agent->execute_command(agent, cmd, &jresult):-1;
+		double elapsed = app_timer_stop(timer);
+		
+		journal_end(priv->journal, cmd, journal_id, rc, jresult);
+		
+		pthread_mutex_lock(&priv->mutex);
+		perf_stats_update(priv->command_stats, elapsed);
+		pthread_mutex_unlock(&priv->mutex);
+		
+		if(cmd->on_completed) cmd->on_completed(cmd, rc, jresult);
+		if(jresult) json_object_put(jresult);
+	}
+	return count;
+}
+
+// returns the poll timeout (ms) until the next timer, -1 if there are no timers
+static int process_timers(trading_agency_private_t * priv)
+{
+	trading_agency_t * agent = priv->agent;
+	int timeout = -1;
+	int64_t now = get_monotonic_ms();
+	
+	pthread_mutex_lock(&priv->mutex);
+	for(int i = 0; i < priv->num_timers; ++i) {
+		struct trading_agency_timer * timer = &priv->timers[i];
+		if(timer->expires_at <= now) {
+			trading_agency_timer_fn on_timeout = timer->on_timeout;
+			void * user_data = timer->user_data;
+			int timer_id = timer->id;
+			
+			// the callback may add or remove timers
+			pthread_mutex_unlock(&priv->mutex);
+			int rc = on_timeout(agent, user_data);
+			pthread_mutex_lock(&priv->mutex);
+			
+			// the timers array might be changed by the callback
+			if(i >= priv->num_timers || priv->timers[i].id != timer_id) { --i; continue; }
+			if(rc) {
+				priv->timers[i] = priv->timers[--priv->num_timers];
+				--i;
+				continue;
+			}
+			now = get_monotonic_ms();
+			timer->expires_at = now + timer->interval_ms;
+		}
+		
+		int64_t remaining = timer->expires_at - now;
+		if(remaining < 0) remaining = 0;
+		if(timeout < 0 || remaining < timeout) timeout = (int)remaining;
+	}
+	pthread_mutex_unlock(&priv->mutex);
+	return timeout;
+}
+
+static void on_wakeup(struct reactor_context * reactor, int fd, int events, void * user_data)
+{
+	uint64_t value = 0;
+	ssize_t cb = read(fd, &value, sizeof(value));
+	(void)cb;
+	return;
+}
+
 static void * worker_thread(void * user_data)
 {
 	struct trading_agency * agent = user_data;
 	assert(agent && agent->priv);
 	trading_agency_private_t * priv = agent->priv;
+	reactor_context_t * reactor = priv->reactor;
 	int rc = 0;
-
-	struct timespec timer = {
-		.tv_sec = priv->query_inteval_ms / 1000,
-		.tv_nsec = (priv->query_inteval_ms % 1000) * 1000000,
-	};
 	
+	rc = reactor->add_fd(reactor, priv->efd, REACTOR_EVENT_READ, on_wakeup, priv);
+	assert(0 == rc);
+	
+	mpsc_queue_t * commands = priv->commands;
 	while(!priv->quit) 
 	{
-		struct timespec remaining = { 0 };
-		nanosleep(&timer, &remaining);
+		int timeout = process_timers(priv);
+		
+		// producers only signal the eventfd when the loop is (about to be) blocked,
+		// a busy-polling loop never blocks.
+		if(!reactor->busy_poll) __atomic_store_n(&commands->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+		if(!mpsc_queue_is_empty(commands)) timeout = 0;
+		
+		// fd events (eventfd, curl_multi, websockets) and the reactor's timers
+		reactor->dispatch(reactor, timeout);
+		__atomic_store_n(&commands->consumer_waiting, 0, __ATOMIC_SEQ_CST);
+		if(priv->quit) break;
+		
+		process_commands(priv);
+		process_jobs(priv);
 	}
 	
-	priv->is_running = 0;
+	cancel_async_requests(priv);
+	reactor->remove_fd(reactor, priv->efd);
 	priv->quit = 1;
 	pthread_exit((void *)(intptr_t)rc);
 }
@@ -322,6 +790,7 @@ static int trading_agency_run(struct trading_agency * agent)
 	pthread_mutex_lock(mutex);
 	if(priv->is_running) return 0;
 	
+	priv->quit = 0;
 	priv->is_running = 1;
 	rc = pthread_create(&priv->th, NULL, worker_thread, agent);
 	assert(0 == rc);
@@ -336,15 +805,37 @@ static int trading_agency_stop(struct trading_agency * agent)
 	
 	if(!priv->is_running) return -1;
 	
+	priv->quit = 1;
+	wakeup_loop(priv);
+	
 	void * exit_code = NULL;
 	if(priv->th) {
 		int rc = pthread_join(priv->th, &exit_code);
 		if(rc) {
 			
 		}
+		priv->th = (pthread_t)0;
 	}
+	
+	// complete the pending jobs and commands with TRADING_AGENCY_ERROR_STOPPED, 
+	// their owners release the results in on_completed()
+	pthread_mutex_lock(&priv->mutex);
+	struct trading_agency_job * job = priv->jobs_head;
+	priv->jobs_head = priv->jobs_tail = NULL;
 	priv->is_running = 0;
-	priv->quit = 1;
+	pthread_mutex_unlock(&priv->mutex);
+	
+	while(job) {
+		struct trading_agency_job * next = job->next;
+		job->next = NULL;
+		job->rc = TRADING_AGENCY_ERROR_STOPPED;
+		if(job->on_completed) job->on_completed(job);
+		trading_agency_job_free(job);
+		job = next;
+	}
+	
+	ssize_t num_cancelled = cancel_commands(priv);
+	if(num_cancelled > 0) debug_printf("%s(%s): %ld command(s) not sent", __FUNCTION__, agent->exchange_name, (long)num_cancelled);
 	return (int)(intptr_t)exit_code;
 }
 
@@ -358,12 +849,26 @@ static void trading_agency_cleanup(struct trading_agency * agent)
 	return;
 }
 
+static int trading_agency_execute_command(struct trading_agency * agent, 
+		const struct trading_agency_command * cmd, 
+		json_object ** p_jresult)
+{
+	debug_printf("%s(): command type %d is not supported by '%s'", __FUNCTION__, cmd->type, agent->exchange_name);
+	return -1;
+}
+
 static int trading_agency_get_credentials(struct trading_agency * agent, 
 		enum trading_agency_credentials_type type, 
 		const char ** p_api_key, const char ** p_api_secret)
 {
 	assert(agent && agent->priv);
 	trading_agency_private_t * priv = agent->priv;
+	if(priv->vault) {
+		// decrypted on first use, a missing record gives empty strings as with the json file
+		int rc = priv->vault->get(priv->vault, (enum credentials_vault_type)type, p_api_key, p_api_secret);
+		return (rc < 0)?-1:0;
+	}
+	
 	switch(type)
 	{
 	case trading_agency_credentials_type_query:
@@ -383,3 +888,364 @@ static int trading_agency_get_credentials(struct trading_agency * agent,
 	}
 	return 0;
 }
+
+static int trading_agency_get_signer(struct trading_agency * agent, 
+		enum trading_agency_credentials_type type, gnutls_mac_algorithm_t algorithm,
+		const char ** p_api_key, const struct hmac_signer ** p_signer)
+{
+	assert(agent && agent->priv && p_signer);
+	trading_agency_private_t * priv = agent->priv;
+	*p_signer = NULL;
+	if((int)type < 0 || (int)type >= credentials_vault_types_count) return -1;
+	
+	if(priv->vault) {
+		// kept next to the decrypted record
+		int rc = priv->vault->get_signer(priv->vault, (enum credentials_vault_type)type, algorithm, p_api_key, p_signer);
+		if(rc <= 0) return rc;
+		// no record of this type: the empty secret, as with the json file
+	}
+	
+	const char * api_key = NULL;
+	const char * api_secret = NULL;
+	int rc = agent->get_credentials(agent, type, &api_key, &api_secret);
+	if(rc) return -1;
+	if(p_api_key) *p_api_key = api_key;
+	
+	hmac_signer_t * signer = priv->signers[type].signer;
+	if(!__atomic_load_n(&priv->signers[type].ready, __ATOMIC_ACQUIRE)) {
+		pthread_mutex_lock(&priv->signers_mutex);
+		if(!priv->signers[type].ready) {
+			rc = hmac_signer_init(signer, algorithm, api_secret, strlen(api_secret));
+			if(0 == rc) __atomic_store_n(&priv->signers[type].ready, 1, __ATOMIC_RELEASE);
+		}
+		pthread_mutex_unlock(&priv->signers_mutex);
+		if(rc) return -1;
+	}
+	if(signer->algorithm != algorithm) return -1;
+	
+	*p_signer = signer;
+	return 0;
+}
+
+/************************************************
+ * trading_agency::event loop (public interfaces)
+************************************************/
+struct trading_agency_job * trading_agency_job_new(size_t size, 
+	int (* execute)(struct trading_agency_job *), 
+	void (* on_completed)(struct trading_agency_job *), 
+	void * user_data)
+{
+	if(size < sizeof(struct trading_agency_job)) size = sizeof(struct trading_agency_job);
+	struct trading_agency_job * job = calloc(1, size);
+	assert(job);
+	
+	job->execute = execute;
+	job->on_completed = on_completed;
+	job->user_data = user_data;
+	return job;
+}
+
+int trading_agency_submit(trading_agency_t * agent, struct trading_agency_job * job)
+{
+	assert(agent && agent->priv && job);
+	trading_agency_private_t * priv = agent->priv;
+	
+	job->agent = agent;
+	job->next = NULL;
+	
+	app_timer_t timer[1];
+	job->submitted_at = app_timer_start(timer);
+	
+	pthread_mutex_lock(&priv->mutex);
+	if(!priv->is_running || priv->quit) {
+		pthread_mutex_unlock(&priv->mutex);
+		return -1;
+	}
+	if(priv->jobs_tail) priv->jobs_tail->next = job;
+	else priv->jobs_head = job;
+	priv->jobs_tail = job;
+	pthread_mutex_unlock(&priv->mutex);
+	
+	wakeup_loop(priv);
+	return 0;
+}
+
+void trading_agency_job_complete(struct trading_agency_job * job, int rc)
+{
+	assert(job);
+	job->rc = rc;
+	if(job->on_completed) job->on_completed(job);
+	trading_agency_job_free(job);
+	return;
+}
+
+int trading_agency_async_get(trading_agency_t * agent, const char * url, trading_agency_response_fn on_response, void * user_data)
+{
+	assert(agent && agent->priv && url);
+	trading_agency_private_t * priv = agent->priv;
+	assert(pthread_equal(pthread_self(), priv->th));	// the reactor is not thread-safe
+	if(priv->quit) return TRADING_AGENCY_ERROR_STOPPED;
+	
+	struct trading_agency_async_request * request = calloc(1, sizeof(*request));
+	assert(request);
+	request->agent = agent;
+	request->on_response = on_response;
+	request->user_data = user_data;
+	
+	struct http_json_context * http = http_json_context_init(request->http, agent);
+	assert(http == request->http);
+	
+	debug_printf("%s(%p, %s) ...", __FUNCTION__, request, url);
+	CURL * curl = http->curl;
+	curl_easy_setopt(curl, CURLOPT_URL, url);
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, http->on_response);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, http);
+	
+	int rc = priv->rcurl->add_handle(priv->rcurl, curl, on_async_request_completed, request);
+	if(rc) {
+		async_request_free(request);
+		return -1;
+	}
+	
+	request->next = priv->requests;
+	if(priv->requests) priv->requests->prev = request;
+	priv->requests = request;
+	return 0;
+}
+
+int trading_agency_add_timer(trading_agency_t * agent, int64_t interval_ms, trading_agency_timer_fn on_timeout, void * user_data)
+{
+	assert(agent && agent->priv && on_timeout);
+	trading_agency_private_t * priv = agent->priv;
+	if(interval_ms <= 0) interval_ms = priv->query_inteval_ms;
+	
+	pthread_mutex_lock(&priv->mutex);
+	if(priv->num_timers >= TRADING_AGENCY_MAX_TIMERS) {
+		pthread_mutex_unlock(&priv->mutex);
+		return -1;
+	}
+	
+	struct trading_agency_timer * timer = &priv->timers[priv->num_timers++];
+	timer->id = ++priv->next_timer_id;
+	timer->interval_ms = interval_ms;
+	timer->expires_at = get_monotonic_ms() + interval_ms;
+	timer->on_timeout = on_timeout;
+	timer->user_data = user_data;
+	
+	int timer_id = timer->id;
+	pthread_mutex_unlock(&priv->mutex);
+	
+	wakeup_loop(priv);	// re-calculate the poll timeout
+	return timer_id;
+}
+
+int trading_agency_remove_timer(trading_agency_t * agent, int timer_id)
+{
+	assert(agent && agent->priv);
+	trading_agency_private_t * priv = agent->priv;
+	
+	AUTO_UNLOCK_MUTEX_PTR pthread_mutex_t * mutex = &priv->mutex;
+	pthread_mutex_lock(mutex);
+	for(int i = 0; i < priv->num_timers; ++i) {
+		if(priv->timers[i].id == timer_id) {
+			priv->timers[i] = priv->timers[--priv->num_timers];
+			return 0;
+		}
+	}
+	return -1;
+}
+
+reactor_context_t * trading_agency_get_reactor(trading_agency_t * agent)
+{
+	assert(agent && agent->priv);
+	trading_agency_private_t * priv = agent->priv;
+	return priv->reactor;
+}
+
+reactor_curl_context_t * trading_agency_get_reactor_curl(trading_agency_t * agent)
+{
+	assert(agent && agent->priv);
+	trading_agency_private_t * priv = agent->priv;
+	return priv->rcurl;
+}
+
+int trading_agency_is_running(trading_agency_t * agent)
+{
+	assert(agent && agent->priv);
+	trading_agency_private_t * priv = agent->priv;
+	return priv->is_running && !priv->quit;
+}
+
+void trading_agency_get_loop_stats(trading_agency_t * agent, 
+	struct perf_stats * exec_stats,
+	struct perf_stats * wait_stats)
+{
+	assert(agent && agent->priv);
+	trading_agency_private_t * priv = agent->priv;
+	
+	AUTO_UNLOCK_MUTEX_PTR pthread_mutex_t * mutex = &priv->mutex;
+	pthread_mutex_lock(mutex);
+	if(exec_stats) *exec_stats = *priv->exec_stats;
+	if(wait_stats) *wait_stats = *priv->wait_stats;
+	return;
+}
+
+int trading_agency_post_command(trading_agency_t * agent, struct trading_agency_command * cmd)
+{
+	assert(agent && agent->priv && cmd);
+	trading_agency_private_t * priv = agent->priv;
+	
+	if(priv->quit) return TRADING_AGENCY_ERROR_STOPPED;	// would never be executed
+	
+	cmd->seq = __atomic_add_fetch(&priv->command_seq, 1, __ATOMIC_RELAXED);
+	if(mpsc_queue_push(priv->commands, cmd)) {
+		__atomic_add_fetch(&priv->num_dropped_commands, 1, __ATOMIC_RELAXED);
+		return TRADING_AGENCY_ERROR_QUEUE_FULL;
+	}
+	
+	if(__atomic_exchange_n(&priv->commands->consumer_waiting, 0, __ATOMIC_SEQ_CST)) {
+		wakeup_loop(priv);
+	}
+	return 0;
+}
+
+void trading_agency_set_order_journal(trading_agency_t * agent, struct order_journal * journal)
+{
+	assert(agent && agent->priv);
+	trading_agency_private_t * priv = agent->priv;
+	priv->journal = journal;
+	return;
+}
+
+struct order_journal * trading_agency_get_order_journal(trading_agency_t * agent)
+{
+	assert(agent && agent->priv);
+	trading_agency_private_t * priv = agent->priv;
+	return priv->journal;
+}
+
+/************************************************
+ * trading_agency::http pool
+************************************************/
+static int http_pool_find_context(trading_agency_private_t * priv, const struct http_json_context * http)
+{
+	for(int i = 0; i < priv->http_pool.num_created; ++i) {
+		if(priv->http_pool.contexts[i] == http) return i;
+	}
+	return -1;
+}
+
+struct http_json_context * trading_agency_lease_http(trading_agency_t * agent)
+{
+	assert(agent && agent->priv);
+	trading_agency_private_t * priv = agent->priv;
+	struct http_json_context * http = NULL;
+	
+	app_timer_t timer[1];
+	app_timer_start(timer);
+	
+	AUTO_UNLOCK_MUTEX_PTR pthread_mutex_t * mutex = &priv->http_pool.mutex;
+	pthread_mutex_lock(mutex);
+	while(1) {
+		if(priv->http_pool.num_idle > 0) {
+			http = priv->http_pool.idle[--priv->http_pool.num_idle];
+			break;
+		}
+		if(priv->http_pool.num_created < priv->http_pool.size) {
+			http = http_json_context_init(NULL, agent);
+			assert(http);
+			priv->http_pool.contexts[priv->http_pool.num_created++] = http;
+			break;
+		}
+		pthread_cond_wait(&priv->http_pool.cond, &priv->http_pool.mutex);
+	}
+	
+	perf_stats_update(priv->http_pool.lease_wait, app_timer_stop(timer));
+	
+	int index = http_pool_find_context(priv, http);
+	assert(index >= 0);
+	priv->http_pool.leased_at[index] = timer->end;
+	
+	int num_in_use = priv->http_pool.num_created - priv->http_pool.num_idle;
+	if(num_in_use > priv->http_pool.max_in_use) priv->http_pool.max_in_use = num_in_use;
+	return http;
+}
+
+struct http_json_context * trading_agency_lease_signed_http(trading_agency_t * agent)
+{
+	assert(agent && agent->priv);
+	trading_agency_private_t * priv = agent->priv;
+	
+	pthread_mutex_lock(&priv->http_pool.signed_mutex);
+	struct http_json_context * http = trading_agency_lease_http(agent);
+	__atomic_store_n(&priv->http_pool.signed_http, http, __ATOMIC_RELEASE);
+	return http;
+}
+
+void trading_agency_release_http(trading_agency_t * agent, struct http_json_context * http)
+{
+	assert(agent && agent->priv);
+	if(NULL == http) return;
+	trading_agency_private_t * priv = agent->priv;
+	
+	// do not keep the signed headers of the last request
+	http->clear_headers(http);
+	
+	app_timer_t timer[1];
+	double now = app_timer_start(timer);
+	
+	// only the holder of signed_mutex can find its own context here
+	int is_signed = (__atomic_load_n(&priv->http_pool.signed_http, __ATOMIC_ACQUIRE) == http);
+	if(is_signed) __atomic_store_n(&priv->http_pool.signed_http, NULL, __ATOMIC_RELEASE);
+	
+	pthread_mutex_lock(&priv->http_pool.mutex);
+	int index = http_pool_find_context(priv, http);
+	assert(index >= 0);
+	if(index >= 0) {
+		priv->http_pool.busy_time += now - priv->http_pool.leased_at[index];
+		assert(priv->http_pool.num_idle < priv->http_pool.num_created);
+		priv->http_pool.idle[priv->http_pool.num_idle++] = http;
+		pthread_cond_signal(&priv->http_pool.cond);
+	}
+	pthread_mutex_unlock(&priv->http_pool.mutex);
+	
+	if(is_signed) pthread_mutex_unlock(&priv->http_pool.signed_mutex);
+	return;
+}
+
+void trading_agency_auto_release_http(void * p_http)
+{
+	struct http_json_context ** p = p_http;
+	if(NULL == p || NULL == *p) return;
+	
+	struct http_json_context * http = *p;
+	trading_agency_release_http(http->user_data, http);
+	*p = NULL;
+	return;
+}
+
+void trading_agency_get_http_pool_stats(trading_agency_t * agent, 
+	struct trading_agency_http_pool_stats * stats,
+	struct perf_stats * lease_wait)
+{
+	assert(agent && agent->priv);
+	trading_agency_private_t * priv = agent->priv;
+	
+	app_timer_t timer[1];
+	double now = app_timer_start(timer);
+	
+	AUTO_UNLOCK_MUTEX_PTR pthread_mutex_t * mutex = &priv->http_pool.mutex;
+	pthread_mutex_lock(mutex);
+	if(stats) {
+		stats->pool_size = priv->http_pool.size;
+		stats->num_created = priv->http_pool.num_created;
+		stats->num_in_use = priv->http_pool.num_created - priv->http_pool.num_idle;
+		stats->max_in_use = priv->http_pool.max_in_use;
+		
+		double elapsed = now - priv->http_pool.created_at;
+		stats->utilization = (elapsed > 0 && priv->http_pool.size > 0)?
+			(priv->http_pool.busy_time / (elapsed * priv->http_pool.size)):0.0;
+	}
+	if(lease_wait) *lease_wait = *priv->http_pool.lease_wait;
+	return;
+}
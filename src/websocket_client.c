@@ -0,0 +1,524 @@
+/*
+ * websocket_client.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <assert.h>
+
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/random.h>
+
+#include <curl/curl.h>
+#include <gnutls/crypto.h>
+#include "websocket_client.h"
+#include "utils.h"
+
+#define WEBSOCKET_HANDSHAKE_TIMEOUT (10 * 1000) // ms
+#define WEBSOCKET_MAX_HEADERS_SIZE (16 * 1024)
+#define WEBSOCKET_ACCEPT_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"	// RFC 6455 1.3
+
+/************************************************
+ * websocket_client_private
+************************************************/
+struct frame_buffer
+{
+	size_t size;
+	size_t length;
+	unsigned char * data;
+};
+
+static int frame_buffer_append(struct frame_buffer * buf, const void * data, size_t length)
+{
+	if((buf->length + length) > buf->size) {
+		size_t new_size = buf->size?buf->size:4096;
+		while(new_size < (buf->length + length)) new_size *= 2;
+		unsigned char * p = realloc(buf->data, new_size);
+		if(NULL == p) return -1;
+		buf->data = p;
+		buf->size = new_size;
+	}
+	memcpy(buf->data + buf->length, data, length);
+	buf->length += length;
+	return 0;
+}
+
+static void frame_buffer_consume(struct frame_buffer * buf, size_t length)
+{
+	assert(length <= buf->length);
+	buf->length -= length;
+	if(buf->length) memmove(buf->data, buf->data + length, buf->length);
+	return;
+}
+
+typedef struct websocket_client_private
+{
+	websocket_client_context_t * wss;
+	CURL * curl;
+	curl_socket_t fd;
+	
+	struct frame_buffer rx[1];		// raw bytes received from the socket
+	struct frame_buffer message[1];	// payloads of a fragmented message
+	int message_opcode;
+	int close_sent;
+}websocket_client_private_t;
+
+static websocket_client_private_t * websocket_client_private_new(websocket_client_context_t * wss)
+{
+	websocket_client_private_t * priv = calloc(1, sizeof(*priv));
+	assert(priv);
+	priv->wss = wss;
+	priv->fd = CURL_SOCKET_BAD;
+	wss->priv = priv;
+	return priv;
+}
+
+static void websocket_client_private_free(websocket_client_private_t * priv)
+{
+	if(NULL == priv) return;
+	if(priv->curl) curl_easy_cleanup(priv->curl);
+	free(priv->rx->data);
+	free(priv->message->data);
+	free(priv);
+	return;
+}
+
+/************************************************
+ * transport (curl CONNECT_ONLY)
+************************************************/
+static int wait_socket(curl_socket_t fd, int for_write, int timeout_ms)
+{
+	struct pollfd pfd = { .fd = fd, .events = for_write?POLLOUT:POLLIN };
+	int rc = poll(&pfd, 1, timeout_ms);
+	return (rc > 0)?0:-1;
+}
+
+static int send_all(websocket_client_private_t * priv, const void * data, size_t length)
+{
+	const unsigned char * p = data;
+	while(length > 0) {
+		size_t cb = 0;
+		CURLcode ret = curl_easy_send(priv->curl, p, length, &cb);
+		if(ret == CURLE_AGAIN) {
+			if(wait_socket(priv->fd, 1, WEBSOCKET_HANDSHAKE_TIMEOUT)) return -1;
+			continue;
+		}
+		if(ret != CURLE_OK) {
+			debug_printf("curl_easy_send() failed: %s", curl_easy_strerror(ret));
+			return -1;
+		}
+		p += cb;
+		length -= cb;
+	}
+	return 0;
+}
+
+// read everything available without blocking.
+// return: 0 = ok, 1 = connection closed by peer, -1 = error
+static int recv_available(websocket_client_private_t * priv)
+{
+	unsigned char buf[16384];
+	while(1) {
+		size_t cb = 0;
+		CURLcode ret = curl_easy_recv(priv->curl, buf, sizeof(buf), &cb);
+		if(ret == CURLE_AGAIN) return 0;
+		if(ret != CURLE_OK) {
+			debug_printf("curl_easy_recv() failed: %s", curl_easy_strerror(ret));
+			return -1;
+		}
+		if(cb == 0) return 1;
+		if(frame_buffer_append(priv->rx, buf, cb)) return -1;
+		priv->wss->num_bytes += cb;
+	}
+	return 0;
+}
+
+/************************************************
+ * framing
+************************************************/
+static int send_frame(websocket_client_private_t * priv, int opcode, const void * data, size_t length)
+{
+	unsigned char header[14];
+	size_t cb_header = 0;
+	header[cb_header++] = 0x80 | (opcode & 0x0f);	// FIN
+	if(length < 126) {
+		header[cb_header++] = 0x80 | (unsigned char)length;
+	}else if(length <= 0xffff) {
+		header[cb_header++] = 0x80 | 126;
+		header[cb_header++] = (length >> 8) & 0xff;
+		header[cb_header++] = length & 0xff;
+	}else {
+		header[cb_header++] = 0x80 | 127;
+		for(int i = 7; i >= 0; --i) header[cb_header++] = ((uint64_t)length >> (i * 8)) & 0xff;
+	}
+	
+	// client-to-server frames are always masked
+	unsigned char mask[4];
+	if(getrandom(mask, sizeof(mask), 0) != sizeof(mask)) return -1;
+	memcpy(header + cb_header, mask, 4);
+	cb_header += 4;
+	
+	unsigned char * frame = malloc(cb_header + length);
+	assert(frame);
+	memcpy(frame, header, cb_header);
+	const unsigned char * payload = data;
+	for(size_t i = 0; i < length; ++i) frame[cb_header + i] = payload[i] ^ mask[i & 3];
+	
+	int rc = send_all(priv, frame, cb_header + length);
+	free(frame);
+	return rc;
+}
+
+static void on_closed(websocket_client_private_t * priv, int status_code)
+{
+	websocket_client_context_t * wss = priv->wss;
+	if(!wss->is_connected) return;
+	
+	wss->is_connected = 0;
+	if(wss->reactor && priv->fd != CURL_SOCKET_BAD) wss->reactor->remove_fd(wss->reactor, priv->fd);
+	if(wss->on_closed) wss->on_closed(wss, status_code);
+	return;
+}
+
+static int on_frame(websocket_client_private_t * priv, int fin, int opcode, const unsigned char * payload, size_t length)
+{
+	websocket_client_context_t * wss = priv->wss;
+	switch(opcode) {
+	case WEBSOCKET_OPCODE_ping:
+		return send_frame(priv, WEBSOCKET_OPCODE_pong, payload, length);
+	case WEBSOCKET_OPCODE_pong:
+		return 0;
+	case WEBSOCKET_OPCODE_close:
+		{
+			int status_code = (length >= 2)?((payload[0] << 8) | payload[1]):1005;
+			if(!priv->close_sent) {
+				priv->close_sent = 1;
+				send_frame(priv, WEBSOCKET_OPCODE_close, payload, (length >= 2)?2:0);
+			}
+			on_closed(priv, status_code);
+		}
+		return 1;
+	default:
+		break;
+	}
+	
+	if(opcode != WEBSOCKET_OPCODE_continuation) {
+		if(fin) {	// unfragmented message, no copy
+			++wss->num_messages;
+			if(wss->on_message) wss->on_message(wss, opcode, (const char *)payload, length);
+			return 0;
+		}
+		priv->message->length = 0;
+		priv->message_opcode = opcode;
+	}
+	
+	if((priv->message->length + length) > WEBSOCKET_MAX_MESSAGE_SIZE) return -1;
+	if(frame_buffer_append(priv->message, payload, length)) return -1;
+	if(fin) {
+		++wss->num_messages;
+		if(wss->on_message) wss->on_message(wss, priv->message_opcode, (const char *)priv->message->data, priv->message->length);
+		priv->message->length = 0;
+	}
+	return 0;
+}
+
+// parse all complete frames in priv->rx
+static int process_frames(websocket_client_private_t * priv)
+{
+	struct frame_buffer * rx = priv->rx;
+	size_t offset = 0;
+	int rc = 0;
+	
+	while(0 == rc && priv->wss->is_connected && (rx->length - offset) >= 2) {
+		const unsigned char * p = rx->data + offset;
+		size_t available = rx->length - offset;
+		
+		int fin = (p[0] & 0x80) != 0;
+		int opcode = p[0] & 0x0f;
+		int masked = (p[1] & 0x80) != 0;
+		uint64_t length = p[1] & 0x7f;
+		size_t cb_header = 2;
+		
+		if(length == 126) {
+			if(available < 4) break;
+			length = ((uint64_t)p[2] << 8) | p[3];
+			cb_header = 4;
+		}else if(length == 127) {
+			if(available < 10) break;
+			length = 0;
+			for(int i = 0; i < 8; ++i) length = (length << 8) | p[2 + i];
+			cb_header = 10;
+		}
+		if(length > WEBSOCKET_MAX_MESSAGE_SIZE) return -1;
+		
+		unsigned char mask[4] = { 0 };
+		if(masked) {	// servers must not mask, accept it anyway
+			if(available < cb_header + 4) break;
+			memcpy(mask, p + cb_header, 4);
+			cb_header += 4;
+		}
+		if(available < cb_header + length) break;
+		
+		unsigned char * payload = rx->data + offset + cb_header;
+		if(masked) for(uint64_t i = 0; i < length; ++i) payload[i] ^= mask[i & 3];
+		
+		rc = on_frame(priv, fin, opcode, payload, length);
+		offset += cb_header + length;
+	}
+	
+	if(offset) frame_buffer_consume(rx, offset);
+	return rc;
+}
+
+static void on_readable(struct reactor_context * reactor, int fd, int events, void * user_data)
+{
+	websocket_client_private_t * priv = user_data;
+	
+	int rc = recv_available(priv);
+	if(priv->rx->length && process_frames(priv) < 0) rc = -1;
+	if(rc) on_closed(priv, (rc > 0)?1006:1002);
+	return;
+}
+
+/************************************************
+ * opening handshake
+************************************************/
+static void base64_encode(const unsigned char * data, size_t length, char * b64)
+{
+	static const char s_b64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	size_t i = 0;
+	for(; i + 2 < length; i += 3) {
+		uint32_t v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+		*b64++ = s_b64_chars[(v >> 18) & 0x3f];
+		*b64++ = s_b64_chars[(v >> 12) & 0x3f];
+		*b64++ = s_b64_chars[(v >> 6) & 0x3f];
+		*b64++ = s_b64_chars[v & 0x3f];
+	}
+	if(i < length) {
+		uint32_t v = data[i] << 16;
+		if(i + 1 < length) v |= data[i + 1] << 8;
+		*b64++ = s_b64_chars[(v >> 18) & 0x3f];
+		*b64++ = s_b64_chars[(v >> 12) & 0x3f];
+		*b64++ = (i + 1 < length)?s_b64_chars[(v >> 6) & 0x3f]:'=';
+		*b64++ = '=';
+	}
+	*b64 = '\0';
+	return;
+}
+
+// the value of the first header @name (case-insensitive), surrounding spaces trimmed
+static const char * find_header(const char * headers, const char * end, const char * name, size_t * p_length)
+{
+	size_t cb_name = strlen(name);
+	const char * line = memmem(headers, end - headers, "\r\n", 2);	// skip the status line
+	while(line && line < end) {
+		line += 2;
+		const char * eol = memmem(line, end - line, "\r\n", 2);
+		if(NULL == eol) eol = end;
+		if((size_t)(eol - line) > cb_name && line[cb_name] == ':' && strncasecmp(line, name, cb_name) == 0) {
+			const char * value = line + cb_name + 1;
+			while(value < eol && (*value == ' ' || *value == '\t')) ++value;
+			const char * value_end = eol;
+			while(value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t')) --value_end;
+			*p_length = value_end - value;
+			return value;
+		}
+		line = (eol < end)?eol:NULL;
+	}
+	return NULL;
+}
+
+// RFC 6455 4.1: Sec-WebSocket-Accept == base64(SHA-1(key | GUID))
+static int verify_accept(const char * key, const char * headers, const char * end)
+{
+	char message[64] = "";
+	int cb = snprintf(message, sizeof(message), "%s%s", key, WEBSOCKET_ACCEPT_GUID);
+	assert(cb > 0 && cb < (int)sizeof(message));
+	
+	unsigned char sha1[20];
+	char expected[32] = "";
+	if(gnutls_hash_fast(GNUTLS_DIG_SHA1, message, cb, sha1) != 0) return -1;
+	base64_encode(sha1, sizeof(sha1), expected);
+	
+	size_t cb_accept = 0;
+	const char * accept = find_header(headers, end, "Sec-WebSocket-Accept", &cb_accept);
+	if(NULL == accept || cb_accept != strlen(expected) || memcmp(accept, expected, cb_accept) != 0) return -1;
+	return 0;
+}
+
+static int handshake(websocket_client_private_t * priv, const char * host, const char * path)
+{
+	unsigned char nonce[16];
+	char key[32] = "";
+	if(getrandom(nonce, sizeof(nonce), 0) != sizeof(nonce)) return -1;
+	base64_encode(nonce, sizeof(nonce), key);
+	
+	char request[4096] = "";
+	int cb = snprintf(request, sizeof(request), 
+		"GET %s HTTP/1.1\r\n"
+		"Host: %s\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: Upgrade\r\n"
+		"Sec-WebSocket-Key: %s\r\n"
+		"Sec-WebSocket-Version: 13\r\n"
+		"\r\n", 
+		path, host, key);
+	if(cb <= 0 || cb >= (int)sizeof(request)) return -1;
+	if(send_all(priv, request, cb)) return -1;
+	
+	// read the response headers, frames may follow in the same packet
+	struct frame_buffer * rx = priv->rx;
+	char * end_of_headers = NULL;
+	while(NULL == end_of_headers) {
+		if(wait_socket(priv->fd, 0, WEBSOCKET_HANDSHAKE_TIMEOUT)) return -1;
+		if(recv_available(priv)) return -1;
+		if(rx->length > WEBSOCKET_MAX_HEADERS_SIZE) return -1;
+		if(rx->length) end_of_headers = memmem(rx->data, rx->length, "\r\n\r\n", 4);
+	}
+	
+	if(rx->length < 12 || memcmp(rx->data, "HTTP/1.1 101", 12) != 0
+		|| verify_accept(key, (char *)rx->data, end_of_headers) != 0) 
+	{
+		debug_printf("websocket handshake failed: %.*s", 
+			(int)((unsigned char *)end_of_headers - rx->data), rx->data);
+		return -1;
+	}
+	frame_buffer_consume(rx, (unsigned char *)end_of_headers + 4 - rx->data);
+	return 0;
+}
+
+/************************************************
+ * websocket_client_context::member functions
+************************************************/
+static int websocket_client_connect(struct websocket_client_context * wss, const char * uri)
+{
+	assert(wss && wss->priv && wss->reactor && uri);
+	websocket_client_private_t * priv = wss->priv;
+	if(wss->is_connected) return 0;
+	
+	// wss://host[:port]/path ==> https://host[:port]/path
+	int secure = 1;
+	if(strncasecmp(uri, "wss://", 6) == 0) uri += 6;
+	else if(strncasecmp(uri, "ws://", 5) == 0) { uri += 5; secure = 0; }
+	else return -1;
+	
+	char host[256] = "";
+	const char * path = strchr(uri, '/');
+	size_t cb_host = path?(size_t)(path - uri):strlen(uri);
+	if(cb_host == 0 || cb_host >= sizeof(host)) return -1;
+	memcpy(host, uri, cb_host);
+	if(NULL == path) path = "/";
+	
+	char url[1024] = "";
+	snprintf(url, sizeof(url), "%s://%s%s", secure?"https":"http", host, path);
+	
+	if(priv->curl) curl_easy_cleanup(priv->curl);
+	priv->curl = curl_easy_init();
+	assert(priv->curl);
+	priv->rx->length = 0;
+	priv->message->length = 0;
+	priv->close_sent = 0;
+	
+	curl_easy_setopt(priv->curl, CURLOPT_URL, url);
+	curl_easy_setopt(priv->curl, CURLOPT_CONNECT_ONLY, 1L);
+	curl_easy_setopt(priv->curl, CURLOPT_TCP_NODELAY, 1L);
+	CURLcode ret = curl_easy_perform(priv->curl);
+	if(ret != CURLE_OK) {
+		debug_printf("connect to %s failed: %s", url, curl_easy_strerror(ret));
+		return -1;
+	}
+	curl_easy_getinfo(priv->curl, CURLINFO_ACTIVESOCKET, &priv->fd);
+	if(priv->fd == CURL_SOCKET_BAD) return -1;
+	
+	if(handshake(priv, host, path)) return -1;
+	
+	int rc = wss->reactor->add_fd(wss->reactor, priv->fd, REACTOR_EVENT_READ, on_readable, priv);
+	if(rc) return -1;
+	
+	wss->is_connected = 1;
+	if(wss->on_connected) wss->on_connected(wss);
+	
+	// frames received together with the handshake response
+	if(priv->rx->length && process_frames(priv) < 0) on_closed(priv, 1002);
+	return 0;
+}
+
+static int websocket_client_send(struct websocket_client_context * wss, int opcode, const void * data, size_t length)
+{
+	assert(wss && wss->priv);
+	websocket_client_private_t * priv = wss->priv;
+	if(!wss->is_connected || priv->close_sent) return -1;
+	return send_frame(priv, opcode, data, length);
+}
+
+static int websocket_client_close(struct websocket_client_context * wss)
+{
+	assert(wss && wss->priv);
+	websocket_client_private_t * priv = wss->priv;
+	if(!wss->is_connected) return 0;
+	
+	if(!priv->close_sent) {
+		static const unsigned char normal_closure[2] = { 1000 >> 8, 1000 & 0xff };
+		priv->close_sent = 1;
+		send_frame(priv, WEBSOCKET_OPCODE_close, normal_closure, sizeof(normal_closure));
+	}
+	on_closed(priv, 1000);
+	return 0;
+}
+
+/************************************************
+ * public interfaces
+************************************************/
+websocket_client_context_t * websocket_client_context_init(websocket_client_context_t * wss, reactor_context_t * reactor, void * user_data)
+{
+	if(NULL == wss) wss = calloc(1, sizeof(*wss));
+	assert(wss);
+	
+	wss->user_data = user_data;
+	wss->reactor = reactor;
+	wss->connect = websocket_client_connect;
+	wss->send = websocket_client_send;
+	wss->close = websocket_client_close;
+	
+	websocket_client_private_t * priv = websocket_client_private_new(wss);
+	assert(priv && priv == wss->priv);
+	return wss;
+}
+
+void websocket_client_context_cleanup(websocket_client_context_t * wss)
+{
+	if(NULL == wss) return;
+	if(wss->is_connected) websocket_client_close(wss);
+	websocket_client_private_free(wss->priv);
+	wss->priv = NULL;
+	return;
+}
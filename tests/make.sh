@@ -15,18 +15,20 @@ case "$TARGET" in
 	test_coincheck_api)
 		${LINKER} -o tests/test_coincheck_api \
 			tests/test_coincheck_api.c \
-			src/trading_agency.c src/trading_agencies/coincheck.c \
+			src/trading_agency.c src/order_journal.c src/credentials_vault.c src/trading_agencies/coincheck.c \
+			src/reactor.c src/reactor_curl.c utils/mpsc_queue.c \
 			src/json-response.c \
-			utils/utils.c utils/auto_buffer.c \
+			utils/utils.c utils/auto_buffer.c utils/crypto/hmac_signer.c utils/crypto/ctaes.c \
 			$(pkg-config --cflags --libs gnutls) \
 			-lm -lpthread -ljson-c -lcurl
 		;;
 	test_zaif_api)
 		${LINKER} -o tests/test_zaif_api \
 			tests/test_zaif_api.c \
-			src/trading_agency.c src/trading_agencies/zaif.c \
+			src/trading_agency.c src/order_journal.c src/credentials_vault.c src/trading_agencies/zaif.c \
+			src/reactor.c src/reactor_curl.c utils/mpsc_queue.c \
 			src/json-response.c \
-			utils/utils.c utils/auto_buffer.c \
+			utils/utils.c utils/auto_buffer.c utils/crypto/hmac_signer.c utils/crypto/ctaes.c \
 			$(pkg-config --cflags --libs gnutls) \
 			-lm -lpthread -ljson-c -lcurl
 		;;
@@ -56,11 +58,95 @@ case "$TARGET" in
 	test_db-utils)
 		${LINKER} -o tests/${TARGET} \
 			tests/${TARGET}.c \
-			src/json-response.c \
+			src/db_context.c src/bank_codes.c src/json-response.c \
 			utils/utils.c utils/auto_buffer.c \
 			-lm -lpthread -ljson-c -lcurl -ldb
 		;;
 		
+	test_tick_store)
+		${LINKER} -o tests/${TARGET} \
+			tests/${TARGET}.c \
+			src/db_context.c src/tick_store.c \
+			utils/utils.c \
+			-lm -lpthread -ldb
+		;;
+		
+	test_candles)
+		${LINKER} -o tests/${TARGET} \
+			-D_TEST_CANDLES -D_STAND_ALONE \
+			src/candles.c src/db_context.c \
+			utils/utils.c \
+			-lm -lpthread -ldb
+		;;
+	test_trade_archive)
+		${LINKER} -o tests/${TARGET} \
+			-D_TEST_TRADE_ARCHIVE -D_STAND_ALONE \
+			utils/trade_archive.c \
+			utils/utils.c \
+			-lm -lpthread
+		;;
+	test_hex)
+		${LINKER} -o tests/${TARGET} \
+			tests/${TARGET}.c \
+			utils/utils.c \
+			-lm -lpthread
+		;;
+	test_ctaes)
+		${LINKER} -o tests/${TARGET} \
+			tests/${TARGET}.c \
+			utils/crypto/ctaes.c utils/utils.c \
+			-lm -lpthread
+		;;
+	test_sha256_batch)
+		${LINKER} -o tests/${TARGET} \
+			tests/${TARGET}.c \
+			utils/crypto/sha256_batch.c utils/utils.c \
+			$(pkg-config --cflags --libs gnutls) \
+			-lm -lpthread
+		;;
+	test_base58)
+		${LINKER} -o tests/${TARGET} \
+			tests/${TARGET}.c \
+			utils/crypto/base58.c utils/crypto/sha256_batch.c utils/utils.c \
+			$(pkg-config --cflags --libs gnutls) \
+			-lm -lpthread
+		;;
+	test_credentials_vault)
+		${LINKER} -o tests/${TARGET} \
+			-D_TEST_CREDENTIALS_VAULT -D_STAND_ALONE \
+			src/credentials_vault.c \
+			utils/utils.c utils/crypto/ctaes.c utils/crypto/hmac_signer.c \
+			$(pkg-config --cflags --libs gnutls) \
+			-lm -lpthread
+		;;
+	test_ticker_history)
+		${LINKER} -o tests/${TARGET} \
+			-D_TEST_TICKER_HISTORY -D_STAND_ALONE \
+			utils/ticker_history.c \
+			-lm -lpthread
+		;;
+	test_order_journal)
+		${LINKER} -o tests/${TARGET} \
+			-D_TEST_ORDER_JOURNAL -D_STAND_ALONE \
+			src/order_journal.c \
+			utils/utils.c \
+			-lm -lpthread
+		;;
+	test_reactor)
+		${LINKER} -o tests/${TARGET} \
+			-D_TEST_REACTOR -D_STAND_ALONE \
+			src/reactor.c \
+			utils/utils.c \
+			-lm -lpthread
+		;;
+	test_panel_snapshot)
+		${LINKER} -o tests/${TARGET} \
+			-D_TEST_PANEL_SNAPSHOT -D_STAND_ALONE -Isrc/gui \
+			src/gui/panel_snapshot.c \
+			utils/utils.c utils/auto_buffer.c \
+			-lm -lpthread -ljson-c
+		;;
+		
 	*)
 		echo "not found"
 		exit 1
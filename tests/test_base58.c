@@ -0,0 +1,193 @@
+/*
+ * test_base58.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "crypto/base58.h"
+
+/*
+ * base58: the vectors of bitcoin core (src/test/data/base58_encode_decode.json),
+ *   round trips of random data with 0 .. 3 leading zero bytes, invalid digits.
+ * base58check: known addresses, corrupted checksums, batch decoding.
+ */
+
+#define CHECK(cond) do { if(!(cond)) { fprintf(stderr, "[FAILED] %s:%d: %s\n", __FILE__, __LINE__, #cond); exit(1); } } while(0)
+
+static const char * s_vectors[][2] = {
+	{ "", "" },
+	{ "61", "2g" },
+	{ "626262", "a3gV" },
+	{ "636363", "aPEr" },
+	{ "73696d706c792061206c6f6e6720737472696e67", "2cFupjhnEsSn59qHXstmK2ffpLv2" },
+	{ "00eb15231dfceb60925886b67d065299925915aeb172c06647", "1NS17iag9jJgTHD1VXjvLCEnZuQ3rJDE9L" },
+	{ "516b6fcd0f", "ABnLTmg" },
+	{ "bf4f89001e670274dd", "3SEo3LWLoPntC" },
+	{ "572e4794", "3EFU7m" },
+	{ "ecac89cad93923c02321", "EJDM8drfXA6uyA" },
+	{ "10c8511e", "Rt5zm" },
+	{ "00000000000000000000", "1111111111" },
+	{ "000111d38e5fc9071ffcd20b4a763cc9ae4f252bb4e48fd66a835e252ada93ff480d6dd43dc62a641155a5",
+		"123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz" },
+};
+
+static void test_vectors(void)
+{
+	for(size_t i = 0; i < sizeof(s_vectors) / sizeof(s_vectors[0]); ++i) {
+		const char * hex = s_vectors[i][0];
+		const char * expected = s_vectors[i][1];
+		uint8_t data[BASE58_MAX_DATA_SIZE];
+		uint8_t decoded[BASE58_MAX_DATA_SIZE];
+		char b58[BASE58_ENCODED_SIZE(BASE58_MAX_DATA_SIZE)];
+		
+		ssize_t length = hex_decode(hex, strlen(hex), data);
+		CHECK(length >= 0);
+		ssize_t cb = base58_encode(data, length, b58, sizeof(b58));
+		CHECK(cb == (ssize_t)strlen(expected) && 0 == strcmp(b58, expected));
+		CHECK(base58_encode(data, length, b58, cb) == -1);	// no room for the '\0'
+		
+		CHECK(base58_decode(expected, strlen(expected), decoded, sizeof(decoded)) == length);
+		CHECK(0 == memcmp(decoded, data, length));
+		if(length) CHECK(base58_decode(expected, strlen(expected), decoded, length - 1) == -1);
+	}
+}
+
+static void test_round_trips(void)
+{
+	uint32_t seed = 0x2468ace1;
+	uint8_t data[BASE58_MAX_DATA_SIZE];
+	uint8_t decoded[BASE58_MAX_DATA_SIZE];
+	char b58[BASE58_ENCODED_SIZE(BASE58_MAX_DATA_SIZE)];
+	
+	for(size_t length = 0; length <= BASE58_MAX_DATA_SIZE; ++length) {
+		for(int round = 0; round < 16; ++round) {
+			for(size_t i = 0; i < length; ++i) {
+				seed = seed * 1103515245 + 12345;
+				data[i] = (uint8_t)(seed >> 16);
+			}
+			for(size_t i = 0; i < length && i < (size_t)(round % 4); ++i) data[i] = 0;
+			if(length && round == 15) data[0] = 0xff;
+			
+			ssize_t cb = base58_encode(data, length, b58, sizeof(b58));
+			CHECK(cb >= 0 && (size_t)cb < BASE58_ENCODED_SIZE(length));
+			CHECK(base58_decode(b58, cb, decoded, sizeof(decoded)) == (ssize_t)length);
+			CHECK(0 == memcmp(decoded, data, length));
+		}
+	}
+	
+	CHECK(base58_encode(data, BASE58_MAX_DATA_SIZE + 1, b58, sizeof(b58)) == -1);
+	
+	// BASE58_MAX_DATA_SIZE zero bytes
+	memset(data, 0, sizeof(data));
+	CHECK(base58_encode(data, BASE58_MAX_DATA_SIZE, b58, sizeof(b58)) == BASE58_MAX_DATA_SIZE);
+	CHECK(strspn(b58, "1") == BASE58_MAX_DATA_SIZE);
+	
+	static const char * invalid[] = { "0", "O", "I", "l", "3SEo3LWLo PntC", "3SEo3LWLoPntC\n", "\xff", "+" };
+	for(size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i) {
+		CHECK(base58_decode(invalid[i], strlen(invalid[i]), decoded, sizeof(decoded)) == -1);
+	}
+	
+	// the longest accepted string, its value needs more than BASE58_MAX_DATA_SIZE bytes
+	size_t max_digits = BASE58_ENCODED_SIZE(BASE58_MAX_DATA_SIZE) - 1;
+	memset(b58, 'z', max_digits);
+	CHECK(base58_decode(b58, max_digits, decoded, sizeof(decoded)) == -1);
+	CHECK(base58_decode(b58, max_digits + 1, decoded, sizeof(decoded)) == -1);
+}
+
+static void test_base58check(void)
+{
+	static const char * valid[] = { "1BvBMSEYstWetqTFn5Au4m4GFg7xJaNVN2", "3J98t1WpEZ73CNmQviecrnyiWrnqRhWNLy" };
+	uint8_t payload[BASE58CHECK_MAX_PAYLOAD_SIZE];
+	char b58[BASE58_ENCODED_SIZE(BASE58CHECK_MAX_PAYLOAD_SIZE + 4)];
+	uint8_t hash[20];
+	
+	CHECK(btc_address_decode(valid[0], hash) == btc_address_type_p2pkh);
+	CHECK(btc_address_decode(valid[1], NULL) == btc_address_type_p2sh);
+	
+	for(size_t i = 0; i < 2; ++i) {
+		ssize_t cb = base58check_decode(valid[i], strlen(valid[i]), payload, sizeof(payload));
+		CHECK(cb == 21);
+		CHECK(base58check_encode(payload, cb, b58, sizeof(b58)) == (ssize_t)strlen(valid[i]));
+		CHECK(0 == strcmp(b58, valid[i]));
+		if(i == 0) CHECK(0 == memcmp(hash, payload + 1, 20));
+	}
+	
+	// every single-character substitution breaks the checksum (or the format)
+	char corrupted[64];
+	strcpy(corrupted, valid[0]);
+	for(size_t i = 0; corrupted[i]; ++i) {
+		char c = corrupted[i];
+		corrupted[i] = (c == 'z')?'y':'z';
+		ssize_t cb = base58check_decode(corrupted, strlen(corrupted), payload, sizeof(payload));
+		CHECK(cb == base58check_error_checksum || cb == base58check_error_invalid);
+		CHECK(btc_address_decode(corrupted, NULL) == btc_address_type_invalid);
+		corrupted[i] = c;
+	}
+	CHECK(btc_address_decode("bc1qar0srrr7xfkvy5l643lydnw9re59gtzzwf5mdq", NULL) == btc_address_type_invalid);
+	CHECK(base58check_decode("1", 1, payload, sizeof(payload)) == base58check_error_invalid);
+	
+	// batch: valid, corrupted and malformed entries mixed, more than one chunk
+	enum { NUM_ENTRIES = 200 };
+	static char storage[NUM_ENTRIES][BASE58_ENCODED_SIZE(BASE58CHECK_MAX_PAYLOAD_SIZE + 4)];
+	const char * list[NUM_ENTRIES];
+	struct base58check_payload * payloads = calloc(NUM_ENTRIES, sizeof(*payloads));
+	assert(payloads);
+	
+	size_t expected_valid = 0;
+	for(size_t i = 0; i < NUM_ENTRIES; ++i) {
+		size_t length = 1 + (i * 7) % BASE58CHECK_MAX_PAYLOAD_SIZE;
+		for(size_t k = 0; k < length; ++k) payload[k] = (uint8_t)(i * 31 + k);
+		CHECK(base58check_encode(payload, length, storage[i], sizeof(storage[i])) > 0);
+		list[i] = storage[i];
+		switch(i % 5)
+		{
+		case 1: storage[i][strlen(storage[i]) - 1] ^= 1; break;	// '1' <-> '0' may even be invalid
+		case 3: list[i] = (i % 2)?"0OIl":NULL; break;
+		default: ++expected_valid; break;
+		}
+	}
+	CHECK(base58check_decode_batch(list, NUM_ENTRIES, payloads) == expected_valid);
+	for(size_t i = 0; i < NUM_ENTRIES; ++i) {
+		ssize_t cb = list[i]?base58check_decode(list[i], strlen(list[i]), payload, sizeof(payload)):base58check_error_invalid;
+		CHECK(cb == payloads[i].length);
+		if(cb > 0) CHECK(0 == memcmp(payload, payloads[i].data, cb));
+	}
+	free(payloads);
+}
+
+int main(int argc, char ** argv)
+{
+	test_vectors();
+	test_round_trips();
+	test_base58check();
+	printf("[PASSED]\n");
+	return 0;
+}
@@ -0,0 +1,151 @@
+/*
+ * test_ctaes.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "crypto/ctaes.h"
+
+/*
+ * every backend:
+ *   FIPS-197 appendix C vectors (AES-128 / 192 / 256)
+ *   random keys and messages of 0..40 blocks (covers the 8 / 16 block pipelines and their tails)
+ *   against the bitsliced implementation, then decrypt(encrypt(x)) == x
+ */
+
+static const unsigned char s_key[32] = {
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+	0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+};
+static const unsigned char s_plain[16] = {
+	0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff,
+};
+static const char * s_expected[3] = {
+	"69c4e0d86a7b0430d8cdb78070b4c55a",	// AES-128
+	"dda97ca4864cdfe06eaf70a0ec0d7191",	// AES-192
+	"8ea2b7ca516745bfeafc49904b496089",	// AES-256
+};
+
+#define MAX_BLOCKS (40)
+struct aes_ctx
+{
+	AES128_ctx aes128;
+	AES192_ctx aes192;
+	AES256_ctx aes256;
+};
+
+static void aes_init(struct aes_ctx * ctx, const unsigned char key[32])
+{
+	AES128_init(&ctx->aes128, key);
+	AES192_init(&ctx->aes192, key);
+	AES256_init(&ctx->aes256, key);
+}
+
+static void aes_encrypt(const struct aes_ctx * ctx, int bits, size_t blocks, unsigned char * cipher, const unsigned char * plain)
+{
+	switch(bits) {
+	case 128: AES128_encrypt(&ctx->aes128, blocks, cipher, plain); break;
+	case 192: AES192_encrypt(&ctx->aes192, blocks, cipher, plain); break;
+	default: AES256_encrypt(&ctx->aes256, blocks, cipher, plain); break;
+	}
+}
+
+static void aes_decrypt(const struct aes_ctx * ctx, int bits, size_t blocks, unsigned char * plain, const unsigned char * cipher)
+{
+	switch(bits) {
+	case 128: AES128_decrypt(&ctx->aes128, blocks, plain, cipher); break;
+	case 192: AES192_decrypt(&ctx->aes192, blocks, plain, cipher); break;
+	default: AES256_decrypt(&ctx->aes256, blocks, plain, cipher); break;
+	}
+}
+
+static void test_backend(enum AES_BACKEND backend)
+{
+	static const int bits[3] = { 128, 192, 256 };
+	struct aes_ctx soft[1], ctx[1];
+	unsigned char key[32];
+	unsigned char plain[MAX_BLOCKS * 16], cipher[MAX_BLOCKS * 16], expected[MAX_BLOCKS * 16], decrypted[MAX_BLOCKS * 16];
+	char hex[33];
+	
+	// FIPS-197
+	aes_init(ctx, s_key);
+	for(int i = 0; i < 3; ++i) {
+		aes_encrypt(ctx, bits[i], 1, cipher, s_plain);
+		hex_encode(cipher, 16, hex);
+		assert(0 == strcmp(hex, s_expected[i]));
+		aes_decrypt(ctx, bits[i], 1, decrypted, cipher);
+		assert(0 == memcmp(decrypted, s_plain, 16));
+	}
+	
+	// random keys / messages
+	srand(12345);
+	for(int round = 0; round < 200; ++round) {
+		for(size_t i = 0; i < sizeof(key); ++i) key[i] = (unsigned char)rand();
+		for(size_t i = 0; i < sizeof(plain); ++i) plain[i] = (unsigned char)rand();
+		
+		AES_select_backend(AES_BACKEND_soft);
+		aes_init(soft, key);
+		AES_select_backend(backend);
+		aes_init(ctx, key);
+		
+		for(int i = 0; i < 3; ++i) {
+			for(size_t blocks = 0; blocks <= MAX_BLOCKS; ++blocks) {
+				memset(cipher, 0xcc, sizeof(cipher));
+				aes_encrypt(soft, bits[i], blocks, expected, plain);
+				aes_encrypt(ctx, bits[i], blocks, cipher, plain);
+				assert(0 == memcmp(cipher, expected, blocks * 16));
+				if(blocks < MAX_BLOCKS) assert(cipher[blocks * 16] == 0xcc);	// no overrun
+				
+				aes_decrypt(ctx, bits[i], blocks, decrypted, cipher);
+				assert(0 == memcmp(decrypted, plain, blocks * 16));
+			}
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	static const enum AES_BACKEND backends[] = { AES_BACKEND_soft, AES_BACKEND_aesni, AES_BACKEND_vaes };
+	for(size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); ++i) {
+		const char * name = AES_backend_name(backends[i]);
+		if(AES_select_backend(backends[i])) {
+			printf("%-6s: not supported, skipped\n", name);
+			continue;
+		}
+		test_backend(backends[i]);
+		printf("%-6s: ok\n", name);
+	}
+	
+	AES_select_backend(AES_BACKEND_auto);
+	printf("default: %s\n", AES_backend_name(AES_BACKEND_auto));
+	return 0;
+}
@@ -36,27 +36,9 @@
 #include <json-c/json.h>
 
 #include "json-response.h"
+#include "db_context.h"
+#include "bank_codes.h"
 
-struct bank_code_record_data
-{
-	char name[64];
-	char half_width_kana[256];
-	char full_width_kana[256];
-	char hiragana[256];
-};
-struct bank_code_record
-{
-	char code[8];
-	union {
-		struct bank_code_record_data data[1];
-		struct {
-			char name[64];
-			char half_width_kana[256];
-			char full_width_kana[256];
-			char hiragana[256];
-		};
-	};
-};
 void bank_code_record_dump(const struct bank_code_record * record)
 {
 	printf("code: %s\n", record->code);
@@ -82,37 +64,8 @@ int bank_code_record_set(struct bank_code_record * record, json_object * jrecord
 	return 0;
 }
 
-#define BANK_CODES_SDBP_COUNT (4)
-typedef struct db_context
-{
-	DB_ENV * env;
-	DB * bank_codes;			// for write
-	DB * bank_codes_readonly;	// for read
-	union {
-		struct {
-			DB * bank_codes_by_name;
-			DB * bank_codes_by_half_width_kana;
-			DB * bank_codes_by_full_width_kana;
-			DB * bank_codes_by_hiragana;
-		};
-		DB * sdbps[BANK_CODES_SDBP_COUNT];
-	};
-	
-	struct {
-		DB * tickers;
-	} coincheck;
-}db_context_t;
-db_context_t * db_context_init(db_context_t * db, const char * db_home, void * user_data);
-void db_context_cleanup(db_context_t * db);
-
-#define exit_on_failure(rc) do { \
-		if(0 == rc) break; \
-		fprintf(stderr, "[ERROR]: %s\n", db_strerror(rc)); \
-		exit(1); \
-	}while(0)
-
-static int load_bank_codes(db_context_t * db, struct http_json_context * http);
-static void run_tests(db_context_t * db);
+static int load_bank_codes(bank_codes_index_t * index, struct http_json_context * http);
+static void run_tests(bank_codes_index_t * index);
 int main(int argc, char **argv)
 {
 	const char * db_home = "data";
@@ -125,10 +78,14 @@ int main(int argc, char **argv)
 	db_context_t * db = db_context_init(NULL, db_home, NULL);
 	assert(db);
 	
-	load_bank_codes(db, http);
+	bank_codes_index_t * index = bank_codes_index_init(NULL, db, NULL);
+	assert(index);
+	load_bank_codes(index, http);	// refresh: only the changes are written
 	
-	run_tests(db);
+	run_tests(index);
 	
+	bank_codes_index_cleanup(index);
+	free(index);
 	db_context_cleanup(db);
 	free(db);
 	
@@ -177,202 +134,40 @@ int main(int argc, char **argv)
     },
     ...
 **/
-static void run_tests(db_context_t * db)
-{
-	DB * dbp = db->bank_codes;
-	DB * sdbp_by_name = db->bank_codes_by_name;
-	DB * sdbp_by_hiragana = db->bank_codes_by_hiragana;
-	DB * sdbp_by_half_width_kana = db->bank_codes_by_half_width_kana;
-	DB * sdbp_by_full_width_kana = db->bank_codes_by_full_width_kana;
-	assert(dbp && sdbp_by_name);
-	assert(sdbp_by_hiragana && sdbp_by_half_width_kana && sdbp_by_full_width_kana);
-	
-	
-	DBC * cursorp = NULL;
-	int rc = 0;
-	
-	rc = dbp->cursor(dbp, NULL, &cursorp, DB_READ_COMMITTED);
-	exit_on_failure(rc);
-	
-	
-	DBT key, value;
-	memset(&key, 0, sizeof(key));
-	memset(&value, 0, sizeof(value));
-	
-	struct bank_code_record record[1];
-	memset(record, 0, sizeof(record));
-	
-	
-	
-	static const char * prefix = "000";
-	int cb_prefix = strlen(prefix);
-	
-	strncpy(record->code, prefix, sizeof(record->code));
-	key.data = record->code;
-	key.flags = DB_DBT_USERMEM | DB_DBT_PARTIAL;
-	key.dlen = cb_prefix;
-	key.ulen = sizeof(record->code);
-	
-	value.data = record->data;
-	value.flags = DB_DBT_USERMEM;
-	value.ulen = sizeof(record->data);
-	
-	
-	rc = cursorp->get(cursorp, &key, &value, DB_SET_RANGE); // move to the first record starting with the prefix
-	exit_on_failure(rc);
-	
-	while(0 == rc){
-		if(memcmp(record->code, prefix, cb_prefix) != 0) break;	
-		bank_code_record_dump(record);
-		rc = cursorp->get(cursorp, &key, &value, DB_NEXT);
-	}
-	if(!rc && rc != DB_NOTFOUND) {
-		fprintf(stderr, "ret=%d, err_msg: %s\n", rc, db_strerror(rc));
-	}
-	cursorp->close(cursorp);
-	return;
-}
-
-static int bank_codes_associate_by_name(DB * sdbp, const DBT *key, const DBT *value, DBT * skey)
-{
-	struct bank_code_record_data * record = value->data;
-	skey->data = record->name;
-	skey->size = strlen(record->name) + 1;
-	return 0;
-}
-static int bank_codes_associate_by_half_width_kana(DB * sdbp, const DBT *key, const DBT *value, DBT * skey)
-{
-	struct bank_code_record_data * record = value->data;
-	skey->data = record->half_width_kana;
-	skey->size = strlen(record->half_width_kana) + 1;
-	return 0;
-}
-static int bank_codes_associate_by_full_width_kana(DB * sdbp, const DBT *key, const DBT *value, DBT * skey)
+static void run_tests(bank_codes_index_t * index)
 {
-	struct bank_code_record_data * record = value->data;
-	skey->data = record->half_width_kana;
-	skey->size = strlen(record->full_width_kana) + 1;
-	return 0;
-}
-static int bank_codes_associate_by_hiragana(DB * sdbp, const DBT *key, const DBT *value, DBT * skey)
-{
-	struct bank_code_record_data * record = value->data;
-	skey->data = record->half_width_kana;
-	skey->size = strlen(record->hiragana) + 1;
-	return 0;
-}
-
-db_context_t * db_context_init(db_context_t * db, const char * db_home, void * user_data)
-{
-	if(NULL == db) {
-		db = calloc(1, sizeof(*db));
-		assert(db);
-	}
-	
-	DB_ENV * env = NULL;
-	DB * dbp = NULL;
-	DB * sdbp = NULL;
-	int rc = 0;
-	
-	rc = db_env_create(&env, 0);
-	exit_on_failure(rc);
-	db->env = env;
-	
-	u_int32_t env_flags = DB_CREATE | DB_INIT_MPOOL
-		| DB_INIT_LOCK
-		| DB_INIT_TXN
-		| DB_INIT_LOG
-		| DB_INIT_REP
-		| DB_RECOVER
-		| DB_REGISTER
-		| DB_THREAD
-		| 0;
-	u_int32_t db_flags = DB_CREATE 
-		| DB_THREAD
-		| DB_READ_UNCOMMITTED
-		| DB_AUTO_COMMIT
-		| 0;
-	u_int32_t sdb_flags = DB_CREATE
-		//~ | DB_IMMUTABLE_KEY
-		| 0;
-	rc = env->open(env, db_home, env_flags, 0);
-	exit_on_failure(rc);
-	
-	// create db
-	rc = db_create(&dbp, env, 0);
-	exit_on_failure(rc);
-	
-	rc = dbp->open(dbp, NULL, "bank_codes.db", NULL, DB_BTREE, db_flags, 0); 
-	exit_on_failure(rc);
-	db->bank_codes = dbp;
-	
-	// create index db - sorted by names
-	rc = db_create(&sdbp, env, 0);
-	exit_on_failure(rc);
-	sdbp->set_flags(sdbp, DB_DUPSORT);
-	//~ sdbp->set_bt_compare(sdbp, partial_string_compare);
-	rc = sdbp->open(sdbp, NULL, "bank_codes_by_name.db", NULL, DB_BTREE, db_flags, 0);
-	exit_on_failure	(rc);
-	rc = dbp->associate(dbp, NULL, sdbp, bank_codes_associate_by_name, sdb_flags);
-	db->bank_codes_by_name = sdbp;
-	sdbp = NULL;
-	
-	// create index db - sorted by half_width_kana 
-	rc = db_create(&sdbp, env, 0);
-	exit_on_failure(rc);
-	sdbp->set_flags(sdbp, DB_DUPSORT);
-	//~ sdbp->set_bt_compare(sdbp, partial_string_compare);
-	rc = sdbp->open(sdbp, NULL, "bank_codes_by_half_width_kana.db", NULL, DB_BTREE, db_flags, 0);
-	exit_on_failure	(rc);
-	rc = dbp->associate(dbp, NULL, sdbp, bank_codes_associate_by_half_width_kana, sdb_flags);
-	db->bank_codes_by_half_width_kana = sdbp;
-	sdbp = NULL;
-	
-	// create index db - sorted by full_width_kana 
-	rc = db_create(&sdbp, env, 0);
-	exit_on_failure(rc);
-	sdbp->set_flags(sdbp, DB_DUPSORT);
-	//~ sdbp->set_bt_compare(sdbp, partial_string_compare);
-	rc = sdbp->open(sdbp, NULL, "bank_codes_by_full_width_kana.db", NULL, DB_BTREE, db_flags, 0);
-	exit_on_failure	(rc);
-	rc = dbp->associate(dbp, NULL, sdbp, bank_codes_associate_by_full_width_kana, sdb_flags);
-	db->bank_codes_by_full_width_kana = sdbp;
-	sdbp = NULL;
-	
-	// create index db - sorted by hiragana
-	rc = db_create(&sdbp, env, 0);
-	exit_on_failure(rc);
-	sdbp->set_flags(sdbp, DB_DUPSORT);
-	//~ sdbp->set_bt_compare(sdbp, partial_string_compare);
-	rc = sdbp->open(sdbp, NULL, "bank_codes_by_hiragana.db", NULL, DB_BTREE, db_flags, 0);
-	exit_on_failure	(rc);
-	rc = dbp->associate(dbp, NULL, sdbp, bank_codes_associate_by_hiragana, sdb_flags);
-	db->bank_codes_by_hiragana = sdbp;
-	sdbp = NULL;
+	static const struct {
+		enum bank_code_field field;
+		const char * prefix;
+	} queries[] = {
+		{ BANK_CODE_FIELD_code, "000" },
+		{ BANK_CODE_FIELD_hiragana, "みつ" },
+		{ BANK_CODE_FIELD_half_width_kana, "ﾐｽﾞ" },
+		{ BANK_CODE_FIELD_any, "り" },
+	};
+	printf("num banks: %ld\n", (long)index->num_banks);
 	
-	return db;
-}
-void db_context_cleanup(db_context_t * db)
-{
-	if(NULL == db) return;
-	if(db->env) {
-		for(int i = 0; i < BANK_CODES_SDBP_COUNT; ++i) {
-			if(db->sdbps[i]) db->sdbps[i]->close(db->sdbps[i], 0);
-			db->sdbps[i] = NULL;
-		}
-		if(db->bank_codes) db->bank_codes->close(db->bank_codes, 0);
-		db->bank_codes = NULL;
+	for(size_t i = 0; i < sizeof(queries) / sizeof(queries[0]); ++i) {
+		const struct bank_code_entry * results[10];
 		
-		db->env->close(db->env, 0);
-		db->env = NULL;
+		app_timer_t timer[1];
+		app_timer_start(timer);
+		ssize_t count = index->search(index, queries[i].field, queries[i].prefix, 10, results);
+		double elapsed = app_timer_stop(timer);
+		
+		printf("== search(field=%d, prefix=%s): %ld results, %.3f us\n", 
+			queries[i].field, queries[i].prefix, (long)count, elapsed * 1000000.0);
+		for(ssize_t j = 0; j < count; ++j) {
+			printf("  %s: %s (%s / %s)\n", results[j]->code, results[j]->name, results[j]->hiragana, results[j]->half_width_kana);
+		}
 	}
+	
+	const struct bank_code_entry * entry = index->find(index, "0001");
+	if(entry) printf("find(0001): %s\n", entry->name);
 	return;
 }
 
-
-
-
-static int load_bank_codes(db_context_t * db, struct http_json_context * http)
+static int load_bank_codes(bank_codes_index_t * index, struct http_json_context * http)
 {
 	static const char * get_banklist_url = "https://apis.bankcode-jp.com/v1/banks?limit=2000";
 	
@@ -385,36 +180,24 @@ static int load_bank_codes(db_context_t * db, struct http_json_context * http)
 	int num_banks = json_object_array_length(jbanks_list);
 	assert(num_banks > 0);
 	
-	int rc = 0;
-	static int overwritable = 1;
-	
-	DB * dbp = db->bank_codes;
-	assert(dbp);
+	struct bank_code_record * records = calloc(num_banks, sizeof(*records));
+	assert(records);
 	
 	printf("num banks: %d\n", num_banks);
 	for(int i = 0; i < num_banks; ++i) 
 	{
 		json_object * jbank = json_object_array_get_idx(jbanks_list, i);
 		assert(jbank);
-		struct bank_code_record record[1];
-		memset(record, 0, sizeof(record));
-		
-		rc = bank_code_record_set(record, jbank);
-		
-		DBT key, value;
-		memset(&key, 0, sizeof(key));
-		memset(&value, 0, sizeof(value));
-		key.data = record->code;
-		key.size = strlen(record->code) + 1;
-		value.data = record->data;
-		value.size = sizeof(record->data);
-		
-		rc = dbp->put(dbp, NULL, &key, &value, overwritable?0:DB_NOOVERWRITE);
-		if(rc && rc != DB_KEYEXIST) {
-			fprintf(stderr, "[ERROR]: %s\n", db_strerror(rc));
-			break;
-		}
+		bank_code_record_set(&records[i], jbank);
 	}
+	
+	// sorted, diffed against the stored list and bulk loaded
+	struct bank_codes_load_stats stats[1];
+	int rc = index->bulk_load(index, records, num_banks, stats);
+	printf("bulk_load(rc=%d): inserted=%ld, updated=%ld, deleted=%ld, unchanged=%ld, full_rebuild=%d, %.3f ms\n", 
+		rc, (long)stats->num_inserted, (long)stats->num_updated, (long)stats->num_deleted, (long)stats->num_unchanged,
+		stats->full_rebuild, stats->elapsed * 1000.0);
+	free(records);
 	json_object_put(jresponse);
 	return rc;
 }
@@ -0,0 +1,151 @@
+/*
+ * test_hex.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "utils.h"
+
+/*
+ * exhaustive equivalence of the hex implementations with a plain reference:
+ *   encode: every byte value at every position of every length in [0, 130)
+ *   decode: every pair of chars (65536) at every pair position of a 128-digit string
+ */
+
+static int ref_nibble(unsigned char c)
+{
+	if(c >= '0' && c <= '9') return c - '0';
+	if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+static void test_encode(void)
+{
+	static const char digits[] = "0123456789abcdef";
+	unsigned char data[130 + 8];
+	char hex[(130 + 8) * 2 + 8];
+	char expected[(130 + 8) * 2 + 8];
+	
+	for(size_t length = 0; length < 130; ++length) {
+		for(size_t pos = 0; pos < length || (pos == 0 && length == 0); ++pos) {
+			for(int value = 0; value < 256; ++value) {
+				for(size_t i = 0; i < length; ++i) data[i] = (unsigned char)(i * 37 + 11);
+				if(length) data[pos] = (unsigned char)value;
+				
+				for(size_t i = 0; i < length; ++i) {
+					expected[i * 2] = digits[data[i] >> 4];
+					expected[i * 2 + 1] = digits[data[i] & 0x0f];
+				}
+				expected[length * 2] = '\0';
+				
+				memset(hex, 'x', sizeof(hex));
+				size_t cb = hex_encode(data, length, hex);
+				assert(cb == length * 2);
+				assert(0 == memcmp(hex, expected, length * 2 + 1));
+				assert(hex[length * 2 + 1] == 'x');	// no overrun
+				if(length == 0) break;
+			}
+		}
+	}
+}
+
+static void test_decode(void)
+{
+	char hex[128 + 1];
+	unsigned char data[64 + 8];
+	unsigned char expected[64];
+	
+	for(size_t pos = 0; pos < 128; pos += 2) {
+		for(int pair = 0; pair < 65536; ++pair) {
+			for(int i = 0; i < 128; ++i) hex[i] = "0123456789abcdefABCDEF"[(i * 7) % 22];
+			hex[128] = '\0';
+			hex[pos] = (char)(pair >> 8);
+			hex[pos + 1] = (char)(pair & 0xff);
+			
+			int valid = 1;
+			for(int i = 0; i < 64; ++i) {
+				int hi = ref_nibble(hex[i * 2]), lo = ref_nibble(hex[i * 2 + 1]);
+				if(hi < 0 || lo < 0) { valid = 0; break; }
+				expected[i] = (unsigned char)((hi << 4) | lo);
+			}
+			
+			memset(data, 0xcc, sizeof(data));
+			ssize_t cb = hex_decode(hex, 128, data);
+			if(!valid) { assert(cb == -1); continue; }
+			assert(cb == 64);
+			assert(0 == memcmp(data, expected, 64));
+			assert(data[64] == 0xcc);
+		}
+	}
+	
+	// odd length, empty input
+	assert(hex_decode("abc", 3, data) == -1);
+	assert(hex_decode("", 0, data) == 0);
+}
+
+static void test_compat(void)
+{
+	// bin2hex / hex2bin keep their allocation semantics
+	const unsigned char bin[] = { 0x00, 0x7f, 0x80, 0xff, 0x12, 0xab };
+	char * hex = NULL;
+	ssize_t cb = bin2hex(bin, sizeof(bin), &hex);
+	assert(cb == sizeof(bin) * 2 && hex && 0 == strcmp(hex, "007f80ff12ab"));
+	
+	void * data = NULL;
+	cb = hex2bin("007F80FF12AB", -1, &data);
+	assert(cb == sizeof(bin) && data && 0 == memcmp(data, bin, sizeof(bin)));
+	free(data);
+	data = NULL;
+	assert(hex2bin("007g", -1, &data) == -1 && NULL == data);
+	free(hex);
+}
+
+int main(int argc, char **argv)
+{
+	static const enum hex_impl impls[] = { hex_impl_scalar, hex_impl_ssse3, hex_impl_avx2 };
+	static const char * names[] = { "scalar", "ssse3", "avx2" };
+	for(size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); ++i) {
+		if(hex_impl_select(impls[i])) {
+			printf("%-8s: not supported, skipped\n", names[i]);
+			continue;
+		}
+		assert(0 == strcmp(hex_impl_name(), names[i]));
+		
+		app_timer_t timer[1];
+		app_timer_start(timer);
+		test_encode();
+		test_decode();
+		test_compat();
+		printf("%-8s: ok (%.3f s)\n", names[i], app_timer_stop(timer));
+	}
+	return 0;
+}
@@ -0,0 +1,167 @@
+/*
+ * test_sha256_batch.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <gnutls/gnutls.h>
+#include "utils.h"
+#include "crypto/sha.h"
+
+/*
+ * every sha256_batch engine against gnutls_hash_fast():
+ *   lengths [0, 300) in one batch (every padding case, lanes refilled at different times),
+ *   batches of 1 .. 20 messages (idle lanes, the gnutls cut-off, the last lane finished alone),
+ *   and a few large messages mixed with tiny ones.
+ * hash256 / hash160 / ripemd160 against published vectors.
+ */
+
+static void check_hex(const char * title, const uint8_t * digest, size_t size, const char * expected)
+{
+	char hex[64 * 2 + 1];
+	hex_encode(digest, size, hex);
+	if(strcmp(hex, expected)) {
+		fprintf(stderr, "[FAILED] %s: %s (expected %s)\n", title, hex, expected);
+		exit(1);
+	}
+}
+
+static void check_batch(const struct iovec * messages, size_t count)
+{
+	uint8_t (* digests)[32] = calloc(count, 32);
+	uint8_t (* hashes)[32] = calloc(count, 32);
+	uint8_t (* hashes160)[20] = calloc(count, 20);
+	assert(digests && hashes && hashes160);
+	
+	sha256_batch(messages, count, digests);
+	hash256_batch(messages, count, hashes);
+	hash160_batch(messages, count, hashes160);
+	for(size_t i = 0; i < count; ++i) {
+		uint8_t expected[32];
+		uint8_t expected160[20];
+		int rc = gnutls_hash_fast(GNUTLS_DIG_SHA256, messages[i].iov_len?messages[i].iov_base:"", messages[i].iov_len, expected);
+		assert(0 == rc);
+		if(memcmp(digests[i], expected, 32)) {
+			fprintf(stderr, "[FAILED] %s: sha256 of message %zu / %zu (%zu bytes)\n",
+				sha256_batch_impl_name(), i, count, messages[i].iov_len);
+			exit(1);
+		}
+		hash256(messages[i].iov_base, messages[i].iov_len, expected);
+		hash160(messages[i].iov_base, messages[i].iov_len, expected160);
+		if(memcmp(hashes[i], expected, 32) || memcmp(hashes160[i], expected160, 20)) {
+			fprintf(stderr, "[FAILED] %s: hash256 / hash160 of message %zu / %zu (%zu bytes)\n",
+				sha256_batch_impl_name(), i, count, messages[i].iov_len);
+			exit(1);
+		}
+	}
+	free(digests);
+	free(hashes);
+	free(hashes160);
+}
+
+static void test_engine(const uint8_t * data, size_t cb_data)
+{
+	enum { NUM_LENGTHS = 300 };
+	struct iovec messages[NUM_LENGTHS];
+	
+	// every length, each message at a different offset
+	for(size_t i = 0; i < NUM_LENGTHS; ++i) {
+		messages[i].iov_base = (void *)(data + i * 7);
+		messages[i].iov_len = i;
+	}
+	check_batch(messages, NUM_LENGTHS);
+	
+	// small batches
+	for(size_t count = 1; count <= 20; ++count) {
+		for(size_t i = 0; i < count; ++i) {
+			messages[i].iov_base = (void *)(data + i * 13);
+			messages[i].iov_len = (i * 37 + count * 11) % 200;
+		}
+		check_batch(messages, count);
+	}
+	
+	// large and tiny messages mixed, the large ones outlive several refills of the other lanes
+	for(size_t i = 0; i < 40; ++i) {
+		messages[i].iov_base = (void *)(data + i);
+		messages[i].iov_len = (i % 9 == 0)?(cb_data - 64 - i):(i % 5);
+	}
+	messages[3].iov_base = NULL;
+	messages[3].iov_len = 0;
+	check_batch(messages, 40);
+}
+
+int main(int argc, char ** argv)
+{
+	// published vectors
+	static const char * rmd_vectors[][2] = {
+		{ "", "9c1185a5c5e9fc54612808977ee8f548b2258d31" },
+		{ "abc", "8eb208f7e05d987a9b044a8e98c6b087f15a0bfc" },
+		{ "message digest", "5d0689ef49d2fae572b881b123a85ffa21595f36" },
+		{ "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", "12a053384a9c0c88e405a06c27dcf49ada62eb2b" },
+		{ "12345678901234567890123456789012345678901234567890123456789012345678901234567890",
+			"9b752e45573d4b39f4dbd3323cab82bf63326bfb" },
+	};
+	for(size_t i = 0; i < sizeof(rmd_vectors) / sizeof(rmd_vectors[0]); ++i) {
+		uint8_t digest[20];
+		ripemd160_hash(rmd_vectors[i][0], strlen(rmd_vectors[i][0]), digest);
+		check_hex("ripemd160", digest, 20, rmd_vectors[i][1]);
+	}
+	
+	uint8_t hash[32];
+	hash256("", 0, hash);
+	check_hex("hash256(\"\")", hash, 32, "5df6e0e2761359d30a8275058e299fcc0381534545f55cf43e41983f5d4c9456");
+	hash160("", 0, hash);
+	check_hex("hash160(\"\")", hash, 20, "b472a266d0bd89c13706a4132ccfb16f7c3b9fcb");
+	
+	size_t cb_data = 4096 + 4096;
+	uint8_t * data = malloc(cb_data);
+	assert(data);
+	uint32_t seed = 0x12345678;
+	for(size_t i = 0; i < cb_data; ++i) {
+		seed = seed * 1103515245 + 12345;
+		data[i] = (uint8_t)(seed >> 16);
+	}
+	
+	static const enum sha256_batch_impl impls[] = {
+		sha256_batch_impl_gnutls, sha256_batch_impl_avx2, sha256_batch_impl_shani, sha256_batch_impl_auto,
+	};
+	for(size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); ++i) {
+		if(sha256_batch_impl_select(impls[i])) {
+			printf("impl %d: not supported by this cpu\n", (int)impls[i]);
+			continue;
+		}
+		test_engine(data, cb_data);
+		printf("%-6s: ok\n", sha256_batch_impl_name());
+	}
+	
+	free(data);
+	printf("[PASSED]\n");
+	return 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * test_tick_store.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "db_context.h"
+#include "tick_store.h"
+#include "utils.h"
+
+#define NUM_TICKS (100000)
+int main(int argc, char **argv)
+{
+	const char * db_home = (argc > 1)?argv[1]:"data";
+	
+	db_context_t * db = db_context_init(NULL, db_home, NULL);
+	assert(db);
+	tick_store_t * store = tick_store_init(NULL, db, NULL);
+	assert(store);
+	
+	app_timer_t timer[1];
+	const int64_t begin_ms = 1600000000000LL;
+	
+	// 1. bulk put
+	struct tick_store_item * items = calloc(NUM_TICKS, sizeof(*items));
+	assert(items);
+	for(int i = 0; i < NUM_TICKS; ++i) {
+		strncpy(items[i].pair, "test_jpy", sizeof(items[i].pair));
+		items[i].tick.timestamp = begin_ms + i * 1000;
+		items[i].tick.last = 1000000.0 + i;
+		items[i].tick.volume = i * 0.001;
+	}
+	app_timer_start(timer);
+	int rc = store->put_batch(store, items, NUM_TICKS);
+	assert(0 == rc);
+	printf("put_batch: %d ticks, %.3f ms\n", NUM_TICKS, app_timer_stop(timer) * 1000.0);
+	free(items);
+	
+	// 2. group commit
+	app_timer_start(timer);
+	for(int i = 0; i < 1000; ++i) {
+		struct tick_data tick = { .timestamp = begin_ms + (NUM_TICKS + i) * 1000LL, .last = -1.0 };
+		rc = store->append(store, "test_jpy", &tick);
+		assert(0 == rc);
+	}
+	store->flush(store);
+	printf("append + flush: 1000 ticks, %.3f ms, %ld commits\n", 
+		app_timer_stop(timer) * 1000.0, (long)store->commit_stats->count);
+	
+	// 3. range scan, the other pairs must not be included
+	struct tick_data tick = { .timestamp = begin_ms + 5000, .last = 1.0 };
+	store->append(store, "other_jpy", &tick);
+	store->flush(store);
+	
+	struct tick_data * ticks = NULL;
+	app_timer_start(timer);
+	ssize_t count = store->query(store, "test_jpy", begin_ms + 10 * 1000, begin_ms + 20 * 1000, &ticks);
+	printf("query: %ld ticks, %.3f ms\n", (long)count, app_timer_stop(timer) * 1000.0);
+	assert(count == 10);
+	for(ssize_t i = 0; i < count; ++i) {
+		assert(ticks[i].timestamp == begin_ms + (10 + i) * 1000);
+		assert(ticks[i].last == 1000000.0 + 10 + i);
+	}
+	free(ticks);
+	
+	// no ticks of the requested pair in the range: the cursor lands on another pair
+	count = store->query(store, "empty_jpy", begin_ms, begin_ms + 20 * 1000, &ticks);
+	assert(count == 0 && NULL == ticks);
+	count = store->query(store, "other_jpy", begin_ms + 6000, begin_ms + 20 * 1000, &ticks);
+	assert(count == 0 && NULL == ticks);
+	
+	app_timer_start(timer);
+	count = store->query(store, "test_jpy", begin_ms, begin_ms + (NUM_TICKS + 1000) * 1000LL, &ticks);
+	printf("query (full): %ld ticks, %.3f ms\n", (long)count, app_timer_stop(timer) * 1000.0);
+	assert(count == NUM_TICKS + 1000);
+	assert(ticks[NUM_TICKS].last == -1.0);
+	free(ticks);
+	
+	tick_store_cleanup(store);
+	free(store);
+	db_context_cleanup(db);
+	free(db);
+	return 0;
+}
@@ -34,8 +34,10 @@
 #include <json-c/json.h>
 #include <search.h>
 #include <errno.h>
+#include <time.h>
 
 #include "trading_agency_coincheck.h"
+#include "trade_archive.h"
 
 struct cli_context;
 int cli_get_ticker(struct cli_context * ctx);
@@ -326,6 +328,70 @@ int cli_get_ticker(cli_context_t * ctx)
 	return output_json_response(rc, jresponse);
 }
 
+static int compare_trade_id(const void * a, const void * b)
+{
+	const struct trade_record * t1 = a;
+	const struct trade_record * t2 = b;
+	return (t1->id > t2->id) - (t1->id < t2->id);
+}
+
+// REST trades: { "data": [ { "id", "amount", "rate", "order_type", "created_at" }, ... ] } (descending)
+static int archive_trades(const char * archive_dir, json_object * jresponse)
+{
+	json_object * jdata = NULL;
+	if(!json_object_object_get_ex(jresponse, "data", &jdata)) return -1;
+	
+	int num_trades = json_object_array_length(jdata);
+	struct trade_record * trades = calloc(num_trades + 1, sizeof(*trades));
+	assert(trades);
+	
+	int count = 0;
+	for(int i = 0; i < num_trades; ++i) {
+		json_object * jtrade = json_object_array_get_idx(jdata, i);
+		json_object * jvalue = NULL;
+		struct trade_record * trade = &trades[count];
+		
+		if(!json_object_object_get_ex(jtrade, "id", &jvalue)) continue;
+		trade->id = json_object_get_int64(jvalue);
+		if(json_object_object_get_ex(jtrade, "rate", &jvalue)) trade->price = atof(json_object_get_string(jvalue));
+		if(json_object_object_get_ex(jtrade, "amount", &jvalue)) trade->amount = atof(json_object_get_string(jvalue));
+		if(json_object_object_get_ex(jtrade, "order_type", &jvalue)) {
+			trade->side = (strcmp(json_object_get_string(jvalue), "sell") == 0)?TRADE_SIDE_sell:TRADE_SIDE_buy;
+		}
+		if(json_object_object_get_ex(jtrade, "created_at", &jvalue)) {
+			// "2015-01-10T05:55:38.000Z"
+			struct tm t[1];
+			memset(t, 0, sizeof(t));
+			const char * p_end = strptime(json_object_get_string(jvalue), "%Y-%m-%dT%H:%M:%S", t);
+			if(p_end) {
+				trade->timestamp = (int64_t)timegm(t) * 1000;
+				if(*p_end == '.') trade->timestamp += atoi(p_end + 1);
+			}
+		}
+		++count;
+	}
+	qsort(trades, count, sizeof(*trades), compare_trade_id);
+	
+	trade_archive_t * archive = trade_archive_init(NULL, archive_dir, 0, 8, NULL);
+	if(NULL == archive) {
+		free(trades);
+		return -1;
+	}
+	
+	int num_appended = 0;
+	for(int i = 0; i < count; ++i) {
+		if(0 == archive->append(archive, &trades[i])) ++num_appended;
+	}
+	archive->flush(archive);
+	fprintf(stderr, "archive(%s): %d / %d trades appended, total: %ld, last_id: %ld\n", 
+		archive_dir, num_appended, count, (long)archive->num_trades, (long)archive->last_id);
+	
+	trade_archive_cleanup(archive);
+	free(archive);
+	free(trades);
+	return 0;
+}
+
 int cli_get_trades(struct cli_context * ctx)
 {
 	assert(ctx && ctx->agent);
@@ -333,6 +399,7 @@ int cli_get_trades(struct cli_context * ctx)
 	
 	json_object * jresponse = NULL;
 	const char * pair = NULL;
+	const char * archive_dir = NULL;
 	struct coincheck_pagination_params pagination = { 
 		.limit = 50,
 	};
@@ -354,10 +421,23 @@ int cli_get_trades(struct cli_context * ctx)
 			pagination.limit = atoi(p_find + strlen(pattern));
 			continue;
 		}
+		
+		pattern = "archive=";
+		p_find = strstr(ctx->params_list[i], pattern);
+		if(p_find) {
+			archive_dir = p_find + strlen(pattern);
+			continue;
+		}
 	}
 	if(NULL == pair) pair = "btc_jpy";
 	
 	rc = coincheck_public_get_trades(ctx->agent, pair, &pagination, &jresponse);
+	if(0 == rc && archive_dir) {
+		// backfill: only trades newer than the archived ones are appended
+		rc = archive_trades(archive_dir, jresponse);
+		json_object_put(jresponse);
+		return rc;
+	}
 	return output_json_response(rc, jresponse);
 }
 
@@ -0,0 +1,127 @@
+/*
+ * credentials-vault.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <json-c/json.h>
+
+#include <gnutls/gnutls.h>
+#include "credentials_vault.h"
+
+/*
+ * credentials-vault keygen <key_file>
+ * credentials-vault seal <credentials.json> <vault_file> [key_file]
+ * credentials-vault verify <vault_file> [key_file]
+ * 
+ *   key_file omitted: the key is read from $BTC_TRADER_VAULT_KEY (hex)
+ *   credentials.json: { "query": { "api_key": "", "api_secret": "" }, "trade": {...}, "withdraw": {...} }
+ *   after sealing, delete credentials.json and set in the agency's config:
+ *     "credentials_vault": "<vault_file>", "credentials_key_file": "<key_file>"
+ */
+static const char * s_type_names[credentials_vault_types_count] = { "query", "trade", "withdraw" };
+
+static int print_usuage(const char * app_name)
+{
+	fprintf(stderr, "usuage: \n"
+		"  %s keygen <key_file>\n"
+		"  %s seal <credentials.json> <vault_file> [key_file]\n"
+		"  %s verify <vault_file> [key_file]\n",
+		app_name, app_name, app_name);
+	return 1;
+}
+
+static int seal(const char * credentials_file, const char * vault_file, const unsigned char master_key[])
+{
+	json_object * jcredentials = json_object_from_file(credentials_file);
+	if(NULL == jcredentials) {
+		fprintf(stderr, "invalid credentials file: %s\n", credentials_file);
+		return -1;
+	}
+	
+	struct credentials_vault_entry entries[credentials_vault_types_count];
+	memset(entries, 0, sizeof(entries));
+	for(int type = 0; type < credentials_vault_types_count; ++type) {
+		json_object * jentry = NULL;
+		if(!json_object_object_get_ex(jcredentials, s_type_names[type], &jentry)) continue;
+		entries[type].api_key = json_get_value(jentry, string, api_key);
+		entries[type].api_secret = json_get_value(jentry, string, api_secret);
+	}
+	
+	int rc = credentials_vault_seal(vault_file, master_key, entries);
+	json_object_put(jcredentials);
+	return rc;
+}
+
+static int verify(const char * vault_file, const unsigned char master_key[])
+{
+	credentials_vault_t * vault = credentials_vault_init(NULL, vault_file, master_key, NULL);
+	if(NULL == vault) return -1;
+	
+	int rc = 0;
+	for(int type = 0; type < credentials_vault_types_count; ++type) {
+		const char * api_key = NULL;
+		int ok = vault->get(vault, type, &api_key, NULL);
+		if(ok < 0) rc = -1;
+		// never print the secrets, only the beginning of the api key
+		printf("%-8s: %s", s_type_names[type], (ok < 0)?"ERROR":(ok > 0)?"(none)":"");
+		if(0 == ok) printf("%.4s... (%d chars)", api_key, (int)strlen(api_key));
+		printf("\n");
+	}
+	credentials_vault_cleanup(vault);
+	free(vault);
+	return rc;
+}
+
+int main(int argc, char ** argv)
+{
+	if(argc < 3) return print_usuage(argv[0]);
+	const char * command = argv[1];
+	unsigned char master_key[CREDENTIALS_VAULT_KEY_SIZE];
+	int rc = -1;
+	
+	gnutls_global_init();
+	if(0 == strcmp(command, "keygen")) {
+		rc = credentials_vault_generate_key(argv[2], master_key);
+	}else if(0 == strcmp(command, "seal") && argc >= 4) {
+		rc = credentials_vault_load_key((argc > 4)?argv[4]:NULL, master_key);
+		if(0 == rc) rc = seal(argv[2], argv[3], master_key);
+	}else if(0 == strcmp(command, "verify")) {
+		rc = credentials_vault_load_key((argc > 3)?argv[3]:NULL, master_key);
+		if(0 == rc) rc = verify(argv[2], master_key);
+	}else {
+		return print_usuage(argv[0]);
+	}
+	gnutls_memset(master_key, 0, sizeof(master_key));
+	gnutls_global_deinit();
+	
+	if(rc) fprintf(stderr, "%s: failed\n", command);
+	return rc?1:0;
+}
@@ -9,9 +9,10 @@ case "$TARGET" in
         gcc -std=gnu99 -D_GNU_SOURCE -D_DEFAULT_SOURCE -g -Wall \
             -I../include -I../utils \
             -o coincheck-cli coincheck-cli.c \
-            ../src/trading_agency.c ../src/trading_agencies/coincheck.c \
+            ../src/trading_agency.c ../src/order_journal.c ../src/credentials_vault.c ../src/trading_agencies/coincheck.c \
+            ../src/reactor.c ../src/reactor_curl.c ../utils/mpsc_queue.c \
             ../src/json-response.c \
-            ../utils/utils.c ../utils/auto_buffer.c \
+            ../utils/utils.c ../utils/auto_buffer.c ../utils/trade_archive.c ../utils/crypto/hmac_signer.c ../utils/crypto/ctaes.c \
             $(pkg-config --cflags --libs gnutls) \
             -lm -lpthread -ljson-c -lcurl
         ;;
@@ -20,12 +21,22 @@ case "$TARGET" in
         gcc -std=gnu99 -D_GNU_SOURCE -D_DEFAULT_SOURCE -g -Wall \
             -I../include -I../utils \
             -o zaif-cli zaif-cli.c \
-            ../src/trading_agency.c ../src/trading_agencies/zaif.c \
+            ../src/trading_agency.c ../src/order_journal.c ../src/credentials_vault.c ../src/trading_agencies/zaif.c \
+            ../src/reactor.c ../src/reactor_curl.c ../utils/mpsc_queue.c \
             ../src/json-response.c \
-            ../utils/utils.c ../utils/auto_buffer.c \
+            ../utils/utils.c ../utils/auto_buffer.c ../utils/crypto/hmac_signer.c ../utils/crypto/ctaes.c \
             $(pkg-config --cflags --libs gnutls) \
             -lm -lpthread -ljson-c -lcurl
         ;;
+    credentials-vault)
+        gcc -std=gnu99 -D_GNU_SOURCE -D_DEFAULT_SOURCE -g -Wall \
+            -I../include -I../utils \
+            -o credentials-vault credentials-vault.c \
+            ../src/credentials_vault.c \
+            ../utils/utils.c ../utils/crypto/ctaes.c ../utils/crypto/hmac_signer.c \
+            $(pkg-config --cflags --libs gnutls) \
+            -lm -lpthread -ljson-c
+        ;;
 	*)
 		exit 1
 		;;
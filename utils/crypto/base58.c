@@ -0,0 +1,274 @@
+/*
+ * base58.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "base58.h"
+#include "sha.h"
+#include "utils.h"
+
+#define B58_LIMB_BASE (656356768u)		// 58^5, the largest power of 58 below 2^32
+#define B58_MAX_DIGITS (BASE58_ENCODED_SIZE(BASE58_MAX_DATA_SIZE) - 1)
+#define B58_CHECKSUM_SIZE (4)
+
+static const char s_b58_alphabet[] = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+static const int8_t s_b58_values[128] = {
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1,  0,  1,  2,  3,  4,  5,  6,  7,  8, -1, -1, -1, -1, -1, -1,
+	-1,  9, 10, 11, 12, 13, 14, 15, 16, -1, 17, 18, 19, 20, 21, -1,
+	22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, -1, -1, -1, -1, -1,
+	-1, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, -1, 44, 45, 46,
+	47, 48, 49, 50, 51, 52, 53, 54, 55, 56, 57, -1, -1, -1, -1, -1,
+};
+
+/*****************************************************
+ * base58
+*****************************************************/
+ssize_t base58_encode(const void * data, size_t length, char * b58, size_t size)
+{
+	const uint8_t * p = data;
+	if(NULL == p) length = 0;
+	if(length > BASE58_MAX_DATA_SIZE) return -1;
+	
+	size_t zeros = 0;
+	while(zeros < length && p[zeros] == 0) ++zeros;
+	
+	// base 58^5 limbs, least significant first
+	uint32_t limbs[B58_MAX_DIGITS / 5 + 2];
+	size_t num_limbs = 0;
+	
+	size_t first = (length - zeros) % 4;	// the leading partial word
+	for(size_t i = zeros; i < length; ) {
+		size_t n = (i == zeros && first)?first:4;
+		uint32_t word = 0;
+		for(size_t k = 0; k < n; ++k) word = (word << 8) | p[i + k];
+		i += n;
+		
+		// limbs = limbs * 2^(8n) + word
+		const int shift = (int)n * 8;
+		uint64_t carry = word;
+		for(size_t l = 0; l < num_limbs; ++l) {
+			uint64_t t = ((uint64_t)limbs[l] << shift) + carry;
+			limbs[l] = (uint32_t)(t % B58_LIMB_BASE);
+			carry = t / B58_LIMB_BASE;
+		}
+		while(carry) {
+			limbs[num_limbs++] = (uint32_t)(carry % B58_LIMB_BASE);
+			carry /= B58_LIMB_BASE;
+		}
+	}
+	
+	size_t num_digits = 0;
+	if(num_limbs) {
+		uint32_t top = limbs[num_limbs - 1];
+		size_t top_digits = 0;
+		for(; top; top /= 58) ++top_digits;
+		num_digits = (num_limbs - 1) * 5 + top_digits;
+	}
+	if(!b58 || (zeros + num_digits + 1) > size) return -1;
+	
+	memset(b58, '1', zeros);
+	char * digit = b58 + zeros + num_digits;
+	*digit = '\0';
+	for(size_t l = 0; l < num_limbs; ++l) {
+		uint32_t limb = limbs[l];
+		for(int k = 0; k < 5 && digit > b58 + zeros; ++k) {
+			*--digit = s_b58_alphabet[limb % 58];
+			limb /= 58;
+		}
+	}
+	return (ssize_t)(zeros + num_digits);
+}
+
+ssize_t base58_decode(const char * b58, size_t length, void * data, size_t size)
+{
+	uint8_t * p = data;
+	if(NULL == b58) length = 0;
+	if(length > B58_MAX_DIGITS) return -1;
+	
+	size_t ones = 0;
+	while(ones < length && b58[ones] == '1') ++ones;
+	
+	// base 2^32 limbs, least significant first
+	uint32_t limbs[BASE58_MAX_DATA_SIZE / 4 + 2];
+	size_t num_limbs = 0;
+	
+	size_t first = (length - ones) % 5;		// the leading partial group
+	for(size_t i = ones; i < length; ) {
+		size_t n = (i == ones && first)?first:5;
+		uint32_t value = 0, multiplier = 1;
+		for(size_t k = 0; k < n; ++k) {
+			unsigned char c = (unsigned char)b58[i + k];
+			int digit = (c < 128)?s_b58_values[c]:-1;
+			if(digit < 0) return -1;
+			value = value * 58 + (uint32_t)digit;
+			multiplier *= 58;
+		}
+		i += n;
+		
+		// limbs = limbs * 58^n + value
+		uint64_t carry = value;
+		for(size_t l = 0; l < num_limbs; ++l) {
+			uint64_t t = (uint64_t)limbs[l] * multiplier + carry;
+			limbs[l] = (uint32_t)t;
+			carry = t >> 32;
+		}
+		if(carry) {
+			if(num_limbs == sizeof(limbs) / sizeof(limbs[0])) return -1;
+			limbs[num_limbs++] = (uint32_t)carry;
+		}
+	}
+	
+	size_t num_bytes = 0;
+	if(num_limbs) {
+		uint32_t top = limbs[num_limbs - 1];
+		size_t top_bytes = 0;
+		for(; top; top >>= 8) ++top_bytes;
+		num_bytes = (num_limbs - 1) * 4 + top_bytes;
+	}
+	if((ones + num_bytes) > size || (ones + num_bytes) > BASE58_MAX_DATA_SIZE) return -1;
+	if(ones + num_bytes == 0) return 0;
+	assert(p);
+	
+	memset(p, 0, ones);
+	uint8_t * byte = p + ones + num_bytes;
+	for(size_t l = 0; l < num_limbs; ++l) {
+		uint32_t limb = limbs[l];
+		for(int k = 0; k < 4 && byte > p + ones; ++k) {
+			*--byte = (uint8_t)limb;
+			limb >>= 8;
+		}
+	}
+	return (ssize_t)(ones + num_bytes);
+}
+
+/*****************************************************
+ * base58check
+*****************************************************/
+ssize_t base58check_encode(const void * payload, size_t length, char * b58, size_t size)
+{
+	uint8_t buf[BASE58_MAX_DATA_SIZE];
+	uint8_t hash[32];
+	if(length + B58_CHECKSUM_SIZE > sizeof(buf)) return -1;
+	if(length) {
+		assert(payload);
+		memcpy(buf, payload, length);
+	}
+	
+	hash256(buf, length, hash);
+	memcpy(buf + length, hash, B58_CHECKSUM_SIZE);
+	return base58_encode(buf, length + B58_CHECKSUM_SIZE, b58, size);
+}
+
+ssize_t base58check_decode(const char * b58, size_t length, void * payload, size_t size)
+{
+	uint8_t buf[BASE58_MAX_DATA_SIZE];
+	uint8_t hash[32];
+	ssize_t cb = base58_decode(b58, length, buf, sizeof(buf));
+	if(cb < B58_CHECKSUM_SIZE) return base58check_error_invalid;
+	
+	size_t cb_payload = cb - B58_CHECKSUM_SIZE;
+	if(cb_payload > size) return base58check_error_invalid;
+	
+	hash256(buf, cb_payload, hash);
+	if(memcmp(buf + cb_payload, hash, B58_CHECKSUM_SIZE)) return base58check_error_checksum;
+	if(cb_payload) memcpy(payload, buf, cb_payload);
+	return (ssize_t)cb_payload;
+}
+
+#define B58_BATCH_CHUNK_SIZE (64)
+size_t base58check_decode_batch(const char * const * b58_list, size_t count, struct base58check_payload * payloads)
+{
+	struct iovec messages[B58_BATCH_CHUNK_SIZE];
+	uint8_t checksums[B58_BATCH_CHUNK_SIZE][B58_CHECKSUM_SIZE];
+	uint8_t hashes[B58_BATCH_CHUNK_SIZE][32];
+	size_t indices[B58_BATCH_CHUNK_SIZE];
+	size_t num_valid = 0;
+	
+	assert(count == 0 || (b58_list && payloads));
+	for(size_t i = 0; i < count; ) {
+		// decode a chunk, keep the checksums aside
+		size_t n = 0;
+		for(; i < count && n < B58_BATCH_CHUNK_SIZE; ++i) {
+			struct base58check_payload * payload = &payloads[i];
+			uint8_t buf[BASE58_MAX_DATA_SIZE];
+			const char * b58 = b58_list[i];
+			ssize_t cb = b58?base58_decode(b58, strlen(b58), buf, sizeof(buf)):-1;
+			if(cb < B58_CHECKSUM_SIZE || (cb - B58_CHECKSUM_SIZE) > BASE58CHECK_MAX_PAYLOAD_SIZE) {
+				payload->length = base58check_error_invalid;
+				continue;
+			}
+			payload->length = cb - B58_CHECKSUM_SIZE;
+			memcpy(payload->data, buf, payload->length);
+			memcpy(checksums[n], buf + payload->length, B58_CHECKSUM_SIZE);
+			
+			messages[n].iov_base = payload->data;
+			messages[n].iov_len = payload->length;
+			indices[n++] = i;
+		}
+		
+		hash256_batch(messages, n, hashes);
+		for(size_t k = 0; k < n; ++k) {
+			if(memcmp(hashes[k], checksums[k], B58_CHECKSUM_SIZE)) {
+				payloads[indices[k]].length = base58check_error_checksum;
+				continue;
+			}
+			++num_valid;
+		}
+	}
+	return num_valid;
+}
+
+/*****************************************************
+ * bitcoin addresses
+*****************************************************/
+enum btc_address_type btc_address_decode(const char * address, uint8_t hash[20])
+{
+	uint8_t payload[1 + 20];
+	if(NULL == address) return btc_address_type_invalid;
+	
+	ssize_t cb = base58check_decode(address, strlen(address), payload, sizeof(payload));
+	if(cb != sizeof(payload)) return btc_address_type_invalid;
+	
+	enum btc_address_type type = btc_address_type_invalid;
+	switch(payload[0])
+	{
+	case 0x00: type = btc_address_type_p2pkh; break;
+	case 0x05: type = btc_address_type_p2sh; break;
+	case 0x6f: type = btc_address_type_testnet_p2pkh; break;
+	case 0xc4: type = btc_address_type_testnet_p2sh; break;
+	default: return btc_address_type_invalid;
+	}
+	if(hash) memcpy(hash, payload + 1, 20);
+	return type;
+}
@@ -6,6 +6,67 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+#include <sys/types.h>
+
+/*****************************************************
+ * base58 (bitcoin alphabet):
+ *   the number is converted with 32-bit limbs instead of one byte at a time:
+ *   encode: input words are folded into base 58^5 limbs,
+ *   decode: groups of 5 digits are folded into base 2^32 limbs,
+ *   so the quadratic part runs over (length / 4) x (length / 4) limbs.
+ *   leading zero bytes <==> leading '1's.
+ *
+ *   caller-provided buffers, nothing is allocated.
+ *   no whitespace is accepted.
+*****************************************************/
+#define BASE58_MAX_DATA_SIZE (256)	// larger inputs are rejected (addresses and keys are < 100 bytes)
+#define BASE58_ENCODED_SIZE(length) (((length) * 138) / 100 + 2)	// upper bound, including the '\0'
+
+// return strlen(b58), or -1 (length > BASE58_MAX_DATA_SIZE or @size too small)
+ssize_t base58_encode(const void * data, size_t length, char * b58, size_t size);
+// return the decoded length, or -1 (invalid digit, too long, or @size too small)
+ssize_t base58_decode(const char * b58, size_t length, void * data, size_t size);
+
+/*****************************************************
+ * base58check: payload || hash256(payload)[0..4]
+ *   the payload includes the version byte (addresses, WIF keys, ...)
+*****************************************************/
+#define BASE58CHECK_MAX_PAYLOAD_SIZE (80)	// a serialized extended key is 78 bytes
+
+enum base58check_error
+{
+	base58check_error_invalid = -1,		// not base58 / too long / buffer too small
+	base58check_error_checksum = -2,
+};
+
+ssize_t base58check_encode(const void * payload, size_t length, char * b58, size_t size);
+// return the payload length, or enum base58check_error
+ssize_t base58check_decode(const char * b58, size_t length, void * payload, size_t size);
+
+struct base58check_payload
+{
+	ssize_t length;		// < 0: enum base58check_error
+	uint8_t data[BASE58CHECK_MAX_PAYLOAD_SIZE];
+};
+// decode every string, then verify all the checksums with one hash256_batch() call
+// return the number of valid entries
+size_t base58check_decode_batch(const char * const * b58_list, size_t count, struct base58check_payload * payloads);
+
+/*****************************************************
+ * bitcoin legacy addresses (P2PKH '1...', P2SH '3...', testnet 'm/n...', '2...')
+ *   bech32 (bc1...) addresses are not base58 and are reported as invalid
+*****************************************************/
+enum btc_address_type
+{
+	btc_address_type_invalid = -1,
+	btc_address_type_p2pkh,
+	btc_address_type_p2sh,
+	btc_address_type_testnet_p2pkh,
+	btc_address_type_testnet_p2sh,
+};
+// @hash: (nullable) the hash160 carried by the address
+enum btc_address_type btc_address_decode(const char * address, uint8_t hash[20]);
 
 #ifdef __cplusplus
 }
@@ -12,6 +12,8 @@
  * integers representing 8 AES states.
  */
 
+#include <string.h>
+
 #include "ctaes.h"
 
 /* Slice variable slice_i contains the i'th bit of the 16 state variables in this order:
@@ -494,63 +496,235 @@ static void AES_decrypt(const AES_state* rounds, int nrounds, unsigned char* pla
     SaveBytes(plain16, &s);
 }
 
-void AES128_init(AES128_ctx* ctx, const unsigned char* key16) {
-    AES_setup(ctx->rk, key16, 4, 10);
+/* Hardware backend (x86: AES-NI, VAES).
+ *
+ * The round keys come from the bitsliced key schedule above (SaveBytes() of
+ * each round key), so there is a single key expansion and no table lookups.
+ * Independent blocks are interleaved to hide the latency of aesenc/aesdec.
+ */
+static int s_backend = AES_BACKEND_auto;
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CTAES_HAS_HW 1
+
+static int AES_backend_supported(int backend) {
+    __builtin_cpu_init();
+    switch (backend) {
+    case AES_BACKEND_soft: return 1;
+    case AES_BACKEND_aesni: return __builtin_cpu_supports("aes");
+    case AES_BACKEND_vaes: return __builtin_cpu_supports("aes") && __builtin_cpu_supports("vaes") && __builtin_cpu_supports("avx2");
+    default: break;
+    }
+    return 0;
 }
 
-void AES128_encrypt(const AES128_ctx* ctx, size_t blocks, unsigned char* cipher16, const unsigned char* plain16) {
+__attribute__((target("aes,sse2")))
+static void AES_hw_setup(AES_hw_keys* hw, const AES_state* rounds, int nrounds, int backend) {
+    int i;
+    for (i = 0; i <= nrounds; i++) {
+        SaveBytes(hw->enc[i], &rounds[i]);
+    }
+    memcpy(hw->dec[0], hw->enc[nrounds], 16);
+    for (i = 1; i < nrounds; i++) {
+        __m128i k = _mm_loadu_si128((const __m128i*)hw->enc[nrounds - i]);
+        _mm_storeu_si128((__m128i*)hw->dec[i], _mm_aesimc_si128(k));
+    }
+    memcpy(hw->dec[nrounds], hw->enc[0], 16);
+    hw->nrounds = nrounds;
+    hw->backend = backend;
+}
+
+#define AES_X8(op, k) do { \
+        b0 = op(b0, k); b1 = op(b1, k); b2 = op(b2, k); b3 = op(b3, k); \
+        b4 = op(b4, k); b5 = op(b5, k); b6 = op(b6, k); b7 = op(b7, k); \
+    } while (0)
+
+/* AES-NI: 8 blocks in flight, keys: enc (aesenc) or dec (aesdec) */
+#define AESNI_CRYPT(name, keys, round_op, last_op) \
+__attribute__((target("aes,sse2"))) \
+static void name(const AES_hw_keys* hw, size_t blocks, unsigned char* out, const unsigned char* in) { \
+    const int nrounds = hw->nrounds; \
+    __m128i rk[15]; \
+    int r; \
+    for (r = 0; r <= nrounds; r++) rk[r] = _mm_loadu_si128((const __m128i*)hw->keys[r]); \
+    for (; blocks >= 8; blocks -= 8, in += 128, out += 128) { \
+        __m128i b0 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in + 0x00)), rk[0]); \
+        __m128i b1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in + 0x10)), rk[0]); \
+        __m128i b2 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in + 0x20)), rk[0]); \
+        __m128i b3 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in + 0x30)), rk[0]); \
+        __m128i b4 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in + 0x40)), rk[0]); \
+        __m128i b5 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in + 0x50)), rk[0]); \
+        __m128i b6 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in + 0x60)), rk[0]); \
+        __m128i b7 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in + 0x70)), rk[0]); \
+        for (r = 1; r < nrounds; r++) AES_X8(round_op, rk[r]); \
+        AES_X8(last_op, rk[nrounds]); \
+        _mm_storeu_si128((__m128i*)(out + 0x00), b0); \
+        _mm_storeu_si128((__m128i*)(out + 0x10), b1); \
+        _mm_storeu_si128((__m128i*)(out + 0x20), b2); \
+        _mm_storeu_si128((__m128i*)(out + 0x30), b3); \
+        _mm_storeu_si128((__m128i*)(out + 0x40), b4); \
+        _mm_storeu_si128((__m128i*)(out + 0x50), b5); \
+        _mm_storeu_si128((__m128i*)(out + 0x60), b6); \
+        _mm_storeu_si128((__m128i*)(out + 0x70), b7); \
+    } \
+    for (; blocks > 0; blocks--, in += 16, out += 16) { \
+        __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i*)in), rk[0]); \
+        for (r = 1; r < nrounds; r++) b = round_op(b, rk[r]); \
+        _mm_storeu_si128((__m128i*)out, last_op(b, rk[nrounds])); \
+    } \
+}
+
+AESNI_CRYPT(AESNI_encrypt, enc, _mm_aesenc_si128, _mm_aesenclast_si128)
+AESNI_CRYPT(AESNI_decrypt, dec, _mm_aesdec_si128, _mm_aesdeclast_si128)
+
+/* VAES: 8 registers of 2 blocks, the remaining blocks go through AES-NI */
+#define VAES_CRYPT(name, keys, round_op, last_op, tail) \
+__attribute__((target("aes,vaes,avx2"))) \
+static void name(const AES_hw_keys* hw, size_t blocks, unsigned char* out, const unsigned char* in) { \
+    const int nrounds = hw->nrounds; \
+    __m256i rk[15]; \
+    int r; \
+    if (blocks < 16) { tail(hw, blocks, out, in); return; } \
+    for (r = 0; r <= nrounds; r++) rk[r] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)hw->keys[r])); \
+    for (; blocks >= 16; blocks -= 16, in += 256, out += 256) { \
+        __m256i b0 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(in + 0x00)), rk[0]); \
+        __m256i b1 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(in + 0x20)), rk[0]); \
+        __m256i b2 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(in + 0x40)), rk[0]); \
+        __m256i b3 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(in + 0x60)), rk[0]); \
+        __m256i b4 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(in + 0x80)), rk[0]); \
+        __m256i b5 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(in + 0xa0)), rk[0]); \
+        __m256i b6 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(in + 0xc0)), rk[0]); \
+        __m256i b7 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(in + 0xe0)), rk[0]); \
+        for (r = 1; r < nrounds; r++) AES_X8(round_op, rk[r]); \
+        AES_X8(last_op, rk[nrounds]); \
+        _mm256_storeu_si256((__m256i*)(out + 0x00), b0); \
+        _mm256_storeu_si256((__m256i*)(out + 0x20), b1); \
+        _mm256_storeu_si256((__m256i*)(out + 0x40), b2); \
+        _mm256_storeu_si256((__m256i*)(out + 0x60), b3); \
+        _mm256_storeu_si256((__m256i*)(out + 0x80), b4); \
+        _mm256_storeu_si256((__m256i*)(out + 0xa0), b5); \
+        _mm256_storeu_si256((__m256i*)(out + 0xc0), b6); \
+        _mm256_storeu_si256((__m256i*)(out + 0xe0), b7); \
+    } \
+    if (blocks) tail(hw, blocks, out, in); \
+}
+
+VAES_CRYPT(VAES_encrypt, enc, _mm256_aesenc_epi128, _mm256_aesenclast_epi128, AESNI_encrypt)
+VAES_CRYPT(VAES_decrypt, dec, _mm256_aesdec_epi128, _mm256_aesdeclast_epi128, AESNI_decrypt)
+
+static void AES_hw_encrypt(const AES_hw_keys* hw, size_t blocks, unsigned char* cipher16, const unsigned char* plain16) {
+    if (hw->backend == AES_BACKEND_vaes) VAES_encrypt(hw, blocks, cipher16, plain16);
+    else AESNI_encrypt(hw, blocks, cipher16, plain16);
+}
+
+static void AES_hw_decrypt(const AES_hw_keys* hw, size_t blocks, unsigned char* plain16, const unsigned char* cipher16) {
+    if (hw->backend == AES_BACKEND_vaes) VAES_decrypt(hw, blocks, plain16, cipher16);
+    else AESNI_decrypt(hw, blocks, plain16, cipher16);
+}
+#else
+static int AES_backend_supported(int backend) {
+    return backend == AES_BACKEND_soft;
+}
+#endif
+
+static int AES_current_backend(void) {
+    int backend = __atomic_load_n(&s_backend, __ATOMIC_RELAXED);
+    if (backend == AES_BACKEND_auto) {
+        backend = AES_BACKEND_soft;
+        if (AES_backend_supported(AES_BACKEND_vaes)) backend = AES_BACKEND_vaes;
+        else if (AES_backend_supported(AES_BACKEND_aesni)) backend = AES_BACKEND_aesni;
+        __atomic_store_n(&s_backend, backend, __ATOMIC_RELAXED);
+    }
+    return backend;
+}
+
+int AES_select_backend(enum AES_BACKEND backend) {
+    if (backend != AES_BACKEND_auto && !AES_backend_supported(backend)) return -1;
+    __atomic_store_n(&s_backend, (int)backend, __ATOMIC_RELAXED);
+    AES_current_backend();
+    return 0;
+}
+
+const char* AES_backend_name(enum AES_BACKEND backend) {
+    static const char* names[] = { "auto", "soft", "aesni", "vaes" };
+    if (backend == AES_BACKEND_auto) backend = AES_current_backend();
+    if ((unsigned)backend >= sizeof(names) / sizeof(names[0])) return "unknown";
+    return names[backend];
+}
+
+static void AES_init(AES_state* rounds, AES_hw_keys* hw, const unsigned char* key, int nkeywords, int nrounds) {
+    int backend = AES_current_backend();
+    memset(hw, 0, sizeof(*hw));
+    hw->backend = AES_BACKEND_soft;
+    AES_setup(rounds, key, nkeywords, nrounds);
+#ifdef CTAES_HAS_HW
+    if (backend != AES_BACKEND_soft) AES_hw_setup(hw, rounds, nrounds, backend);
+#else
+    (void)backend;
+#endif
+}
+
+static void AES_encrypt_blocks(const AES_state* rounds, const AES_hw_keys* hw, int nrounds, size_t blocks, unsigned char* cipher16, const unsigned char* plain16) {
+#ifdef CTAES_HAS_HW
+    if (hw->backend != AES_BACKEND_soft) {
+        AES_hw_encrypt(hw, blocks, cipher16, plain16);
+        return;
+    }
+#endif
     while (blocks--) {
-        AES_encrypt(ctx->rk, 10, cipher16, plain16);
+        AES_encrypt(rounds, nrounds, cipher16, plain16);
         cipher16 += 16;
         plain16 += 16;
     }
 }
 
-void AES128_decrypt(const AES128_ctx* ctx, size_t blocks, unsigned char* plain16, const unsigned char* cipher16) {
+static void AES_decrypt_blocks(const AES_state* rounds, const AES_hw_keys* hw, int nrounds, size_t blocks, unsigned char* plain16, const unsigned char* cipher16) {
+#ifdef CTAES_HAS_HW
+    if (hw->backend != AES_BACKEND_soft) {
+        AES_hw_decrypt(hw, blocks, plain16, cipher16);
+        return;
+    }
+#endif
     while (blocks--) {
-        AES_decrypt(ctx->rk, 10, plain16, cipher16);
+        AES_decrypt(rounds, nrounds, plain16, cipher16);
         cipher16 += 16;
         plain16 += 16;
     }
 }
 
+void AES128_init(AES128_ctx* ctx, const unsigned char* key16) {
+    AES_init(ctx->rk, &ctx->hw, key16, 4, 10);
+}
+
+void AES128_encrypt(const AES128_ctx* ctx, size_t blocks, unsigned char* cipher16, const unsigned char* plain16) {
+    AES_encrypt_blocks(ctx->rk, &ctx->hw, 10, blocks, cipher16, plain16);
+}
+
+void AES128_decrypt(const AES128_ctx* ctx, size_t blocks, unsigned char* plain16, const unsigned char* cipher16) {
+    AES_decrypt_blocks(ctx->rk, &ctx->hw, 10, blocks, plain16, cipher16);
+}
+
 void AES192_init(AES192_ctx* ctx, const unsigned char* key24) {
-    AES_setup(ctx->rk, key24, 6, 12);
+    AES_init(ctx->rk, &ctx->hw, key24, 6, 12);
 }
 
 void AES192_encrypt(const AES192_ctx* ctx, size_t blocks, unsigned char* cipher16, const unsigned char* plain16) {
-    while (blocks--) {
-        AES_encrypt(ctx->rk, 12, cipher16, plain16);
-        cipher16 += 16;
-        plain16 += 16;
-    }
-
+    AES_encrypt_blocks(ctx->rk, &ctx->hw, 12, blocks, cipher16, plain16);
 }
 
 void AES192_decrypt(const AES192_ctx* ctx, size_t blocks, unsigned char* plain16, const unsigned char* cipher16) {
-    while (blocks--) {
-        AES_decrypt(ctx->rk, 12, plain16, cipher16);
-        cipher16 += 16;
-        plain16 += 16;
-    }
+    AES_decrypt_blocks(ctx->rk, &ctx->hw, 12, blocks, plain16, cipher16);
 }
 
 void AES256_init(AES256_ctx* ctx, const unsigned char* key32) {
-    AES_setup(ctx->rk, key32, 8, 14);
+    AES_init(ctx->rk, &ctx->hw, key32, 8, 14);
 }
 
 void AES256_encrypt(const AES256_ctx* ctx, size_t blocks, unsigned char* cipher16, const unsigned char* plain16) {
-    while (blocks--) {
-        AES_encrypt(ctx->rk, 14, cipher16, plain16);
-        cipher16 += 16;
-        plain16 += 16;
-    }
+    AES_encrypt_blocks(ctx->rk, &ctx->hw, 14, blocks, cipher16, plain16);
 }
 
 void AES256_decrypt(const AES256_ctx* ctx, size_t blocks, unsigned char* plain16, const unsigned char* cipher16) {
-    while (blocks--) {
-        AES_decrypt(ctx->rk, 14, plain16, cipher16);
-        cipher16 += 16;
-        plain16 += 16;
-    }
+    AES_decrypt_blocks(ctx->rk, &ctx->hw, 14, blocks, plain16, cipher16);
 }
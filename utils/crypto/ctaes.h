@@ -14,18 +14,41 @@ typedef struct {
     uint16_t slice[8];
 } AES_state, aes_gcm_state;
 
+/* Round keys of the hardware backend (AES-NI / VAES), in the usual byte order.
+ * backend == AES_BACKEND_soft: not used, the bitsliced rk[] are used instead. */
+typedef struct {
+    unsigned char enc[15][16];
+    unsigned char dec[15][16]; /* Equivalent Inverse Cipher: reversed, InvMixColumns applied */
+    int nrounds;
+    int backend;
+} AES_hw_keys;
+
 typedef struct {
     AES_state rk[11];
+    AES_hw_keys hw;
 } AES128_ctx, aes128_gcm_ctx_t;
 
 typedef struct {
     AES_state rk[13];
+    AES_hw_keys hw;
 } AES192_ctx, aes192_gcm_ctx_t;
 
 typedef struct {
     AES_state rk[15];
+    AES_hw_keys hw;
 } AES256_ctx, aes256_gcm_ctx_t;
 
+/* Backend selection: the fastest one supported by the CPU (cpuid) unless forced.
+ * A context keeps the backend it was initialized with. */
+enum AES_BACKEND {
+    AES_BACKEND_auto,
+    AES_BACKEND_soft,   /* bitsliced, constant time */
+    AES_BACKEND_aesni,  /* AES-NI, 8 blocks in flight */
+    AES_BACKEND_vaes,   /* VAES + AVX2, 2 blocks per register, 16 blocks in flight */
+};
+int AES_select_backend(enum AES_BACKEND backend); /* -1: not supported by this CPU */
+const char* AES_backend_name(enum AES_BACKEND backend); /* AES_BACKEND_auto: the current default */
+
 void AES128_init(AES128_ctx* ctx, const unsigned char* key16);
 void AES128_encrypt(const AES128_ctx* ctx, size_t blocks, unsigned char* cipher16, const unsigned char* plain16);
 void AES128_decrypt(const AES128_ctx* ctx, size_t blocks, unsigned char* plain16, const unsigned char* cipher16);
@@ -0,0 +1,114 @@
+/*
+ * hmac_signer.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <gnutls/gnutls.h>
+#include "hmac_signer.h"
+#include "utils.h"
+
+#if GNUTLS_VERSION_NUMBER >= 0x030609
+#define HMAC_SIGNER_HAS_COPY (1)
+#endif
+
+int hmac_signer_init(hmac_signer_t * signer, gnutls_mac_algorithm_t algorithm, const void * key, size_t cb_key)
+{
+	assert(signer && key);
+	memset(signer, 0, sizeof(*signer));
+	signer->algorithm = algorithm;
+	signer->digest_size = gnutls_hmac_get_len(algorithm);
+	if(0 == signer->digest_size || signer->digest_size > HMAC_SIGNER_MAX_DIGEST_SIZE) return -1;
+	
+	int rc = gnutls_hmac_init(&signer->keyed, algorithm, key, cb_key);
+	if(rc) {
+		signer->keyed = NULL;
+		return rc;
+	}
+	
+#ifdef HMAC_SIGNER_HAS_COPY
+	// some backends can not clone a handle
+	gnutls_hmac_hd_t clone = gnutls_hmac_copy(signer->keyed);
+	if(clone) {
+		gnutls_hmac_deinit(clone, NULL);
+		return 0;
+	}
+#endif
+	signer->key = malloc(cb_key + 1);
+	assert(signer->key);
+	memcpy(signer->key, key, cb_key);
+	signer->cb_key = cb_key;
+	return 0;
+}
+
+void hmac_signer_cleanup(hmac_signer_t * signer)
+{
+	if(NULL == signer) return;
+	if(signer->keyed) gnutls_hmac_deinit(signer->keyed, NULL);
+	if(signer->key) {
+		gnutls_memset(signer->key, 0, signer->cb_key);
+		free(signer->key);
+	}
+	memset(signer, 0, sizeof(*signer));
+	return;
+}
+
+int hmac_signer_sign(const hmac_signer_t * signer, const struct iovec * parts, int num_parts, unsigned char * digest)
+{
+	assert(signer && signer->keyed && digest);
+	gnutls_hmac_hd_t hmac = NULL;
+	
+#ifdef HMAC_SIGNER_HAS_COPY
+	if(NULL == signer->key) hmac = gnutls_hmac_copy(signer->keyed);
+#endif
+	if(NULL == hmac) {
+		if(NULL == signer->key) return -1;
+		int rc = gnutls_hmac_init(&hmac, signer->algorithm, signer->key, signer->cb_key);
+		if(rc) return rc;
+	}
+	
+	for(int i = 0; i < num_parts; ++i) {
+		if(parts[i].iov_len > 0) gnutls_hmac(hmac, parts[i].iov_base, parts[i].iov_len);
+	}
+	gnutls_hmac_deinit(hmac, digest);
+	return 0;
+}
+
+int hmac_signer_sign_hex(const hmac_signer_t * signer, const struct iovec * parts, int num_parts, char * hex)
+{
+	assert(hex);
+	unsigned char digest[HMAC_SIGNER_MAX_DIGEST_SIZE];
+	int rc = hmac_signer_sign(signer, parts, num_parts, digest);
+	if(rc) return rc;
+	
+	hex_encode(digest, signer->digest_size, hex);
+	gnutls_memset(digest, 0, sizeof(digest));
+	return 0;
+}
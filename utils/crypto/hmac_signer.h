@@ -0,0 +1,51 @@
+#ifndef CRYPTO_HMAC_SIGNER_H_
+#define CRYPTO_HMAC_SIGNER_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <gnutls/crypto.h>
+
+/*****************************************************
+ * hmac_signer:
+ *   HMAC with the key pads computed once per credential.
+ *
+ *   init() absorbs the key into a template handle,
+ *   each sign() clones it (gnutls_hmac_copy) and hashes the message parts
+ *   in place, so no message buffer is built and nothing is allocated
+ *   besides the clone.
+ *   the template is never updated, sign() can run on several threads.
+ *   keep one signer per credential, owned by whoever owns the secret
+ *   (e.g. trading_agency::get_signer()).
+ *
+ *   gnutls < 3.6.9 (no gnutls_hmac_copy) falls back to a keyed init per call.
+*****************************************************/
+#define HMAC_SIGNER_MAX_DIGEST_SIZE (64)
+
+typedef struct hmac_signer
+{
+	gnutls_mac_algorithm_t algorithm;
+	size_t digest_size;
+	gnutls_hmac_hd_t keyed;		// template: key pads absorbed, no data
+
+	// fallback only (no gnutls_hmac_copy)
+	unsigned char * key;
+	size_t cb_key;
+}hmac_signer_t;
+
+int hmac_signer_init(hmac_signer_t * signer, gnutls_mac_algorithm_t algorithm, const void * key, size_t cb_key);
+void hmac_signer_cleanup(hmac_signer_t * signer);
+
+// hash the concatenation of @parts, @digest: signer->digest_size bytes
+int hmac_signer_sign(const hmac_signer_t * signer, const struct iovec * parts, int num_parts, unsigned char * digest);
+// lowercase hex, @hex: at least (signer->digest_size * 2 + 1) bytes
+int hmac_signer_sign_hex(const hmac_signer_t * signer, const struct iovec * parts, int num_parts, char * hex);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
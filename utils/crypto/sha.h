@@ -7,6 +7,7 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include <sys/uio.h>
 #include <gnutls/crypto.h>
 
 #define sha_hash(algorithm, msg, cb_msg, digest) gnutls_hash_fast(algorithm, msg, cb_msg, digest)
@@ -45,6 +46,38 @@ typedef struct hash_ctx
 #define sha512_final(ctx, digest) sha_final(ctx, digest)
 #define ripemd_final(ctx, digest) sha_final(ctx, digest)
 
+/*****************************************************
+ * sha256_batch:
+ *   hash @count independent messages per call (archive blocks, snapshot pages, ...)
+ *
+ *   multi-buffer: the messages are assigned to lanes, a lane takes the next
+ *   message as soon as its current one is finished, so a batch of mixed sizes
+ *   keeps every lane busy until the last few messages.
+ *     shani: 2 lanes interleaved (hides the latency of sha256rnds2)
+ *     avx2:  8 lanes, one message per 32-bit element
+ *     gnutls: one gnutls_hash_fast() per message (no SIMD, or tiny batches)
+ *   selected by cpuid on the first call: shani > avx2 > gnutls.
+ *
+ *   digests[i] may overlap messages[i] (e.g. hash256_batch() hashes its digests in place),
+ *   but no other message.
+ *   hash160_batch() uses a local RIPEMD-160, GnuTLS builds may not provide GNUTLS_DIG_RMD160.
+*****************************************************/
+enum sha256_batch_impl
+{
+	sha256_batch_impl_auto,
+	sha256_batch_impl_gnutls,
+	sha256_batch_impl_avx2,
+	sha256_batch_impl_shani,
+};
+int sha256_batch_impl_select(enum sha256_batch_impl impl);	// (tests / benchmarks) -1: not supported by this cpu
+const char * sha256_batch_impl_name(void);
+
+void sha256_batch(const struct iovec * messages, size_t count, uint8_t (* digests)[32]);
+void hash256_batch(const struct iovec * messages, size_t count, uint8_t (* hashes)[32]);	// sha256(sha256(m))
+void hash160_batch(const struct iovec * messages, size_t count, uint8_t (* hashes)[20]);	// ripemd160(sha256(m))
+
+void ripemd160_hash(const void * msg, size_t cb_msg, uint8_t digest[static 20]);
+
 #ifdef __cplusplus
 }
 #endif
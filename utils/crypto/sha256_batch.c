@@ -0,0 +1,579 @@
+/*
+ * sha256_batch.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <gnutls/gnutls.h>
+#include "sha.h"
+#include "utils.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SHA256_BATCH_HAS_SIMD (1)
+#endif
+
+#define SHA256_MAX_LANES (8)
+#define HASH160_CHUNK_SIZE (256)	// intermediate sha256 digests kept on the stack
+
+static const uint32_t s_sha256_iv[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+static const uint32_t s_sha256_k[64] __attribute__((aligned(32))) = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t load_be32(const uint8_t * p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline void store_be32(uint8_t * p, uint32_t x)
+{
+	p[0] = (uint8_t)(x >> 24); p[1] = (uint8_t)(x >> 16); p[2] = (uint8_t)(x >> 8); p[3] = (uint8_t)x;
+}
+
+static inline uint32_t ror32(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+static inline uint32_t rol32(uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+
+/*****************************************************
+ * sha256: portable compression function
+ *   only finishes the last message of an avx2 batch (no other lane left to share the work)
+*****************************************************/
+static void sha256_compress_generic(uint32_t state[static 8], const uint8_t * block)
+{
+	uint32_t w[64];
+	for(int t = 0; t < 16; ++t) w[t] = load_be32(block + t * 4);
+	for(int t = 16; t < 64; ++t) {
+		uint32_t s0 = ror32(w[t - 15], 7) ^ ror32(w[t - 15], 18) ^ (w[t - 15] >> 3);
+		uint32_t s1 = ror32(w[t - 2], 17) ^ ror32(w[t - 2], 19) ^ (w[t - 2] >> 10);
+		w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+	}
+	
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+	uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+	for(int t = 0; t < 64; ++t) {
+		uint32_t t1 = h + (ror32(e, 6) ^ ror32(e, 11) ^ ror32(e, 25)) + (g ^ (e & (f ^ g))) + s_sha256_k[t] + w[t];
+		uint32_t t2 = (ror32(a, 2) ^ ror32(a, 13) ^ ror32(a, 22)) + ((a & b) | (c & (a | b)));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+#ifdef SHA256_BATCH_HAS_SIMD
+/*****************************************************
+ * sha256: SHA-NI, 2 lanes
+ *   the 16 groups of 4 rounds are generated by one unrolled loop,
+ *   msg[] rotates through the 4 message schedule registers.
+*****************************************************/
+__attribute__((target("sha,sse4.1,ssse3")))
+static inline void sha_ni_load_state(const uint32_t state[static 8], __m128i * abef, __m128i * cdgh)
+{
+	__m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xB1);	// CDAB
+	__m128i efgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1B);	// EFGH
+	*abef = _mm_alignr_epi8(tmp, efgh, 8);
+	*cdgh = _mm_blend_epi16(efgh, tmp, 0xF0);
+}
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static inline void sha_ni_store_state(uint32_t state[static 8], __m128i abef, __m128i cdgh)
+{
+	__m128i tmp = _mm_shuffle_epi32(abef, 0x1B);	// FEBA
+	cdgh = _mm_shuffle_epi32(cdgh, 0xB1);			// DCHG
+	_mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(tmp, cdgh, 0xF0));	// DCBA
+	_mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(cdgh, tmp, 8));		// HGFE
+}
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static void sha256_compress_shani(uint32_t state[][8], const uint8_t * blocks[])
+{
+	const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i abef[2], cdgh[2], abef_save[2], cdgh_save[2];
+	__m128i msg[2][4];
+	
+	for(int l = 0; l < 2; ++l) {
+		sha_ni_load_state(state[l], &abef[l], &cdgh[l]);
+		abef_save[l] = abef[l];
+		cdgh_save[l] = cdgh[l];
+	}
+	
+#pragma GCC unroll 16
+	for(int g = 0; g < 16; ++g) {
+		const __m128i k = _mm_load_si128((const __m128i *)&s_sha256_k[g * 4]);
+	#pragma GCC unroll 2
+		for(int l = 0; l < 2; ++l) {
+			__m128i * m = msg[l];
+			if(g < 4) m[g] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(blocks[l] + g * 16)), bswap);
+			
+			__m128i wk = _mm_add_epi32(m[g & 3], k);
+			cdgh[l] = _mm_sha256rnds2_epu32(cdgh[l], abef[l], wk);
+			if(g >= 3 && g <= 14) {
+				__m128i tmp = _mm_alignr_epi8(m[g & 3], m[(g - 1) & 3], 4);
+				m[(g + 1) & 3] = _mm_sha256msg2_epu32(_mm_add_epi32(m[(g + 1) & 3], tmp), m[g & 3]);
+			}
+			abef[l] = _mm_sha256rnds2_epu32(abef[l], cdgh[l], _mm_shuffle_epi32(wk, 0x0E));
+			if(g >= 1 && g <= 12) m[(g - 1) & 3] = _mm_sha256msg1_epu32(m[(g - 1) & 3], m[g & 3]);
+		}
+	}
+	
+	for(int l = 0; l < 2; ++l) {
+		sha_ni_store_state(state[l], _mm_add_epi32(abef[l], abef_save[l]), _mm_add_epi32(cdgh[l], cdgh_save[l]));
+	}
+}
+
+/*****************************************************
+ * sha256: AVX2, 8 lanes
+ *   lane j lives in the 32-bit element j of every register,
+ *   states and message words are transposed on the way in and out.
+*****************************************************/
+__attribute__((target("avx2")))
+static inline void transpose8x8(__m256i r[8])
+{
+	__m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]), t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+	__m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]), t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+	__m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]), t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+	__m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]), t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+	
+	__m256i u0 = _mm256_unpacklo_epi64(t0, t2), u1 = _mm256_unpackhi_epi64(t0, t2);
+	__m256i u2 = _mm256_unpacklo_epi64(t1, t3), u3 = _mm256_unpackhi_epi64(t1, t3);
+	__m256i u4 = _mm256_unpacklo_epi64(t4, t6), u5 = _mm256_unpackhi_epi64(t4, t6);
+	__m256i u6 = _mm256_unpacklo_epi64(t5, t7), u7 = _mm256_unpackhi_epi64(t5, t7);
+	
+	r[0] = _mm256_permute2x128_si256(u0, u4, 0x20); r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+	r[1] = _mm256_permute2x128_si256(u1, u5, 0x20); r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+	r[2] = _mm256_permute2x128_si256(u2, u6, 0x20); r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+	r[3] = _mm256_permute2x128_si256(u3, u7, 0x20); r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+#define ROR8(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define XOR3(x, y, z) _mm256_xor_si256(_mm256_xor_si256(x, y), z)
+
+__attribute__((target("avx2")))
+static void sha256_compress_avx2(uint32_t state[][8], const uint8_t * blocks[])
+{
+	const __m256i bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	__m256i s[8], w[16];
+	
+	for(int j = 0; j < 8; ++j) s[j] = _mm256_loadu_si256((const __m256i *)state[j]);
+	transpose8x8(s);
+	for(int half = 0; half < 2; ++half) {
+		__m256i * r = &w[half * 8];
+		for(int j = 0; j < 8; ++j) r[j] = _mm256_loadu_si256((const __m256i *)(blocks[j] + half * 32));
+		transpose8x8(r);
+		for(int j = 0; j < 8; ++j) r[j] = _mm256_shuffle_epi8(r[j], bswap);
+	}
+	
+	__m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+	for(int t = 0; t < 64; ++t) {
+		if(t >= 16) {
+			__m256i w15 = w[(t - 15) & 15], w2 = w[(t - 2) & 15];
+			__m256i s0 = XOR3(ROR8(w15, 7), ROR8(w15, 18), _mm256_srli_epi32(w15, 3));
+			__m256i s1 = XOR3(ROR8(w2, 17), ROR8(w2, 19), _mm256_srli_epi32(w2, 10));
+			w[t & 15] = _mm256_add_epi32(_mm256_add_epi32(w[t & 15], s0), _mm256_add_epi32(w[(t - 7) & 15], s1));
+		}
+		__m256i ch = _mm256_xor_si256(g, _mm256_and_si256(e, _mm256_xor_si256(f, g)));
+		__m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, XOR3(ROR8(e, 6), ROR8(e, 11), ROR8(e, 25))),
+			_mm256_add_epi32(_mm256_add_epi32(ch, w[t & 15]), _mm256_set1_epi32((int)s_sha256_k[t])));
+		__m256i maj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+		__m256i t2 = _mm256_add_epi32(XOR3(ROR8(a, 2), ROR8(a, 13), ROR8(a, 22)), maj);
+		h = g; g = f; f = e; e = _mm256_add_epi32(d, t1);
+		d = c; c = b; b = a; a = _mm256_add_epi32(t1, t2);
+	}
+	
+	s[0] = _mm256_add_epi32(s[0], a); s[1] = _mm256_add_epi32(s[1], b);
+	s[2] = _mm256_add_epi32(s[2], c); s[3] = _mm256_add_epi32(s[3], d);
+	s[4] = _mm256_add_epi32(s[4], e); s[5] = _mm256_add_epi32(s[5], f);
+	s[6] = _mm256_add_epi32(s[6], g); s[7] = _mm256_add_epi32(s[7], h);
+	transpose8x8(s);
+	for(int j = 0; j < 8; ++j) _mm256_storeu_si256((__m256i *)state[j], s[j]);
+}
+#undef ROR8
+#undef XOR3
+#endif
+
+/*****************************************************
+ * lanes: feed the messages block by block
+*****************************************************/
+struct sha256_lane
+{
+	size_t index;		// message
+	const uint8_t * data;	// next full block of the message
+	size_t num_blocks;		// full blocks left
+	size_t num_tail_blocks;	// padded blocks left (1 or 2)
+	size_t tail_offset;
+	uint8_t tail[128];
+};
+
+static void sha256_lane_start(struct sha256_lane * lane, uint32_t state[static 8], size_t index, const void * data, size_t length)
+{
+	size_t cb_tail = length % 64;
+	
+	lane->index = index;
+	lane->data = data;
+	lane->num_blocks = length / 64;
+	lane->num_tail_blocks = (cb_tail + 9 > 64)?2:1;
+	lane->tail_offset = 0;
+	
+	// copy the tail now, the digest may overwrite the message
+	size_t cb_padded = lane->num_tail_blocks * 64;
+	memset(lane->tail, 0, cb_padded);
+	if(cb_tail) memcpy(lane->tail, (const uint8_t *)data + length - cb_tail, cb_tail);
+	lane->tail[cb_tail] = 0x80;
+	uint64_t bits = (uint64_t)length * 8;
+	store_be32(lane->tail + cb_padded - 8, (uint32_t)(bits >> 32));
+	store_be32(lane->tail + cb_padded - 4, (uint32_t)bits);
+	
+	memcpy(state, s_sha256_iv, sizeof(s_sha256_iv));
+}
+
+// return the next block, NULL when the message has been consumed
+static inline const uint8_t * sha256_lane_next_block(struct sha256_lane * lane)
+{
+	if(lane->num_blocks) {
+		const uint8_t * block = lane->data;
+		lane->data += 64;
+		--lane->num_blocks;
+		return block;
+	}
+	if(0 == lane->num_tail_blocks) return NULL;
+	const uint8_t * block = lane->tail + lane->tail_offset;
+	lane->tail_offset += 64;
+	--lane->num_tail_blocks;
+	return block;
+}
+
+static inline void sha256_store_digest(uint8_t digest[static 32], const uint32_t state[static 8])
+{
+	for(int i = 0; i < 8; ++i) store_be32(digest + i * 4, state[i]);
+}
+
+/*****************************************************
+ * engines
+*****************************************************/
+typedef void (* sha256_compress_lanes_fn)(uint32_t state[][8], const uint8_t * blocks[]);
+struct sha256_engine
+{
+	const char * name;
+	int num_lanes;		// 0: one gnutls_hash_fast() per message
+	size_t min_batch;	// smaller batches go to gnutls
+	sha256_compress_lanes_fn compress;
+	// finishes the last message alone instead of running every lane for it (NULL: keep the lanes)
+	void (* compress_single)(uint32_t state[static 8], const uint8_t * block);
+};
+
+static const struct sha256_engine s_engine_gnutls = { "gnutls", 0, 0, NULL, NULL };
+#ifdef SHA256_BATCH_HAS_SIMD
+// sha256rnds2 is latency-bound: the idle lane of a 2-lane round is almost free
+static const struct sha256_engine s_engine_shani = { "shani", 2, 2, sha256_compress_shani, NULL };
+static const struct sha256_engine s_engine_avx2 = { "avx2", 8, 4, sha256_compress_avx2, sha256_compress_generic };
+#endif
+
+static const struct sha256_engine * s_engine;	// NULL: not resolved yet
+
+static void sha256_batch_gnutls(const struct iovec * messages, size_t count, uint8_t (* digests)[32])
+{
+	for(size_t i = 0; i < count; ++i) {
+		const void * data = messages[i].iov_len?messages[i].iov_base:"";
+		int rc = gnutls_hash_fast(GNUTLS_DIG_SHA256, data, messages[i].iov_len, digests[i]);
+		assert(0 == rc);
+		(void)rc;
+	}
+}
+
+static void sha256_batch_lanes(const struct sha256_engine * engine, const struct iovec * messages, size_t count, uint8_t (* digests)[32])
+{
+	static const uint8_t idle_block[64];
+	const int num_lanes = engine->num_lanes;
+	assert(num_lanes > 0 && num_lanes <= SHA256_MAX_LANES);
+	
+	struct sha256_lane lanes[SHA256_MAX_LANES];
+	uint32_t state[SHA256_MAX_LANES][8] __attribute__((aligned(32)));
+	const uint8_t * blocks[SHA256_MAX_LANES];
+	int busy[SHA256_MAX_LANES] = { 0 };
+	int num_busy = 0;
+	size_t next = 0;
+	
+	memset(state, 0, sizeof(state));
+	for(int j = 0; j < num_lanes && next < count; ++j, ++next) {
+		sha256_lane_start(&lanes[j], state[j], next, messages[next].iov_base, messages[next].iov_len);
+		busy[j] = 1;
+		++num_busy;
+	}
+	
+	while(num_busy > 0) {
+		if(num_busy == 1 && engine->compress_single) break;
+		
+		for(int j = 0; j < num_lanes; ++j) {
+			blocks[j] = busy[j]?sha256_lane_next_block(&lanes[j]):idle_block;
+		}
+		engine->compress(state, blocks);
+		
+		for(int j = 0; j < num_lanes; ++j) {
+			struct sha256_lane * lane = &lanes[j];
+			if(!busy[j] || lane->num_blocks || lane->num_tail_blocks) continue;
+			
+			sha256_store_digest(digests[lane->index], state[j]);
+			if(next < count) {
+				sha256_lane_start(lane, state[j], next, messages[next].iov_base, messages[next].iov_len);
+				++next;
+			}else {
+				busy[j] = 0;
+				--num_busy;
+			}
+		}
+	}
+	
+	if(0 == num_busy) return;
+	for(int j = 0; j < num_lanes; ++j) {
+		if(!busy[j]) continue;
+		const uint8_t * block;
+		while((block = sha256_lane_next_block(&lanes[j]))) engine->compress_single(state[j], block);
+		sha256_store_digest(digests[lanes[j].index], state[j]);
+	}
+}
+
+int sha256_batch_impl_select(enum sha256_batch_impl impl)
+{
+	const struct sha256_engine * engine = &s_engine_gnutls;
+	
+#ifdef SHA256_BATCH_HAS_SIMD
+	__builtin_cpu_init();
+	int has_avx2 = __builtin_cpu_supports("avx2");
+	int has_shani = __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("ssse3");
+	if(impl == sha256_batch_impl_auto) {
+		impl = has_shani?sha256_batch_impl_shani:(has_avx2?sha256_batch_impl_avx2:sha256_batch_impl_gnutls);
+	}
+	
+	switch(impl)
+	{
+	case sha256_batch_impl_shani:
+		if(!has_shani) return -1;
+		engine = &s_engine_shani;
+		break;
+	case sha256_batch_impl_avx2:
+		if(!has_avx2) return -1;
+		engine = &s_engine_avx2;
+		break;
+	default:
+		break;
+	}
+#else
+	if(impl != sha256_batch_impl_auto && impl != sha256_batch_impl_gnutls) return -1;
+#endif
+	
+	// every engine gives the same digests, a thread still using the old one is harmless
+	__atomic_store_n(&s_engine, engine, __ATOMIC_RELAXED);
+	return 0;
+}
+
+static inline const struct sha256_engine * sha256_batch_get_engine(void)
+{
+	const struct sha256_engine * engine = __atomic_load_n(&s_engine, __ATOMIC_RELAXED);
+	if(NULL == engine) {
+		sha256_batch_impl_select(sha256_batch_impl_auto);
+		engine = __atomic_load_n(&s_engine, __ATOMIC_RELAXED);
+	}
+	return engine;
+}
+
+const char * sha256_batch_impl_name(void)
+{
+	return sha256_batch_get_engine()->name;
+}
+
+void sha256_batch(const struct iovec * messages, size_t count, uint8_t (* digests)[32])
+{
+	if(0 == count) return;
+	assert(messages && digests);
+	
+	const struct sha256_engine * engine = sha256_batch_get_engine();
+	if(engine->num_lanes == 0 || count < engine->min_batch) sha256_batch_gnutls(messages, count, digests);
+	else sha256_batch_lanes(engine, messages, count, digests);
+}
+
+void hash256_batch(const struct iovec * messages, size_t count, uint8_t (* hashes)[32])
+{
+	sha256_batch(messages, count, hashes);
+	
+	// second pass in place, 32-byte messages are copied into the lanes before their digests are written
+	struct iovec digests[HASH160_CHUNK_SIZE];
+	for(size_t i = 0; i < count; i += HASH160_CHUNK_SIZE) {
+		size_t n = count - i;
+		if(n > HASH160_CHUNK_SIZE) n = HASH160_CHUNK_SIZE;
+		for(size_t k = 0; k < n; ++k) {
+			digests[k].iov_base = hashes[i + k];
+			digests[k].iov_len = 32;
+		}
+		sha256_batch(digests, n, &hashes[i]);
+	}
+}
+
+void hash160_batch(const struct iovec * messages, size_t count, uint8_t (* hashes)[20])
+{
+	uint8_t digests[HASH160_CHUNK_SIZE][32];
+	for(size_t i = 0; i < count; i += HASH160_CHUNK_SIZE) {
+		size_t n = count - i;
+		if(n > HASH160_CHUNK_SIZE) n = HASH160_CHUNK_SIZE;
+		sha256_batch(&messages[i], n, digests);
+		for(size_t k = 0; k < n; ++k) ripemd160_hash(digests[k], 32, hashes[i + k]);
+	}
+}
+
+/*****************************************************
+ * utils.h: single messages
+*****************************************************/
+void hash256(const void * data, size_t length, uint8_t hash[static 32])
+{
+	uint8_t digest[32];
+	int rc = gnutls_hash_fast(GNUTLS_DIG_SHA256, length?data:"", length, digest);
+	assert(0 == rc);
+	rc = gnutls_hash_fast(GNUTLS_DIG_SHA256, digest, sizeof(digest), hash);
+	assert(0 == rc);
+	(void)rc;
+}
+
+void hash160(const void * data, size_t length, uint8_t hash[static 20])
+{
+	uint8_t digest[32];
+	int rc = gnutls_hash_fast(GNUTLS_DIG_SHA256, length?data:"", length, digest);
+	assert(0 == rc);
+	(void)rc;
+	ripemd160_hash(digest, sizeof(digest), hash);
+}
+
+/*****************************************************
+ * ripemd160
+*****************************************************/
+static const uint8_t s_rmd_rl[80] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	7, 4, 13, 1, 10, 6, 15, 3, 12, 0, 9, 5, 2, 14, 11, 8,
+	3, 10, 14, 4, 9, 15, 8, 1, 2, 7, 0, 6, 13, 11, 5, 12,
+	1, 9, 11, 10, 0, 8, 12, 4, 13, 3, 7, 15, 14, 5, 6, 2,
+	4, 0, 5, 9, 7, 12, 2, 10, 14, 1, 3, 8, 11, 6, 15, 13,
+};
+static const uint8_t s_rmd_rr[80] = {
+	5, 14, 7, 0, 9, 2, 11, 4, 13, 6, 15, 8, 1, 10, 3, 12,
+	6, 11, 3, 7, 0, 13, 5, 10, 14, 15, 8, 12, 4, 9, 1, 2,
+	15, 5, 1, 3, 7, 14, 6, 9, 11, 8, 12, 2, 10, 0, 4, 13,
+	8, 6, 4, 1, 3, 11, 15, 0, 5, 12, 2, 13, 9, 7, 10, 14,
+	12, 15, 10, 4, 1, 5, 8, 7, 6, 2, 13, 14, 0, 3, 9, 11,
+};
+static const uint8_t s_rmd_sl[80] = {
+	11, 14, 15, 12, 5, 8, 7, 9, 11, 13, 14, 15, 6, 7, 9, 8,
+	7, 6, 8, 13, 11, 9, 7, 15, 7, 12, 15, 9, 11, 7, 13, 12,
+	11, 13, 6, 7, 14, 9, 13, 15, 14, 8, 13, 6, 5, 12, 7, 5,
+	11, 12, 14, 15, 14, 15, 9, 8, 9, 14, 5, 6, 8, 6, 5, 12,
+	9, 15, 5, 11, 6, 8, 13, 12, 5, 12, 13, 14, 11, 8, 5, 6,
+};
+static const uint8_t s_rmd_sr[80] = {
+	8, 9, 9, 11, 13, 15, 15, 5, 7, 7, 8, 11, 14, 14, 12, 6,
+	9, 13, 15, 7, 12, 8, 9, 11, 7, 7, 12, 7, 6, 15, 13, 11,
+	9, 7, 15, 11, 8, 6, 6, 14, 12, 13, 5, 14, 13, 13, 7, 5,
+	15, 5, 8, 11, 14, 14, 6, 14, 6, 9, 12, 9, 12, 5, 15, 8,
+	8, 5, 12, 9, 12, 5, 14, 6, 8, 13, 6, 5, 15, 13, 11, 11,
+};
+static const uint32_t s_rmd_kl[5] = { 0x00000000, 0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xa953fd4e };
+static const uint32_t s_rmd_kr[5] = { 0x50a28be6, 0x5c4dd124, 0x6d703ef3, 0x7a6d76e9, 0x00000000 };
+
+static inline uint32_t rmd_f(int round, uint32_t x, uint32_t y, uint32_t z)
+{
+	switch(round)
+	{
+	case 0: return x ^ y ^ z;
+	case 1: return (x & y) | (~x & z);
+	case 2: return (x | ~y) ^ z;
+	case 3: return (x & z) | (y & ~z);
+	default: break;
+	}
+	return x ^ (y | ~z);
+}
+
+static void ripemd160_compress(uint32_t h[static 5], const uint8_t * block)
+{
+	uint32_t x[16];
+	for(int i = 0; i < 16; ++i) {
+		const uint8_t * p = block + i * 4;
+		x[i] = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	}
+	
+	uint32_t al = h[0], bl = h[1], cl = h[2], dl = h[3], el = h[4];
+	uint32_t ar = h[0], br = h[1], cr = h[2], dr = h[3], er = h[4];
+	for(int j = 0; j < 80; ++j) {
+		int round = j / 16;
+		uint32_t t = rol32(al + rmd_f(round, bl, cl, dl) + x[s_rmd_rl[j]] + s_rmd_kl[round], s_rmd_sl[j]) + el;
+		al = el; el = dl; dl = rol32(cl, 10); cl = bl; bl = t;
+		
+		t = rol32(ar + rmd_f(4 - round, br, cr, dr) + x[s_rmd_rr[j]] + s_rmd_kr[round], s_rmd_sr[j]) + er;
+		ar = er; er = dr; dr = rol32(cr, 10); cr = br; br = t;
+	}
+	
+	uint32_t t = h[1] + cl + dr;
+	h[1] = h[2] + dl + er;
+	h[2] = h[3] + el + ar;
+	h[3] = h[4] + al + br;
+	h[4] = h[0] + bl + cr;
+	h[0] = t;
+}
+
+void ripemd160_hash(const void * msg, size_t cb_msg, uint8_t digest[static 20])
+{
+	uint32_t h[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+	const uint8_t * p = msg;
+	size_t length = cb_msg;
+	
+	for(; length >= 64; length -= 64, p += 64) ripemd160_compress(h, p);
+	
+	uint8_t tail[128] = { 0 };
+	size_t cb_padded = (length + 9 > 64)?128:64;
+	if(length) memcpy(tail, p, length);
+	tail[length] = 0x80;
+	uint64_t bits = (uint64_t)cb_msg * 8;
+	for(int i = 0; i < 8; ++i) tail[cb_padded - 8 + i] = (uint8_t)(bits >> (i * 8));
+	ripemd160_compress(h, tail);
+	if(cb_padded == 128) ripemd160_compress(h, tail + 64);
+	
+	for(int i = 0; i < 5; ++i) {
+		digest[i * 4 + 0] = (uint8_t)h[i];
+		digest[i * 4 + 1] = (uint8_t)(h[i] >> 8);
+		digest[i * 4 + 2] = (uint8_t)(h[i] >> 16);
+		digest[i * 4 + 3] = (uint8_t)(h[i] >> 24);
+	}
+}
@@ -0,0 +1,189 @@
+/*
+ * mpsc_queue.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "mpsc_queue.h"
+
+#define slot_at(queue, pos) ((queue)->slots + ((pos) & (queue)->mask) * (queue)->slot_size)
+#define slot_sequence(slot) ((size_t *)(slot))
+#define slot_data(slot) ((slot) + sizeof(size_t))
+
+mpsc_queue_t * mpsc_queue_init(mpsc_queue_t * queue, size_t capacity, size_t item_size)
+{
+	assert(item_size > 0);
+	if(NULL == queue) {
+		int rc = posix_memalign((void **)&queue, MPSC_QUEUE_CACHE_LINE_SIZE, sizeof(*queue));
+		assert(0 == rc && queue);
+	}
+	memset(queue, 0, sizeof(*queue));
+	
+	// round up to power of 2
+	size_t size = 2;
+	while(size < capacity) size <<= 1;
+	
+	queue->capacity = size;
+	queue->mask = size - 1;
+	queue->item_size = item_size;
+	queue->slot_size = (sizeof(size_t) + item_size + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1);
+	
+	int rc = posix_memalign((void **)&queue->slots, MPSC_QUEUE_CACHE_LINE_SIZE, size * queue->slot_size);
+	assert(0 == rc && queue->slots);
+	
+	for(size_t i = 0; i < size; ++i) {
+		*slot_sequence(slot_at(queue, i)) = i;
+	}
+	return queue;
+}
+
+void mpsc_queue_cleanup(mpsc_queue_t * queue)
+{
+	if(NULL == queue) return;
+	free(queue->slots);
+	queue->slots = NULL;
+	queue->capacity = 0;
+	queue->mask = 0;
+	return;
+}
+
+int mpsc_queue_push(mpsc_queue_t * queue, const void * item)
+{
+	assert(queue && queue->slots && item);
+	unsigned char * slot = NULL;
+	size_t pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+	
+	while(1) {
+		slot = slot_at(queue, pos);
+		size_t seq = __atomic_load_n(slot_sequence(slot), __ATOMIC_ACQUIRE);
+		intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+		if(0 == diff) {
+			// the slot is free, try to claim it
+			if(__atomic_compare_exchange_n(&queue->enqueue_pos, &pos, pos + 1, 
+				1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+			// pos was updated by compare_exchange
+		}else if(diff < 0) {
+			return -1;	// full
+		}else {
+			pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+		}
+	}
+	
+	memcpy(slot_data(slot), item, queue->item_size);
+	__atomic_store_n(slot_sequence(slot), pos + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+int mpsc_queue_pop(mpsc_queue_t * queue, void * item)
+{
+	assert(queue && queue->slots);
+	size_t pos = queue->dequeue_pos;
+	unsigned char * slot = slot_at(queue, pos);
+	size_t seq = __atomic_load_n(slot_sequence(slot), __ATOMIC_ACQUIRE);
+	if(seq != pos + 1) return -1;	// empty (or the producer has not finished copying yet)
+	
+	if(item) memcpy(item, slot_data(slot), queue->item_size);
+	__atomic_store_n(slot_sequence(slot), pos + queue->capacity, __ATOMIC_RELEASE);
+	queue->dequeue_pos = pos + 1;
+	return 0;
+}
+
+ssize_t mpsc_queue_pop_batch(mpsc_queue_t * queue, void * items, size_t max_items)
+{
+	assert(queue && items);
+	unsigned char * p = items;
+	ssize_t count = 0;
+	for(; count < (ssize_t)max_items; ++count) {
+		if(mpsc_queue_pop(queue, p)) break;
+		p += queue->item_size;
+	}
+	return count;
+}
+
+int mpsc_queue_is_empty(const mpsc_queue_t * queue)
+{
+	assert(queue && queue->slots);
+	size_t pos = queue->dequeue_pos;
+	const unsigned char * slot = queue->slots + (pos & queue->mask) * queue->slot_size;
+	return __atomic_load_n((const size_t *)slot, __ATOMIC_ACQUIRE) != (pos + 1);
+}
+
+
+#if defined(_TEST_MPSC_QUEUE) && defined(_STAND_ALONE)
+#include <pthread.h>
+#include <sched.h>
+
+#define NUM_PRODUCERS (4)
+#define NUM_ITEMS (100000)
+static mpsc_queue_t s_queue[1];
+
+static void * producer_thread(void * user_data)
+{
+	int64_t id = (int64_t)(intptr_t)user_data;
+	for(int64_t i = 0; i < NUM_ITEMS; ++i) {
+		int64_t value = (id << 32) | i;
+		while(mpsc_queue_push(s_queue, &value)) sched_yield();
+	}
+	return NULL;
+}
+
+int main(int argc, char ** argv) 
+{
+	mpsc_queue_init(s_queue, 1024, sizeof(int64_t));
+	
+	pthread_t threads[NUM_PRODUCERS];
+	for(int i = 0; i < NUM_PRODUCERS; ++i) {
+		pthread_create(&threads[i], NULL, producer_thread, (void *)(intptr_t)i);
+	}
+	
+	// items from the same producer must keep their order
+	int64_t next[NUM_PRODUCERS] = { 0 };
+	int64_t total = 0;
+	int64_t batch[64];
+	while(total < (int64_t)NUM_PRODUCERS * NUM_ITEMS) {
+		ssize_t count = mpsc_queue_pop_batch(s_queue, batch, 64);
+		for(ssize_t i = 0; i < count; ++i) {
+			int64_t id = batch[i] >> 32;
+			int64_t seq = batch[i] & 0xffffffff;
+			assert(id >= 0 && id < NUM_PRODUCERS);
+			assert(seq == next[id]);
+			++next[id];
+		}
+		total += count;
+	}
+	for(int i = 0; i < NUM_PRODUCERS; ++i) pthread_join(threads[i], NULL);
+	assert(mpsc_queue_is_empty(s_queue));
+	
+	printf("%d producers, %ld items: OK\n", NUM_PRODUCERS, (long)total);
+	mpsc_queue_cleanup(s_queue);
+	return 0;
+}
+#endif
@@ -0,0 +1,49 @@
+#ifndef CHLIB_MPSC_QUEUE_H_
+#define CHLIB_MPSC_QUEUE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************
+ * mpsc_queue:
+ *   bounded lock-free multi-producer / single-consumer queue.
+ *   (D. Vyukov's bounded queue, each slot carries a sequence number)
+ *
+ *   items are copied into preallocated fixed-size slots,
+ *   push() never blocks and fails when the queue is full.
+*****************************************************/
+#define MPSC_QUEUE_CACHE_LINE_SIZE (64)
+typedef struct mpsc_queue
+{
+	size_t capacity;	// power of 2
+	size_t mask;
+	size_t item_size;
+	size_t slot_size;	// sizeof(sequence) + item_size, aligned
+	unsigned char * slots;
+	
+	// producers
+	size_t enqueue_pos __attribute__((aligned(MPSC_QUEUE_CACHE_LINE_SIZE)));
+	
+	// consumer
+	size_t dequeue_pos __attribute__((aligned(MPSC_QUEUE_CACHE_LINE_SIZE)));
+	int consumer_waiting;	// set by the consumer before it goes to sleep
+}mpsc_queue_t;
+
+// queue: NULL ==> allocated (cache-line aligned), free() it after mpsc_queue_cleanup()
+mpsc_queue_t * mpsc_queue_init(mpsc_queue_t * queue, size_t capacity, size_t item_size);
+void mpsc_queue_cleanup(mpsc_queue_t * queue);	// releases the slots only
+
+int mpsc_queue_push(mpsc_queue_t * queue, const void * item);	// 0: ok, -1: full
+int mpsc_queue_pop(mpsc_queue_t * queue, void * item);			// 0: ok, -1: empty
+ssize_t mpsc_queue_pop_batch(mpsc_queue_t * queue, void * items, size_t max_items);
+int mpsc_queue_is_empty(const mpsc_queue_t * queue);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
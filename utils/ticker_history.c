@@ -0,0 +1,534 @@
+/*
+ * ticker_history.c
+ *
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ticker_history.h"
+
+#define TICKER_HISTORY_MAGIC "TKHIST01"
+struct ticker_history_header
+{
+	char magic[8];
+	uint32_t page_size;
+	uint32_t num_columns;
+	uint64_t capacity;
+	uint64_t total;		// updated after the columns are written
+};
+
+#define TICKER_HISTORY_LOD_MIN_SHIFT (4)	// finest pyramid level: 16 tickers per node
+#define TICKER_HISTORY_LOD_MAX_LEVELS (48)
+
+struct lod_node
+{
+	double first;
+	double last;
+	double min;
+	double max;
+};
+
+struct lod_level
+{
+	struct lod_node * nodes;	// ring, node of absolute index i: (i >> shift) % num_nodes
+	size_t num_nodes;
+};
+
+typedef struct ticker_history_private
+{
+	int fd;
+	size_t page_size;
+	size_t column_size;		// capacity * 8, page aligned
+	
+	struct ticker_history_header * header;	// mapped header page
+	unsigned char * columns[TICKER_HISTORY_COLUMNS_COUNT];	// each mapped twice (2 * column_size)
+	
+	// decimation pyramid, level l: 2^(TICKER_HISTORY_LOD_MIN_SHIFT + l) tickers per node
+	int num_levels;
+	struct lod_level levels[TICKER_HISTORY_LOD_MAX_LEVELS];
+	struct lod_node * lod_nodes;	// all levels
+}ticker_history_private_t;
+
+/*****************************************************
+ * decimation pyramid
+*****************************************************/
+static int lod_init(ticker_history_private_t * priv, uint64_t capacity)
+{
+	size_t num_nodes = 0;
+	int num_levels = 0;
+	
+	// a node larger than the capacity could never be complete
+	for(; num_levels < TICKER_HISTORY_LOD_MAX_LEVELS; ++num_levels) {
+		int shift = TICKER_HISTORY_LOD_MIN_SHIFT + num_levels;
+		if((UINT64_C(1) << shift) > capacity) break;
+		
+		// +2: the kept range can straddle one more node than it fills
+		priv->levels[num_levels].num_nodes = (capacity >> shift) + 2;
+		num_nodes += priv->levels[num_levels].num_nodes;
+	}
+	priv->num_levels = num_levels;
+	if(0 == num_levels) return 0;
+	
+	priv->lod_nodes = calloc(num_nodes, sizeof(*priv->lod_nodes));
+	if(NULL == priv->lod_nodes) return -1;
+	
+	struct lod_node * nodes = priv->lod_nodes;
+	for(int l = 0; l < num_levels; ++l) {
+		priv->levels[l].nodes = nodes;
+		nodes += priv->levels[l].num_nodes;
+	}
+	return 0;
+}
+
+static inline void lod_update(ticker_history_private_t * priv, uint64_t index, double value)
+{
+	for(int l = 0; l < priv->num_levels; ++l) {
+		int shift = TICKER_HISTORY_LOD_MIN_SHIFT + l;
+		struct lod_level * level = &priv->levels[l];
+		struct lod_node * node = &level->nodes[(index >> shift) % level->num_nodes];
+		
+		if(0 == (index & ((UINT64_C(1) << shift) - 1))) {	// first ticker of the node
+			node->first = node->last = node->min = node->max = value;
+			continue;
+		}
+		node->last = value;
+		if(value < node->min) node->min = value;
+		if(value > node->max) node->max = value;
+	}
+}
+
+// nodes which straddle the start of the kept range are never read (see lod_aggregate())
+static void lod_rebuild(ticker_history_t * history)
+{
+	ticker_history_private_t * priv = history->priv;
+	const double * last = (const double *)priv->columns[TICKER_HISTORY_COLUMN_last];
+	for(uint64_t i = history->total - history->length; i < history->total; ++i) {
+		lod_update(priv, i, last[i % history->capacity]);
+	}
+}
+
+static inline void bucket_merge(struct ticker_history_bucket * bucket, 
+	double first, double last, double min, double max, uint64_t count)
+{
+	if(0 == bucket->count) {
+		bucket->first = first;
+		bucket->min = min;
+		bucket->max = max;
+	}else {
+		if(min < bucket->min) bucket->min = min;
+		if(max > bucket->max) bucket->max = max;
+	}
+	bucket->last = last;
+	bucket->count += count;
+}
+
+// [begin, end) inside the kept range: the largest aligned node that fits, raw tickers at the edges
+static void lod_aggregate(ticker_history_t * history, uint64_t begin, uint64_t end, struct ticker_history_bucket * bucket)
+{
+	ticker_history_private_t * priv = history->priv;
+	const double * last = (const double *)priv->columns[TICKER_HISTORY_COLUMN_last];
+	const int64_t * timestamp = (const int64_t *)priv->columns[TICKER_HISTORY_COLUMN_timestamp];
+	const uint64_t min_size = UINT64_C(1) << TICKER_HISTORY_LOD_MIN_SHIFT;
+	
+	memset(bucket, 0, sizeof(*bucket));
+	if(begin >= end) return;
+	bucket->timestamp = timestamp[begin % history->capacity];
+	
+	uint64_t pos = begin;
+	while(pos < end) {
+		if(priv->num_levels == 0 || (pos & (min_size - 1)) || (end - pos) < min_size) {
+			double value = last[pos % history->capacity];
+			bucket_merge(bucket, value, value, value, value, 1);
+			++pos;
+			continue;
+		}
+		
+		int level_align = (pos?__builtin_ctzll(pos):63) - TICKER_HISTORY_LOD_MIN_SHIFT;
+		int level_fit = (63 - __builtin_clzll(end - pos)) - TICKER_HISTORY_LOD_MIN_SHIFT;
+		int l = (level_align < level_fit)?level_align:level_fit;
+		if(l >= priv->num_levels) l = priv->num_levels - 1;
+		
+		int shift = TICKER_HISTORY_LOD_MIN_SHIFT + l;
+		const struct lod_level * level = &priv->levels[l];
+		const struct lod_node * node = &level->nodes[(pos >> shift) % level->num_nodes];
+		bucket_merge(bucket, node->first, node->last, node->min, node->max, UINT64_C(1) << shift);
+		pos += UINT64_C(1) << shift;
+	}
+}
+
+
+static void unmap_all(ticker_history_private_t * priv)
+{
+	for(int i = 0; i < TICKER_HISTORY_COLUMNS_COUNT; ++i) {
+		if(priv->columns[i]) munmap(priv->columns[i], priv->column_size * 2);
+		priv->columns[i] = NULL;
+	}
+	if(priv->header) munmap(priv->header, priv->page_size);
+	priv->header = NULL;
+	
+	free(priv->lod_nodes);
+	priv->lod_nodes = NULL;
+	priv->num_levels = 0;
+	return;
+}
+
+// reserve 2 * column_size of address space, then map the same file region into both halves
+static unsigned char * map_column_twice(int fd, off_t offset, size_t column_size)
+{
+	unsigned char * addr = mmap(NULL, column_size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(addr == MAP_FAILED) return NULL;
+	
+	void * p1 = mmap(addr, column_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, offset);
+	void * p2 = mmap(addr + column_size, column_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, offset);
+	if(p1 == MAP_FAILED || p2 == MAP_FAILED) {
+		munmap(addr, column_size * 2);
+		return NULL;
+	}
+	return addr;
+}
+
+ticker_history_t * ticker_history_init(ticker_history_t * history, const char * path, size_t capacity)
+{
+	assert(capacity > 0);
+	int is_allocated = 0;
+	if(NULL == history) {
+		history = calloc(1, sizeof(*history));
+		assert(history);
+		is_allocated = 1;
+	}
+	
+	ticker_history_private_t * priv = calloc(1, sizeof(*priv));
+	assert(priv);
+	priv->fd = -1;
+	history->priv = priv;
+	
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	size_t items_per_page = page_size / sizeof(double);
+	capacity = (capacity + items_per_page - 1) / items_per_page * items_per_page;
+	
+	priv->page_size = page_size;
+	priv->column_size = capacity * sizeof(double);
+	history->capacity = capacity;
+	
+	int fd = -1;
+	if(path) fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	else fd = memfd_create("ticker_history", MFD_CLOEXEC);
+	if(fd < 0) {
+		perror("ticker_history_init::open()");
+		goto label_error;
+	}
+	priv->fd = fd;
+	
+	off_t file_size = page_size + priv->column_size * TICKER_HISTORY_COLUMNS_COUNT;
+	struct stat st[1];
+	memset(st, 0, sizeof(st));
+	fstat(fd, st);
+	
+	// check the existing header before the file is resized
+	int is_valid = 0;
+	if(st->st_size == file_size) {
+		struct ticker_history_header header;
+		if(pread(fd, &header, sizeof(header), 0) == sizeof(header)) {
+			is_valid = (memcmp(header.magic, TICKER_HISTORY_MAGIC, 8) == 0)
+				&& header.page_size == page_size
+				&& header.num_columns == TICKER_HISTORY_COLUMNS_COUNT
+				&& header.capacity == capacity;
+		}
+	}
+	if(!is_valid) {
+		// sparse file, pages are allocated on first touch
+		if(ftruncate(fd, 0) || ftruncate(fd, file_size)) {
+			perror("ticker_history_init::ftruncate()");
+			goto label_error;
+		}
+	}
+	
+	priv->header = mmap(NULL, page_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(priv->header == MAP_FAILED) {
+		priv->header = NULL;
+		goto label_error;
+	}
+	for(int i = 0; i < TICKER_HISTORY_COLUMNS_COUNT; ++i) {
+		priv->columns[i] = map_column_twice(fd, page_size + priv->column_size * i, priv->column_size);
+		if(NULL == priv->columns[i]) {
+			perror("ticker_history_init::mmap()");
+			goto label_error;
+		}
+	}
+	
+	struct ticker_history_header * header = priv->header;
+	if(!is_valid) {
+		memcpy(header->magic, TICKER_HISTORY_MAGIC, 8);
+		header->page_size = page_size;
+		header->num_columns = TICKER_HISTORY_COLUMNS_COUNT;
+		header->capacity = capacity;
+		header->total = 0;
+	}
+	history->total = header->total;
+	history->length = (history->total < capacity)?history->total:capacity;
+	
+	if(lod_init(priv, capacity)) goto label_error;
+	lod_rebuild(history);
+	return history;
+	
+label_error:
+	ticker_history_cleanup(history);
+	if(is_allocated) free(history);
+	return NULL;
+}
+
+void ticker_history_cleanup(ticker_history_t * history)
+{
+	if(NULL == history || NULL == history->priv) return;
+	ticker_history_private_t * priv = history->priv;
+	
+	ticker_history_sync(history);
+	unmap_all(priv);
+	if(priv->fd >= 0) close(priv->fd);
+	free(priv);
+	history->priv = NULL;
+	return;
+}
+
+int ticker_history_sync(ticker_history_t * history)
+{
+	assert(history && history->priv);
+	ticker_history_private_t * priv = history->priv;
+	if(NULL == priv->header) return -1;
+	
+	// only the first half of each mirrored column, both halves share the same pages
+	for(int i = 0; i < TICKER_HISTORY_COLUMNS_COUNT; ++i) {
+		if(priv->columns[i]) msync(priv->columns[i], priv->column_size, MS_ASYNC);
+	}
+	return msync(priv->header, priv->page_size, MS_ASYNC);
+}
+
+int ticker_history_append(ticker_history_t * history, const struct ticker_history_record * record)
+{
+	assert(history && history->priv && record);
+	ticker_history_private_t * priv = history->priv;
+	
+	size_t pos = history->total % history->capacity;
+	((int64_t *)priv->columns[TICKER_HISTORY_COLUMN_timestamp])[pos] = record->timestamp;
+	((double *)priv->columns[TICKER_HISTORY_COLUMN_last])[pos] = record->last;
+	((double *)priv->columns[TICKER_HISTORY_COLUMN_bid])[pos] = record->bid;
+	((double *)priv->columns[TICKER_HISTORY_COLUMN_ask])[pos] = record->ask;
+	((double *)priv->columns[TICKER_HISTORY_COLUMN_high])[pos] = record->high;
+	((double *)priv->columns[TICKER_HISTORY_COLUMN_low])[pos] = record->low;
+	((double *)priv->columns[TICKER_HISTORY_COLUMN_volume])[pos] = record->volume;
+	lod_update(priv, history->total, record->last);
+	
+	// publish the record after its columns
+	++history->total;
+	__atomic_store_n(&priv->header->total, history->total, __ATOMIC_RELEASE);
+	if(history->length < history->capacity) ++history->length;
+	return 0;
+}
+
+ssize_t ticker_history_get_latest(ticker_history_t * history, size_t count, struct ticker_history_view * view)
+{
+	assert(history && history->priv);
+	ticker_history_private_t * priv = history->priv;
+	if(count == 0 || count > history->length) count = history->length;
+	if(NULL == view) return (ssize_t)count;
+	
+	memset(view, 0, sizeof(*view));
+	view->count = count;
+	if(count == 0) return 0;
+	
+	// start + count <= 2 * capacity: always inside the mirrored mapping
+	size_t start = (history->total - count) % history->capacity;
+	view->timestamp = (const int64_t *)priv->columns[TICKER_HISTORY_COLUMN_timestamp] + start;
+	view->last = (const double *)priv->columns[TICKER_HISTORY_COLUMN_last] + start;
+	view->bid = (const double *)priv->columns[TICKER_HISTORY_COLUMN_bid] + start;
+	view->ask = (const double *)priv->columns[TICKER_HISTORY_COLUMN_ask] + start;
+	view->high = (const double *)priv->columns[TICKER_HISTORY_COLUMN_high] + start;
+	view->low = (const double *)priv->columns[TICKER_HISTORY_COLUMN_low] + start;
+	view->volume = (const double *)priv->columns[TICKER_HISTORY_COLUMN_volume] + start;
+	return (ssize_t)count;
+}
+
+ssize_t ticker_history_decimate(ticker_history_t * history, uint64_t begin, uint64_t end, 
+	size_t count, struct ticker_history_bucket * buckets)
+{
+	assert(history && history->priv);
+	uint64_t oldest = history->total - history->length;
+	if(begin < oldest) begin = oldest;
+	if(end > history->total) end = history->total;
+	if(begin >= end || count == 0) return 0;
+	assert(buckets);
+	
+	uint64_t span = end - begin;
+	for(size_t i = 0; i < count; ++i) {
+		lod_aggregate(history, begin + span * i / count, begin + span * (i + 1) / count, &buckets[i]);
+	}
+	return (ssize_t)count;
+}
+
+uint64_t ticker_history_find(ticker_history_t * history, int64_t timestamp)
+{
+	assert(history && history->priv);
+	ticker_history_private_t * priv = history->priv;
+	const int64_t * timestamps = (const int64_t *)priv->columns[TICKER_HISTORY_COLUMN_timestamp];
+	
+	uint64_t lo = history->total - history->length;
+	uint64_t hi = history->total;
+	while(lo < hi) {
+		uint64_t mid = lo + (hi - lo) / 2;
+		if(timestamps[mid % history->capacity] < timestamp) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo;
+}
+
+
+#if defined(_TEST_TICKER_HISTORY) && defined(_STAND_ALONE)
+// every bucket of decimate() against a plain scan of the kept tickers
+static void check_decimate(ticker_history_t * history, uint64_t begin, uint64_t end, size_t count)
+{
+	struct ticker_history_view view[1];
+	ssize_t length = ticker_history_get_latest(history, 0, view);
+	uint64_t oldest = history->total - length;
+	struct ticker_history_bucket * buckets = calloc(count, sizeof(*buckets));
+	assert(buckets);
+	
+	ssize_t n = ticker_history_decimate(history, begin, end, count, buckets);
+	if(begin < oldest) begin = oldest;
+	if(end > history->total) end = history->total;
+	if(begin >= end) {
+		assert(n == 0);
+		free(buckets);
+		return;
+	}
+	assert(n == (ssize_t)count);
+	
+	uint64_t span = end - begin;
+	for(size_t i = 0; i < count; ++i) {
+		uint64_t a = begin + span * i / count, b = begin + span * (i + 1) / count;
+		const struct ticker_history_bucket * bucket = &buckets[i];
+		assert(bucket->count == b - a);
+		if(a == b) continue;
+		
+		const double * last = view->last + (a - oldest);
+		double min = last[0], max = last[0];
+		for(uint64_t k = 1; k < b - a; ++k) {
+			if(last[k] < min) min = last[k];
+			if(last[k] > max) max = last[k];
+		}
+		assert(bucket->timestamp == view->timestamp[a - oldest]);
+		assert(bucket->first == last[0] && bucket->last == last[b - a - 1]);
+		assert(bucket->min == min && bucket->max == max);
+	}
+	free(buckets);
+}
+
+static void check_decimate_ranges(ticker_history_t * history)
+{
+	uint64_t total = history->total;
+	uint64_t oldest = total - history->length;
+	static const size_t counts[] = { 1, 3, 7, 100, 1000, 2000 };
+	for(size_t k = 0; k < sizeof(counts) / sizeof(counts[0]); ++k) {
+		check_decimate(history, 0, total, counts[k]);
+		check_decimate(history, oldest + 1, total - 1, counts[k]);
+		check_decimate(history, oldest + 17, oldest + 17 + 33, counts[k]);
+		check_decimate(history, total - 100, total + 100, counts[k]);
+	}
+	for(uint64_t begin = oldest; begin < total; begin += 37) {
+		check_decimate(history, begin, begin + 1 + (begin * 7919) % 600, 5);
+	}
+	check_decimate(history, total, total + 10, 10);
+}
+
+int main(int argc, char ** argv) 
+{
+	const char * path = "/tmp/test_ticker_history.dat";
+	unlink(path);
+	
+	ticker_history_t history[1];
+	memset(history, 0, sizeof(history));
+	ticker_history_t * p = ticker_history_init(history, path, 1000);
+	assert(p && history->capacity == 1024);
+	
+	// wrap around: the latest entries must still be contiguous
+	for(int i = 0; i < 1500; ++i) {
+		struct ticker_history_record record = { .timestamp = i, .last = i * 10.0, .volume = i * 0.1 };
+		ticker_history_append(history, &record);
+		if(i == 700) check_decimate_ranges(history);
+	}
+	check_decimate_ranges(history);
+	assert(ticker_history_find(history, 0) == 1500 - 1024);
+	assert(ticker_history_find(history, 1000) == 1000);
+	assert(ticker_history_find(history, 5000) == 1500);
+	struct ticker_history_view view[1];
+	ssize_t count = ticker_history_get_latest(history, 1000, view);
+	assert(count == 1000);
+	for(ssize_t i = 0; i < count; ++i) {
+		assert(view->timestamp[i] == 500 + i);
+		assert(view->last[i] == (500 + i) * 10.0);
+	}
+	ticker_history_cleanup(history);
+	
+	// reopen: persisted
+	p = ticker_history_init(history, path, 1000);
+	assert(p && history->total == 1500 && history->length == 1024);
+	count = ticker_history_get_latest(history, 0, view);
+	assert(count == 1024);
+	assert(view->timestamp[0] == 1500 - 1024 && view->timestamp[count - 1] == 1499);
+	check_decimate_ranges(history);	// the pyramid is rebuilt on init()
+	
+	// random walk, several wrap arounds
+	uint32_t seed = 12345;
+	double value = 3000000.0;
+	for(int i = 0; i < 5000; ++i) {
+		seed = seed * 1103515245 + 12345;
+		value += (double)((int)(seed >> 16) % 2001 - 1000);
+		struct ticker_history_record record = { .timestamp = 1500 + i, .last = value };
+		ticker_history_append(history, &record);
+		if(i % 997 == 0) check_decimate_ranges(history);
+	}
+	check_decimate_ranges(history);
+	ticker_history_cleanup(history);
+	
+	// a different capacity discards the old file
+	p = ticker_history_init(history, path, 5000);
+	assert(p && history->total == 0);
+	ticker_history_cleanup(history);
+	unlink(path);
+	
+	printf("ticker_history: OK\n");
+	return 0;
+}
+#endif
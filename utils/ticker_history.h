@@ -0,0 +1,107 @@
+#ifndef CHLIB_TICKER_HISTORY_H_
+#define CHLIB_TICKER_HISTORY_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************
+ * ticker_history:
+ *   memory-mapped, column-oriented ring buffer of tickers.
+ *
+ *   file layout: [header page] [timestamp column] [last column] ... [volume column]
+ *   each column is page aligned and mapped twice back-to-back,
+ *   so the latest N entries are always one contiguous (zero-copy) span.
+ *   the file is sparse, pages are only touched when they are used.
+ *
+ *   single writer; views stay valid until the next append().
+*****************************************************/
+enum ticker_history_column
+{
+	TICKER_HISTORY_COLUMN_timestamp,	// int64_t
+	TICKER_HISTORY_COLUMN_last,		// double
+	TICKER_HISTORY_COLUMN_bid,
+	TICKER_HISTORY_COLUMN_ask,
+	TICKER_HISTORY_COLUMN_high,
+	TICKER_HISTORY_COLUMN_low,
+	TICKER_HISTORY_COLUMN_volume,
+	TICKER_HISTORY_COLUMNS_COUNT
+};
+
+struct ticker_history_record
+{
+	int64_t timestamp;	// ms
+	double last;
+	double bid;
+	double ask;
+	double high;
+	double low;
+	double volume;
+};
+
+struct ticker_history_view
+{
+	size_t count;
+	const int64_t * timestamp;
+	const double * last;
+	const double * bid;
+	const double * ask;
+	const double * high;
+	const double * low;
+	const double * volume;
+};
+
+typedef struct ticker_history
+{
+	void * priv;
+	size_t capacity;	// rounded up to a multiple of (page_size / 8)
+	size_t length;		// min(total, capacity)
+	uint64_t total;		// number of records ever appended
+}ticker_history_t;
+
+// path: NULL ==> anonymous (not persistent)
+// an existing file with a different capacity is discarded.
+ticker_history_t * ticker_history_init(ticker_history_t * history, const char * path, size_t capacity);
+void ticker_history_cleanup(ticker_history_t * history);
+
+int ticker_history_append(ticker_history_t * history, const struct ticker_history_record * record);
+ssize_t ticker_history_get_latest(ticker_history_t * history, size_t count, struct ticker_history_view * view);
+int ticker_history_sync(ticker_history_t * history);	// msync(), called by cleanup()
+
+/*****************************************************
+ * decimation (level of detail) of the 'last' column:
+ *   a pyramid of first / last / min / max buckets of 16, 32, 64 ... tickers,
+ *   aligned on absolute indices, updated by append() in O(levels)
+ *   and rebuilt in memory by init() (it is not persisted).
+ *
+ *   decimate() splits [begin, end) into @count buckets, each one is aggregated from
+ *   at most 2 pyramid nodes per level plus the < 16 raw tickers at its edges,
+ *   so a chart costs O(pixels) whatever the number of tickers it covers.
+ *
+ *   absolute index: 0 .. total - 1, only [total - length, total) is kept.
+*****************************************************/
+struct ticker_history_bucket
+{
+	uint64_t count;		// tickers, 0: empty bucket (the other fields are undefined)
+	int64_t timestamp;	// of the first ticker
+	double first;
+	double last;
+	double min;
+	double max;
+};
+
+// [begin, end) is clipped to the kept range, return the number of buckets written (@count or 0)
+ssize_t ticker_history_decimate(ticker_history_t * history, uint64_t begin, uint64_t end, 
+	size_t count, struct ticker_history_bucket * buckets);
+// absolute index of the first kept ticker with (timestamp >= @timestamp), total if none
+// (timestamps are expected to be non-decreasing)
+uint64_t ticker_history_find(ticker_history_t * history, int64_t timestamp);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,984 @@
+/*
+ * trade_archive.c
+ * 
+ * Copyright 2021 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of 
+ * this software and associated documentation files (the "Software"), to deal in 
+ * the Software without restriction, including without limitation the rights to 
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+ * of the Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+ * SOFTWARE.
+ * 
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <limits.h>
+
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trade_archive.h"
+
+/************************************************
+ * on-disk layout
+************************************************/
+#define TRADE_SEGMENT_MAGIC "TRDSEG01"
+#define TRADE_INDEX_MAGIC 	"TRDIDX01"
+#define TRADE_BLOCK_MAGIC 	(0x314b4c42)	// "BLK1"
+#define TRADE_SEGMENT_VERSION (1)
+
+// id, timestamp, price, amount|side: at most 10 bytes each
+#define TRADE_BLOCK_MAX_PAYLOAD (TRADE_ARCHIVE_BLOCK_TRADES * 4 * 10)
+
+struct segment_header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t price_digits;
+	uint32_t amount_digits;
+	uint32_t reserved;
+	uint64_t seq;
+	char padding[32];
+}__attribute__((packed));
+
+struct block_header
+{
+	uint32_t magic;
+	uint32_t count;
+	uint32_t payload_size;
+	uint32_t checksum;	// FNV-1a of the payload
+	int64_t first_id;
+	int64_t last_id;
+	int64_t min_ts;
+	int64_t max_ts;
+}__attribute__((packed));
+
+struct block_index
+{
+	int64_t first_id;
+	int64_t last_id;
+	int64_t min_ts;
+	int64_t max_ts;
+	uint64_t offset;
+	uint32_t count;
+	uint32_t payload_size;
+}__attribute__((packed));
+
+struct segment_trailer
+{
+	uint64_t index_offset;
+	uint32_t num_blocks;
+	uint32_t reserved;
+	char magic[8];
+}__attribute__((packed));
+
+static uint32_t fnv1a(const unsigned char * data, size_t length)
+{
+	uint32_t hash = 2166136261u;
+	for(size_t i = 0; i < length; ++i) {
+		hash ^= data[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static inline size_t varint_encode(unsigned char * p, uint64_t value)
+{
+	size_t n = 0;
+	while(value >= 0x80) {
+		p[n++] = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+	p[n++] = (unsigned char)value;
+	return n;
+}
+
+static inline const unsigned char * varint_decode(const unsigned char * p, const unsigned char * p_end, uint64_t * p_value)
+{
+	uint64_t value = 0;
+	for(int shift = 0; p < p_end && shift < 64; shift += 7) {
+		unsigned char c = *p++;
+		value |= (uint64_t)(c & 0x7f) << shift;
+		if(0 == (c & 0x80)) {
+			*p_value = value;
+			return p;
+		}
+	}
+	return NULL;
+}
+
+static inline uint64_t zigzag_encode(int64_t value) { return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63); }
+static inline int64_t zigzag_decode(uint64_t value) { return (int64_t)(value >> 1) ^ -(int64_t)(value & 1); }
+
+static int64_t pow10_i64(int digits)
+{
+	int64_t scale = 1;
+	while(digits-- > 0) scale *= 10;
+	return scale;
+}
+
+/************************************************
+ * segment
+************************************************/
+struct segment
+{
+	struct segment * next_to_seal;
+	uint64_t seq;
+	char path[PATH_MAX];
+	int fd;
+	int is_sealed;
+	
+	int64_t price_scale;
+	int64_t amount_scale;
+	
+	unsigned char * map;	// sealed only
+	size_t map_size;
+	off_t size;				// end of the last block
+	
+	size_t num_blocks;
+	size_t max_blocks;
+	struct block_index * index;	// sealed: points into the map
+	
+	int64_t first_id;
+	int64_t last_id;
+	int64_t min_ts;
+	int64_t max_ts;
+};
+
+static void segment_free(struct segment * seg)
+{
+	if(NULL == seg) return;
+	if(seg->map) munmap(seg->map, seg->map_size);
+	else free(seg->index);
+	if(seg->fd >= 0) close(seg->fd);
+	free(seg);
+	return;
+}
+
+static struct segment * segment_new(uint64_t seq, const char * path)
+{
+	struct segment * seg = calloc(1, sizeof(*seg));
+	assert(seg);
+	seg->seq = seq;
+	seg->fd = -1;
+	seg->min_ts = INT64_MAX;
+	seg->max_ts = INT64_MIN;
+	snprintf(seg->path, sizeof(seg->path), "%s", path);
+	return seg;
+}
+
+static void segment_add_index(struct segment * seg, const struct block_index * entry)
+{
+	if(seg->num_blocks >= seg->max_blocks) {
+		size_t new_size = seg->max_blocks?(seg->max_blocks * 2):256;
+		struct block_index * index = realloc(seg->index, new_size * sizeof(*index));
+		assert(index);
+		seg->index = index;
+		seg->max_blocks = new_size;
+	}
+	seg->index[seg->num_blocks++] = *entry;
+	
+	if(seg->num_blocks == 1) seg->first_id = entry->first_id;
+	seg->last_id = entry->last_id;
+	if(entry->min_ts < seg->min_ts) seg->min_ts = entry->min_ts;
+	if(entry->max_ts > seg->max_ts) seg->max_ts = entry->max_ts;
+	return;
+}
+
+static int segment_set_header(struct segment * seg, const struct segment_header * hdr)
+{
+	if(memcmp(hdr->magic, TRADE_SEGMENT_MAGIC, 8) != 0 || hdr->version != TRADE_SEGMENT_VERSION) return -1;
+	if(hdr->price_digits > 12 || hdr->amount_digits > 12) return -1;
+	seg->price_scale = pow10_i64(hdr->price_digits);
+	seg->amount_scale = pow10_i64(hdr->amount_digits);
+	return 0;
+}
+
+static int pread_all(int fd, void * buf, size_t size, off_t offset)
+{
+	unsigned char * p = buf;
+	while(size > 0) {
+		ssize_t cb = pread(fd, p, size, offset);
+		if(cb < 0 && errno == EINTR) continue;
+		if(cb <= 0) return -1;
+		p += cb;
+		size -= cb;
+		offset += cb;
+	}
+	return 0;
+}
+
+static int pwrite_all(int fd, const void * buf, size_t size, off_t offset)
+{
+	const unsigned char * p = buf;
+	while(size > 0) {
+		ssize_t cb = pwrite(fd, p, size, offset);
+		if(cb < 0 && errno == EINTR) continue;
+		if(cb <= 0) return -1;
+		p += cb;
+		size -= cb;
+		offset += cb;
+	}
+	return 0;
+}
+
+// sealed segment: [header] [blocks] [index] [trailer], everything is read through the map
+static struct segment * segment_open_sealed(uint64_t seq, const char * path)
+{
+	struct segment * seg = segment_new(seq, path);
+	int fd = open(path, O_RDONLY);
+	struct stat st[1];
+	if(fd < 0 || fstat(fd, st) != 0) goto label_error;
+	
+	size_t size = st->st_size;
+	if(size < sizeof(struct segment_header) + sizeof(struct segment_trailer)) goto label_error;
+	
+	unsigned char * map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if(map == MAP_FAILED) goto label_error;
+	close(fd);
+	fd = -1;
+	seg->map = map;
+	seg->map_size = size;
+	
+	if(segment_set_header(seg, (const struct segment_header *)map) != 0) goto label_error;
+	
+	const struct segment_trailer * trailer = (const struct segment_trailer *)(map + size - sizeof(*trailer));
+	if(memcmp(trailer->magic, TRADE_INDEX_MAGIC, 8) != 0) goto label_error;
+	if(trailer->index_offset + (uint64_t)trailer->num_blocks * sizeof(struct block_index) + sizeof(*trailer) != size) goto label_error;
+	
+	seg->is_sealed = 1;
+	seg->size = trailer->index_offset;
+	seg->index = (struct block_index *)(map + trailer->index_offset);
+	seg->num_blocks = trailer->num_blocks;
+	seg->max_blocks = trailer->num_blocks;
+	for(size_t i = 0; i < seg->num_blocks; ++i) {
+		const struct block_index * entry = &seg->index[i];
+		if(i == 0) seg->first_id = entry->first_id;
+		seg->last_id = entry->last_id;
+		if(entry->min_ts < seg->min_ts) seg->min_ts = entry->min_ts;
+		if(entry->max_ts > seg->max_ts) seg->max_ts = entry->max_ts;
+	}
+	return seg;
+	
+label_error:
+	fprintf(stderr, "[ERROR]: %s(%s): invalid segment\n", __FUNCTION__, path);
+	if(fd >= 0) close(fd);
+	segment_free(seg);
+	return NULL;
+}
+
+// unsealed segment: rebuild the index from the block headers, drop a torn block at the end
+static struct segment * segment_open_active(uint64_t seq, const char * path, unsigned char * buf)
+{
+	struct segment * seg = segment_new(seq, path);
+	int fd = open(path, O_RDWR);
+	struct stat st[1];
+	if(fd < 0 || fstat(fd, st) != 0) goto label_error;
+	seg->fd = fd;
+	
+	struct segment_header hdr[1];
+	if(pread_all(fd, hdr, sizeof(hdr), 0) != 0 || segment_set_header(seg, hdr) != 0) goto label_error;
+	
+	off_t offset = sizeof(hdr);
+	while(offset + (off_t)sizeof(struct block_header) <= st->st_size) {
+		struct block_header block[1];
+		if(pread_all(fd, block, sizeof(block), offset) != 0) break;
+		if(block->magic != TRADE_BLOCK_MAGIC 
+			|| block->count == 0 || block->count > TRADE_ARCHIVE_BLOCK_TRADES
+			|| block->payload_size > TRADE_BLOCK_MAX_PAYLOAD
+			|| offset + (off_t)(sizeof(block) + block->payload_size) > st->st_size) break;
+		if(pread_all(fd, buf, block->payload_size, offset + sizeof(block)) != 0) break;
+		if(fnv1a(buf, block->payload_size) != block->checksum) break;
+		
+		struct block_index entry = {
+			.first_id = block->first_id, .last_id = block->last_id,
+			.min_ts = block->min_ts, .max_ts = block->max_ts,
+			.offset = offset, .count = block->count, .payload_size = block->payload_size,
+		};
+		segment_add_index(seg, &entry);
+		offset += sizeof(block) + block->payload_size;
+	}
+	if(offset < st->st_size) {
+		fprintf(stderr, "[WARNING]: %s(%s): drop %ld bytes of a torn block\n", __FUNCTION__, path, (long)(st->st_size - offset));
+		if(ftruncate(fd, offset) != 0) goto label_error;
+	}
+	seg->size = offset;
+	return seg;
+	
+label_error:
+	fprintf(stderr, "[ERROR]: %s(%s): invalid segment\n", __FUNCTION__, path);
+	segment_free(seg);
+	return NULL;
+}
+
+/************************************************
+ * block codec
+************************************************/
+static size_t encode_block(const struct segment * seg, const struct trade_record * trades, size_t count, unsigned char * buf)
+{
+	assert(count > 0 && count <= TRADE_ARCHIVE_BLOCK_TRADES);
+	struct block_header * hdr = (struct block_header *)buf;
+	unsigned char * p = buf + sizeof(*hdr);
+	
+	hdr->magic = TRADE_BLOCK_MAGIC;
+	hdr->count = count;
+	hdr->first_id = trades[0].id;
+	hdr->last_id = trades[count - 1].id;
+	hdr->min_ts = INT64_MAX;
+	hdr->max_ts = INT64_MIN;
+	
+	int64_t prev_id = trades[0].id - 1;
+	int64_t prev_ts = 0;
+	int64_t prev_price = 0;
+	for(size_t i = 0; i < count; ++i) {
+		const struct trade_record * trade = &trades[i];
+		int64_t price = llround(trade->price * seg->price_scale);
+		int64_t amount = llround(trade->amount * seg->amount_scale);
+		if(amount < 0) amount = 0;
+		
+		p += varint_encode(p, (uint64_t)(trade->id - prev_id - 1));	// ascending
+		p += varint_encode(p, zigzag_encode(trade->timestamp - prev_ts));
+		p += varint_encode(p, zigzag_encode(price - prev_price));
+		p += varint_encode(p, ((uint64_t)amount << 1) | (trade->side == TRADE_SIDE_sell));
+		
+		prev_id = trade->id;
+		prev_ts = trade->timestamp;
+		prev_price = price;
+		if(trade->timestamp < hdr->min_ts) hdr->min_ts = trade->timestamp;
+		if(trade->timestamp > hdr->max_ts) hdr->max_ts = trade->timestamp;
+	}
+	hdr->payload_size = p - (buf + sizeof(*hdr));
+	assert(hdr->payload_size <= TRADE_BLOCK_MAX_PAYLOAD);
+	hdr->checksum = fnv1a(buf + sizeof(*hdr), hdr->payload_size);
+	return p - buf;
+}
+
+enum scan_mode
+{
+	SCAN_MODE_by_time,
+	SCAN_MODE_by_id,
+};
+
+struct scan_params
+{
+	enum scan_mode mode;
+	int64_t begin;
+	int64_t end;
+	trade_archive_scan_callback callback;
+	void * user_data;
+	ssize_t count;
+};
+
+static inline int scan_filter(struct scan_params * params, const struct trade_record * trade)
+{
+	int64_t key = (params->mode == SCAN_MODE_by_id)?trade->id:trade->timestamp;
+	if(key < params->begin || key >= params->end) return 0;
+	++params->count;
+	return params->callback(trade, params->user_data)?-1:0;
+}
+
+// return -1: stopped by the callback, -2: corrupted block
+static int decode_block(const struct segment * seg, const struct block_index * entry, const unsigned char * payload, struct scan_params * params)
+{
+	const unsigned char * p = payload;
+	const unsigned char * p_end = payload + entry->payload_size;
+	
+	int64_t prev_id = entry->first_id - 1;
+	int64_t prev_ts = 0;
+	int64_t prev_price = 0;
+	for(uint32_t i = 0; i < entry->count; ++i) {
+		uint64_t delta_id = 0, delta_ts = 0, delta_price = 0, amount_side = 0;
+		if(NULL == (p = varint_decode(p, p_end, &delta_id))
+			|| NULL == (p = varint_decode(p, p_end, &delta_ts))
+			|| NULL == (p = varint_decode(p, p_end, &delta_price))
+			|| NULL == (p = varint_decode(p, p_end, &amount_side))) return -2;
+		
+		prev_id += (int64_t)delta_id + 1;
+		prev_ts += zigzag_decode(delta_ts);
+		prev_price += zigzag_decode(delta_price);
+		
+		struct trade_record trade = {
+			.id = prev_id,
+			.timestamp = prev_ts,
+			.price = (double)prev_price / seg->price_scale,
+			.amount = (double)(amount_side >> 1) / seg->amount_scale,
+			.side = (amount_side & 1)?TRADE_SIDE_sell:TRADE_SIDE_buy,
+		};
+		if(scan_filter(params, &trade)) return -1;
+	}
+	return 0;
+}
+
+/************************************************
+ * trade_archive_private
+************************************************/
+typedef struct trade_archive_private
+{
+	trade_archive_t * archive;
+	char dir[PATH_MAX / 2];
+	pthread_rwlock_t rwlock;
+	
+	size_t num_segments;
+	size_t max_segments;
+	struct segment ** segments;	// ascending seq, the last one is active
+	struct segment * active;
+	
+	// the block being filled
+	size_t num_pending;
+	struct trade_record pending[TRADE_ARCHIVE_BLOCK_TRADES];
+	unsigned char block_buf[sizeof(struct block_header) + TRADE_BLOCK_MAX_PAYLOAD];	// writer only
+	
+	// background sealing
+	pthread_t sealer;
+	int quit;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct segment * seal_head;
+	struct segment * seal_tail;
+}trade_archive_private_t;
+
+static trade_archive_private_t * trade_archive_private_new(trade_archive_t * archive)
+{
+	trade_archive_private_t * priv = calloc(1, sizeof(*priv));
+	assert(priv);
+	priv->archive = archive;
+	archive->priv = priv;
+	
+	int rc = pthread_rwlock_init(&priv->rwlock, NULL);
+	assert(0 == rc);
+	rc = pthread_mutex_init(&priv->mutex, NULL);
+	assert(0 == rc);
+	rc = pthread_cond_init(&priv->cond, NULL);
+	assert(0 == rc);
+	return priv;
+}
+
+static void trade_archive_private_free(trade_archive_private_t * priv)
+{
+	if(NULL == priv) return;
+	for(size_t i = 0; i < priv->num_segments; ++i) segment_free(priv->segments[i]);
+	free(priv->segments);
+	
+	pthread_cond_destroy(&priv->cond);
+	pthread_mutex_destroy(&priv->mutex);
+	pthread_rwlock_destroy(&priv->rwlock);
+	free(priv);
+	return;
+}
+
+static void add_segment(trade_archive_private_t * priv, struct segment * seg)
+{
+	if(priv->num_segments >= priv->max_segments) {
+		size_t new_size = priv->max_segments?(priv->max_segments * 2):64;
+		struct segment ** segments = realloc(priv->segments, new_size * sizeof(*segments));
+		assert(segments);
+		priv->segments = segments;
+		priv->max_segments = new_size;
+	}
+	priv->segments[priv->num_segments++] = seg;
+	priv->archive->num_segments = priv->num_segments;
+	return;
+}
+
+static struct segment * create_segment(trade_archive_private_t * priv, uint64_t seq)
+{
+	trade_archive_t * archive = priv->archive;
+	char path[PATH_MAX] = "";
+	snprintf(path, sizeof(path), "%s/%08lu.open", priv->dir, (unsigned long)seq);
+	
+	struct segment_header hdr = {
+		.magic = TRADE_SEGMENT_MAGIC,
+		.version = TRADE_SEGMENT_VERSION,
+		.price_digits = archive->price_digits,
+		.amount_digits = archive->amount_digits,
+		.seq = seq,
+	};
+	
+	struct segment * seg = segment_new(seq, path);
+	seg->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(seg->fd < 0 || pwrite_all(seg->fd, &hdr, sizeof(hdr), 0) != 0) {
+		perror("trade_archive::create_segment()");
+		segment_free(seg);
+		return NULL;
+	}
+	segment_set_header(seg, &hdr);
+	seg->size = sizeof(hdr);
+	return seg;
+}
+
+/************************************************
+ * background sealing
+************************************************/
+static int seal_segment(trade_archive_private_t * priv, struct segment * seg)
+{
+	// the writer does not touch the segment any more, the index is stable
+	struct segment_trailer trailer = {
+		.index_offset = seg->size,
+		.num_blocks = seg->num_blocks,
+		.magic = TRADE_INDEX_MAGIC,
+	};
+	size_t index_size = seg->num_blocks * sizeof(struct block_index);
+	size_t map_size = seg->size + index_size + sizeof(trailer);
+	
+	char path[PATH_MAX] = "";
+	snprintf(path, sizeof(path), "%s/%08lu.seg", priv->dir, (unsigned long)seg->seq);
+	
+	if(pwrite_all(seg->fd, seg->index, index_size, seg->size) != 0
+		|| pwrite_all(seg->fd, &trailer, sizeof(trailer), seg->size + index_size) != 0
+		|| ftruncate(seg->fd, map_size) != 0
+		|| fdatasync(seg->fd) != 0
+		|| rename(seg->path, path) != 0) {
+		perror("trade_archive::seal_segment()");
+		return -1;
+	}
+	
+	unsigned char * map = mmap(NULL, map_size, PROT_READ, MAP_SHARED, seg->fd, 0);
+	if(map == MAP_FAILED) {
+		perror("trade_archive::seal_segment()::mmap()");
+		snprintf(seg->path, sizeof(seg->path), "%s", path);
+		return -1;
+	}
+	
+	// swap the readers over to the mapped index
+	pthread_rwlock_wrlock(&priv->rwlock);
+	free(seg->index);
+	seg->index = (struct block_index *)(map + seg->size);
+	seg->max_blocks = seg->num_blocks;
+	seg->map = map;
+	seg->map_size = map_size;
+	close(seg->fd);
+	seg->fd = -1;
+	seg->is_sealed = 1;
+	snprintf(seg->path, sizeof(seg->path), "%s", path);
+	pthread_rwlock_unlock(&priv->rwlock);
+	return 0;
+}
+
+static void * sealer_thread(void * user_data)
+{
+	trade_archive_private_t * priv = user_data;
+	while(1) {
+		pthread_mutex_lock(&priv->mutex);
+		while(!priv->quit && NULL == priv->seal_head) pthread_cond_wait(&priv->cond, &priv->mutex);
+		
+		// drain the queue before quitting
+		struct segment * seg = priv->seal_head;
+		if(seg) {
+			priv->seal_head = seg->next_to_seal;
+			if(NULL == priv->seal_head) priv->seal_tail = NULL;
+			seg->next_to_seal = NULL;
+		}
+		pthread_mutex_unlock(&priv->mutex);
+		if(NULL == seg) break;
+		
+		seal_segment(priv, seg);
+	}
+	pthread_exit((void *)(intptr_t)0);
+}
+
+static void queue_seal(trade_archive_private_t * priv, struct segment * seg)
+{
+	pthread_mutex_lock(&priv->mutex);
+	if(priv->seal_tail) priv->seal_tail->next_to_seal = seg;
+	else priv->seal_head = seg;
+	priv->seal_tail = seg;
+	pthread_cond_signal(&priv->cond);
+	pthread_mutex_unlock(&priv->mutex);
+	return;
+}
+
+/************************************************
+ * writer
+************************************************/
+// (write-locked)
+static int write_block(trade_archive_private_t * priv)
+{
+	trade_archive_t * archive = priv->archive;
+	struct segment * seg = priv->active;
+	if(NULL == seg) return -1;
+	if(priv->num_pending == 0) return 0;
+	
+	size_t size = encode_block(seg, priv->pending, priv->num_pending, priv->block_buf);
+	if(pwrite_all(seg->fd, priv->block_buf, size, seg->size) != 0) {
+		perror("trade_archive::write_block()");
+		return -1;
+	}
+	
+	const struct block_header * hdr = (const struct block_header *)priv->block_buf;
+	struct block_index entry = {
+		.first_id = hdr->first_id, .last_id = hdr->last_id,
+		.min_ts = hdr->min_ts, .max_ts = hdr->max_ts,
+		.offset = seg->size, .count = hdr->count, .payload_size = hdr->payload_size,
+	};
+	segment_add_index(seg, &entry);
+	seg->size += size;
+	archive->num_bytes += size;
+	priv->num_pending = 0;
+	
+	if(seg->num_blocks >= TRADE_ARCHIVE_SEGMENT_BLOCKS) {
+		struct segment * next = create_segment(priv, seg->seq + 1);
+		if(next) {
+			add_segment(priv, next);
+			priv->active = next;
+			queue_seal(priv, seg);
+		}
+		// else: keep appending to the current segment, retried at the next block
+	}
+	return 0;
+}
+
+/************************************************
+ * reader
+************************************************/
+// (read-locked)
+static int scan_segment(struct segment * seg, struct scan_params * params, unsigned char * buf)
+{
+	size_t first = 0;
+	if(params->mode == SCAN_MODE_by_id) {
+		if(seg->last_id < params->begin || seg->first_id >= params->end) return 0;
+		
+		// ids are ascending: the first block with last_id >= begin
+		size_t lo = 0, hi = seg->num_blocks;
+		while(lo < hi) {
+			size_t mid = (lo + hi) / 2;
+			if(seg->index[mid].last_id < params->begin) lo = mid + 1;
+			else hi = mid;
+		}
+		first = lo;
+	}else {
+		if(seg->max_ts < params->begin || seg->min_ts >= params->end) return 0;
+	}
+	
+	for(size_t i = first; i < seg->num_blocks; ++i) {
+		const struct block_index * entry = &seg->index[i];
+		if(params->mode == SCAN_MODE_by_id) {
+			if(entry->first_id >= params->end) break;
+		}else if(entry->max_ts < params->begin || entry->min_ts >= params->end) continue;
+		
+		const unsigned char * payload = NULL;
+		if(seg->map) {
+			payload = seg->map + entry->offset + sizeof(struct block_header);
+		}else {
+			if(pread_all(seg->fd, buf, entry->payload_size, entry->offset + sizeof(struct block_header)) != 0) return -2;
+			payload = buf;
+		}
+		int rc = decode_block(seg, entry, payload, params);
+		if(rc) return rc;
+	}
+	return 0;
+}
+
+static ssize_t scan(trade_archive_private_t * priv, struct scan_params * params)
+{
+	unsigned char * buf = malloc(TRADE_BLOCK_MAX_PAYLOAD);
+	assert(buf);
+	
+	int rc = 0;
+	pthread_rwlock_rdlock(&priv->rwlock);
+	for(size_t i = 0; 0 == rc && i < priv->num_segments; ++i) {
+		rc = scan_segment(priv->segments[i], params, buf);
+	}
+	for(size_t i = 0; 0 == rc && i < priv->num_pending; ++i) {
+		rc = scan_filter(params, &priv->pending[i]);
+	}
+	pthread_rwlock_unlock(&priv->rwlock);
+	free(buf);
+	
+	if(rc == -2) {
+		fprintf(stderr, "[ERROR]: trade_archive(%s)::scan(): corrupted block\n", priv->dir);
+		return -1;
+	}
+	return params->count;
+}
+
+/************************************************
+ * trade_archive::member functions
+************************************************/
+static int trade_archive_append(struct trade_archive * archive, const struct trade_record * trade)
+{
+	assert(archive && archive->priv && trade);
+	trade_archive_private_t * priv = archive->priv;
+	
+	int rc = 0;
+	pthread_rwlock_wrlock(&priv->rwlock);
+	if(trade->id <= archive->last_id) rc = 1;
+	else if(priv->num_pending >= TRADE_ARCHIVE_BLOCK_TRADES) rc = write_block(priv);	// the previous write failed
+	
+	if(0 == rc) {
+		priv->pending[priv->num_pending++] = *trade;
+		archive->last_id = trade->id;
+		archive->last_timestamp = trade->timestamp;
+		++archive->num_trades;
+		if(priv->num_pending >= TRADE_ARCHIVE_BLOCK_TRADES) write_block(priv);
+	}
+	pthread_rwlock_unlock(&priv->rwlock);
+	return rc;
+}
+
+static int trade_archive_flush(struct trade_archive * archive)
+{
+	assert(archive && archive->priv);
+	trade_archive_private_t * priv = archive->priv;
+	
+	pthread_rwlock_wrlock(&priv->rwlock);
+	int rc = write_block(priv);
+	if(0 == rc && priv->active) rc = fdatasync(priv->active->fd);
+	pthread_rwlock_unlock(&priv->rwlock);
+	return rc;
+}
+
+static ssize_t trade_archive_scan_by_time(struct trade_archive * archive, int64_t begin_ms, int64_t end_ms, 
+	trade_archive_scan_callback callback, void * user_data)
+{
+	assert(archive && archive->priv && callback);
+	struct scan_params params = { .mode = SCAN_MODE_by_time, 
+		.begin = begin_ms, .end = end_ms, 
+		.callback = callback, .user_data = user_data };
+	return scan(archive->priv, &params);
+}
+
+static ssize_t trade_archive_scan_by_id(struct trade_archive * archive, int64_t begin_id, int64_t end_id, 
+	trade_archive_scan_callback callback, void * user_data)
+{
+	assert(archive && archive->priv && callback);
+	struct scan_params params = { .mode = SCAN_MODE_by_id, 
+		.begin = begin_id, .end = end_id, 
+		.callback = callback, .user_data = user_data };
+	return scan(archive->priv, &params);
+}
+
+/************************************************
+ * public interfaces
+************************************************/
+static int segment_file_filter(const struct dirent * entry)
+{
+	const char * ext = strrchr(entry->d_name, '.');
+	if(NULL == ext || ext == entry->d_name) return 0;
+	return (strcmp(ext, ".seg") == 0 || strcmp(ext, ".open") == 0);
+}
+
+static int load_segments(trade_archive_private_t * priv)
+{
+	trade_archive_t * archive = priv->archive;
+	struct dirent ** names = NULL;
+	int num_names = scandir(priv->dir, &names, segment_file_filter, alphasort);
+	if(num_names < 0) return -1;
+	
+	for(int i = 0; i < num_names; ++i) {
+		char path[PATH_MAX] = "";
+		snprintf(path, sizeof(path), "%s/%s", priv->dir, names[i]->d_name);
+		uint64_t seq = strtoull(names[i]->d_name, NULL, 10);
+		int is_sealed = (strcmp(strrchr(names[i]->d_name, '.'), ".seg") == 0);
+		free(names[i]);
+		
+		struct segment * seg = is_sealed?segment_open_sealed(seq, path)
+			:segment_open_active(seq, path, priv->block_buf);
+		if(NULL == seg) continue;
+		
+		// an unsealed segment followed by others was left by a crash during rotation
+		if(priv->active) queue_seal(priv, priv->active);
+		priv->active = is_sealed?NULL:seg;
+		add_segment(priv, seg);
+		
+		for(size_t block = 0; block < seg->num_blocks; ++block) {
+			archive->num_trades += seg->index[block].count;
+			archive->num_bytes += sizeof(struct block_header) + seg->index[block].payload_size;
+		}
+		if(seg->num_blocks > 0) {
+			archive->last_id = seg->last_id;
+			archive->last_timestamp = seg->max_ts;
+		}
+	}
+	free(names);
+	
+	if(priv->active && priv->active->num_blocks >= TRADE_ARCHIVE_SEGMENT_BLOCKS) {
+		queue_seal(priv, priv->active);
+		priv->active = NULL;
+	}
+	if(NULL == priv->active) {
+		uint64_t seq = priv->num_segments?(priv->segments[priv->num_segments - 1]->seq + 1):1;
+		priv->active = create_segment(priv, seq);
+		if(NULL == priv->active) return -1;
+		add_segment(priv, priv->active);
+	}
+	return 0;
+}
+
+trade_archive_t * trade_archive_init(trade_archive_t * archive, const char * dir, 
+	int price_digits, int amount_digits, void * user_data)
+{
+	assert(dir);
+	if(strlen(dir) >= PATH_MAX / 2) return NULL;
+	if(price_digits < 0 || price_digits > 12 || amount_digits < 0 || amount_digits > 12) return NULL;
+	if(mkdir(dir, 0755) != 0 && errno != EEXIST) {
+		perror("trade_archive_init()::mkdir()");
+		return NULL;
+	}
+	
+	int is_allocated = (NULL == archive);
+	if(NULL == archive) archive = calloc(1, sizeof(*archive));
+	assert(archive);
+	
+	archive->user_data = user_data;
+	archive->price_digits = price_digits;
+	archive->amount_digits = amount_digits;
+	archive->last_id = INT64_MIN;
+	archive->last_timestamp = 0;
+	archive->num_trades = 0;
+	archive->num_bytes = 0;
+	archive->num_segments = 0;
+	
+	archive->append = trade_archive_append;
+	archive->flush = trade_archive_flush;
+	archive->scan_by_time = trade_archive_scan_by_time;
+	archive->scan_by_id = trade_archive_scan_by_id;
+	
+	trade_archive_private_t * priv = trade_archive_private_new(archive);
+	assert(priv && priv == archive->priv);
+	snprintf(priv->dir, sizeof(priv->dir), "%s", dir);
+	
+	int rc = pthread_create(&priv->sealer, NULL, sealer_thread, priv);
+	assert(0 == rc);
+	
+	rc = load_segments(priv);
+	if(rc) {
+		fprintf(stderr, "[ERROR]: %s(%s): load segments failed\n", __FUNCTION__, dir);
+		trade_archive_cleanup(archive);
+		if(is_allocated) free(archive);
+		return NULL;
+	}
+	return archive;
+}
+
+void trade_archive_cleanup(trade_archive_t * archive)
+{
+	if(NULL == archive || NULL == archive->priv) return;
+	trade_archive_private_t * priv = archive->priv;
+	
+	// the active segment stays unsealed and is resumed by the next trade_archive_init()
+	if(priv->active) archive->flush(archive);
+	
+	pthread_mutex_lock(&priv->mutex);
+	priv->quit = 1;
+	pthread_cond_signal(&priv->cond);
+	pthread_mutex_unlock(&priv->mutex);
+	
+	void * exit_code = NULL;
+	pthread_join(priv->sealer, &exit_code);
+	
+	trade_archive_private_free(priv);
+	archive->priv = NULL;
+	return;
+}
+
+
+#if defined(_TEST_TRADE_ARCHIVE) && defined(_STAND_ALONE)
+struct scan_result
+{
+	int64_t first_id;
+	int64_t last_id;
+	ssize_t count;
+	int errors;
+};
+
+static int on_trade(const struct trade_record * trade, void * user_data)
+{
+	struct scan_result * result = user_data;
+	if(result->count == 0) result->first_id = trade->id;
+	else if(trade->id != result->last_id + 1) ++result->errors;
+	
+	// the generator below
+	int64_t i = trade->id - 1000;
+	if(trade->timestamp != 1600000000000LL + i * 250
+		|| trade->price != 5000000.0 + (i % 100) * 5 
+		|| trade->amount != 0.001 * (1 + i % 7)
+		|| trade->side != (i & 1)) ++result->errors;
+	
+	result->last_id = trade->id;
+	++result->count;
+	return 0;
+}
+
+int main(int argc, char ** argv)
+{
+	const char * dir = "/tmp/test_trade_archive";
+	system("rm -rf /tmp/test_trade_archive");
+	
+	trade_archive_t archive[1];
+	memset(archive, 0, sizeof(archive));
+	trade_archive_t * p = trade_archive_init(archive, dir, 0, 8, NULL);
+	assert(p);
+	
+	const int num_trades = TRADE_ARCHIVE_BLOCK_TRADES * TRADE_ARCHIVE_SEGMENT_BLOCKS * 2 + 100;
+	for(int i = 0; i < num_trades; ++i) {
+		struct trade_record trade = {
+			.id = 1000 + i, 
+			.timestamp = 1600000000000LL + i * 250LL,
+			.price = 5000000.0 + (i % 100) * 5,
+			.amount = 0.001 * (1 + i % 7),
+			.side = (i & 1),
+		};
+		int rc = archive->append(archive, &trade);
+		assert(0 == rc);
+	}
+	struct trade_record dup = { .id = 1000, .timestamp = 1600000000000LL, .price = 1.0, .amount = 1.0 };
+	assert(archive->append(archive, &dup) == 1);
+	
+	struct scan_result result = { 0 };
+	ssize_t count = archive->scan_by_id(archive, 1500, 1000 + num_trades, on_trade, &result);
+	assert(count == num_trades - 500 && result.count == count && result.errors == 0);
+	assert(result.first_id == 1500 && result.last_id == 1000 + num_trades - 1);
+	
+	archive->flush(archive);
+	printf("trade_archive: %ld trades, %ld bytes (%.2f bytes/trade), %d segments\n", 
+		(long)archive->num_trades, (long)archive->num_bytes, 
+		(double)archive->num_bytes / archive->num_trades, archive->num_segments);
+	trade_archive_cleanup(archive);
+	
+	// reopen: sealed segments are mapped, the active one is resumed
+	p = trade_archive_init(archive, dir, 0, 8, NULL);
+	assert(p && archive->num_trades == num_trades && archive->last_id == 1000 + num_trades - 1);
+	
+	memset(&result, 0, sizeof(result));
+	int64_t begin_ms = 1600000000000LL + 3000LL * 250;
+	count = archive->scan_by_time(archive, begin_ms, begin_ms + 1000 * 250, on_trade, &result);
+	assert(count == 1000 && result.errors == 0 && result.first_id == 4000);
+	
+	struct trade_record next = { .id = 1000 + num_trades, .timestamp = 1600000000000LL + num_trades * 250LL, 
+		.price = 5000000.0 + (num_trades % 100) * 5, .amount = 0.001 * (1 + num_trades % 7), .side = (num_trades & 1) };
+	assert(archive->append(archive, &next) == 0);
+	
+	memset(&result, 0, sizeof(result));
+	count = archive->scan_by_id(archive, 0, INT64_MAX, on_trade, &result);
+	assert(count == num_trades + 1 && result.errors == 0);
+	trade_archive_cleanup(archive);
+	
+	printf("trade_archive: OK\n");
+	return 0;
+}
+#endif
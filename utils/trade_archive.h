@@ -0,0 +1,87 @@
+#ifndef CHLIB_TRADE_ARCHIVE_H_
+#define CHLIB_TRADE_ARCHIVE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************
+ * trade_archive:
+ *   append-only, segmented archive of public trades (one pair per directory).
+ *
+ *   <dir>/<seq>.open: the active segment, <dir>/<seq>.seg: sealed segments.
+ *   segment: [header] [block] ... [block] [sparse index] [trailer]
+ *   block:   up to TRADE_ARCHIVE_BLOCK_TRADES trades, delta / varint encoded
+ *            (id, timestamp, price, amount | side), ~6-10 bytes per trade.
+ *   index:   one entry per block (id range, time range, file offset),
+ *            kept in memory for the active segment and written on sealing.
+ *
+ *   sealed segments are read through mmap, sealing runs on a background thread.
+ *   a torn block at the end of the active segment is dropped on startup.
+ *
+ *   trades must be appended in ascending id order, 
+ *   trades with id <= last_id are skipped (overlapping REST pages).
+ *   scan callbacks are called with the archive read-locked, 
+ *   they must not append to the same archive.
+*****************************************************/
+#define TRADE_ARCHIVE_BLOCK_TRADES (1024)
+#ifndef TRADE_ARCHIVE_SEGMENT_BLOCKS
+#define TRADE_ARCHIVE_SEGMENT_BLOCKS (4096)	// ~4M trades per segment
+#endif
+
+enum trade_side
+{
+	TRADE_SIDE_buy,		// taker side
+	TRADE_SIDE_sell,
+};
+
+struct trade_record
+{
+	int64_t id;
+	int64_t timestamp;	// ms
+	double price;
+	double amount;
+	enum trade_side side;
+};
+
+// return non-zero to stop the scan
+typedef int (* trade_archive_scan_callback)(const struct trade_record * trade, void * user_data);
+
+typedef struct trade_archive
+{
+	void * priv;
+	void * user_data;
+	
+	int price_digits;	// fixed-point precision of the new segments
+	int amount_digits;
+	
+	int64_t last_id;
+	int64_t last_timestamp;
+	int64_t num_trades;		// archived, including the pending block
+	int64_t num_bytes;		// encoded blocks on disk
+	int num_segments;
+	
+	// return 0: appended, 1: skipped (id <= last_id), -1: error
+	int (* append)(struct trade_archive * archive, const struct trade_record * trade);
+	int (* flush)(struct trade_archive * archive);	// write the pending (partial) block
+	
+	// [begin, end), return the number of trades passed to the callback or -1 on error
+	ssize_t (* scan_by_time)(struct trade_archive * archive, int64_t begin_ms, int64_t end_ms, 
+		trade_archive_scan_callback callback, void * user_data);
+	ssize_t (* scan_by_id)(struct trade_archive * archive, int64_t begin_id, int64_t end_id, 
+		trade_archive_scan_callback callback, void * user_data);
+}trade_archive_t;
+
+// return NULL on failure
+trade_archive_t * trade_archive_init(trade_archive_t * archive, const char * dir, 
+	int price_digits, int amount_digits, void * user_data);
+void trade_archive_cleanup(trade_archive_t * archive);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -84,25 +84,242 @@ static const unsigned char s_hex_table[256] = {
 };
 
 
+/*****************************************************
+ * hex: scalar
+*****************************************************/
+static size_t hex_encode_scalar(const unsigned char * p, size_t length, char * hex)
+{
+	const uint16_t * digits = (const uint16_t *)s_hex_digits;
+	for(size_t i = 0; i < length; ++i) memcpy(hex + i * 2, &digits[p[i]], 2);
+	return length * 2;
+}
+
+static ssize_t hex_decode_scalar(const char * hex, size_t size, unsigned char * data)
+{
+	for(size_t i = 0; i < size; ++i)
+	{
+		unsigned char hi = s_hex_table[(unsigned char)hex[i * 2]];
+		unsigned char lo = s_hex_table[(unsigned char)hex[i * 2 + 1]];
+		if(hi > 0x0F || lo > 0x0F) return -1;
+		data[i] = (hi << 4) | lo;
+	}
+	return size;
+}
+
+/*****************************************************
+ * hex: SSSE3 / AVX2
+ *   encode: split the nibbles, map them with pshufb, interleave
+ *   decode: ('0'..'9') and ((c | 0x20) 'a'..'f') ranges checked with unsigned min,
+ *           pairs of nibbles merged by pmaddubsw (hi * 16 + lo) and packed back to bytes
+*****************************************************/
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HEX_HAS_SIMD (1)
+
+__attribute__((target("ssse3")))
+static inline __m128i hex_nibbles_to_values_ssse3(__m128i chars, __m128i * invalid)
+{
+	__m128i digits = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+	__m128i letters = _mm_sub_epi8(_mm_or_si128(chars, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+	__m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digits, _mm_set1_epi8(9)), digits);
+	__m128i is_letter = _mm_cmpeq_epi8(_mm_min_epu8(letters, _mm_set1_epi8(5)), letters);
+	*invalid = _mm_or_si128(*invalid, _mm_andnot_si128(_mm_or_si128(is_digit, is_letter), _mm_set1_epi8(-1)));
+	
+	letters = _mm_add_epi8(letters, _mm_set1_epi8(10));
+	return _mm_or_si128(_mm_and_si128(is_digit, digits), _mm_andnot_si128(is_digit, letters));
+}
+
+__attribute__((target("ssse3")))
+static size_t hex_encode_ssse3(const unsigned char * p, size_t length, char * hex)
+{
+	const __m128i table = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	size_t i = 0;
+	for(; i + 16 <= length; i += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+		__m128i hi = _mm_shuffle_epi8(table, _mm_and_si128(_mm_srli_epi16(v, 4), mask));
+		__m128i lo = _mm_shuffle_epi8(table, _mm_and_si128(v, mask));
+		_mm_storeu_si128((__m128i *)(hex + i * 2), _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128((__m128i *)(hex + i * 2 + 16), _mm_unpackhi_epi8(hi, lo));
+	}
+	hex_encode_scalar(p + i, length - i, hex + i * 2);
+	return length * 2;
+}
+
+__attribute__((target("ssse3")))
+static ssize_t hex_decode_ssse3(const char * hex, size_t size, unsigned char * data)
+{
+	const __m128i weights = _mm_set1_epi16(0x0110);	// (hi * 16) + (lo * 1)
+	__m128i invalid = _mm_setzero_si128();
+	size_t i = 0;
+	for(; i + 16 <= size; i += 16)
+	{
+		__m128i v0 = hex_nibbles_to_values_ssse3(_mm_loadu_si128((const __m128i *)(hex + i * 2)), &invalid);
+		__m128i v1 = hex_nibbles_to_values_ssse3(_mm_loadu_si128((const __m128i *)(hex + i * 2 + 16)), &invalid);
+		_mm_storeu_si128((__m128i *)(data + i), 
+			_mm_packus_epi16(_mm_maddubs_epi16(v0, weights), _mm_maddubs_epi16(v1, weights)));
+	}
+	if(_mm_movemask_epi8(invalid)) return -1;
+	if(hex_decode_scalar(hex + i * 2, size - i, data + i) < 0) return -1;
+	return size;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i hex_nibbles_to_values_avx2(__m256i chars, __m256i * invalid)
+{
+	__m256i digits = _mm256_sub_epi8(chars, _mm256_set1_epi8('0'));
+	__m256i letters = _mm256_sub_epi8(_mm256_or_si256(chars, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+	__m256i is_digit = _mm256_cmpeq_epi8(_mm256_min_epu8(digits, _mm256_set1_epi8(9)), digits);
+	__m256i is_letter = _mm256_cmpeq_epi8(_mm256_min_epu8(letters, _mm256_set1_epi8(5)), letters);
+	*invalid = _mm256_or_si256(*invalid, _mm256_andnot_si256(_mm256_or_si256(is_digit, is_letter), _mm256_set1_epi8(-1)));
+	
+	letters = _mm256_add_epi8(letters, _mm256_set1_epi8(10));
+	return _mm256_blendv_epi8(letters, digits, is_digit);
+}
+
+__attribute__((target("avx2")))
+static size_t hex_encode_avx2(const unsigned char * p, size_t length, char * hex)
+{
+	const __m256i table = _mm256_setr_epi8(
+		'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f',
+		'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+	const __m256i mask = _mm256_set1_epi8(0x0f);
+	size_t i = 0;
+	for(; i + 32 <= length; i += 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+		__m256i hi = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), mask));
+		__m256i lo = _mm256_shuffle_epi8(table, _mm256_and_si256(v, mask));
+		
+		// unpack works per 128-bit lane: { 0..7, 16..23 } and { 8..15, 24..31 }
+		__m256i a = _mm256_unpacklo_epi8(hi, lo);
+		__m256i b = _mm256_unpackhi_epi8(hi, lo);
+		_mm256_storeu_si256((__m256i *)(hex + i * 2), _mm256_permute2x128_si256(a, b, 0x20));
+		_mm256_storeu_si256((__m256i *)(hex + i * 2 + 32), _mm256_permute2x128_si256(a, b, 0x31));
+	}
+	hex_encode_ssse3(p + i, length - i, hex + i * 2);
+	return length * 2;
+}
+
+__attribute__((target("avx2")))
+static ssize_t hex_decode_avx2(const char * hex, size_t size, unsigned char * data)
+{
+	const __m256i weights = _mm256_set1_epi16(0x0110);
+	__m256i invalid = _mm256_setzero_si256();
+	size_t i = 0;
+	for(; i + 32 <= size; i += 32)
+	{
+		__m256i v0 = hex_nibbles_to_values_avx2(_mm256_loadu_si256((const __m256i *)(hex + i * 2)), &invalid);
+		__m256i v1 = hex_nibbles_to_values_avx2(_mm256_loadu_si256((const __m256i *)(hex + i * 2 + 32)), &invalid);
+		
+		// packus works per 128-bit lane: { v0.lo, v1.lo, v0.hi, v1.hi } ==> reorder the qwords
+		__m256i packed = _mm256_packus_epi16(_mm256_maddubs_epi16(v0, weights), _mm256_maddubs_epi16(v1, weights));
+		_mm256_storeu_si256((__m256i *)(data + i), _mm256_permute4x64_epi64(packed, 0xD8));
+	}
+	if(!_mm256_testz_si256(invalid, invalid)) return -1;
+	if(hex_decode_ssse3(hex + i * 2, size - i, data + i) < 0) return -1;
+	return size;
+}
+#endif
+
+/*****************************************************
+ * hex: runtime dispatch
+*****************************************************/
+typedef size_t (* hex_encode_fn)(const unsigned char * p, size_t length, char * hex);
+typedef ssize_t (* hex_decode_fn)(const char * hex, size_t size, unsigned char * data);
+
+static size_t hex_encode_resolve(const unsigned char * p, size_t length, char * hex);
+static ssize_t hex_decode_resolve(const char * hex, size_t size, unsigned char * data);
+static hex_encode_fn s_hex_encode = hex_encode_resolve;
+static hex_decode_fn s_hex_decode = hex_decode_resolve;
+static const char * s_hex_impl_name = "scalar";
+
+int hex_impl_select(enum hex_impl impl)
+{
+	hex_encode_fn encode = hex_encode_scalar;
+	hex_decode_fn decode = hex_decode_scalar;
+	const char * name = "scalar";
+	
+#ifdef HEX_HAS_SIMD
+	__builtin_cpu_init();
+	int has_avx2 = __builtin_cpu_supports("avx2");
+	int has_ssse3 = __builtin_cpu_supports("ssse3");
+	if(impl == hex_impl_auto) impl = has_avx2?hex_impl_avx2:(has_ssse3?hex_impl_ssse3:hex_impl_scalar);
+	
+	switch(impl)
+	{
+	case hex_impl_avx2:
+		if(!has_avx2) return -1;
+		encode = hex_encode_avx2; decode = hex_decode_avx2; name = "avx2";
+		break;
+	case hex_impl_ssse3:
+		if(!has_ssse3) return -1;
+		encode = hex_encode_ssse3; decode = hex_decode_ssse3; name = "ssse3";
+		break;
+	default:
+		break;
+	}
+#else
+	if(impl != hex_impl_auto && impl != hex_impl_scalar) return -1;
+#endif
+	
+	// every implementation gives the same results, a thread still seeing the old pointer is harmless
+	__atomic_store_n(&s_hex_impl_name, name, __ATOMIC_RELAXED);
+	__atomic_store_n(&s_hex_decode, decode, __ATOMIC_RELAXED);
+	__atomic_store_n(&s_hex_encode, encode, __ATOMIC_RELAXED);
+	return 0;
+}
+
+const char * hex_impl_name(void)
+{
+	if(__atomic_load_n(&s_hex_encode, __ATOMIC_RELAXED) == hex_encode_resolve) hex_impl_select(hex_impl_auto);
+	return __atomic_load_n(&s_hex_impl_name, __ATOMIC_RELAXED);
+}
+
+static size_t hex_encode_resolve(const unsigned char * p, size_t length, char * hex)
+{
+	hex_impl_select(hex_impl_auto);
+	return __atomic_load_n(&s_hex_encode, __ATOMIC_RELAXED)(p, length, hex);
+}
+
+static ssize_t hex_decode_resolve(const char * hex, size_t size, unsigned char * data)
+{
+	hex_impl_select(hex_impl_auto);
+	return __atomic_load_n(&s_hex_decode, __ATOMIC_RELAXED)(hex, size, data);
+}
+
+size_t hex_encode(const void * data, size_t length, char * hex)
+{
+	assert(hex);
+	if(NULL == data) length = 0;
+	__atomic_load_n(&s_hex_encode, __ATOMIC_RELAXED)(data, length, hex);
+	hex[length * 2] = '\0';
+	return length * 2;
+}
+
+ssize_t hex_decode(const char * hex, size_t length, void * data)
+{
+	if(length % 2) return -1;
+	if(length == 0) return 0;
+	assert(hex && data);
+	return __atomic_load_n(&s_hex_decode, __ATOMIC_RELAXED)(hex, length / 2, data);
+}
+
 ssize_t bin2hex(const void * data, size_t length, char ** p_hex)
 {
-	static const uint16_t * digits = (uint16_t *)s_hex_digits;
 	if(length == 0 || NULL == data) return 0;
 	ssize_t size = length * 2;
 	if(NULL == p_hex) return size + 1;
-	const unsigned char * p = data;
 	char * hex = *p_hex;
 	if(NULL == hex)
 	{
 		hex = malloc(size + 1);
 		if(NULL == hex) return -1;
-		hex[size] = '\0';
 		*p_hex = hex;
 	}
 	
-	uint16_t * dst = (uint16_t *)hex;
-	for(size_t i = 0; i < length; ++i) dst[i] = digits[p[i]];
-	return size;
+	return hex_encode(data, length, hex);
 }
 
 ssize_t hex2bin(const char * hex, size_t length, void ** p_data)
@@ -123,13 +340,7 @@ ssize_t hex2bin(const char * hex, size_t length, void ** p_data)
 		if(NULL == data) return -1;
 	}
 
-	for(size_t i = 0; i < size; ++i)
-	{
-		unsigned char hi = s_hex_table[(int)hex[i * 2]];
-		unsigned char lo = s_hex_table[(int)hex[i * 2 + 1]];
-		if(hi > 0x0F || lo > 0x0F) goto label_err;
-		data[i] = (hi << 4) | lo;
-	}
+	if(hex_decode(hex, length, data) < 0) goto label_err;
 
 	*p_data = data;
 	return size;
@@ -141,24 +352,26 @@ label_err:
 void dump2(FILE * fp, const void * data, ssize_t length)
 {
 	const unsigned char * p = data;
-	const unsigned char * p_end = p + length;
+	if(NULL == p || length <= 0) return;
 	
 #define BUF_SIZE (4096)
+	char buffer[BUF_SIZE * 2 + 1];
+	
+	// encode before taking the lock, most dumps fit in one chunk
+	size_t len = (length > BUF_SIZE)?BUF_SIZE:length;
+	hex_encode(p, len, buffer);
 	
 	global_lock();
-	char buffer[BUF_SIZE * 2 + 1];
-	char * p_buf = buffer;
-	while(p < p_end)
+	while(1)
 	{
-		memset(buffer, 0, sizeof(buffer));
-		int len = (length > BUF_SIZE)?BUF_SIZE:length;
-		int cb = bin2hex(p, len, &p_buf);
-		assert(cb >= 0);
-		fprintf(fp, "%*s", (int)cb, buffer);
+		fwrite(buffer, 1, len * 2, fp);
 		p += len;
 		length -= len;
+		if(length <= 0) break;
+		
+		len = (length > BUF_SIZE)?BUF_SIZE:length;
+		hex_encode(p, len, buffer);
 	}
-	
 	global_unlock();
 #undef BUF_SIZE
 	return;
@@ -202,3 +415,13 @@ double app_timer_stop(app_timer_t * timer)
 	timer->end = (double)ts->tv_sec + (double)ts->tv_nsec / 1000000000;
 	return (timer->end - timer->begin);
 }
+
+void perf_stats_update(perf_stats_t * stats, double elapsed)
+{
+	assert(stats);
+	stats->last = elapsed;
+	stats->total += elapsed;
+	if(elapsed > stats->max) stats->max = elapsed;
+	++stats->count;
+	return;
+}
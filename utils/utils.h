@@ -11,6 +11,26 @@ extern "C" {
 
 ssize_t bin2hex(const void * data, size_t length, char ** p_hex);
 ssize_t hex2bin(const char * hex, size_t length, void ** p_data);
+
+/*
+ * hex_encode / hex_decode: caller-provided buffers, never allocate.
+ *   hex_encode() writes (length * 2) lowercase digits and a '\0', @hex: (length * 2 + 1) bytes
+ *   hex_decode() accepts both cases, returns (length / 2), or -1 (odd length or invalid digit)
+ * 
+ * SSSE3 / AVX2 versions are selected by cpuid on the first call, the scalar code is the fallback.
+ */
+size_t hex_encode(const void * data, size_t length, char * hex);
+ssize_t hex_decode(const char * hex, size_t length, void * data);
+
+enum hex_impl
+{
+	hex_impl_auto,
+	hex_impl_scalar,
+	hex_impl_ssse3,
+	hex_impl_avx2,
+};
+int hex_impl_select(enum hex_impl impl);	// (tests / benchmarks) -1: not supported by this cpu
+const char * hex_impl_name(void);
 void dump2(FILE * fp, const void * data, ssize_t length);
 #define dump(data, length) dump2(stdout, data, length)
 #define dump_line(prefix, data, length) do { printf("%s", prefix); dump(data, length); printf("\n"); } while(0)
@@ -31,6 +51,16 @@ double app_timer_start(app_timer_t * timer);
 double app_timer_stop(app_timer_t * timer);
 #define app_timer_get_elapsed(timer) app_timer_stop(timer)
 
+typedef struct perf_stats
+{
+	int64_t count;
+	double last;	// seconds
+	double total;
+	double max;
+}perf_stats_t;
+void perf_stats_update(perf_stats_t * stats, double elapsed);
+#define perf_stats_average(stats) ((stats)->count?((stats)->total / (double)(stats)->count):0.0)
+
 typedef char * string;
 typedef int64_t int64;
 typedef _Bool boolean;
@@ -30,133 +30,76 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <signal.h>
+#include <time.h>
 
 #include <json-c/json.h>
-#include <libsoup/soup.h>
+#include <curl/curl.h>
 
-static const char * s_connection_state_name[] = 
-{
-	[SOUP_CONNECTION_NEW] = "SOUP_CONNECTION_NEW", 
-	[SOUP_CONNECTION_CONNECTING] = "SOUP_CONNECTION_CONNECTING", 
-	[SOUP_CONNECTION_IDLE] = "SOUP_CONNECTION_IDLE", 
-	[SOUP_CONNECTION_IN_USE] = "SOUP_CONNECTION_IN_USE", 
-	[SOUP_CONNECTION_REMOTE_DISCONNECTED] = "SOUP_CONNECTION_REMOTE_DISCONNECTED", 
-	[SOUP_CONNECTION_DISCONNECTED] = "SOUP_CONNECTION_DISCONNECTED", 
-};
-static const char * connection_state_to_string(SoupConnectionState state)
-{
-	if(state < SOUP_CONNECTION_NEW || state > SOUP_CONNECTION_DISCONNECTED) return "unknown error";
-	return s_connection_state_name[state];
-}
-
-typedef struct websocket_client_context
-{
-	void * priv;
-	void * user_data;
-	
-	SoupConnectionState state;
-	SoupSession * session;
-	SoupMessage * msg;
-	SoupWebsocketConnection * conn;
-	
-	void (* on_connected)(SoupWebsocketConnection * conn, struct websocket_client_context * wss);
-	void (* on_message)(SoupWebsocketConnection * conn, gint type, GBytes * message, struct websocket_client_context * wss);
-	void (* on_closed)(SoupWebsocketConnection * conn, struct websocket_client_context * wss);
-	void (* on_closing)(SoupWebsocketConnection * conn, struct websocket_client_context * wss);
-	void (* on_pong)(SoupWebsocketConnection * conn, GBytes * message, struct websocket_client_context * wss);
-	void (* on_error)(SoupWebsocketConnection * conn, GError * gerr, struct websocket_client_context * wss);
-}websocket_client_context_t;
-
-static void on_connection_state_changed(GObject * conn, GAsyncResult * result, websocket_client_context_t * wss)
-{
-	SoupConnectionState new_state = SOUP_CONNECTION_NEW;
-	g_object_get(conn, "state", &new_state, NULL);
-	fprintf(stderr, "state changed: from %s(%d) to %s(%d)\n", 
-		connection_state_to_string(wss->state), wss->state, 
-		connection_state_to_string(new_state), new_state);
-	wss->state = new_state;
-	return;
-}
-static void on_session_connection_created(SoupSession * session, GObject * conn, websocket_client_context_t * wss)
-{
-	g_object_get(conn, "state", &wss->state, NULL);
-	g_signal_connect(conn, "notify::state", G_CALLBACK(on_connection_state_changed), wss);
-}
+#include "reactor.h"
+#include "websocket_client.h"
+#include "trade_archive.h"
 
-static void on_connected(SoupSession * session, GAsyncResult * result, websocket_client_context_t * wss)
+static reactor_context_t * s_reactor;
+static trade_archive_t * s_archive;	// (nullable) --archive=<dir>
+static void on_signal(int sig)
 {
-	GError * gerr = NULL;
-	SoupWebsocketConnection * conn = soup_session_websocket_connect_finish(session, result, &gerr);
-	if(gerr) {
-		fprintf(stderr, "[ERROR]: %s(%d): %s\n", __FILE__, __LINE__, gerr->message);
-		g_error_free(gerr);
-		gerr = NULL;
-	}
-	
-	if(conn) {
-		wss->conn = conn;
-		if(wss->on_message) g_signal_connect(conn, "message", G_CALLBACK(wss->on_message), wss);
-		if(wss->on_closed)  g_signal_connect(conn, "closed", G_CALLBACK(wss->on_closed), wss);
-		if(wss->on_closing) g_signal_connect(conn, "closing", G_CALLBACK(wss->on_closing), wss);
-		if(wss->on_pong)    g_signal_connect(conn, "pong", G_CALLBACK(wss->on_pong), wss);
-		if(wss->on_error)   g_signal_connect(conn, "error", G_CALLBACK(wss->on_error), wss);
-	}
-	
-	if(wss->on_connected) wss->on_connected(conn, wss);
+	if(s_reactor) s_reactor->stop(s_reactor);
 	return;
 }
 
-gboolean websocket_client_connect(websocket_client_context_t * wss, const char * uri)
-{
-	assert(wss && uri);
-	
-	if(NULL == wss->conn 
-		|| wss->state == SOUP_CONNECTION_NEW
-		|| wss->state == SOUP_CONNECTION_DISCONNECTED
-		|| wss->state == SOUP_CONNECTION_REMOTE_DISCONNECTED)
-	{
-		SoupSession * session = soup_session_new();
-		SoupMessage * msg = soup_message_new(SOUP_METHOD_GET, uri);
-		
-		g_signal_connect(session, "connection-created", G_CALLBACK(on_session_connection_created), wss);
-		soup_session_websocket_connect_async(session, msg, 
-			NULL, 
-			(char **)NULL,
-			NULL, 
-			(GAsyncReadyCallback)on_connected, 
-			wss);
-	}
-	return TRUE;
-}
+static void on_connected_coincheck(websocket_client_context_t * wss);
+static void on_message_coincheck(websocket_client_context_t * wss, int opcode, const char * data, size_t length);
+static void on_closed_coincheck(websocket_client_context_t * wss, int status_code);
+static int on_stats_timer(struct reactor_context * reactor, void * user_data);
 
-static void on_connected_coincheck(SoupWebsocketConnection * conn, websocket_client_context_t * wss);
-static void on_message_coincheck(SoupWebsocketConnection * conn, gint type, GBytes * message, websocket_client_context_t * wss);
-static void on_closed_coincheck(SoupWebsocketConnection * conn, websocket_client_context_t * wss);
 int main(int argc, char **argv)
 {
 	static const char * coincheck_wss_uri = "wss://ws-api.coincheck.com/";
+	curl_global_init(CURL_GLOBAL_ALL);
 	
-	GMainLoop * loop = NULL;
-	gboolean ok = FALSE;
-	websocket_client_context_t wss[1];
-	memset(wss, 0, sizeof(wss));
+	reactor_context_t * reactor = reactor_context_init(NULL, NULL);
+	assert(reactor);
+	s_reactor = reactor;
+	for(int i = 1; i < argc; ++i) {
+		if(strcmp(argv[i], "--busy-poll") == 0) reactor->busy_poll = 1;
+		else if(strncmp(argv[i], "--archive=", sizeof("--archive=") - 1) == 0) {
+			const char * archive_dir = argv[i] + sizeof("--archive=") - 1;
+			s_archive = trade_archive_init(NULL, archive_dir, 0, 8, NULL);
+			if(NULL == s_archive) {
+				fprintf(stderr, "open trade archive '%s' failed\n", archive_dir);
+				return 1;
+			}
+		}
+	}
+	signal(SIGINT, on_signal);
 	
+	websocket_client_context_t * wss = websocket_client_context_init(NULL, reactor, NULL);
+	assert(wss);
 	wss->on_connected = on_connected_coincheck;
 	wss->on_message = on_message_coincheck;
 	wss->on_closed = on_closed_coincheck;
 	
-	ok = websocket_client_connect(wss, coincheck_wss_uri);
-	assert(ok);
-	
-	loop = g_main_loop_new(NULL, FALSE);
-	assert(loop);
-	g_main_loop_run(loop);
+	int rc = wss->connect(wss, coincheck_wss_uri);
+	if(0 == rc) {
+		reactor->add_timer(reactor, 10 * 1000, 1, on_stats_timer, wss);
+		reactor->run(reactor);
+	}
 	
-	g_main_loop_unref(loop);
-	return 0;
+	websocket_client_context_cleanup(wss);
+	free(wss);
+	if(s_archive) {
+		trade_archive_cleanup(s_archive);
+		free(s_archive);
+		s_archive = NULL;
+	}
+	reactor_context_cleanup(reactor);
+	free(reactor);
+	curl_global_cleanup();
+	return rc;
 }
 
-static void on_connected_coincheck(SoupWebsocketConnection * conn, websocket_client_context_t * wss)
+static void on_connected_coincheck(websocket_client_context_t * wss)
 {
 	static const char * channels[] = {
 		"btc_jpy-orderbook", 
@@ -171,32 +114,108 @@ static void on_connected_coincheck(SoupWebsocketConnection * conn, websocket_cli
 	for(int i = 0; i < num_channels; ++i) {
 		json_object_object_add(jsubscribe, "channel", json_object_new_string(channels[i]));
 		fprintf(stderr, "subscribe: %s\n", channels[i]); 
-		soup_websocket_connection_send_text(conn, json_object_to_json_string_ext(jsubscribe, JSON_C_TO_STRING_PLAIN));
+		
+		size_t cb_text = 0;
+		const char * text = json_object_to_json_string_length(jsubscribe, JSON_C_TO_STRING_PLAIN, &cb_text);
+		websocket_client_send_text(wss, text, cb_text);
 	}
 	json_object_put(jsubscribe);
 	return;
 }
 
-static void on_message_coincheck(SoupWebsocketConnection * conn, gint type, GBytes * message, websocket_client_context_t * wss)
+/*
+ * btc_jpy-trades: 
+ *   [ [ "timestamp", "id", "pair", "rate", "amount", "order_type", "taker_id", "maker_id" ], ... ]
+ * legacy format: 
+ *   [ id, "pair", "rate", "amount", "order_type" ]
+ */
+static const char * json_array_get_string(json_object * jarray, int index)
+{
+	json_object * jvalue = json_object_array_get_idx(jarray, index);
+	return jvalue?json_object_get_string(jvalue):NULL;
+}
+
+static int parse_trade(struct trade_record * trade, json_object * jtrade)
 {
-	switch(type) {
-	case SOUP_WEBSOCKET_DATA_TEXT:
-		break;
-	case SOUP_WEBSOCKET_DATA_BINARY:
-	default:
-		return;
+	int length = json_object_array_length(jtrade);
+	memset(trade, 0, sizeof(*trade));
+	
+	const char * rate = NULL, * amount = NULL, * side = NULL;
+	if(length >= 6) {
+		trade->timestamp = atoll(json_array_get_string(jtrade, 0)) * 1000;
+		trade->id = atoll(json_array_get_string(jtrade, 1));
+		rate = json_array_get_string(jtrade, 3);
+		amount = json_array_get_string(jtrade, 4);
+		side = json_array_get_string(jtrade, 5);
+	}else if(length == 5) {
+		struct timespec ts[1];
+		clock_gettime(CLOCK_REALTIME, ts);
+		trade->timestamp = (int64_t)ts->tv_sec * 1000 + ts->tv_nsec / 1000000;
+		trade->id = json_object_get_int64(json_object_array_get_idx(jtrade, 0));
+		rate = json_array_get_string(jtrade, 2);
+		amount = json_array_get_string(jtrade, 3);
+		side = json_array_get_string(jtrade, 4);
 	}
-	gsize cb_text = 0;
-	const char * text = g_bytes_get_data(message, &cb_text);
+	if(trade->id <= 0 || NULL == rate || NULL == amount || NULL == side) return -1;
 	
-	fwrite(text, cb_text, 1, stdout);
-	fflush(stdout);
-	//~ g_bytes_unref(message);
+	trade->price = atof(rate);
+	trade->amount = atof(amount);
+	trade->side = (strcmp(side, "sell") == 0)?TRADE_SIDE_sell:TRADE_SIDE_buy;
+	return 0;
+}
+
+static void archive_trades(const char * data, size_t length)
+{
+	json_tokener * jtok = json_tokener_new();
+	json_object * jmessage = json_tokener_parse_ex(jtok, data, length);
+	json_tokener_free(jtok);
+	if(NULL == jmessage) return;
 	
+	if(json_object_is_type(jmessage, json_type_array) && json_object_array_length(jmessage) > 0) {
+		json_object * jfirst = json_object_array_get_idx(jmessage, 0);
+		struct trade_record trade;
+		if(json_object_is_type(jfirst, json_type_array)) {
+			int num_trades = json_object_array_length(jmessage);
+			for(int i = 0; i < num_trades; ++i) {
+				if(0 == parse_trade(&trade, json_object_array_get_idx(jmessage, i))) s_archive->append(s_archive, &trade);
+			}
+		}else if(json_object_is_type(jfirst, json_type_int)) {
+			if(0 == parse_trade(&trade, jmessage)) s_archive->append(s_archive, &trade);
+		}
+		// else: ["pair", { order book }]
+	}
+	json_object_put(jmessage);
 	return;
 }
-static void on_closed_coincheck(SoupWebsocketConnection * conn, websocket_client_context_t * wss)
+
+static void on_message_coincheck(websocket_client_context_t * wss, int opcode, const char * data, size_t length)
 {
-	fprintf(stderr, "%s(%p)\n", __FUNCTION__, conn);
+	if(opcode != WEBSOCKET_OPCODE_text) return;
+	if(s_archive) archive_trades(data, length);
+	
+	fwrite(data, length, 1, stdout);
+	fputc('\n', stdout);
+	fflush(stdout);
 	return;
 }
+
+static void on_closed_coincheck(websocket_client_context_t * wss, int status_code)
+{
+	fprintf(stderr, "%s(%p): status_code=%d\n", __FUNCTION__, wss, status_code);
+	wss->reactor->stop(wss->reactor);
+	return;
+}
+
+static int on_stats_timer(struct reactor_context * reactor, void * user_data)
+{
+	websocket_client_context_t * wss = user_data;
+	fprintf(stderr, "messages: %ld, bytes: %ld, wakeups: %ld, fd events: %ld, timer events: %ld\n", 
+		(long)wss->num_messages, (long)wss->num_bytes, 
+		(long)reactor->num_wakeups, (long)reactor->num_fd_events, (long)reactor->num_timer_events);
+	if(s_archive) {
+		s_archive->flush(s_archive);
+		fprintf(stderr, "archived trades: %ld, bytes: %ld, last_id: %ld\n", 
+			(long)s_archive->num_trades, (long)s_archive->num_bytes, (long)s_archive->last_id);
+	}
+	return 0;
+}
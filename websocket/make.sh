@@ -3,5 +3,7 @@
 gcc -std=gnu99 -D_GNU_SOURCE -D_DEFAULT_SOURCE -g -Wall \
     -I../include -I../utils \
     -o coincheck-wss coincheck-wss.c \
-    $(pkg-config --cflags --libs libsoup-2.4) \
+    ../src/reactor.c ../src/websocket_client.c \
+    ../utils/utils.c ../utils/trade_archive.c \
+    $(pkg-config --cflags --libs gnutls) \
     -lm -lpthread -ljson-c -lcurl